@@ -0,0 +1,358 @@
+/**
+ * @file ai_bench.cpp
+ * @brief AI 请求延迟基准测试
+ *
+ * 针对 mock_ollama（或任意 Ollama 端点）测量：
+ *   - 连接器开销：客户端耗时减去服务端报告的 total_duration
+ *   - 端到端 ai 延迟：AIAssistant::process_natural_command 的百分位
+ *   - 命令提取：JSON 模式回复中无法得到命令的比例
+ *   - 缓存效果：本地意图匹配命中率、解释缓存命中率和上下文复用节省的 token
+ *
+ * --scenario failover 改为检查多端点行为（需要 --mock）：启动几个 mock_ollama，
+ * 注入错误、杀掉其中一个，确认 generate 转移到健康端点；长尾延迟时发起对冲请求。
+ *
+ * 用法：nexsh_ai_bench [--mock PATH | --endpoint URL] [--requests N]
+ *                      [--latency-ms N] [--tokens-per-sec N] [--scenario latency|failover]
+ */
+
+#include "ai_assistant.h"
+#include "metrics.h"
+#include "ollama_connector.h"
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+using namespace NeXShell;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string mock_path;
+    std::string endpoint;
+    int requests = 50;
+    int latency_ms = 20;
+    double tokens_per_sec = 0.0;
+    std::string scenario = "latency";
+};
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+void report(const std::string& name, const std::vector<double>& samples) {
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2)
+              << " n=" << std::setw(4) << samples.size()
+              << "  p50=" << std::setw(8) << percentile(samples, 0.50)
+              << "  p95=" << std::setw(8) << percentile(samples, 0.95)
+              << "  p99=" << std::setw(8) << percentile(samples, 0.99) << " ms" << std::endl;
+}
+
+/**
+ * @brief 启动 mock_ollama 并从它的第一行输出中读取端点
+ * @param extra_args 附加的 mock_ollama 参数（故障注入等）
+ */
+std::string spawn_mock(const Options& options, pid_t& pid, const std::vector<std::string>& extra_args = {}) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return "";
+    }
+
+    std::vector<std::string> args = {options.mock_path, "--port", "0",
+                                     "--latency-ms", std::to_string(options.latency_ms),
+                                     "--tokens-per-sec", std::to_string(options.tokens_per_sec)};
+    args.insert(args.end(), extra_args.begin(), extra_args.end());
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    int spawned = posix_spawn(&pid, options.mock_path.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (spawned != 0) {
+        close(fds[0]);
+        return "";
+    }
+
+    std::string line;
+    char c;
+    while (read(fds[0], &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    close(fds[0]);
+
+    size_t url = line.find("http://");
+    return url == std::string::npos ? "" : line.substr(url);
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "--mock") options.mock_path = value;
+        else if (arg == "--endpoint") options.endpoint = value;
+        else if (arg == "--requests") options.requests = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--latency-ms") options.latency_ms = std::atoi(value.c_str());
+        else if (arg == "--tokens-per-sec") options.tokens_per_sec = std::atof(value.c_str());
+        else if (arg == "--scenario") options.scenario = value;
+        else return false;
+    }
+    if (options.scenario == "failover") {
+        return (argc % 2) == 1 && !options.mock_path.empty();
+    }
+    return (argc % 2) == 1 && options.scenario == "latency" &&
+           (!options.mock_path.empty() || !options.endpoint.empty());
+}
+
+void stop_mock(pid_t pid, int signal_number = SIGTERM) {
+    if (pid > 0) {
+        kill(pid, signal_number);
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+/**
+ * @brief 连续发送 generate 请求
+ * @return 失败的请求数
+ */
+int run_generates(OllamaConnector& connector, int requests, const std::string& phase, std::vector<double>& latency) {
+    int failed = 0;
+    for (int i = 0; i < requests; ++i) {
+        auto start = Clock::now();
+        OllamaGeneration result = connector.generate(phase + " prompt " + std::to_string(i), "llama3.2");
+        latency.push_back(elapsed_ms(start));
+        if (!result.success) {
+            std::cerr << "nexsh_ai_bench: " << phase << " request " << i << " failed: " << result.error << std::endl;
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+/**
+ * @brief 多端点场景：故障转移和对冲
+ * @return 进程退出码
+ */
+int run_failover(const Options& options) {
+    int status = 0;
+    auto check = [&status](bool ok, const std::string& what) {
+        std::cout << (ok ? "  ok   " : "  FAIL ") << what << std::endl;
+        if (!ok) {
+            status = 1;
+        }
+    };
+
+    // 1. 三个端点：一个总是返回 HTTP 500，请求应当转移到另外两个；随后杀掉下一个请求
+    //    会选中的健康端点（EWMA 延迟较低的那个）
+    pid_t healthy_pid = -1;
+    pid_t failing_pid = -1;
+    pid_t backup_pid = -1;
+    std::string healthy = spawn_mock(options, healthy_pid);
+    std::string failing = spawn_mock(options, failing_pid, {"--fail-rate", "1"});
+    std::string backup = spawn_mock(options, backup_pid);
+    if (healthy.empty() || failing.empty() || backup.empty()) {
+        std::cerr << "nexsh_ai_bench: failed to start " << options.mock_path << std::endl;
+        stop_mock(healthy_pid);
+        stop_mock(failing_pid);
+        stop_mock(backup_pid);
+        return 1;
+    }
+    {
+        OllamaConnector connector(failing + "," + healthy + "," + backup);
+        connector.set_hedge_percentile(0.0);
+        std::vector<double> latency;
+        int failed = run_generates(connector, options.requests, "failover", latency);
+        report("failover (HTTP 500)", latency);
+        check(failed == 0, "generate fails over from an endpoint returning HTTP 500");
+        check(connector.get_endpoint_status()[0].failures > 0, "failing endpoint was tried and marked");
+
+        auto endpoints = connector.get_endpoint_status();
+        size_t killed = endpoints[1].ewma_ms <= endpoints[2].ewma_ms ? 1 : 2;
+        stop_mock(killed == 1 ? healthy_pid : backup_pid, SIGKILL);
+        latency.clear();
+        failed = run_generates(connector, options.requests, "killed", latency);
+        report("failover (killed endpoint)", latency);
+        check(failed == 0, "generate fails over from a killed endpoint");
+        check(connector.get_endpoint_status()[killed].failures > 0, "killed endpoint was tried and marked");
+        stop_mock(killed == 1 ? backup_pid : healthy_pid);
+    }
+    stop_mock(failing_pid);
+
+    // 2. 两个有长尾的端点：攒够延迟样本之后，慢请求应当在另一个端点上对冲。
+    //    取中位数作为对冲等待时间，长尾样本不会把它推到注入的延迟上
+    const int slow_ms = 500;
+    std::vector<std::string> tail = {"--slow-rate", "0.2", "--slow-ms", std::to_string(slow_ms)};
+    pid_t first_pid = -1;
+    pid_t second_pid = -1;
+    std::vector<std::string> first_args = tail;
+    first_args.insert(first_args.end(), {"--seed", "1"});
+    std::vector<std::string> second_args = tail;
+    second_args.insert(second_args.end(), {"--seed", "2"});
+    std::string first = spawn_mock(options, first_pid, first_args);
+    std::string second = spawn_mock(options, second_pid, second_args);
+    if (first.empty() || second.empty()) {
+        std::cerr << "nexsh_ai_bench: failed to start " << options.mock_path << std::endl;
+        stop_mock(first_pid);
+        stop_mock(second_pid);
+        return 1;
+    }
+    {
+        OllamaConnector connector(first + "," + second);
+        connector.set_hedge_percentile(0.5);
+        std::vector<double> warmup;
+        int failed = run_generates(connector, static_cast<int>(EndpointPool::MIN_HEDGE_SAMPLES), "warmup", warmup);
+
+        uint64_t hedges = Metrics::instance().ai_hedges.value();
+        std::vector<double> latency;
+        failed += run_generates(connector, std::max(options.requests, 40), "hedged", latency);
+        report("hedged generate", latency);
+        uint64_t fired = Metrics::instance().ai_hedges.value() - hedges;
+        std::cout << "  hedged requests: " << fired << "/" << latency.size() << std::endl;
+        check(failed == 0, "generate succeeds on endpoints with a slow tail");
+        check(fired > 0, "slow requests are hedged on the other endpoint");
+    }
+    stop_mock(first_pid);
+    stop_mock(second_pid);
+    return status;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: nexsh_ai_bench (--mock PATH | --endpoint URL) [--requests N] "
+                     "[--latency-ms N] [--tokens-per-sec N] [--scenario latency|failover]" << std::endl;
+        return 2;
+    }
+    if (options.scenario == "failover") {
+        return run_failover(options);
+    }
+
+    pid_t mock_pid = -1;
+    if (!options.mock_path.empty()) {
+        options.endpoint = spawn_mock(options, mock_pid);
+        if (options.endpoint.empty()) {
+            std::cerr << "nexsh_ai_bench: failed to start " << options.mock_path << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Endpoint: " << options.endpoint << ", " << options.requests << " requests per phase" << std::endl;
+
+    // 隔离用户的意图模板和嵌入索引
+    std::string scratch = "/tmp/nexsh_ai_bench_" + std::to_string(getpid());
+    setenv("NEXSH_OLLAMA_ENDPOINTS", options.endpoint.c_str(), 1);
+    setenv("NEXSH_INTENTS", (scratch + "_intents").c_str(), 1);
+    setenv("NEXSH_EMBEDDINGS", (scratch + "_embeddings").c_str(), 1);
+
+    int status = 0;
+    {
+        // 1. 连接器开销
+        OllamaConnector connector(options.endpoint);
+        std::vector<double> overhead;
+        std::vector<double> generate;
+        for (int i = 0; i < options.requests; ++i) {
+            auto start = Clock::now();
+            OllamaGeneration result = connector.generate("benchmark prompt " + std::to_string(i), "llama3.2");
+            double total = elapsed_ms(start);
+            if (result.success) {
+                generate.push_back(total);
+                overhead.push_back(std::max(0.0, total - result.total_ms));
+            }
+        }
+        report("connector generate", generate);
+        report("connector overhead", overhead);
+        if (generate.size() != static_cast<size_t>(options.requests)) {
+            std::cerr << "nexsh_ai_bench: " << options.requests - static_cast<int>(generate.size())
+                      << " generate requests failed" << std::endl;
+            status = 1;
+        }
+
+        // 2. 端到端 ai 延迟（模型路径，上下文在轮次之间复用）
+        AIAssistant assistant(nullptr);
+        if (!assistant.initialize("llama3.2")) {
+            std::cerr << "nexsh_ai_bench: AI assistant failed to initialize" << std::endl;
+            status = 1;
+        } else {
+            std::vector<double> model_latency;
+            int unparsed = 0;
+            for (int i = 0; i < options.requests; ++i) {
+                auto start = Clock::now();
+                std::string result =
+                    assistant.process_natural_command("summarize benchmark scenario " + std::to_string(i), "/tmp");
+                model_latency.push_back(elapsed_ms(start));
+                unparsed += result.rfind("AI Response:", 0) == 0 || result.rfind("Error", 0) == 0;
+            }
+            report("ai (model)", model_latency);
+            std::cout << "  responses without a command: " << unparsed << "/" << options.requests << std::endl;
+
+            AIUsage usage = assistant.get_total_usage();
+            std::cout << "  prompt tokens evaluated: " << usage.prompt_tokens
+                      << ", completion tokens: " << usage.completion_tokens << std::endl;
+
+            // 3a. 本地意图匹配
+            const std::vector<std::string> common = {
+                "list all files", "find all txt files", "show disk usage",
+                "show the first 10 lines of README.md", "count lines in main.cpp"};
+            std::vector<double> local_latency;
+            size_t before = assistant.get_local_match_count();
+            for (int i = 0; i < options.requests; ++i) {
+                auto start = Clock::now();
+                assistant.process_natural_command(common[static_cast<size_t>(i) % common.size()], "/tmp");
+                local_latency.push_back(elapsed_ms(start));
+            }
+            size_t local = assistant.get_local_match_count() - before;
+            report("ai (common requests)", local_latency);
+            std::cout << "  answered locally: " << local << "/" << options.requests << std::endl;
+
+            // 3b. 解释缓存：少量命令重复出现
+            const std::vector<std::string> commands = {
+                "ls -la", "grep -rn TODO src", "tar czf backup.tar.gz src", "du -sh .", "ps aux"};
+            std::vector<double> miss_latency;
+            std::vector<double> hit_latency;
+            for (int i = 0; i < options.requests; ++i) {
+                size_t hits = assistant.get_explanation_cache_hits();
+                auto start = Clock::now();
+                assistant.explain_command(commands[static_cast<size_t>(i * i) % commands.size()]);
+                double latency = elapsed_ms(start);
+                (assistant.get_explanation_cache_hits() > hits ? hit_latency : miss_latency).push_back(latency);
+            }
+            report("explain (cache miss)", miss_latency);
+            report("explain (cache hit)", hit_latency);
+            std::cout << "  explanation cache hit rate: " << std::setprecision(1)
+                      << 100.0 * static_cast<double>(hit_latency.size()) / options.requests << "%" << std::endl;
+        }
+    }
+
+    std::remove((scratch + "_intents").c_str());
+    stop_mock(mock_pid);
+    return status;
+}
@@ -0,0 +1,332 @@
+/**
+ * @file mock_ollama.cpp
+ * @brief 用于测试和基准测试的 Ollama 模拟服务
+ *
+ * 实现 /api/tags、/api/generate（流式和非流式）和 /api/embeddings，
+ * 可配置首 token 延迟、生成速度和故障注入，不需要真实模型。
+ *
+ * 用法：mock_ollama [--port N] [--latency-ms N] [--tokens-per-sec N]
+ *                    [--fail-rate P] [--drop-rate P] [--slow-rate P --slow-ms N]
+ *                    [--model NAME]
+ *                    [--response TEXT] [--embedding-dim N] [--seed N]
+ * 启动后在标准输出打印一行 "mock_ollama listening on http://127.0.0.1:PORT"。
+ */
+
+#include "json.h"
+#include <arpa/inet.h>
+#include <strings.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NeXShell::JsonValue;
+
+namespace {
+
+struct Options {
+    int port = 0;                   // 0 表示由系统分配
+    int latency_ms = 50;            // 首 token 前的延迟
+    double tokens_per_sec = 0.0;    // 生成速度，0 表示立即返回
+    double fail_rate = 0.0;         // 返回 HTTP 500 的概率
+    double drop_rate = 0.0;         // 不响应直接断开连接的概率
+    double slow_rate = 0.0;         // 首 token 延迟换成 slow_ms 的概率（模拟长尾）
+    int slow_ms = 0;
+    std::string model = "llama3.2";
+    std::string response = "ls -la";
+    size_t embedding_dim = 64;
+    unsigned seed = 1;
+};
+
+Options g_options;
+std::mt19937 g_random;
+std::mutex g_random_mutex;
+std::atomic<int> g_next_context{1};
+
+double random_unit() {
+    std::lock_guard<std::mutex> lock(g_random_mutex);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(g_random);
+}
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void send_response(int fd, int status, const std::string& body) {
+    std::ostringstream out;
+    out << "HTTP/1.1 " << status << (status == 200 ? " OK" : " Error") << "\r\n"
+        << "Content-Type: application/json\r\n"
+        << "Content-Length: " << body.size() << "\r\n"
+        << "Connection: close\r\n\r\n"
+        << body;
+    send_all(fd, out.str());
+}
+
+void send_chunk(int fd, const std::string& data) {
+    std::ostringstream out;
+    out << std::hex << data.size() << "\r\n" << data << "\r\n";
+    send_all(fd, out.str());
+}
+
+std::vector<std::string> split_words(const std::string& text) {
+    std::vector<std::string> words;
+    std::istringstream in(text);
+    std::string word;
+    while (in >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+void sleep_ms(double ms) {
+    if (ms > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(ms * 1000.0)));
+    }
+}
+
+/**
+ * @brief 根据请求生成回复文本；format=json 时按提示中的编号任务生成结构化结果，
+ *        format 为 JSON Schema 时返回单条命令建议
+ */
+std::string response_text(const JsonValue& request) {
+    if (request["format"].is_object()) {
+        return "{\"command\":" + JsonValue::quote(g_options.response) +
+               ",\"explanation\":" + JsonValue::quote("Runs " + g_options.response + ".") + ",\"risk\":\"low\"}";
+    }
+    if (request["format"].as_string() != "json") {
+        return g_options.response;
+    }
+
+    std::ostringstream json;
+    json << "{\"results\":[";
+    std::istringstream prompt(request["prompt"].as_string());
+    std::string line;
+    int tasks = 0;
+    while (std::getline(prompt, line)) {
+        size_t dot = line.find(". ");
+        if (dot == std::string::npos || dot == 0 || line.find_first_not_of("0123456789") != dot) {
+            continue;
+        }
+        json << (tasks++ > 0 ? "," : "") << "{\"task\":" << line.substr(0, dot)
+             << ",\"commands\":[" << JsonValue::quote(g_options.response) << "]}";
+    }
+    json << "]}";
+    return tasks > 0 ? json.str() : "{\"command\":" + JsonValue::quote(g_options.response) + "}";
+}
+
+void handle_generate(int fd, const JsonValue& request) {
+    std::string text = response_text(request);
+    std::vector<std::string> tokens = split_words(text);
+    double token_ms = g_options.tokens_per_sec > 0 ? 1000.0 / g_options.tokens_per_sec : 0.0;
+
+    // 新的上下文 = 旧上下文 + 本轮的 token；只有新提示需要评估
+    std::vector<int> context;
+    for (const auto& token : request["context"].items()) {
+        context.push_back(static_cast<int>(token.as_number()));
+    }
+    size_t prompt_tokens = (request["prompt"].as_string().size() + request["system"].as_string().size()) / 4 + 1;
+    for (size_t i = 0; i < prompt_tokens + tokens.size(); ++i) {
+        context.push_back(g_next_context++);
+    }
+    std::ostringstream context_json;
+    for (size_t i = 0; i < context.size(); ++i) {
+        context_json << (i > 0 ? "," : "") << context[i];
+    }
+
+    auto final_fields = [&](double total_ms) {
+        std::ostringstream out;
+        out << "\"done\":true,\"context\":[" << context_json.str() << "]"
+            << ",\"prompt_eval_count\":" << prompt_tokens
+            << ",\"eval_count\":" << tokens.size()
+            << ",\"total_duration\":" << static_cast<long long>(total_ms * 1e6);
+        return out.str();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    sleep_ms(random_unit() < g_options.slow_rate ? g_options.slow_ms : g_options.latency_ms);
+    std::string model = JsonValue::quote(request["model"].as_string(g_options.model));
+
+    if (!request["stream"].as_bool(true)) {
+        sleep_ms(token_ms * static_cast<double>(tokens.size()));
+        double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        send_response(fd, 200, "{\"model\":" + model + ",\"response\":" + JsonValue::quote(text) + "," +
+                               final_fields(total_ms) + "}");
+        return;
+    }
+
+    // 流式：每个 token 一行 JSON，使用分块传输编码
+    send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\n"
+                 "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        std::string piece = (i > 0 ? " " : "") + tokens[i];
+        send_chunk(fd, "{\"model\":" + model + ",\"response\":" + JsonValue::quote(piece) + ",\"done\":false}\n");
+        sleep_ms(token_ms);
+    }
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    send_chunk(fd, "{\"model\":" + model + ",\"response\":\"\"," + final_fields(total_ms) + "}\n");
+    send_all(fd, "0\r\n\r\n");
+}
+
+void handle_embeddings(int fd, const JsonValue& request) {
+    // 词哈希到固定维度：共享词越多的文本越相似
+    std::vector<float> embedding(g_options.embedding_dim, 0.0f);
+    for (const auto& word : split_words(request["prompt"].as_string())) {
+        size_t h = std::hash<std::string>{}(word);
+        embedding[h % embedding.size()] += 1.0f;
+        embedding[(h / embedding.size()) % embedding.size()] += 0.5f;
+    }
+
+    std::ostringstream body;
+    body << "{\"embedding\":[";
+    for (size_t i = 0; i < embedding.size(); ++i) {
+        body << (i > 0 ? "," : "") << embedding[i];
+    }
+    body << "]}";
+    sleep_ms(g_options.latency_ms / 5.0);
+    send_response(fd, 200, body.str());
+}
+
+void handle_connection(int fd) {
+    // 读取请求头和 Content-Length 指定的请求体
+    std::string data;
+    char buffer[4096];
+    size_t header_end = std::string::npos;
+    while (header_end == std::string::npos) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        data.append(buffer, static_cast<size_t>(n));
+        header_end = data.find("\r\n\r\n");
+    }
+
+    std::string head = data.substr(0, header_end);
+    size_t content_length = 0;
+    std::istringstream lines(head);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.size() > 15 && strncasecmp(line.c_str(), "content-length:", 15) == 0) {
+            content_length = std::strtoul(line.c_str() + 15, nullptr, 10);
+        }
+    }
+    std::string body = data.substr(header_end + 4);
+    while (body.size() < content_length) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        body.append(buffer, static_cast<size_t>(n));
+    }
+
+    std::string method = head.substr(0, head.find(' '));
+    size_t path_start = head.find(' ') + 1;
+    std::string path = head.substr(path_start, head.find(' ', path_start) - path_start);
+
+    if (random_unit() < g_options.drop_rate) {
+        close(fd);
+        return;
+    }
+    if (method == "POST" && random_unit() < g_options.fail_rate) {
+        send_response(fd, 500, "{\"error\":\"injected failure\"}");
+        close(fd);
+        return;
+    }
+
+    if (method == "GET" && path == "/api/tags") {
+        send_response(fd, 200, "{\"models\":[{\"name\":" + JsonValue::quote(g_options.model) + "}]}");
+    } else if (method == "POST" && (path == "/api/generate" || path == "/api/embeddings")) {
+        auto request = JsonValue::parse(body);
+        if (!request || !request->is_object()) {
+            send_response(fd, 400, "{\"error\":\"invalid JSON\"}");
+        } else if (path == "/api/generate") {
+            handle_generate(fd, *request);
+        } else {
+            handle_embeddings(fd, *request);
+        }
+    } else {
+        send_response(fd, 404, "{\"error\":\"not found\"}");
+    }
+    close(fd);
+}
+
+bool parse_options(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "mock_ollama: missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--port") g_options.port = std::atoi(value.c_str());
+        else if (arg == "--latency-ms") g_options.latency_ms = std::atoi(value.c_str());
+        else if (arg == "--tokens-per-sec") g_options.tokens_per_sec = std::atof(value.c_str());
+        else if (arg == "--fail-rate") g_options.fail_rate = std::atof(value.c_str());
+        else if (arg == "--drop-rate") g_options.drop_rate = std::atof(value.c_str());
+        else if (arg == "--slow-rate") g_options.slow_rate = std::atof(value.c_str());
+        else if (arg == "--slow-ms") g_options.slow_ms = std::atoi(value.c_str());
+        else if (arg == "--model") g_options.model = value;
+        else if (arg == "--response") g_options.response = value;
+        else if (arg == "--embedding-dim") g_options.embedding_dim = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+        else if (arg == "--seed") g_options.seed = static_cast<unsigned>(std::atoi(value.c_str()));
+        else {
+            std::cerr << "mock_ollama: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (!parse_options(argc, argv)) {
+        return 2;
+    }
+    g_random.seed(g_options.seed);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(g_options.port));
+    if (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 128) != 0) {
+        perror("mock_ollama");
+        return 1;
+    }
+    socklen_t length = sizeof(address);
+    getsockname(server, reinterpret_cast<sockaddr*>(&address), &length);
+    std::cout << "mock_ollama listening on http://127.0.0.1:" << ntohs(address.sin_port) << std::endl;
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        std::thread(handle_connection, client).detach();
+    }
+}
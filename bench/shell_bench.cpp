@@ -0,0 +1,707 @@
+/**
+ * @file shell_bench.cpp
+ * @brief Shell 核心路径的基准测试
+ *
+ * 微基准（进程内，ns/op）：
+ *   - CommandParser::parse、Utils::split/trim/join 及其视图版本、to_lower
+ *   - 内建命令分派（构造 BuiltinCommands、查找、执行 echo）
+ *   - 安全检查（SafetyEngine::scan 和 CommandValidator::is_safe）
+ *   - JSON 解析（典型的 Ollama 回复）
+ * 宏基准（启动 nexsh 子进程）：
+ *   - 启动时间、外部命令的 spawn 吞吐、脚本执行速度
+ *   - N 级管道吞吐（MB/s）：进程内 splice 的 cat 阶段与每级 fork 的对比
+ *   - 不同管道容量（默认、1M、自适应）下 tr | tr | wc 的吞吐
+ *   - 父进程占用不同内存时，直接 fork 与经过 fork server 的 spawn 延迟
+ *   - nexshd：nexsh --client 的单条命令耗时和客户端到守护进程的往返延迟
+ *   - cache 内建命令：第一次执行（保存输出）与命中后回放的耗时
+ *
+ * 结果可以输出为 JSON，并与保存的基线比较；超过阈值的退化使退出码为 1。
+ *
+ * 用法：nexsh_bench [--quick] [--json] [--output FILE] [--baseline FILE]
+ *                   [--threshold PCT] [--filter TEXT] [--nexsh PATH] [--stages N]
+ *                   [--pipeline-mb N]
+ */
+
+#include "ai_assistant.h"
+#include "builtin_commands.h"
+#include "command_cache.h"
+#include "command_parser.h"
+#include "fork_server.h"
+#include "json.h"
+#include "safety_engine.h"
+#include "shell_daemon.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+using namespace NeXShell;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    bool quick = false;
+    bool json = false;
+    std::string output;
+    std::string baseline;
+    double threshold = 10.0;        // 允许的退化百分比
+    std::string filter;
+    std::string nexsh;
+    int stages = 4;
+    long long pipeline_mb = 0;      // 0 表示按模式选择（quick 16MB，否则 2GB）
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    double value = 0.0;
+    bool lower_is_better = true;
+};
+
+/**
+ * @brief 阻止编译器把基准循环中的计算优化掉
+ */
+template <typename T>
+void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+double elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+double median(std::vector<double> samples) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+/**
+ * @brief 微基准：先估计批大小使每轮至少运行 min_ns，再取多轮每次操作耗时的中位数
+ * @param body 执行 ops 次操作
+ * @param ops_per_call 每次调用 body 完成的操作数（例如语料的行数）
+ */
+double measure_ns_per_op(const Options& options, size_t ops_per_call, const std::function<void()>& body) {
+    const double min_ns = options.quick ? 2e6 : 5e7;
+    const int rounds = options.quick ? 3 : 7;
+
+    size_t batch = 1;
+    for (;;) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            body();
+        }
+        if (elapsed_ns(start) >= min_ns || batch >= (size_t{1} << 30)) {
+            break;
+        }
+        batch *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int round = 0; round < rounds; ++round) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            body();
+        }
+        samples.push_back(elapsed_ns(start) / static_cast<double>(batch * ops_per_call));
+    }
+    return median(samples);
+}
+
+/**
+ * @brief 启动 nexsh 并等待它退出
+ * @param args nexsh 之后的参数（为空时进入交互模式，从 stdin 读取脚本）
+ * @param stdin_path 标准输入文件
+ * @return 耗时（纳秒），失败时为负数
+ */
+double run_nexsh(const Options& options, const std::vector<std::string>& args, const std::string& stdin_path) {
+    std::vector<std::string> strings = {options.nexsh};
+    strings.insert(strings.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (auto& arg : strings) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, stdin_path.c_str(), O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    auto start = Clock::now();
+    pid_t pid;
+    int spawned = posix_spawn(&pid, options.nexsh.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0) {
+        return -1.0;
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    double elapsed = elapsed_ns(start);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1.0;
+}
+
+/**
+ * @brief 多次运行 nexsh 取中位数
+ */
+double median_run(const Options& options, int runs, const std::vector<std::string>& args,
+                  const std::string& stdin_path) {
+    std::vector<double> samples;
+    for (int i = 0; i < runs; ++i) {
+        double ns = run_nexsh(options, args, stdin_path);
+        if (ns < 0) {
+            return -1.0;
+        }
+        samples.push_back(ns);
+    }
+    return median(samples);
+}
+
+/**
+ * @brief 写一个交互模式脚本；第一行留空，用于回答 Ollama 服务菜单
+ */
+bool write_script(const std::string& path, const std::vector<std::string>& lines) {
+    std::ofstream out(path, std::ios::trunc);
+    out << "\n";
+    for (const auto& line : lines) {
+        out << line << "\n";
+    }
+    out << "exit\n";
+    return static_cast<bool>(out);
+}
+
+const std::vector<std::string>& command_corpus() {
+    static const std::vector<std::string> corpus = {
+        "ls -la",
+        "cd ~/projects/nexsh",
+        "grep -rn \"TODO\" src include | sort | uniq -c | sort -rn | head -20",
+        "find . -name '*.cpp' -newer CMakeLists.txt",
+        "tar czf backup.tar.gz src include tests > /tmp/tar.log",
+        "cat access.log | awk '{print $1}' | sort | uniq -c | sort -rn",
+        "export PATH=$HOME/bin:$PATH",
+        "echo \"hello world\" >> notes.txt",
+        "make -j8 2>&1 | tee build.log",
+        "sleep 10 &",
+        "git log --oneline --graph --decorate --all",
+        "wc -l < input.txt",
+    };
+    return corpus;
+}
+
+void micro_benchmarks(const Options& options, std::vector<Result>& results) {
+    const auto& corpus = command_corpus();
+    auto add = [&](const std::string& name, size_t ops, const std::function<void()>& body) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return;
+        }
+        results.push_back({name, "ns/op", measure_ns_per_op(options, ops, body), true});
+    };
+
+    CommandParser parser;
+    add("parse.corpus_line", corpus.size(), [&]() {
+        for (const auto& line : corpus) {
+            Pipeline pipeline = parser.parse(line);
+            keep(pipeline);
+        }
+    });
+
+    std::string path_like = "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin:/opt/tools/bin";
+    add("utils.split", 1, [&]() {
+        auto parts = Utils::split(path_like, ':');
+        keep(parts);
+    });
+    std::string padded = "   \t  git status --short --branch   \n";
+    add("utils.trim", 1, [&]() {
+        auto trimmed = Utils::trim(padded);
+        keep(trimmed);
+    });
+    std::vector<std::string_view> path_fields;
+    add("utils.split_view", 1, [&]() {
+        Utils::split_view(path_like, ':', path_fields);
+        keep(path_fields);
+    });
+    add("utils.trim_view", 1, [&]() {
+        auto trimmed = Utils::trim_view(padded);
+        keep(trimmed);
+    });
+    std::string response_text = corpus[2] + " " + corpus[5] + " " + corpus[10];
+    add("utils.to_lower", 1, [&]() {
+        auto lowered = Utils::to_lower(response_text);
+        keep(lowered);
+    });
+    std::vector<std::string> words = Utils::split(corpus[2], ' ');
+    add("utils.join", 1, [&]() {
+        auto joined = Utils::join(words, " ");
+        keep(joined);
+    });
+
+    // 与 CommandExecutor::execute_command 相同：每条命令构造一次 BuiltinCommands
+    Command echo;
+    echo.program = "echo";
+    echo.arguments = {"benchmark"};
+    std::ostringstream sink;
+    add("builtin.dispatch", 1, [&]() {
+        std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+        BuiltinCommands builtins(nullptr);
+        if (builtins.is_builtin(echo.program)) {
+            builtins.execute(echo);
+        }
+        std::cout.rdbuf(saved);
+        sink.str("");
+    });
+
+    SafetyEngine engine;
+    engine.add_builtin_rules();
+    engine.compile();
+    add("safety.scan", corpus.size(), [&]() {
+        for (const auto& line : corpus) {
+            auto scan = engine.scan(line);
+            keep(scan);
+        }
+    });
+    CommandValidator validator;
+    add("safety.validate", corpus.size(), [&]() {
+        for (const auto& line : corpus) {
+            bool safe = validator.is_safe(line);
+            keep(safe);
+        }
+    });
+
+    const std::string response =
+        R"({"model":"llama3.2","created_at":"2024-05-01T12:00:00.000000Z",)"
+        R"("response":"{\"command\":\"find . -name '*.log' -mtime +7 -delete\",)"
+        R"(\"explanation\":\"Deletes log files older than a week\",\"risk\":\"medium\"}",)"
+        R"("done":true,"context":[128006,882,128007,271,1527,1131,1605,48,7,26],)"
+        R"("total_duration":1834567123,"load_duration":12345678,"prompt_eval_count":412,)"
+        R"("prompt_eval_duration":234567890,"eval_count":38,"eval_duration":987654321})";
+    add("json.parse_response", 1, [&]() {
+        auto parsed = JsonValue::parse(response);
+        keep(parsed);
+    });
+}
+
+bool macro_benchmarks(const Options& options, std::vector<Result>& results) {
+    auto wanted = [&](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+    if (options.nexsh.empty() || access(options.nexsh.c_str(), X_OK) != 0) {
+        std::cerr << "nexsh_bench: nexsh binary not found, skipping macrobenchmarks (use --nexsh PATH)" << std::endl;
+        return true;
+    }
+
+    // 让 AI 服务探测快速失败，避免测到网络
+    setenv("NEXSH_OLLAMA_ENDPOINTS", "http://127.0.0.1:9", 1);
+    unsetenv("NEXSH_METRICS_TEXTFILE");
+
+    const int runs = options.quick ? 3 : 10;
+    const std::string scratch = "/tmp/nexsh_bench_" + std::to_string(getpid());
+    bool ok = true;
+
+    double startup = median_run(options, runs, {"true"}, "/dev/null");
+    if (startup < 0) {
+        std::cerr << "nexsh_bench: " << options.nexsh << " true failed" << std::endl;
+        return false;
+    }
+    if (wanted("startup")) {
+        results.push_back({"startup", "ms", startup / 1e6, true});
+    }
+
+    if (wanted("daemon")) {
+        // 与 startup 对比：同样执行 true，但由常驻的 nexshd 执行
+        std::string socket_path = scratch + "_daemon.sock";
+        std::vector<std::string> strings = {options.nexsh, "--daemon", "--socket", socket_path, "--threads", "2"};
+        std::vector<char*> argv;
+        for (auto& arg : strings) {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+        pid_t daemon_pid;
+        int spawned = posix_spawn(&daemon_pid, options.nexsh.c_str(), &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+
+        std::unique_ptr<DaemonClient> client;
+        for (int attempt = 0; spawned == 0 && !client && attempt < 500; ++attempt) {
+            client = DaemonClient::connect(socket_path);
+            if (!client) {
+                usleep(10000);
+            }
+        }
+        if (!client) {
+            std::cerr << "nexsh_bench: nexshd did not start" << std::endl;
+            ok = false;
+        } else {
+            double command = median_run(options, runs * 5, {"--client", "--socket", socket_path, "true"}, "/dev/null");
+            if (command < 0) {
+                std::cerr << "nexsh_bench: nexsh --client failed" << std::endl;
+                ok = false;
+            } else {
+                results.push_back({"daemon.client_command", "ms", command / 1e6, true});
+            }
+            int null_fd = open("/dev/null", O_RDWR);
+            std::vector<double> samples;
+            for (int i = 0; i < runs * 5; ++i) {
+                auto start = Clock::now();
+                if (client->execute("true", "", null_fd, null_fd, null_fd) != 0) {
+                    std::cerr << "nexsh_bench: nexshd request failed" << std::endl;
+                    ok = false;
+                    break;
+                }
+                samples.push_back(elapsed_ns(start));
+            }
+            close(null_fd);
+            if (!samples.empty()) {
+                results.push_back({"daemon.round_trip", "ms", median(samples) / 1e6, true});
+            }
+            client.reset();
+        }
+        if (spawned == 0) {
+            kill(daemon_pid, SIGTERM);
+            while (waitpid(daemon_pid, nullptr, 0) < 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    if (wanted("cache")) {
+        // 输出约 6 MB 的命令；第一次执行并保存，之后每次都从缓存回放
+        std::string cache_dir = scratch + "_cache";
+        setenv("NEXSH_CACHE_DIR", cache_dir.c_str(), 1);
+        const std::vector<std::string> command = {"cache -- seq 1 1000000"};
+        double miss = run_nexsh(options, command, "/dev/null");
+        double hit = median_run(options, runs, command, "/dev/null");
+        unsetenv("NEXSH_CACHE_DIR");
+        if (miss < 0 || hit < 0) {
+            std::cerr << "nexsh_bench: cache failed" << std::endl;
+            ok = false;
+        } else {
+            results.push_back({"cache.miss", "ms", miss / 1e6, true});
+            results.push_back({"cache.hit", "ms", hit / 1e6, true});
+        }
+        CommandCache(cache_dir).evict(true);
+        for (const char* subdirectory : {"/entries", "/blobs", "/tmp", ""}) {
+            rmdir((cache_dir + subdirectory).c_str());
+        }
+    }
+
+    // 空脚本的耗时作为交互模式的固定开销
+    std::string empty_script = scratch + "_empty";
+    write_script(empty_script, {});
+    double interactive = median_run(options, runs, {}, empty_script);
+
+    const size_t spawn_count = options.quick ? 50 : 500;
+    if (wanted("spawn") && interactive >= 0) {
+        std::string script = scratch + "_spawn";
+        write_script(script, std::vector<std::string>(spawn_count, "true"));
+        double total = median_run(options, runs, {}, script);
+        if (total < 0) {
+            std::cerr << "nexsh_bench: spawn script failed" << std::endl;
+            ok = false;
+        } else {
+            double per_second = static_cast<double>(spawn_count) / (std::max(total - interactive, 1.0) / 1e9);
+            results.push_back({"spawn.throughput", "commands/s", per_second, false});
+        }
+        std::remove(script.c_str());
+    }
+
+    if (wanted("script") && interactive >= 0) {
+        std::vector<std::string> lines;
+        const size_t repeats = options.quick ? 20 : 200;
+        for (size_t i = 0; i < repeats; ++i) {
+            lines.push_back("export BENCH_ITERATION=" + std::to_string(i));
+            lines.push_back("echo line " + std::to_string(i) + " > /dev/null");
+            lines.push_back("cd /tmp");
+            lines.push_back("pwd");
+            lines.push_back("true");
+        }
+        std::string script = scratch + "_script";
+        write_script(script, lines);
+        double total = median_run(options, runs, {}, script);
+        if (total < 0) {
+            std::cerr << "nexsh_bench: script failed" << std::endl;
+            ok = false;
+        } else {
+            double per_second = static_cast<double>(lines.size()) / (std::max(total - interactive, 1.0) / 1e9);
+            results.push_back({"script.lines", "lines/s", per_second, false});
+        }
+        std::remove(script.c_str());
+    }
+
+    if (wanted("pipeline") || wanted("pipesize")) {
+        // 数据源是把一个页缓存中的文件重复读 8 遍，总量为 megabytes
+        const long long megabytes = options.pipeline_mb > 0 ? options.pipeline_mb : (options.quick ? 16 : 2048);
+        const int repeats = 8;
+        const double total_mb = static_cast<double>(std::max(1ll, megabytes / repeats) * repeats);
+        const int pipeline_runs = options.quick ? 3 : 5;
+        std::string source = scratch + "_source";
+        {
+            std::ofstream out(source, std::ios::binary | std::ios::trunc);
+            std::vector<char> block(1 << 20, 'x');
+            for (long long i = 0; i < std::max(1ll, megabytes / repeats); ++i) {
+                out.write(block.data(), static_cast<std::streamsize>(block.size()));
+            }
+        }
+        std::string cat_source = "cat";
+        for (int i = 0; i < repeats; ++i) {
+            cat_source += " " + source;
+        }
+
+        // 用 env 设置一次运行的变量，运行后恢复
+        auto throughput = [&](const std::string& command, const char* variable, const char* value) {
+            if (variable) {
+                setenv(variable, value, 1);
+            }
+            double total = median_run(options, pipeline_runs, {command}, "/dev/null");
+            if (variable) {
+                unsetenv(variable);
+            }
+            if (total < 0) {
+                std::cerr << "nexsh_bench: pipeline failed: " << command << std::endl;
+                ok = false;
+                return -1.0;
+            }
+            return total_mb / (std::max(total - startup, 1.0) / 1e9);
+        };
+
+        if (wanted("pipeline")) {
+            // cat 默认是进程内的 splice 阶段；NEXSH_ZERO_COPY=0 时每级 fork 一个 cat
+            std::string command = cat_source;
+            for (int i = 1; i < options.stages; ++i) {
+                command += " | cat";
+            }
+            command += " > /dev/null";
+            std::string name = "pipeline." + std::to_string(options.stages) + "_stage";
+            for (bool fork_per_stage : {false, true}) {
+                double rate = throughput(command, fork_per_stage ? "NEXSH_ZERO_COPY" : nullptr, "0");
+                if (rate >= 0) {
+                    results.push_back({name + (fork_per_stage ? "_fork" : ""), "MB/s", rate, false});
+                }
+            }
+        }
+
+        if (wanted("pipesize")) {
+            // 每级都是真正处理数据的进程，对比不同的管道容量
+            std::string command = cat_source + " | tr x y | tr y z | wc -c > /dev/null";
+            for (const char* size : {"default", "1M", "auto"}) {
+                double rate = throughput(command, "NEXSH_PIPE_SIZE", size);
+                if (rate >= 0) {
+                    results.push_back({std::string("pipesize.") + size, "MB/s", rate, false});
+                }
+            }
+        }
+        std::remove(source.c_str());
+    }
+
+    if (wanted("spawn")) {
+        // fork 的开销随父进程已触及的内存增长，fork server 的开销不随之变化
+        auto server = ForkServer::start(options.nexsh);
+        const int spawns = options.quick ? 20 : 200;
+        const std::string true_path = access("/bin/true", X_OK) == 0 ? "/bin/true" : "/usr/bin/true";
+        char* const true_argv[] = {const_cast<char*>("true"), nullptr};
+        auto spawn_ms = [&](bool zygote) {
+            std::vector<double> samples;
+            for (int i = 0; i < spawns; ++i) {
+                auto start = Clock::now();
+                pid_t pid;
+                if (zygote) {
+                    SpawnRequest request;
+                    request.path = true_path;
+                    request.argv = {"true"};
+                    pid = server->spawn(request);
+                } else {
+                    pid = fork();
+                    if (pid == 0) {
+                        execv(true_path.c_str(), true_argv);
+                        _exit(127);
+                    }
+                }
+                double spawned = elapsed_ns(start);
+                int status = 0;
+                if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    return -1.0;
+                }
+                samples.push_back(spawned);
+            }
+            return median(samples) / 1e6;
+        };
+        for (size_t megabytes : {size_t(0), options.quick ? size_t(128) : size_t(1024)}) {
+            std::vector<char> ballast(megabytes << 20);
+            std::memset(ballast.data(), 1, ballast.size());
+            keep(ballast);
+            for (bool zygote : {false, true}) {
+                if (zygote && !server) {
+                    std::cerr << "nexsh_bench: fork server failed to start" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                double latency = spawn_ms(zygote);
+                if (latency < 0) {
+                    std::cerr << "nexsh_bench: spawn failed" << std::endl;
+                    ok = false;
+                } else {
+                    std::string name = std::string("spawn.") + (zygote ? "zygote_" : "fork_") +
+                                       std::to_string(megabytes) + "MiB";
+                    results.push_back({name, "ms", latency, true});
+                }
+            }
+        }
+    }
+
+    std::remove(empty_script.c_str());
+    return ok;
+}
+
+std::string to_json(const Options& options, const std::vector<Result>& results) {
+    std::ostringstream out;
+    out << "{\"benchmark\":\"nexsh_bench\",\"version\":1,\"quick\":" << (options.quick ? "true" : "false")
+        << ",\"results\":[";
+    char number[64];
+    for (size_t i = 0; i < results.size(); ++i) {
+        snprintf(number, sizeof(number), "%.6g", results[i].value);
+        out << (i > 0 ? ",\n" : "\n") << "{\"name\":" << JsonValue::quote(results[i].name)
+            << ",\"unit\":" << JsonValue::quote(results[i].unit) << ",\"value\":" << number
+            << ",\"lower_is_better\":" << (results[i].lower_is_better ? "true" : "false") << "}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+void print_table(const std::vector<Result>& results) {
+    char line[128];
+    for (const auto& result : results) {
+        snprintf(line, sizeof(line), "%-28s %14.2f %s", result.name.c_str(), result.value, result.unit.c_str());
+        std::cout << line << std::endl;
+    }
+}
+
+/**
+ * @brief 与基线比较
+ * @return 超过阈值的退化个数，基线无法读取时为 -1
+ */
+int compare_with_baseline(const Options& options, const std::vector<Result>& results) {
+    std::ifstream in(options.baseline);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    auto baseline = JsonValue::parse(buffer.str());
+    if (!in || !baseline || !(*baseline)["results"].is_array()) {
+        std::cerr << "nexsh_bench: cannot read baseline " << options.baseline << std::endl;
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[160];
+    std::cerr << "\nComparison with " << options.baseline << " (threshold " << options.threshold << "%):" << std::endl;
+    for (const auto& result : results) {
+        const JsonValue* previous = nullptr;
+        for (const auto& item : (*baseline)["results"].items()) {
+            if (item["name"].as_string() == result.name) {
+                previous = &item;
+                break;
+            }
+        }
+        if (!previous || (*previous)["value"].as_number() <= 0.0) {
+            snprintf(line, sizeof(line), "%-28s %14s %14.2f %9s", result.name.c_str(), "-", result.value, "new");
+            std::cerr << line << std::endl;
+            continue;
+        }
+
+        double before = (*previous)["value"].as_number();
+        double change = (result.value - before) * 100.0 / before;
+        double worse = result.lower_is_better ? change : -change;
+        bool regressed = worse > options.threshold;
+        regressions += regressed;
+        snprintf(line, sizeof(line), "%-28s %14.2f %14.2f %+8.1f%%%s", result.name.c_str(), before,
+                 result.value, change, regressed ? "  REGRESSION" : (worse < -options.threshold ? "  improved" : ""));
+        std::cerr << line << std::endl;
+    }
+    return regressions;
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--quick") options.quick = true;
+        else if (arg == "--json") options.json = true;
+        else if (arg == "--output" && has_value) options.output = argv[++i];
+        else if (arg == "--baseline" && has_value) options.baseline = argv[++i];
+        else if (arg == "--threshold" && has_value) options.threshold = std::atof(argv[++i]);
+        else if (arg == "--filter" && has_value) options.filter = argv[++i];
+        else if (arg == "--nexsh" && has_value) options.nexsh = argv[++i];
+        else if (arg == "--stages" && has_value) options.stages = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--pipeline-mb" && has_value) options.pipeline_mb = std::max(1ll, std::atoll(argv[++i]));
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: nexsh_bench [--quick] [--json] [--output FILE] [--baseline FILE] "
+                     "[--threshold PCT] [--filter TEXT] [--nexsh PATH] [--stages N] [--pipeline-mb N]" << std::endl;
+        return 2;
+    }
+    if (options.nexsh.empty()) {
+        // 默认使用与基准程序同目录的 nexsh
+        std::string self = argv[0];
+        size_t slash = self.rfind('/');
+        options.nexsh = (slash == std::string::npos ? std::string(".") : self.substr(0, slash)) + "/nexsh";
+    }
+
+    std::vector<Result> results;
+    micro_benchmarks(options, results);
+    bool ok = macro_benchmarks(options, results);
+
+    std::string json = to_json(options, results);
+    if (options.json) {
+        std::cout << json;
+    } else {
+        print_table(results);
+    }
+    if (!options.output.empty()) {
+        std::ofstream out(options.output, std::ios::trunc);
+        out << json;
+        if (!out) {
+            std::cerr << "nexsh_bench: cannot write " << options.output << std::endl;
+            ok = false;
+        }
+    }
+
+    int status = ok ? 0 : 1;
+    if (!options.baseline.empty()) {
+        int regressions = compare_with_baseline(options, results);
+        if (regressions != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
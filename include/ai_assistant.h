@@ -1,15 +1,45 @@
 #pragma once
 
 #include "ollama_connector.h"
+#include "command_safety.h"
+#include "ai_worker.h"
+#include "intent_matcher.h"
+#include "embedding_index.h"
+#include "prompt_budget.h"
+#include "directory_context.h"
 #include <string>
 #include <vector>
 #include <memory>
-#include <set>
+#include <map>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <optional>
 
 namespace NeXShell {
 
 class Shell;
 
+/**
+ * @brief AI 请求的 token 用量
+ */
+struct AIUsage {
+    int prompt_tokens = 0;          // 服务端实际评估的提示 token 数
+    int completion_tokens = 0;      // 生成的 token 数
+    bool context_reused = false;    // 是否复用了上一轮的上下文
+};
+
+/**
+ * @brief JSON 模式下模型返回的命令建议
+ */
+struct AICommandSuggestion {
+    std::string command;        // 建议的命令，请求不明确时为空
+    std::string explanation;    // 一句话解释（或请求澄清的问题）
+    std::string risk;           // "low"、"medium" 或 "high"，未提供时为空
+};
+
 /**
  * @brief AI 助手类，负责自然语言命令解析和安全验证
  */
@@ -39,6 +69,28 @@ public:
      */
     std::string process_natural_command(const std::string& natural_input);
 
+    /**
+     * @brief 在指定目录上下文中处理自然语言命令（可在工作线程中调用）
+     * @param natural_input 用户的自然语言输入
+     * @param cwd 生成命令时使用的当前目录
+     * @return 解析后的命令或错误信息
+     */
+    std::string process_natural_command(const std::string& natural_input, const std::string& cwd);
+
+    /**
+     * @brief 记录用户接受（并执行）的建议，用于学习本地意图模板
+     * @param natural_input 自然语言输入
+     * @param command 用户接受的命令
+     */
+    void accept_suggestion(const std::string& natural_input, const std::string& command);
+
+    /**
+     * @brief 异步处理自然语言命令
+     * @param natural_input 用户的自然语言输入
+     * @return 结果的 future
+     */
+    std::future<std::string> process_natural_command_async(const std::string& natural_input);
+
     /**
      * @brief 解释命令的作用
      * @param command 要解释的命令
@@ -46,6 +98,47 @@ public:
      */
     std::string explain_command(const std::string& command);
 
+    /**
+     * @brief 异步解释命令
+     * @param command 要解释的命令
+     * @return 解释结果的 future
+     */
+    std::future<std::string> explain_command_async(const std::string& command);
+
+    /**
+     * @brief 根据正在编辑的输入投机地预取命令解释（低优先级，去重）
+     *
+     * 输入为 "ai explain <cmd>" 或较复杂的命令时在后台请求解释，之后的
+     * explain_command 直接使用进行中或已缓存的结果。新的输入会替换
+     * 尚未开始的预取请求，并终止为旧输入进行中的请求。
+     * @param buffer 当前编辑缓冲区
+     */
+    void prefetch_explanation(const std::string& buffer);
+
+    /**
+     * @brief 输入已提交：取消尚未开始的预取请求，并终止与提交的输入无关的进行中请求
+     * @param submitted 提交的输入
+     */
+    void cancel_prefetch(const std::string& submitted = "");
+
+    /**
+     * @brief 开启或关闭解释预取
+     * @param enabled 是否开启
+     */
+    void set_prefetch_enabled(bool enabled) { prefetch_enabled_ = enabled; }
+
+    /**
+     * @brief 检查是否开启了解释预取
+     * @return 开启时返回 true
+     */
+    bool is_prefetch_enabled() const { return prefetch_enabled_; }
+
+    /**
+     * @brief 获取命中解释缓存（含预取）的次数
+     * @return 命中次数
+     */
+    size_t get_explanation_cache_hits() const;
+
     /**
      * @brief 建议相关命令
      * @param intent 用户意图描述
@@ -53,6 +146,40 @@ public:
      */
     std::vector<std::string> suggest_commands(const std::string& intent);
 
+    /**
+     * @brief 批量建议命令：把多个意图打包成 JSON 格式的请求并发处理
+     * @param intents 意图列表
+     * @return 与 intents 一一对应的建议列表
+     */
+    std::vector<std::vector<std::string>> suggest_commands_batch(const std::vector<std::string>& intents);
+
+    /**
+     * @brief 异步建议相关命令
+     * @param intent 用户意图描述
+     * @return 建议列表的 future
+     */
+    std::future<std::vector<std::string>> suggest_commands_async(const std::string& intent);
+
+    /**
+     * @brief 在后台执行 AI 请求，完成后在提示符前报告结果
+     * @param description 请求描述（如 "ai suggest backup"）
+     * @param task 在工作线程上执行并返回输出文本的任务
+     * @return 请求编号，队列已满时返回 -1
+     */
+    int submit_background_request(const std::string& description,
+                                  std::function<std::string()> task);
+
+    /**
+     * @brief 报告并清理已完成的后台 AI 请求
+     */
+    void cleanup_background_requests();
+
+    /**
+     * @brief 获取仍在运行的后台 AI 请求
+     * @return (编号, 描述) 列表
+     */
+    std::vector<std::pair<int, std::string>> get_background_requests() const;
+
     /**
      * @brief 检查是否启用了 AI 功能
      * @return 如果 AI 可用返回 true
@@ -65,39 +192,143 @@ public:
      */
     const std::string& get_current_model() const { return current_model_; }
 
+    /**
+     * @brief 获取最近一次自然语言请求的 token 用量
+     * @return token 用量
+     */
+    AIUsage get_last_usage() const;
+
+    /**
+     * @brief 获取累计 token 用量
+     * @return 累计的提示和生成 token 数
+     */
+    AIUsage get_total_usage() const;
+
+    /**
+     * @brief 获取各 Ollama 端点的负载和健康状态
+     * @return 状态列表，未初始化时为空
+     */
+    std::vector<EndpointStatus> get_endpoint_status() const;
+
+    /**
+     * @brief 获取由本地意图匹配器直接回答的请求数
+     * @return 请求数
+     */
+    size_t get_local_match_count() const;
+
+    /**
+     * @brief 获取首轮提示的 token 预算
+     * @return token 数
+     */
+    size_t get_prompt_budget() const { return prompt_budget_tokens_; }
+
+    /**
+     * @brief 当前目录改变时调用，在后台重新验证并预热目录上下文缓存
+     * @param cwd 新的当前目录
+     */
+    void on_directory_changed(const std::string& cwd);
+
+    /**
+     * @brief 获取最近一次自然语言请求的完整建议（含解释和风险）
+     * @return 建议；本地匹配的建议没有解释
+     */
+    AICommandSuggestion get_last_suggestion() const;
+
+    /**
+     * @brief 解析模型的命令回复
+     *
+     * 优先按 JSON 对象解析（允许外层有代码块等包裹）；服务端不支持 JSON 模式时，
+     * 接受 ``` 代码块中的第一行或单行回复。
+     * @param response 模型回复
+     * @return 解析结果，无法确定命令时返回 std::nullopt
+     */
+    static std::optional<AICommandSuggestion> parse_command_response(const std::string& response);
+
+    /**
+     * @brief 解析 ai batch 的 JSON 回复
+     *
+     * 接受 {"results":[...]} 或直接的数组。task 是从 1 开始的编号，缺少时按顺序对应；
+     * 编号不是 1~task_count 之间的整数的条目被丢弃，同一编号只取第一个条目。
+     * 每个任务最多保留 MAX_SUGGESTIONS 条命令。
+     * @param response 模型回复
+     * @param task_count 请求中的任务数
+     * @return task_count 个建议列表，未回答的任务为空
+     */
+    static std::vector<std::vector<std::string>> parse_batch_response(const std::string& response,
+                                                                      size_t task_count);
+
 private:
+    // 进行中或已完成的解释；请求失败或被取消时为 std::nullopt
+    using CachedExplanation = std::shared_future<std::optional<std::string>>;
+
     /**
-     * @brief 构建系统提示词
-     * @return 系统提示词
+     * @brief 在 token 预算内构建新对话的系统提示和首轮提示
+     *
+     * 规则和本轮输入总是保留；相关示例、最近命令和目录列表按优先级分配剩余预算，
+     * 目录列表放不下时用缓存的压缩摘要替代。
+     * @param user_input 用户输入
+     * @param cwd 当前目录
+     * @return (系统提示, 首轮提示)
      */
-    std::string build_system_prompt();
+    std::pair<std::string, std::string> build_initial_prompts(const std::string& user_input,
+                                                              const std::string& cwd);
 
     /**
-     * @brief 构建用户上下文
+     * @brief 从嵌入索引中检索与输入最相关的历史示例
      * @param user_input 用户输入
-     * @return 包含上下文的完整提示
+     * @return (输入, 命令) 列表，按相关度降序；不可用时为空
      */
-    std::string build_context_prompt(const std::string& user_input);
+    std::vector<std::pair<std::string, std::string>> retrieve_examples(const std::string& user_input);
 
     /**
-     * @brief 验证命令安全性
-     * @param command 要验证的命令
-     * @return 如果命令安全返回 true
+     * @brief 用一次 JSON 格式的请求为一组意图生成建议
+     * @param intents 意图列表
+     * @return 与 intents 一一对应的建议列表，响应中缺失的意图为空
+     */
+    std::vector<std::vector<std::string>> suggest_commands_chunk(const std::vector<std::string>& intents);
+
+    /**
+     * @brief 直接向模型请求命令解释（不经过缓存）
+     * @param command 要解释的命令
+     * @param cancel 置位时终止请求，为空时不可取消
+     * @return 生成结果，success 为 false 时 error 说明失败或取消的原因
+     */
+    OllamaGeneration request_explanation(const std::string& command, const std::atomic<bool>* cancel = nullptr);
+
+    /**
+     * @brief 在工作线程上依次处理最新的预取目标
      */
-    bool is_command_safe(const std::string& command);
+    void run_prefetch();
 
     /**
-     * @brief 解析 AI 响应，提取命令
-     * @param ai_response AI 的响应
-     * @return 提取的命令
+     * @brief 把解释放入缓存，超出容量时淘汰最早的条目（需持有 prefetch_mutex_）
+     * @param key 规范化后的命令
+     * @param explanation 解释结果
      */
-    std::string extract_command_from_response(const std::string& ai_response);
+    void cache_explanation(const std::string& key, CachedExplanation explanation);
 
     /**
-     * @brief 获取当前系统上下文信息
-     * @return 系统上下文字符串
+     * @brief 构建复用上下文时的单轮提示，只包含本轮输入
+     * @param user_input 用户输入
+     * @param cwd 当前目录
+     * @return 单轮提示
      */
-    std::string get_system_context();
+    std::string build_turn_prompt(const std::string& user_input, const std::string& cwd);
+
+    /**
+     * @brief 验证命令安全性
+     * @param command 要验证的命令
+     * @param cwd 解析相对路径所用的目录
+     * @return 如果命令安全返回 true
+     */
+    bool is_command_safe(const std::string& command, const std::string& cwd);
+
+    /**
+     * @brief 构建目录列表段落（来自缓存的目录上下文）
+     * @param cwd 目录
+     * @return 带类型和大小的条目，放不下时用快照摘要替代
+     */
+    PromptSection build_directory_section(const std::string& cwd);
 
     /**
      * @brief 检查Ollama服务状态并处理用户选择
@@ -124,12 +355,79 @@ private:
     std::string current_model_;
     bool ai_enabled_;
     
-    // 危险命令黑名单
-    std::set<std::string> dangerous_commands_;
+    // 基于语法树的命令安全分析器（带缓存）
+    CommandSafetyAnalyzer safety_analyzer_;
     
     // 命令历史记录（用于上下文）
     std::vector<std::pair<std::string, std::string>> command_history_;
     static const size_t MAX_HISTORY_SIZE = 10;
+    
+    // 本地意图匹配器，常见请求无需调用模型
+    IntentMatcher intent_matcher_;
+    size_t local_matches_ = 0;
+    
+    // 已接受建议的嵌入索引，用于检索相关示例
+    EmbeddingIndex history_index_;
+    std::string embedding_model_;
+    std::atomic<bool> embeddings_enabled_{true};   // 嵌入模型不可用时关闭
+    mutable std::mutex index_mutex_;               // 保护 history_index_
+    static const size_t RETRIEVED_EXAMPLES = 3;
+    static const size_t RECENT_HISTORY_WITH_EXAMPLES = 3;
+    static constexpr float MIN_EXAMPLE_SIMILARITY = 0.5f;
+    
+    // 命令解释缓存和投机预取状态，由 prefetch_mutex_ 保护
+    std::map<std::string, CachedExplanation> explanation_cache_;
+    std::deque<std::string> explanation_order_;
+    std::string prefetch_target_;           // 等待预取的命令，新输入会替换它
+    bool prefetch_scheduled_ = false;       // 是否已有预取任务在队列或执行中
+    std::string prefetch_running_;          // 正在请求的预取目标
+    std::shared_ptr<std::atomic<bool>> prefetch_cancel_;    // 终止正在进行的预取请求
+    size_t explanation_cache_hits_ = 0;
+    std::atomic<bool> prefetch_enabled_{false};
+    mutable std::mutex prefetch_mutex_;
+    static const size_t MAX_CACHED_EXPLANATIONS = 32;
+    
+    // Ollama 返回的对话上下文 token，下一轮直接复用
+    std::vector<int> conversation_context_;
+    static const size_t MAX_CONTEXT_TOKENS = 4096;
+    
+    // 首轮提示的 token 预算（$NEXSH_PROMPT_BUDGET）和压缩摘要缓存
+    size_t prompt_budget_tokens_ = DEFAULT_PROMPT_BUDGET;
+    CompactionCache compaction_cache_;
+    static const size_t DEFAULT_PROMPT_BUDGET = 1536;
+    
+    // 按目录缓存的列表，通过 inotify 或 mtime 失效
+    DirectoryContext directory_context_{MAX_DIRECTORY_ENTRIES};
+    static const size_t MAX_DIRECTORY_ENTRIES = 500;
+    
+    // 最近一次的完整建议和请求它时使用的 JSON Schema
+    AICommandSuggestion last_suggestion_;
+    static const char* const COMMAND_SCHEMA;
+    
+    // token 用量统计
+    AIUsage last_usage_;
+    AIUsage total_usage_;
+    
+    // 保护历史、意图模板、上下文、用量和 safety_analyzer_，它们会被工作线程访问
+    mutable std::mutex mutex_;
+    
+    // 后台 AI 请求（只在主线程访问）
+    struct BackgroundRequest {
+        int id;
+        std::string description;
+        std::future<std::string> result;
+    };
+    std::vector<BackgroundRequest> background_requests_;
+    int next_request_id_ = 1;
+    
+    // 批量建议时每个请求包含的意图数
+    static const size_t BATCH_CHUNK_SIZE = 8;
+    static const size_t MAX_SUGGESTIONS = 3;
+    
+    // 工作线程池，最后声明以保证最先析构
+    static const size_t AI_WORKER_THREADS = 2;
+    static const size_t AI_QUEUE_CAPACITY = 16;
+    AIWorkerPool workers_;
 };
 
 /**
@@ -163,9 +461,16 @@ public:
 private:
     void initialize_dangerous_patterns();
     
+    /**
+     * @brief 综合语法树分析和可疑模式给出结论
+     * @param command 命令
+     * @return 分析结论
+     */
+    SafetyVerdict evaluate(const std::string& command);
+    
 private:
-    std::set<std::string> dangerous_commands_;
-    std::set<std::string> dangerous_patterns_;
+    const SafetyEngine& safety_engine_;
+    CommandSafetyAnalyzer safety_analyzer_;
     std::map<std::string, std::string> safe_alternatives_;
 };
 
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief AI 任务优先级
+ */
+enum class AIPriority {
+    Normal,     // 用户发起的请求
+    Low         // 预取等投机请求，只在空闲时执行且不占满所有线程
+};
+
+/**
+ * @brief AI 请求工作线程池
+ *
+ * 请求进入有界队列，由专用工作线程执行，调用方通过 future 获取结果。
+ * 线程在第一次提交请求时才启动，未使用 AI 时不产生额外线程。
+ */
+class AIWorkerPool {
+public:
+    /**
+     * @brief 构造工作线程池
+     * @param thread_count 工作线程数量（决定可同时进行的请求数）
+     * @param queue_capacity 等待队列容量
+     */
+    explicit AIWorkerPool(size_t thread_count = 2, size_t queue_capacity = 16);
+    ~AIWorkerPool();
+
+    AIWorkerPool(const AIWorkerPool&) = delete;
+    AIWorkerPool& operator=(const AIWorkerPool&) = delete;
+
+    /**
+     * @brief 提交任务
+     * @param task 要在工作线程上执行的可调用对象
+     * @param priority 优先级，低优先级任务在没有普通任务时才执行
+     * @return 任务结果的 future
+     * @throws std::runtime_error 队列已满时抛出
+     */
+    template<typename F>
+    auto submit(F&& task, AIPriority priority = AIPriority::Normal)
+        -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        if (!enqueue([packaged]() { (*packaged)(); }, priority)) {
+            throw std::runtime_error("AI request queue is full");
+        }
+        return future;
+    }
+
+    /**
+     * @brief 获取排队中和执行中的任务数
+     * @return 任务数
+     */
+    size_t pending() const;
+
+private:
+    /**
+     * @brief 把任务放入队列
+     * @param job 任务
+     * @param priority 优先级
+     * @return 队列已满或线程池已停止时返回 false
+     */
+    bool enqueue(std::function<void()> job, AIPriority priority);
+
+    /**
+     * @brief 是否可以开始一个低优先级任务（至少留一个线程给普通请求）
+     */
+    bool can_run_low_priority() const;
+
+    /**
+     * @brief 工作线程主循环
+     */
+    void worker_loop();
+
+private:
+    size_t thread_count_;
+    size_t queue_capacity_;
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    std::deque<std::function<void()>> low_priority_queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t running_ = 0;
+    size_t running_low_priority_ = 0;
+    bool stopping_ = false;
+};
+
+} // namespace NeXShell
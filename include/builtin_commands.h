@@ -59,10 +59,25 @@ private:
     int cmd_fg(const std::vector<std::string>& args);
     int cmd_bg(const std::vector<std::string>& args);
     int cmd_ai(const std::vector<std::string>& args);
+    int cmd_trace(const std::vector<std::string>& args);
+    int cmd_stats(const std::vector<std::string>& args);
+    int cmd_pipesize(const std::vector<std::string>& args);
+    int cmd_parallel(const std::vector<std::string>& args);
+    int cmd_limit(const std::vector<std::string>& args);
+    int cmd_cache(const std::vector<std::string>& args);
+
+    /**
+     * @brief ai batch：为文件中的每个任务批量生成建议并报告吞吐量
+     * @param ai AI 助手
+     * @param path 任务文件（每行一个任务）
+     * @return 所有任务都有建议时返回 0
+     */
+    int ai_batch(AIAssistant* ai, const std::string& path);
 
 private:
     Shell* shell_;
     std::unordered_map<std::string, CommandHandler> commands_;
+    bool run_in_background_ = false;    // 当前执行的命令是否以 & 结尾
 };
 
 } // namespace NeXShell
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief cache 内建命令的参数：cache [--ttl N] [--key-files F...] [--env VAR...] -- command...
+ */
+struct CacheOptions {
+    int64_t ttl_seconds = 0;                // 0 表示不过期
+    std::vector<std::string> key_files;     // 输入文件，内容变化时缓存失效
+    std::vector<std::string> key_env;       // 额外参与键计算的环境变量
+    std::vector<std::string> command;       // -- 之后的命令
+
+    /**
+     * @brief 解析参数；--key-files 和 --env 收集到下一个选项或 -- 为止
+     * @param args cache 的参数
+     * @param error 解析失败时的错误信息
+     * @return 参数无效或缺少命令时为空
+     */
+    static std::optional<CacheOptions> parse(const std::vector<std::string>& args, std::string& error);
+
+    /**
+     * @brief 用于显示和记录的命令行（含空白或特殊字符的词加上引号）；执行时直接使用 command
+     */
+    std::string command_line() const;
+};
+
+/**
+ * @brief 一条缓存记录
+ */
+struct CacheEntry {
+    int exit_code = 0;
+    int64_t created = 0;                    // Unix 时间（秒）
+    int64_t expires = 0;                    // 0 表示不过期
+    std::string stdout_blob;                // 内容哈希
+    std::string stderr_blob;
+    uint64_t stdout_size = 0;
+    uint64_t stderr_size = 0;
+    std::string command;
+};
+
+/**
+ * @brief 缓存目录的统计
+ */
+struct CacheStats {
+    size_t entries = 0;
+    size_t blobs = 0;
+    uint64_t bytes = 0;                     // 输出内容占用的字节数
+    size_t expired = 0;
+};
+
+/**
+ * @brief 确定性命令的输出缓存
+ *
+ * 目录结构：
+ *   entries/<key>   记录（退出码、时间、输出内容的哈希），key 由 argv、cwd、选定的
+ *                   环境变量和输入文件计算
+ *   blobs/<hash>    标准输出和标准错误的内容，按内容寻址，相同的输出只存一份
+ *   tmp/            执行时捕获输出的临时文件
+ * 命中时用 sendfile 把 blob 直接写到输出描述符。每次命中更新记录的 mtime，
+ * 超过容量上限时按 mtime 从旧到新淘汰，不再被引用的 blob 随之删除。
+ */
+class CommandCache {
+public:
+    // 总是参与键计算的环境变量（影响程序查找和输出语言）
+    static const std::vector<std::string>& default_key_env();
+
+    // 超过这个大小的输入文件用大小、mtime 和 inode 代替内容哈希
+    static constexpr uint64_t MAX_HASHED_FILE = 64ull << 20;
+
+    /**
+     * @param directory 缓存目录
+     * @param max_bytes 输出内容的容量上限
+     */
+    CommandCache(std::string directory = default_directory(), uint64_t max_bytes = default_max_bytes());
+
+    /**
+     * @brief $NEXSH_CACHE_DIR、$XDG_CACHE_HOME/nexsh/commands 或 ~/.cache/nexsh/commands
+     */
+    static std::string default_directory();
+
+    /**
+     * @brief $NEXSH_CACHE_MAX_SIZE（支持 K/M/G 后缀），默认 256M
+     */
+    static uint64_t default_max_bytes();
+
+    const std::string& directory() const { return directory_; }
+
+    /**
+     * @brief 计算缓存键（128 位哈希的十六进制）
+     * @param options 命令和键的组成
+     * @param cwd 执行命令的目录
+     */
+    std::string key(const CacheOptions& options, const std::string& cwd) const;
+
+    /**
+     * @brief 查找未过期的记录，命中时更新它的 mtime
+     * @param ttl_seconds 调用者允许的最大年龄，0 表示只看记录自己的过期时间
+     */
+    std::optional<CacheEntry> lookup(const std::string& key, int64_t ttl_seconds) const;
+
+    /**
+     * @brief 把记录的输出写到描述符
+     * @return 成功时为 0；写入已关闭的管道时为 EPIPE，其它错误为对应的 errno
+     */
+    int replay(const CacheEntry& entry, int output_fd, int error_fd) const;
+
+    /**
+     * @brief 创建一个捕获输出的临时文件（已经 unlink，关闭即删除）
+     * @return 描述符，失败时为 -1
+     */
+    int create_capture() const;
+
+    /**
+     * @brief 保存一次执行的结果
+     * @param stdout_fd、stderr_fd create_capture 返回的描述符（读写位置不影响结果）
+     * @return 保存成功时返回 true
+     */
+    bool store(const std::string& key, const CacheOptions& options, int exit_code, int stdout_fd, int stderr_fd);
+
+    /**
+     * @brief 删除过期记录，再按 mtime 淘汰到容量上限以内，最后删除不再引用的 blob
+     * @param all 删除全部记录
+     * @return 删除的记录数
+     */
+    size_t evict(bool all = false);
+
+    CacheStats stats() const;
+
+private:
+    std::string entry_path(const std::string& key) const;
+    std::string blob_path(const std::string& hash) const;
+
+    /**
+     * @brief 把捕获的输出放入 blobs/（已有相同内容时直接复用）
+     * @return 内容哈希，失败时为空
+     */
+    std::string store_blob(int fd, uint64_t& size);
+
+private:
+    std::string directory_;
+    uint64_t max_bytes_;
+};
+
+} // namespace NeXShell
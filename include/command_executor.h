@@ -1,7 +1,15 @@
 #pragma once
 
 #include "command_parser.h"
+#include "resource_usage.h"
+#include "pipe_sizing.h"
+#include "job_cgroup.h"
+#include <memory>
 #include <sys/types.h>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 namespace NeXShell {
 
@@ -12,6 +20,17 @@ class Shell;
  */
 class CommandExecutor {
 public:
+    /**
+     * @brief 一个后台作业；启用作业 cgroup 时持有它的 cgroup，用于 jobs -l 的用量统计
+     */
+    struct BackgroundJob {
+        int id = 0;                     // 启动时分配的作业号，启动通知和 jobs 都显示它
+        pid_t pid = 0;
+        std::string command;
+        std::unique_ptr<JobCgroup> cgroup;
+        JobLimits limits;
+    };
+
     explicit CommandExecutor(Shell* shell);
     ~CommandExecutor() = default;
 
@@ -29,6 +48,23 @@ public:
      */
     int execute_command(const Command& command);
 
+    /**
+     * @brief 运行 parallel 内建命令
+     * @param args parallel 的参数
+     * @param input_fd 没有 ::: 时读取参数的描述符（标准输入或管道上游）
+     * @param output_fd 作业输出的去向（标准输出或管道下游）
+     * @return 失败的作业数（最大 101），参数错误时为 1
+     */
+    int execute_parallel(const std::vector<std::string>& args, int input_fd, int output_fd);
+
+    /**
+     * @brief 运行 cache 内建命令：命中时回放保存的输出，否则执行命令并保存
+     * @param args cache 的参数（[--ttl N] [--key-files F...] [--env VAR...] -- command...）
+     * @param output_fd 标准输出的去向（标准输出或管道下游）；标准错误总是 shell 的标准错误
+     * @return 命令（或保存的）退出码，参数错误时为 1
+     */
+    int execute_cached(const std::vector<std::string>& args, int output_fd);
+
     /**
      * @brief 等待所有后台进程
      */
@@ -39,6 +75,11 @@ public:
      */
     void cleanup_background_processes();
 
+    /**
+     * @brief 仍在运行（尚未被 cleanup_background_processes 回收）的后台作业
+     */
+    const std::vector<BackgroundJob>& background_jobs() const { return background_jobs_; }
+
 private:
     /**
      * @brief 检查是否为内建命令
@@ -88,9 +129,85 @@ private:
      */
     int wait_for_process(pid_t pid);
 
+    /**
+     * @brief 执行带 time 前缀的管道，并向 stderr 报告资源用量
+     * @param pipeline 第一个命令为 time 的管道
+     * @return 被计时管道的退出码
+     */
+    int execute_timed(const Pipeline& pipeline);
+
+    /**
+     * @brief 执行带 pipesize 前缀的管道（pipesize [-v] SIZE|auto|default pipeline）
+     *
+     * 没有跟随命令时交给 pipesize 内建命令处理。
+     * @param pipeline 第一个命令为 pipesize 的管道
+     * @return 管道的退出码
+     */
+    int execute_with_pipe_size(const Pipeline& pipeline);
+
+    /**
+     * @brief 启动 parallel 或 cache 的一个作业
+     *
+     * 单个外部命令直接 fork/exec；管道、内建命令或带重定向的命令在 fork 出的子 shell 中执行。
+     * 作业的标准输入为 /dev/null。
+     * @param command_line 展开后的命令行
+     * @param output_fd 作业标准输出
+     * @param error_fd 作业标准错误
+     * @return 子进程 ID，失败时为 -1
+     */
+    pid_t spawn_job(const std::string& command_line, int output_fd, int error_fd);
+
+    /**
+     * @brief 启动已解析的作业；cache 直接传入 argv，不经过命令行的重新解析
+     * @param pipeline 要执行的管道
+     * @param output_fd 作业标准输出
+     * @param error_fd 作业标准错误
+     * @return 子进程 ID，失败时为 -1
+     */
+    pid_t spawn_job(const Pipeline& pipeline, int output_fd, int error_fd);
+
+    /**
+     * @brief 执行带 limit 前缀的管道（limit [-c WEIGHT] [-m SIZE] [-p N] pipeline）
+     *
+     * 没有跟随命令时交给 limit 内建命令处理。
+     * @param pipeline 第一个命令为 limit 的管道
+     * @return 管道的退出码
+     */
+    int execute_with_limits(const Pipeline& pipeline);
+
+    /**
+     * @brief 在 PATH 中查找程序，结果按程序名缓存（PATH 改变时清空）
+     * @param program 程序名
+     * @return 可执行文件的绝对路径；含 '/' 或找不到时为空，由 execvp 处理
+     */
+    std::string resolve_program(const std::string& program);
+
 private:
     Shell* shell_;
-    std::vector<pid_t> background_processes_;
+    std::vector<BackgroundJob> background_jobs_;
+    
+    // 前台进程的启动信息，由 wait4 回收时生成用量记录
+    struct ProcessStart {
+        std::string program;
+        std::chrono::steady_clock::time_point start;
+    };
+    std::unordered_map<pid_t, ProcessStart> process_starts_;
+    std::vector<ProcessUsage> reaped_usage_;    // time 执行期间回收的前台进程，按回收顺序
+    bool recording_usage_ = false;              // 只在 time 前缀执行时记录，避免无限增长
+    
+    // pipesize 前缀对当前管道的覆盖，以及是否报告管道容量和吞吐
+    std::optional<PipeSizeSetting> pipe_size_override_;
+    bool pipe_size_report_ = false;
+    
+    // limit 前缀对当前作业的覆盖；当前作业的限制和 cgroup（未启用时 job_placed_ 为 false）
+    std::optional<JobLimits> job_limits_override_;
+    JobLimits job_limits_;
+    std::unique_ptr<JobCgroup> job_cgroup_;
+    bool job_placed_ = false;
+    
+    // 程序名到绝对路径的缓存，对应 path_cache_env_ 这个 PATH 值
+    std::unordered_map<std::string, std::string> path_cache_;
+    std::string path_cache_env_;
 };
 
 } // namespace NeXShell
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 
@@ -61,7 +62,7 @@ private:
      * @param input 输入字符串
      * @return token 列表
      */
-    std::vector<std::string> tokenize(const std::string& input);
+    std::vector<std::string> tokenize(std::string_view input);
 
     /**
      * @brief 解析单个命令
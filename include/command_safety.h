@@ -0,0 +1,93 @@
+#pragma once
+
+#include "command_parser.h"
+#include "safety_engine.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace NeXShell {
+
+/**
+ * @brief 安全分析结论
+ */
+struct SafetyVerdict {
+    bool safe = true;       // 是否安全
+    std::string reason;     // 不安全时的原因
+};
+
+/**
+ * @brief 基于语法树的命令安全分析器
+ *
+ * 先用 CommandParser 把命令解析为 Pipeline，再对规范化后的 argv
+ * （去掉 sudo/env 等包装、展开合并的短选项、解析出绝对路径）
+ * 应用按程序划分的规则，并检查重定向目标。结论按规范化命令缓存。
+ */
+class CommandSafetyAnalyzer {
+public:
+    explicit CommandSafetyAnalyzer(const SafetyEngine& engine);
+
+    /**
+     * @brief 分析命令是否安全
+     * @param command 命令字符串
+     * @param cwd 解析相对路径所用的目录，为空时使用进程当前目录
+     * @return 分析结论
+     */
+    SafetyVerdict analyze(const std::string& command, const std::string& cwd = "");
+
+    /**
+     * @brief 获取规范化后的命令文本（单空格分隔，选项已展开）
+     * @param pipeline 解析后的管道
+     * @return 规范化文本
+     */
+    static std::string normalize(const Pipeline& pipeline);
+
+    /**
+     * @brief 获取缓存命中次数
+     * @return 命中次数
+     */
+    size_t cache_hits() const { return cache_hits_; }
+
+private:
+    /**
+     * @brief 规范化后的单个命令
+     */
+    struct NormalizedCommand {
+        std::string program;                // 去掉路径后的程序名
+        std::vector<std::string> flags;     // 展开后的选项（"-r"、"-f"、"--force"）
+        std::vector<std::string> operands;  // 非选项参数
+        std::vector<std::string> argv;      // 去掉包装程序后的原始参数
+    };
+
+    static NormalizedCommand normalize_command(const Command& command);
+
+    /**
+     * @brief 结论缓存的键：规范化后的 argv 和重定向按字段编码，不会因拼接产生歧义
+     */
+    static std::string cache_key(const Pipeline& pipeline, const std::string& cwd);
+
+    SafetyVerdict analyze_pipeline(const Pipeline& pipeline, const std::string& cwd, int depth);
+
+    SafetyVerdict analyze_command(const NormalizedCommand& command,
+                                  const std::string& cwd, int depth);
+
+    SafetyVerdict analyze_text(const std::string& command, const std::string& cwd, int depth);
+
+    /**
+     * @brief 把参数解析为绝对路径（最后一级不跟随符号链接）
+     */
+    static std::string resolve_path(const std::string& path, const std::string& cwd);
+
+    /**
+     * @brief 检查路径是否为根目录或位于系统关键目录下
+     */
+    static bool is_critical_path(const std::string& absolute_path);
+
+private:
+    const SafetyEngine& engine_;
+    std::unordered_map<std::string, SafetyVerdict> cache_;
+    size_t cache_hits_ = 0;
+    static const size_t MAX_CACHE_SIZE = 1024;
+};
+
+} // namespace NeXShell
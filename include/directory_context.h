@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 目录中的一个条目
+ */
+struct DirectoryEntry {
+    std::string name;
+    char type = 'f';        // 'd' 目录，'f' 普通文件，'l' 符号链接，'o' 其他
+    uint64_t size = 0;      // 普通文件的大小（字节）
+};
+
+/**
+ * @brief 某个目录在某一时刻的列表
+ */
+struct DirectorySnapshot {
+    std::string path;
+    std::vector<DirectoryEntry> entries;    // 按名称排序，不含隐藏文件
+    size_t total_entries = 0;               // 扫描到的非隐藏条目数
+    bool truncated = false;                 // entries 是否只是一部分
+    uint64_t generation = 0;                // 每次重新扫描递增，可用作缓存键
+};
+
+/**
+ * @brief 带缓存的目录上下文提供器
+ *
+ * 用一次 getdents64 遍历加 statx 收集有界的目录列表，按目录缓存。
+ * 缓存通过 inotify 失效；inotify 不可用（或监视数用尽）时比较目录的 mtime。
+ * 线程安全。
+ */
+class DirectoryContext {
+public:
+    /**
+     * @brief 构造提供器
+     * @param max_entries 每个快照最多保留的条目数
+     * @param max_directories 最多缓存的目录数
+     */
+    explicit DirectoryContext(size_t max_entries = 500, size_t max_directories = 16);
+    ~DirectoryContext();
+
+    DirectoryContext(const DirectoryContext&) = delete;
+    DirectoryContext& operator=(const DirectoryContext&) = delete;
+
+    /**
+     * @brief 获取目录列表，缓存有效时不重新扫描
+     * @param path 目录路径
+     * @return 快照；目录无法打开时 entries 为空
+     */
+    std::shared_ptr<const DirectorySnapshot> get(const std::string& path);
+
+    /**
+     * @brief 切换目录时调用：按 mtime 重新验证并预热缓存
+     * @param path 新的当前目录
+     */
+    void refresh(const std::string& path);
+
+    /**
+     * @brief 把条目格式化为提示中的一行（目录加 '/'，链接加 '@'，文件附带大小）
+     */
+    static std::string format_entry(const DirectoryEntry& entry);
+
+    /**
+     * @brief 目录列表的压缩摘要：条目数、总大小、常见扩展名和前几个子目录
+     */
+    static std::string summarize(const DirectorySnapshot& snapshot);
+
+    size_t scan_count() const;
+    size_t hit_count() const;
+    bool uses_inotify() const { return inotify_fd_ >= 0; }
+
+private:
+    struct CachedDirectory {
+        std::shared_ptr<const DirectorySnapshot> snapshot;
+        int64_t mtime_ns = 0;
+        int watch = -1;
+        bool stale = false;
+        uint64_t last_used = 0;
+    };
+
+    std::shared_ptr<const DirectorySnapshot> lookup(const std::string& path, bool check_mtime);
+    std::shared_ptr<DirectorySnapshot> scan(const std::string& path) const;
+    void drain_events();
+    void evict_one();
+    static int64_t directory_mtime(const std::string& path);
+
+private:
+    size_t max_entries_;
+    size_t max_directories_;
+    int inotify_fd_ = -1;
+    std::unordered_map<std::string, CachedDirectory> cache_;
+    std::unordered_map<int, std::string> watches_;
+    uint64_t clock_ = 0;
+    uint64_t generation_ = 0;
+    size_t scans_ = 0;
+    size_t hits_ = 0;
+    mutable std::mutex mutex_;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace NeXShell {
+
+/**
+ * @brief 相似度检索命中的条目
+ */
+struct EmbeddingHit {
+    size_t index;   // 条目下标
+    float score;    // 余弦相似度
+};
+
+/**
+ * @brief 自然语言请求与命令的嵌入向量索引
+ *
+ * 向量归一化后按行存放在连续的 float32 矩阵中，余弦相似度即点积，
+ * 检索时对全部行做一次（支持时使用 AVX2 的）线性扫描并保留 top-k。
+ * 磁盘上使用两个只追加的文件：<path>.f32 保存矩阵，<path>.tsv 保存
+ * 每行对应的 "输入<TAB>命令"。
+ */
+class EmbeddingIndex {
+public:
+    EmbeddingIndex() = default;
+
+    /**
+     * @brief 添加条目，设置了存储路径时同时追加到磁盘
+     * @param embedding 嵌入向量（无需归一化）
+     * @param input 自然语言输入
+     * @param command 对应的命令
+     * @return 维度与索引一致并已添加时返回 true
+     */
+    bool add(std::vector<float> embedding, const std::string& input, const std::string& command);
+
+    /**
+     * @brief 检索与查询最相似的 k 个条目
+     * @param query 查询向量（无需归一化）
+     * @param k 返回的最大条目数
+     * @return 按相似度降序排列的命中
+     */
+    std::vector<EmbeddingHit> top_k(std::vector<float> query, size_t k) const;
+
+    /**
+     * @brief 获取条目
+     * @param index 条目下标
+     * @return (输入, 命令)
+     */
+    const std::pair<std::string, std::string>& entry(size_t index) const { return entries_[index]; }
+
+    size_t size() const { return entries_.size(); }
+    size_t dimension() const { return dimension_; }
+
+    /**
+     * @brief 从磁盘加载索引（替换当前内容）
+     * @param path 文件路径前缀
+     * @return 加载的条目数，文件无法打开时返回 -1
+     */
+    int load(const std::string& path);
+
+    /**
+     * @brief 设置新条目的保存位置
+     * @param path 文件路径前缀，为空时不保存
+     */
+    void set_storage_path(const std::string& path) { storage_path_ = path; }
+
+    /**
+     * @brief 计算两个向量的点积（运行时选择 AVX2 或标量实现）
+     */
+    static float dot(const float* a, const float* b, size_t n);
+
+private:
+    static bool normalize(std::vector<float>& vector);
+    bool append_to_storage(const std::vector<float>& embedding,
+                           const std::string& input, const std::string& command) const;
+
+private:
+    size_t dimension_ = 0;
+    std::vector<float> matrix_;     // size() x dimension_，行已归一化
+    std::vector<std::pair<std::string, std::string>> entries_;
+    std::string storage_path_;
+};
+
+} // namespace NeXShell
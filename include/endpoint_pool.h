@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 一次请求在某个端点上的结果
+ */
+enum class EndpointOutcome {
+    Success,    // 收到响应
+    Failure,    // 出错或超时，端点暂时标记为不健康
+    Cancelled   // 对冲请求中被取消的一方，不影响统计
+};
+
+/**
+ * @brief 端点的状态快照
+ */
+struct EndpointStatus {
+    std::string url;
+    size_t in_flight = 0;       // 进行中的请求数
+    double ewma_ms = 0.0;       // 延迟的指数加权平均
+    bool healthy = true;        // 是否不在退避期内
+    size_t requests = 0;        // 完成的请求数
+    size_t failures = 0;        // 失败的请求数
+};
+
+/**
+ * @brief 多个 Ollama 端点的负载均衡状态
+ *
+ * 按 (进行中请求数 + 1) x EWMA 延迟选择最空闲的健康端点；失败的端点
+ * 按指数退避暂时跳过。最近成功的 generate 请求的延迟分布用于计算对冲等待时间。
+ * 只负责选择和统计，实际请求由 OllamaConnector 发送。
+ */
+class EndpointPool {
+public:
+    /**
+     * @brief 构造端点池
+     * @param urls 端点地址列表（如 http://localhost:11434）
+     */
+    explicit EndpointPool(std::vector<std::string> urls);
+
+    /**
+     * @brief 选择一个端点并把它的进行中请求数加一
+     * @param excluded 本次请求已尝试过的端点下标
+     * @return 端点下标，没有可用端点时返回 std::nullopt
+     */
+    std::optional<size_t> acquire(const std::vector<size_t>& excluded = {});
+
+    /**
+     * @brief 报告请求结果并更新统计
+     * @param index acquire 返回的下标
+     * @param outcome 请求结果
+     * @param latency_ms 请求耗时（毫秒）
+     * @param record_latency 是否计入延迟统计（只有 /api/generate 计入，健康检查和嵌入请求不计入）
+     */
+    void release(size_t index, EndpointOutcome outcome, double latency_ms, bool record_latency = true);
+
+    /**
+     * @brief 获取发起对冲请求前的等待时间
+     * @return 最近延迟的指定百分位（毫秒），样本不足、只有一个端点或
+     *         对冲已关闭时返回 std::nullopt
+     */
+    std::optional<double> hedge_delay_ms() const;
+
+    /**
+     * @brief 设置对冲使用的延迟百分位
+     * @param percentile 0~1 之间的百分位（如 0.95），不大于 0 时关闭对冲
+     */
+    void set_hedge_percentile(double percentile);
+
+    size_t size() const { return endpoints_.size(); }
+    const std::string& url(size_t index) const { return endpoints_[index].url; }
+
+    /**
+     * @brief 获取所有端点的状态
+     * @return 状态列表
+     */
+    std::vector<EndpointStatus> status() const;
+
+    // 对冲所需的最少延迟样本数
+    static const size_t MIN_HEDGE_SAMPLES = 16;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Endpoint {
+        std::string url;
+        size_t in_flight = 0;
+        double ewma_ms = 0.0;           // 0 表示尚无样本
+        size_t consecutive_failures = 0;
+        Clock::time_point retry_at{};   // 退避结束时间
+        size_t requests = 0;
+        size_t failures = 0;
+    };
+
+    static constexpr double EWMA_ALPHA = 0.3;
+    static const size_t LATENCY_WINDOW = 128;
+
+private:
+    std::vector<Endpoint> endpoints_;
+    std::vector<double> recent_latencies_;  // 环形缓冲区
+    size_t next_latency_ = 0;
+    double hedge_percentile_ = 0.95;
+    mutable std::mutex mutex_;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 一个 spawn 请求
+ */
+struct SpawnRequest {
+    std::string path;                   // 可执行文件的绝对路径；为空时 argv[0] 必须含 '/'
+    std::vector<std::string> argv;
+    std::string cwd;                    // 子进程的工作目录
+    int stdin_fd = STDIN_FILENO;        // 通过 SCM_RIGHTS 传给 fork server
+    int stdout_fd = STDOUT_FILENO;
+    int stderr_fd = STDERR_FILENO;
+};
+
+/**
+ * @brief fork server（zygote）：一个很小的预先启动的辅助进程，替 shell 执行 fork+exec
+ *
+ * fork 的开销随父进程的内存映射增长（页表复制），shell 加载历史索引、AI 缓存和
+ * 嵌入向量之后每次 fork 都更慢。辅助进程由 shell 启动时 exec 自己的可执行文件
+ * 得到（nexsh --fork-server FD），几乎不占内存；shell 通过 SOCK_SEQPACKET 套接字
+ * 发送 argv、环境变量、工作目录，标准输入输出用 SCM_RIGHTS 传递。
+ *
+ * 辅助进程用 clone3(CLONE_PARENT) 创建子进程，子进程的父进程仍然是 shell，
+ * 因此 wait4、资源统计和后台作业的处理都不变。辅助进程忽略终端产生的 SIGINT、
+ * SIGTSTP 等信号，子进程在 exec 前恢复默认处理。
+ * 用 $NEXSH_FORK_SERVER=1 启用；辅助进程不可用时调用者退回到自己 fork。
+ */
+class ForkServer {
+public:
+    // 请求的最大长度（argv + 环境变量），超过时由调用者自己 fork
+    static constexpr size_t MAX_REQUEST = 1 << 20;
+
+    ~ForkServer();
+
+    ForkServer(const ForkServer&) = delete;
+    ForkServer& operator=(const ForkServer&) = delete;
+
+    /**
+     * @brief 是否启用（$NEXSH_FORK_SERVER=1）
+     */
+    static bool enabled();
+
+    /**
+     * @brief 启动辅助进程
+     * @param executable 带 --fork-server 参数运行的程序（通常是 /proc/self/exe）；
+     *                   为空时直接在 fork 出的子进程中服务，不 exec（用于测试）
+     * @return 启动失败时为空
+     */
+    static std::unique_ptr<ForkServer> start(const std::string& executable);
+
+    /**
+     * @brief 辅助进程的主循环，直到 shell 关闭套接字
+     * @param socket_fd 与 shell 相连的套接字
+     * @return 进程退出码
+     */
+    static int serve(int socket_fd);
+
+    /**
+     * @brief 通过辅助进程创建子进程（线程安全）
+     *
+     * 环境变量取自调用时的 environ。exec 失败时子进程向 stderr_fd 报错并以 127 退出，
+     * 与 shell 自己 fork 时相同。
+     * @return 子进程 ID（shell 的子进程）；辅助进程不可用或请求过大时为 -1
+     */
+    pid_t spawn(const SpawnRequest& request);
+
+    /**
+     * @return 辅助进程 ID，已退出并被回收后为 -1
+     */
+    pid_t helper_pid() const { return helper_pid_; }
+
+private:
+    ForkServer(pid_t helper_pid, int socket_fd) : helper_pid_(helper_pid), socket_fd_(socket_fd) {}
+
+    /**
+     * @brief 辅助进程已退出：回收它并报告退回到 fork（需持有 mutex_）
+     */
+    void mark_broken();
+
+    pid_t helper_pid_;
+    int socket_fd_;
+    bool broken_ = false;
+    std::mutex mutex_;
+    std::vector<char> buffer_;
+};
+
+} // namespace NeXShell
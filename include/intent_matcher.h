@@ -0,0 +1,133 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace NeXShell {
+
+/**
+ * @brief 本地意图匹配结果
+ */
+struct IntentMatch {
+    std::string command;        // 填充槽位后的命令
+    double confidence = 0.0;    // 置信度（0~1）
+};
+
+/**
+ * @brief 基于模板的本地意图匹配器
+ *
+ * 模板形如 "find {ext} files" -> "find . -name '*.{ext}'"。输入和模板都会
+ * 经过同样的规范化（小写、同义词、去掉停用词和复数），按关键词加权
+ * Jaccard 相似度打分，剩余的词按类型填入槽位。常见请求无需调用模型。
+ */
+class IntentMatcher {
+public:
+    /**
+     * @brief 构造匹配器并编译内置模板
+     */
+    IntentMatcher();
+
+    /**
+     * @brief 添加模板
+     * @param pattern 模板文本，槽位写作 {n}、{ext}、{file}、{dir}、{name} 等
+     * @param command 命令模板，使用同名槽位
+     * @return 模板有效并已添加时返回 true
+     */
+    bool add_template(const std::string& pattern, const std::string& command);
+
+    /**
+     * @brief 匹配自然语言输入
+     * @param input 用户输入
+     * @return 最佳匹配，没有候选或输入含有否定词时置信度为 0
+     */
+    IntentMatch match(const std::string& input) const;
+
+    /**
+     * @brief 从用户接受的建议中学习新模板
+     *
+     * 输入中原样出现在命令里的词会被泛化为槽位。
+     * @param input 自然语言输入
+     * @param command 用户接受的命令
+     * @return 学到新模板时返回 true
+     */
+    bool learn(const std::string& input, const std::string& command);
+
+    /**
+     * @brief 从文件加载模板（每行 "pattern<TAB>command"）
+     * @param path 文件路径
+     * @return 加载的模板数，文件无法打开时返回 -1
+     */
+    int load_templates(const std::string& path);
+
+    /**
+     * @brief 设置学到的模板的保存位置
+     * @param path 文件路径，为空时不保存
+     */
+    void set_storage_path(const std::string& path) { storage_path_ = path; }
+
+    /**
+     * @brief 获取模板数量
+     * @return 模板数量
+     */
+    size_t template_count() const { return templates_.size(); }
+
+    // 低于该置信度时交给模型处理
+    static constexpr double CONFIDENCE_THRESHOLD = 0.8;
+
+private:
+    enum class SlotType {
+        Word,       // 任意词
+        Number,     // 数字
+        Extension,  // 文件扩展名（txt、.cpp、*.log）
+        Path        // 文件或目录
+    };
+
+    struct Token {
+        std::string text;   // 原文（用于填充槽位）
+        std::string canon;  // 规范化后的关键词
+        bool quoted;        // 是否来自引号
+    };
+
+    struct Slot {
+        std::string name;
+        SlotType type;
+    };
+
+    struct Template {
+        std::vector<std::string> keywords;  // 排序去重后的规范化关键词
+        double keyword_weight;              // 关键词总权重
+        std::vector<Slot> slots;            // 按出现顺序排列的槽位
+        std::string command;
+    };
+
+    /**
+     * @brief 把文本切分为规范化后的 token（已去掉停用词和“在当前目录”等短语）
+     */
+    static std::vector<Token> tokenize(const std::string& text);
+
+    /**
+     * @brief 输入是否含有否定词（not、except、without、non-... 等）
+     */
+    static bool has_negation(const std::vector<Token>& tokens);
+
+    static std::string canonicalize(const std::string& lower_word);
+    static double weight_of(const std::string& keyword);
+    static SlotType slot_type_of(const std::string& name);
+    static bool fits_slot(const Token& token, SlotType type);
+    static std::string slot_value(const Token& token, SlotType type);
+
+    /**
+     * @brief 计算模板与输入的匹配度并填充命令
+     */
+    double score(const Template& tmpl, const std::vector<Token>& tokens, std::string& command) const;
+
+private:
+    std::vector<Template> templates_;
+    std::unordered_map<std::string, std::vector<size_t>> keyword_index_;   // 关键词 -> 模板
+    std::unordered_set<std::string> pattern_keys_;                         // 用于去重
+    std::string storage_path_;
+};
+
+} // namespace NeXShell
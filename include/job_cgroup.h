@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 一个作业（管道）的资源限制
+ *
+ * 全局默认值来自 $NEXSH_JOB_CPU_WEIGHT、$NEXSH_JOB_MEMORY_MAX 和 $NEXSH_JOB_PIDS_MAX，
+ * 单个管道可以用 limit 前缀覆盖。
+ */
+struct JobLimits {
+    std::optional<uint64_t> cpu_weight;     // cpu.weight，1-10000，默认 100
+    std::optional<uint64_t> memory_max;     // memory.max（字节）
+    std::optional<uint64_t> pids_max;       // pids.max
+
+    bool empty() const { return !cpu_weight && !memory_max && !pids_max; }
+
+    /**
+     * @brief 解析带 K/M/G 后缀的字节数
+     */
+    static std::optional<uint64_t> parse_size(const std::string& text);
+
+    /**
+     * @brief 设置 limit 的一个选项
+     * @param option -c（cpu.weight）、-m（memory.max）或 -p（pids.max）
+     * @param value 选项的值
+     * @return 选项或值无效时返回 false
+     */
+    bool set_option(const std::string& option, const std::string& value);
+
+    /**
+     * @brief 从环境变量读取默认限制（无效的值被忽略）
+     */
+    static JobLimits from_environment();
+
+    /**
+     * @brief 形如 "cpu.weight=50 memory.max=512 MiB" 的描述，没有限制时为 "none"
+     */
+    std::string describe() const;
+
+    /**
+     * @brief 用 setrlimit/setpriority 近似这些限制（cgroup 不可用时在子进程中调用）
+     *
+     * memory.max 对应 RLIMIT_AS（按进程计），pids.max 对应 RLIMIT_NPROC（按用户计），
+     * cpu.weight 换算为 nice 值（100 为 0，每级约 1.25 倍）。只调用异步信号安全的函数。
+     */
+    void apply_rlimits() const;
+};
+
+/**
+ * @brief 从 cgroup 读取的作业用量
+ */
+struct CgroupStats {
+    uint64_t usage_usec = 0;                // cpu.stat
+    uint64_t user_usec = 0;
+    uint64_t system_usec = 0;
+    std::optional<uint64_t> memory_current; // memory 控制器可用时
+    std::optional<uint64_t> memory_peak;
+    std::optional<uint64_t> pids_current;   // pids 控制器可用时
+    uint64_t rss_bytes = 0;                 // 没有 memory 控制器时各进程 VmRSS 之和
+    size_t processes = 0;
+
+    /**
+     * @brief 形如 "cpu 1.20s (user 1.10s sys 0.10s) mem 12 MiB peak 30 MiB pids 3" 的摘要
+     */
+    std::string format() const;
+};
+
+/**
+ * @brief 一个作业的 cgroup v2 叶子节点
+ *
+ * 叶子位于 <shell 所在 cgroup>/nexsh.<pid>/job-<n>（或 $NEXSH_CGROUP_ROOT 下），
+ * 子进程用 clone3(CLONE_INTO_CGROUP) 直接创建在其中；内核不支持时 fork 后由子进程
+ * 把自己写入 cgroup.procs。cgroup 无法施加的限制（控制器未委派给我们）在子进程中
+ * 退回到 setrlimit。
+ */
+class JobCgroup {
+public:
+    ~JobCgroup();
+
+    JobCgroup(const JobCgroup&) = delete;
+    JobCgroup& operator=(const JobCgroup&) = delete;
+
+    /**
+     * @brief 是否把每个作业放入 cgroup（$NEXSH_JOB_CGROUPS=1 或设置了任何限制）
+     */
+    static bool enabled(const JobLimits& limits);
+
+    /**
+     * @brief 所有作业 cgroup 的父目录，第一次调用时创建并启用可用的控制器
+     * @return cgroup v2 不可用或没有写权限时为空
+     */
+    static const std::string& base_path();
+
+    /**
+     * @brief 父目录中可以用于作业的控制器（cpu、memory、pids 的子集）
+     */
+    static const std::vector<std::string>& controllers();
+
+    /**
+     * @brief 为一个作业创建叶子节点并写入限制
+     * @return cgroup v2 不可用时为空，调用者只用 setrlimit
+     */
+    static std::unique_ptr<JobCgroup> create(const JobLimits& limits);
+
+    /**
+     * @brief 创建子进程，语义与 fork() 相同
+     *
+     * 在子进程中返回之前已经进入 cgroup 并施加了 cgroup 无法施加的限制。
+     * @param cgroup 作业的 cgroup，为空时只 fork 并施加 setrlimit
+     * @param limits 作业的限制
+     */
+    static pid_t spawn(const JobCgroup* cgroup, const JobLimits& limits);
+
+    const std::string& path() const { return path_; }
+    const JobLimits& limits() const { return limits_; }
+
+    /**
+     * @brief cgroup 未能施加、需要 setrlimit 近似的限制
+     */
+    const JobLimits& unenforced() const { return unenforced_; }
+
+    /**
+     * @brief 读取 cpu.stat、memory.current/peak、pids.current
+     */
+    CgroupStats stats() const;
+
+private:
+    JobCgroup() = default;
+
+    std::string path_;
+    std::string procs_path_;        // 预先拼好，fork 后的子进程不再分配内存
+    int fd_ = -1;
+    JobLimits limits_;
+    JobLimits unenforced_;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 轻量级 JSON 值，用于解析 Ollama 等服务的响应
+ */
+class JsonValue {
+public:
+    enum class Type {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    JsonValue() = default;
+
+    /**
+     * @brief 解析 JSON 文本
+     * @param text JSON 文本
+     * @return 解析结果，语法错误时返回 std::nullopt
+     */
+    static std::optional<JsonValue> parse(std::string_view text);
+
+    /**
+     * @brief 把字符串编码为带引号的 JSON 字符串字面量
+     * @param text 原始字符串
+     * @return JSON 字符串
+     */
+    static std::string quote(std::string_view text);
+
+    Type type() const { return type_; }
+    bool is_null() const { return type_ == Type::Null; }
+    bool is_bool() const { return type_ == Type::Bool; }
+    bool is_number() const { return type_ == Type::Number; }
+    bool is_string() const { return type_ == Type::String; }
+    bool is_array() const { return type_ == Type::Array; }
+    bool is_object() const { return type_ == Type::Object; }
+
+    /**
+     * @brief 获取布尔值，类型不符时返回默认值
+     */
+    bool as_bool(bool default_value = false) const;
+
+    /**
+     * @brief 获取数值，类型不符时返回默认值
+     */
+    double as_number(double default_value = 0.0) const;
+
+    /**
+     * @brief 获取字符串，类型不符时返回默认值
+     */
+    std::string as_string(const std::string& default_value = "") const;
+
+    /**
+     * @brief 获取数组元素（非数组时为空）
+     */
+    const std::vector<JsonValue>& items() const { return items_; }
+
+    /**
+     * @brief 获取对象的键（非对象时为空），与 items() 一一对应
+     */
+    const std::vector<std::string>& keys() const { return keys_; }
+
+    /**
+     * @brief 查找对象成员
+     * @param key 成员名
+     * @return 成员指针，不存在时返回 nullptr
+     */
+    const JsonValue* find(std::string_view key) const;
+
+    /**
+     * @brief 获取对象成员，不存在时返回 null 值
+     * @param key 成员名
+     * @return 成员引用
+     */
+    const JsonValue& operator[](std::string_view key) const;
+
+private:
+    friend class JsonParser;
+
+    Type type_ = Type::Null;
+    bool bool_ = false;
+    double number_ = 0.0;
+    std::string string_;
+    std::vector<std::string> keys_;     // 对象成员名
+    std::vector<JsonValue> items_;      // 数组元素或对象成员值
+};
+
+} // namespace NeXShell
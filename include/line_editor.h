@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+namespace NeXShell {
+
+/**
+ * @brief 最小的原始模式行编辑器
+ *
+ * 支持输入、退格、Ctrl-U/Ctrl-W、Ctrl-C 和 Ctrl-D，忽略方向键等转义序列。
+ * 用户停止输入一段时间后会以当前缓冲区调用空闲回调（每次修改后最多一次），
+ * 用于在用户还在思考时发起投机请求。
+ */
+class LineEditor {
+public:
+    using IdleCallback = std::function<void(const std::string& buffer)>;
+
+    /**
+     * @brief 构造行编辑器
+     * @param fd 终端输入描述符
+     */
+    explicit LineEditor(int fd);
+
+    /**
+     * @brief 检查描述符是否为可切换到原始模式的终端
+     * @param fd 文件描述符
+     * @return 是终端时返回 true
+     */
+    static bool is_supported(int fd);
+
+    /**
+     * @brief 设置空闲回调
+     * @param callback 回调，参数为当前缓冲区
+     * @param idle_ms 触发回调前的静默时间（毫秒）
+     */
+    void set_idle_callback(IdleCallback callback, int idle_ms);
+
+    /**
+     * @brief 显示提示符并读取一行
+     * @param prompt 提示符
+     * @param line 读到的行（Ctrl-C 时为空）
+     * @return 遇到 EOF（空行上的 Ctrl-D）时返回 false
+     */
+    bool read_line(const std::string& prompt, std::string& line);
+
+private:
+    /**
+     * @brief 删除缓冲区末尾的一个 UTF-8 字符并擦除屏幕上的显示
+     */
+    static void erase_last_char(std::string& buffer);
+
+    /**
+     * @brief 跳过方向键等转义序列的剩余字节
+     */
+    void skip_escape_sequence();
+
+private:
+    int fd_;
+    IdleCallback idle_callback_;
+    int idle_ms_ = 0;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace NeXShell {
+
+/**
+ * @brief 单调递增的计数器
+ */
+class Counter {
+public:
+    Counter(const char* name, const char* help) : name_(name), help_(help) {}
+
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+    const char* name() const { return name_; }
+    const char* help() const { return help_; }
+
+private:
+    const char* name_;
+    const char* help_;
+    std::atomic<uint64_t> value_{0};
+};
+
+/**
+ * @brief 可增可减的瞬时值
+ */
+class Gauge {
+public:
+    Gauge(const char* name, const char* help) : name_(name), help_(help) {}
+
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+    const char* name() const { return name_; }
+    const char* help() const { return help_; }
+
+private:
+    const char* name_;
+    const char* help_;
+    std::atomic<int64_t> value_{0};
+};
+
+/**
+ * @brief HDR 风格的延迟直方图（纳秒）
+ *
+ * 每个 2 的幂区间再分为 8 个子桶，相对误差不超过 12.5%，覆盖 1ns 到约 39 小时。
+ * 记录只是几次 relaxed 原子加法，不加锁。
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = 46 * SUB_BUCKETS;
+
+    LatencyHistogram(const char* name, const char* help) : name_(name), help_(help) {}
+
+    /**
+     * @brief 记录一次耗时
+     * @param ns 纳秒
+     */
+    void record_ns(uint64_t ns);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+    uint64_t max_ns() const { return max_ns_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 估算分位数
+     * @param q 分位（0 到 1）
+     * @return 所在桶的中点（纳秒），没有样本时为 0
+     */
+    uint64_t percentile_ns(double q) const;
+
+    const char* name() const { return name_; }
+    const char* help() const { return help_; }
+
+    static size_t bucket_index(uint64_t ns);
+    static uint64_t bucket_lower(size_t index);
+    static uint64_t bucket_upper(size_t index);
+
+private:
+    const char* name_;
+    const char* help_;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+/**
+ * @brief 全 shell 共享的指标
+ *
+ * 指标是固定的成员，热路径上直接访问成员，不需要查找或注册。
+ */
+class Metrics {
+public:
+    static Metrics& instance();
+
+    Counter commands{"nexsh_commands_total", "Command lines executed"};
+    Counter forks{"nexsh_forks_total", "External processes forked"};
+    Counter builtins{"nexsh_builtins_total", "Builtin commands run in-process"};
+    Counter path_cache_hits{"nexsh_path_cache_hits_total", "Program lookups answered by the PATH cache"};
+    Counter path_cache_misses{"nexsh_path_cache_misses_total", "Program lookups that searched PATH"};
+    Counter zero_copy_bytes{"nexsh_zero_copy_bytes_total", "Bytes moved by in-process pipeline stages without a userspace copy"};
+    Counter ai_requests{"nexsh_ai_requests_total", "HTTP requests sent to Ollama"};
+    Counter ai_failures{"nexsh_ai_request_failures_total", "Ollama requests that failed on every endpoint"};
+    Counter ai_hedges{"nexsh_ai_hedged_requests_total", "Slow Ollama requests repeated on a second endpoint"};
+    Counter ai_cache_hits{"nexsh_ai_explanation_cache_hits_total", "Explanations served from the cache"};
+    Counter ai_local_answers{"nexsh_ai_local_answers_total", "Natural-language requests answered without the model"};
+    Counter command_cache_hits{"nexsh_command_cache_hits_total", "cache commands replayed from the store"};
+    Counter command_cache_misses{"nexsh_command_cache_misses_total", "cache commands that ran and were stored"};
+    Gauge history_size{"nexsh_history_size", "Entries in the command history"};
+    LatencyHistogram parse_latency{"nexsh_parse_seconds", "Time to parse a command line"};
+    LatencyHistogram fork_latency{"nexsh_fork_seconds", "Time spent in fork() before the child can exec"};
+    LatencyHistogram command_latency{"nexsh_command_seconds", "Wall time of a command line including waiting"};
+    LatencyHistogram ai_latency{"nexsh_ai_request_seconds", "Latency of Ollama HTTP requests"};
+
+    /**
+     * @brief Prometheus 文本格式（直方图导出为带分位数的 summary）
+     */
+    std::string to_prometheus() const;
+
+    /**
+     * @brief 适合终端阅读的表格
+     */
+    std::string to_table() const;
+
+    /**
+     * @brief 原子地写入 node_exporter textfile（先写临时文件再 rename）
+     * @param path 目标文件，通常以 .prom 结尾
+     * @return 写入成功时返回 true
+     */
+    bool write_textfile(const std::string& path) const;
+
+private:
+    Metrics() = default;
+};
+
+} // namespace NeXShell
@@ -1,17 +1,40 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
+#include "endpoint_pool.h"
 
 namespace NeXShell {
 
+/**
+ * @brief 一次 /api/generate 调用的结果
+ */
+struct OllamaGeneration {
+    bool success = false;           // 请求是否成功
+    std::string response;           // 生成的文本
+    std::string error;              // 失败原因
+    std::vector<int> context;       // 可在下一轮复用的上下文 token
+    int prompt_tokens = 0;          // 本次实际评估的提示 token 数（prompt_eval_count）
+    int completion_tokens = 0;      // 生成的 token 数（eval_count）
+    double total_ms = 0.0;          // 服务端总耗时
+};
+
 /**
  * @brief Ollama API 连接器
+ *
+ * 可以配置多个端点：每个请求发往最空闲的健康端点，出错或超时后自动
+ * 换到下一个端点，慢请求超过最近延迟的百分位后向另一个端点发起对冲请求，
+ * 先返回的结果胜出。
  */
 class OllamaConnector {
 public:
+    /**
+     * @brief 构造连接器
+     * @param api_endpoint 端点地址，多个端点用逗号分隔
+     */
     OllamaConnector(const std::string& api_endpoint = "http://localhost:11434");
     ~OllamaConnector() = default;
 
@@ -19,9 +42,35 @@ public:
      * @brief 查询 Ollama 模型
      * @param prompt 输入提示
      * @param model 模型名称
+     * @param cancel 置位时终止进行中的请求，为空时不可取消
      * @return 模型响应
      */
-    std::string query_model(const std::string& prompt, const std::string& model = "qwen3:4b");
+    std::string query_model(const std::string& prompt, const std::string& model = "qwen3:4b",
+                            const std::atomic<bool>* cancel = nullptr);
+
+    /**
+     * @brief 调用 /api/generate 并返回完整结果
+     * @param prompt 本轮输入提示
+     * @param model 模型名称
+     * @param system 系统提示（复用上下文时通常为空）
+     * @param context 上一轮返回的上下文 token，为空时开始新对话
+     * @param format 输出格式："json"、以 '{' 开头的 JSON Schema，或为空（不限制）
+     * @param cancel 置位时终止进行中的请求，为空时不可取消
+     * @return 生成结果，包含新的上下文和 token 统计
+     */
+    OllamaGeneration generate(const std::string& prompt, const std::string& model,
+                              const std::string& system = "",
+                              const std::vector<int>& context = {},
+                              const std::string& format = "",
+                              const std::atomic<bool>* cancel = nullptr);
+
+    /**
+     * @brief 调用 /api/embeddings 计算文本的嵌入向量
+     * @param text 输入文本
+     * @param model 嵌入模型名称
+     * @return 嵌入向量，失败时为空
+     */
+    std::vector<float> embed(const std::string& text, const std::string& model);
 
     /**
      * @brief 检查 Ollama 服务是否可用
@@ -41,32 +90,57 @@ public:
      */
     void set_timeout(int timeout_seconds);
 
+    /**
+     * @brief 设置模型在服务端保持加载的时间（如 "30m"）
+     * @param keep_alive Ollama keep_alive 取值，为空时使用服务端默认值
+     */
+    void set_keep_alive(const std::string& keep_alive);
+
+    /**
+     * @brief 设置对冲请求的延迟百分位
+     * @param percentile 0~1 之间的百分位（默认 0.95），不大于 0 时关闭对冲
+     */
+    void set_hedge_percentile(double percentile);
+
+    /**
+     * @brief 获取各端点的负载和健康状态
+     * @return 状态列表
+     */
+    std::vector<EndpointStatus> get_endpoint_status() const;
+
 private:
     /**
-     * @brief 发送 HTTP POST 请求
-     * @param endpoint API 端点
-     * @param json_data JSON 数据
-     * @return 响应内容
+     * @brief 发送 HTTP 请求
+     * @param endpoint API 路径（如 /api/generate）
+     * @param json_data JSON 数据，为空时发送 GET 请求
+     * @param cancel 置位时终止请求
+     * @return 响应内容，所有端点都失败或请求被取消时为空
      */
-    std::string send_http_request(const std::string& endpoint, const std::string& json_data);
+    std::string send_http_request(const std::string& endpoint, const std::string& json_data,
+                                  const std::atomic<bool>* cancel = nullptr);
 
     /**
-     * @brief 解析 JSON 响应
-     * @param response JSON 响应字符串
-     * @return 解析后的文本内容
+     * @brief 在端点池中选择端点发送请求，处理故障转移和对冲
+     * @param path API 路径
+     * @param body_file 请求体文件，为空时发送 GET 请求
+     * @param cancel 置位时终止所有进行中的尝试并返回空
+     * @return 响应内容；非 2xx 状态和 {"error": ...} 响应视为失败，所有端点都失败时
+     *         返回最后一个错误响应（没有时为空）
      */
-    std::string parse_ollama_response(const std::string& response);
+    std::string route_request(const std::string& path, const std::string& body_file,
+                              const std::atomic<bool>* cancel = nullptr);
 
     /**
-     * @brief 执行系统命令
-     * @param command 要执行的命令
-     * @return 命令输出
+     * @brief 解析 /api/generate 的 JSON 响应
+     * @param response JSON 响应字符串
+     * @return 解析后的生成结果
      */
-    std::string execute_command(const std::string& command);
+    OllamaGeneration parse_ollama_response(const std::string& response);
 
 private:
-    std::string api_endpoint_;
+    EndpointPool endpoints_;
     int timeout_seconds_;
+    std::string keep_alive_;
 };
 
 } // namespace NeXShell
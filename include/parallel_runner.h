@@ -0,0 +1,119 @@
+#pragma once
+
+#include <sys/types.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief parallel 内建命令的选项
+ *
+ * parallel [-j N] [-k] [--tag] [--joblog FILE] COMMAND [::: ARG...]
+ * 没有 ::: 时从标准输入（或管道上游）逐行读取参数。
+ */
+struct ParallelOptions {
+    size_t jobs = 0;                    // 同时运行的作业数，0 表示 CPU 核数
+    bool keep_order = false;            // -k：按参数顺序输出，而不是按完成顺序
+    bool tag = false;                   // --tag：每行输出前加上参数和制表符
+    std::string joblog;                 // --joblog：作业日志文件
+    std::string command_template;       // 命令模板，支持 {} {.} {/} {#}
+    std::vector<std::string> arguments; // ::: 之后的参数（已展开通配符）
+    bool arguments_from_input = true;   // 没有 ::: 时从输入读取参数
+
+    /**
+     * @brief 解析 parallel 的参数
+     * @param args 内建命令的参数（不含 parallel 本身）
+     * @param error 失败时的错误信息
+     * @return 解析失败时为空
+     */
+    static std::optional<ParallelOptions> parse(const std::vector<std::string>& args, std::string& error);
+};
+
+/**
+ * @brief 一个作业的结果，对应 --joblog 的一行
+ */
+struct ParallelJobResult {
+    size_t seq = 0;
+    std::string argument;
+    std::string command;
+    double start_time = 0.0;            // Unix 时间（秒）
+    double runtime = 0.0;               // 秒
+    size_t received = 0;                // 标准输出字节数
+    int exit_code = 0;
+    int signal = 0;
+};
+
+/**
+ * @brief 并行运行一组作业，始终保持 N 个在运行
+ *
+ * 每个子进程通过 pidfd_open(2) 得到一个 pidfd，与各作业的输出管道一起注册到
+ * epoll；任一子进程退出时立即回收并补上下一个参数，不需要轮询或等待整批完成。
+ * 内核不支持 pidfd 时退回到每 10 ms 用 WNOHANG 检查一次。
+ * 作业的标准输出和标准错误分别缓存，作业结束后整块输出，不同作业不会交错。
+ */
+class ParallelRunner {
+public:
+    /**
+     * @brief 启动一个作业
+     * @param command 展开后的命令行
+     * @param output_fd 作业标准输出的写端
+     * @param error_fd 作业标准错误的写端
+     * @return 子进程 ID，失败时为 -1
+     */
+    using Launcher = std::function<pid_t(const std::string& command, int output_fd, int error_fd)>;
+
+    ParallelRunner(ParallelOptions options, Launcher launcher);
+    ~ParallelRunner();
+
+    /**
+     * @brief 运行所有作业并输出结果
+     * @param input_fd 读取参数的描述符（arguments_from_input 时使用，不会被关闭）
+     * @param output_fd 作业标准输出的去向（不会被关闭）；已关闭时不再启动新作业
+     * @return 失败的作业数（最大 101），与 GNU parallel 相同；输出被关闭时为 128 + SIGPIPE
+     */
+    int run(int input_fd, int output_fd);
+
+    /**
+     * @brief 已启动作业的结果，按参数顺序
+     */
+    const std::vector<ParallelJobResult>& results() const { return results_; }
+
+    /**
+     * @brief 用参数替换模板中的占位符
+     *
+     * {} 为参数，{.} 去掉扩展名，{/} 取文件名，{#} 为作业序号；
+     * 模板中没有占位符时把参数追加到末尾。
+     * @return 展开后的命令行；参数无法加引号表示（空参数或含 $VAR）时为 std::nullopt
+     */
+    static std::optional<std::string> expand(const std::string& command_template, const std::string& argument,
+                                             size_t seq);
+
+private:
+    struct Job;
+
+    void add_argument(std::string argument);
+    bool launch(Job& job, size_t index);
+    void reap(Job& job, int options);
+    void drain(Job& job, int& fd, std::string& buffer);
+    void finish(Job& job);
+    void flush(Job& job);
+
+    ParallelOptions options_;
+    Launcher launcher_;
+    std::vector<Job> jobs_;
+    std::vector<ParallelJobResult> results_;
+    size_t next_to_flush_ = 0;
+    int epoll_fd_ = -1;
+    int output_fd_ = -1;
+    bool output_closed_ = false;
+    bool pidfd_supported_ = true;
+    FILE* joblog_ = nullptr;
+};
+
+} // namespace NeXShell
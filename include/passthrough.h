@@ -0,0 +1,70 @@
+#pragma once
+
+#include "command_parser.h"
+#include <signal.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 在 shell 线程写管道期间屏蔽 SIGPIPE，让写入已关闭的管道返回 EPIPE 而不是终止 shell
+ */
+class SigpipeGuard {
+public:
+    SigpipeGuard();
+    ~SigpipeGuard();
+
+    SigpipeGuard(const SigpipeGuard&) = delete;
+    SigpipeGuard& operator=(const SigpipeGuard&) = delete;
+
+private:
+    sigset_t sigpipe_;
+    sigset_t saved_;
+};
+
+/**
+ * @brief 管道中的直通阶段（cat、tee），由 shell 在进程内搬运数据而不 fork
+ *
+ * 数据在内核中移动：管道之间和管道到文件用 splice(2)，tee 的分流用 tee(2)，
+ * 文件到文件用 copy_file_range(2)；不支持时（终端、O_APPEND 文件等）退回到
+ * read/write。
+ */
+struct PassthroughStage {
+    enum class Kind { Cat, Tee };
+
+    Kind kind = Kind::Cat;
+    std::vector<std::string> files;     // cat 的输入文件（"-" 为标准输入）或 tee 的输出文件
+    bool append = false;                // tee -a
+
+    /**
+     * @brief 判断命令能否作为直通阶段运行
+     *
+     * 只接受不带选项的 cat [FILE...] 和 tee [-a] [FILE...]，其余交给真正的程序。
+     * @param command 管道中的一个命令
+     * @return 可以直通时返回阶段描述
+     */
+    static std::optional<PassthroughStage> detect(const Command& command);
+
+    /**
+     * @brief 运行阶段，直到输入结束
+     * @param input_fd 输入（不会被关闭）
+     * @param output_fd 输出（不会被关闭）
+     * @return 与对应程序一致的退出码；下游已关闭时为 128 + SIGPIPE
+     */
+    int run(int input_fd, int output_fd) const;
+
+    /**
+     * @brief 把 input_fd 的剩余内容全部搬到 output_fd
+     * @return 搬运的字节数，出错时为 -1（errno 保留）
+     */
+    static long long transfer(int input_fd, int output_fd);
+
+    /**
+     * @brief 是否启用直通阶段（$NEXSH_ZERO_COPY=0 时关闭，便于对比 fork 路径）
+     */
+    static bool enabled();
+};
+
+} // namespace NeXShell
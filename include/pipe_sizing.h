@@ -0,0 +1,143 @@
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 管道缓冲区容量的设置
+ *
+ * 文本形式：default（内核默认，通常 64 KiB）、auto（自适应）或带 K/M 后缀的字节数。
+ * 全局设置来自 $NEXSH_PIPE_SIZE，单个管道可以用 pipesize 前缀覆盖。
+ */
+struct PipeSizeSetting {
+    enum class Mode { Default, Fixed, Adaptive };
+
+    Mode mode = Mode::Default;
+    size_t bytes = 0;               // Fixed 模式下请求的容量
+
+    /**
+     * @brief 解析文本形式的设置
+     * @param text default、auto 或大小（例如 256K、1M、1048576）
+     * @return 无法解析时为空
+     */
+    static std::optional<PipeSizeSetting> parse(const std::string& text);
+
+    /**
+     * @brief 从 $NEXSH_PIPE_SIZE 读取（未设置或无效时为 default）
+     */
+    static PipeSizeSetting from_environment();
+
+    std::string describe() const;
+};
+
+/**
+ * @brief F_SETPIPE_SZ 相关的辅助函数
+ */
+class PipeSizer {
+public:
+    /**
+     * @brief 非特权进程可设置的最大容量（/proc/sys/fs/pipe-max-size）
+     */
+    static size_t max_size();
+
+    /**
+     * @brief 新建管道的默认容量
+     */
+    static size_t default_size();
+
+    /**
+     * @brief 把管道容量设为至少 bytes（不超过 max_size）
+     * @param fd 管道的任一端
+     * @param bytes 请求的容量
+     * @return 设置后的实际容量，失败时为当前容量
+     */
+    static size_t resize(int fd, size_t bytes);
+
+    /**
+     * @brief 以 KiB/MiB 格式化字节数
+     */
+    static std::string format_size(double bytes);
+};
+
+/**
+ * @brief 一个管道的观测结果
+ */
+struct PipeReport {
+    std::string writer;
+    std::string reader;
+    size_t initial_bytes = 0;
+    size_t final_bytes = 0;
+    size_t samples = 0;
+    size_t full_samples = 0;        // 采样时缓冲区已满（超过 FULL_PERCENT）的次数
+};
+
+/**
+ * @brief 一个阶段写出的数据量（/proc/<pid>/io 的 wchar）
+ */
+struct StageThroughput {
+    std::string program;
+    unsigned long long bytes_written = 0;
+    double seconds = 0.0;
+};
+
+/**
+ * @brief 在管道运行期间周期性采样各管道的积压量
+ *
+ * 通过 /proc/<读端进程>/fd/0 短暂打开同一个管道，用 FIONREAD 读取积压字节数；
+ * 自适应模式下，积压超过容量的 FULL_PERCENT 时把容量翻倍，直到 pipe-max-size。
+ * 打开的描述符立即关闭，不影响 EOF 和 SIGPIPE。
+ */
+class PipeMonitor {
+public:
+    static constexpr int SAMPLE_INTERVAL_MS = 5;
+    static constexpr size_t FULL_PERCENT = 75;
+
+    explicit PipeMonitor(bool adaptive) : adaptive_(adaptive) {}
+    ~PipeMonitor();
+
+    /**
+     * @brief 登记一个管道（在 start 之前调用）
+     * @param report 写端和读端的程序名、初始容量
+     * @param reader 读端进程，不是子进程（如直通阶段）时为 -1，只报告不采样
+     * @param inode 管道的 inode，用来确认读端的标准输入仍是这个管道
+     */
+    void watch(const PipeReport& report, pid_t reader, ino_t inode);
+
+    void start();
+
+    /**
+     * @brief 停止采样并返回每个管道的结果（按登记顺序）
+     */
+    std::vector<PipeReport> stop();
+
+    /**
+     * @brief 把管道和阶段的观测结果格式化为表格
+     */
+    static std::string format(const PipeSizeSetting& setting, const std::vector<PipeReport>& pipes,
+                              const std::vector<StageThroughput>& stages);
+
+private:
+    struct Entry {
+        PipeReport report;
+        pid_t reader;
+        ino_t inode;
+        bool active;
+    };
+
+    void run();
+    void sample(Entry& entry);
+
+    bool adaptive_;
+    std::vector<Entry> entries_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 提示中的一段上下文（目录列表、历史记录、示例等）
+ */
+struct PromptSection {
+    std::string header;                 // 标题行（如 "Recent commands:"），为空时不输出
+    std::vector<std::string> items;     // 可以单独丢弃的条目，每条一行
+    int priority = 0;                   // 越大越先分配预算
+    bool required = false;              // 必须完整保留（规则、用户输入）
+    bool keep_newest = false;           // 截断时保留末尾的条目（历史记录），否则保留开头的
+    std::string compact_key;            // 非空时，放不下可以用压缩摘要替代，摘要按该键缓存
+    std::function<std::string(const std::vector<std::string>&)> compactor;
+};
+
+/**
+ * @brief 压缩摘要缓存（线程安全，LRU 淘汰）
+ */
+class CompactionCache {
+public:
+    explicit CompactionCache(size_t capacity = 64) : capacity_(capacity) {}
+
+    /**
+     * @brief 获取摘要，不存在时计算并缓存
+     * @param key 缓存键（应包含内容的指纹）
+     * @param compute 计算摘要的函数
+     * @return 摘要
+     */
+    std::string get_or_compute(const std::string& key, const std::function<std::string()>& compute);
+
+    size_t hits() const;
+    size_t size() const;
+
+private:
+    size_t capacity_;
+    std::list<std::pair<std::string, std::string>> entries_;   // 最近使用的在前
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index_;
+    size_t hits_ = 0;
+    mutable std::mutex mutex_;
+};
+
+/**
+ * @brief 提示 token 预算管理
+ *
+ * 用近似分词器估算每段的 token 数。必需的段落总是保留，其余段落按优先级
+ * 依次分配剩余预算：放得下就完整保留，放不下时先尝试压缩摘要，再按条目截断。
+ */
+class PromptBudget {
+public:
+    /**
+     * @brief 构造预算
+     * @param max_tokens token 上限
+     * @param cache 压缩摘要缓存，可为空
+     */
+    explicit PromptBudget(size_t max_tokens, CompactionCache* cache = nullptr);
+
+    /**
+     * @brief 快速估算文本的 token 数
+     *
+     * 连续的字母数字（及非 ASCII 字节）按每 4 字节一个 token 计，
+     * 其他非空白字符各计一个 token。
+     * @param text 文本
+     * @return 估算的 token 数
+     */
+    static size_t estimate_tokens(std::string_view text);
+
+    /**
+     * @brief 添加段落
+     * @param section 段落
+     * @return 段落下标（与 fit() 返回值对应）
+     */
+    size_t add(PromptSection section);
+
+    /**
+     * @brief 分配预算并渲染各段
+     * @return 与添加顺序对应的渲染文本，被丢弃的段落为空字符串
+     */
+    std::vector<std::string> fit();
+
+    /**
+     * @brief 最近一次 fit() 使用的 token 数
+     */
+    size_t used_tokens() const { return used_tokens_; }
+
+    /**
+     * @brief 最近一次 fit() 丢弃的条目数（被摘要替代的也计入）
+     */
+    size_t dropped_items() const { return dropped_items_; }
+
+private:
+    static size_t line_cost(const std::string& line);
+    static std::string render(const std::string& header, const std::vector<std::string>& lines);
+
+private:
+    size_t max_tokens_;
+    CompactionCache* cache_;
+    std::vector<PromptSection> sections_;
+    size_t used_tokens_ = 0;
+    size_t dropped_items_ = 0;
+};
+
+} // namespace NeXShell
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 一个进程（或整个管道）的资源用量
+ */
+struct ProcessUsage {
+    pid_t pid = 0;
+    std::string program;
+    double real_ms = 0.0;           // 从 fork 到回收的墙钟时间
+    double user_ms = 0.0;
+    double sys_ms = 0.0;
+    long max_rss_kb = 0;            // 最大常驻内存
+    long minor_faults = 0;
+    long major_faults = 0;
+    long voluntary_switches = 0;
+    long involuntary_switches = 0;
+    int exit_code = 0;
+
+    /**
+     * @brief 从 wait4/getrusage 的结果填充 CPU、内存和调度统计
+     */
+    void set_rusage(const struct rusage& usage);
+
+    /**
+     * @brief 累加另一个用量：时间和计数相加，最大内存取最大值
+     */
+    void accumulate(const ProcessUsage& other);
+};
+
+/**
+ * @brief time 前缀的选项
+ */
+struct TimeOptions {
+    bool posix = false;             // -p：POSIX 格式
+    bool verbose = false;           // -v：附加内存/缺页/上下文切换和分阶段明细
+    bool json = false;              // --json：输出 JSON
+    bool has_format = false;        // 是否指定了格式（-f 或 $TIMEFORMAT）
+    std::string format;
+};
+
+/**
+ * @brief time 的报告格式化
+ */
+class TimeReport {
+public:
+    // 未设置 TIMEFORMAT 时的默认格式（与 bash 相同）
+    static const char* const DEFAULT_FORMAT;
+    static const char* const POSIX_FORMAT;
+
+    /**
+     * @brief 按 TIMEFORMAT 风格的格式渲染
+     *
+     * 支持 bash 的 %[p][l]R、%[p][l]U、%[p][l]S、%P 和 %%，以及扩展
+     * %M（最大 RSS，KB）、%F（主缺页）、%f（次缺页）、%w（自愿切换）、%c（非自愿切换）。
+     * @param format 格式
+     * @param total 汇总用量
+     * @return 渲染结果
+     */
+    static std::string format(const std::string& format, const ProcessUsage& total);
+
+    /**
+     * @brief 分阶段明细表
+     */
+    static std::string table(const std::vector<ProcessUsage>& stages, const ProcessUsage& total);
+
+    /**
+     * @brief JSON 报告：汇总字段加 stages 数组
+     */
+    static std::string json(const std::vector<ProcessUsage>& stages, const ProcessUsage& total);
+};
+
+} // namespace NeXShell
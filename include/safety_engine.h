@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief 安全规则的类别
+ */
+enum class SafetyRuleKind : uint8_t {
+    DangerousCommand = 0,   // 明确的危险文本（命中即拒绝）
+    DangerousPattern,       // 可疑模式（由严格的验证器拒绝）
+    RemoveCommand,          // 删除类命令标记（如 "rm"）
+    RecursiveRemove,        // 递归强制删除标记（如 "rm -rf"）
+    RootGlob,               // 指向根目录的参数（如 "/*"）
+    CriticalPath,           // 系统关键目录（如 "/usr"）
+    NestedCommand,          // 无法解析的 sh -c 等内嵌文本中的危险命令
+    Count
+};
+
+/**
+ * @brief 一条安全规则
+ */
+struct SafetyRule {
+    std::string pattern;    // 要匹配的子串
+    SafetyRuleKind kind;    // 规则类别
+};
+
+/**
+ * @brief 一次扫描的结果，记录每个类别首次命中的规则
+ */
+struct SafetyScanResult {
+    static constexpr size_t kKindCount = static_cast<size_t>(SafetyRuleKind::Count);
+
+    uint32_t kinds = 0;                         // 命中类别的位掩码
+    std::array<int, kKindCount> first_rule{};   // 每个类别首次命中的规则下标，-1 表示未命中
+
+    SafetyScanResult() { first_rule.fill(-1); }
+
+    bool has(SafetyRuleKind kind) const {
+        return (kinds & (1u << static_cast<uint32_t>(kind))) != 0;
+    }
+};
+
+/**
+ * @brief 基于 Aho-Corasick 自动机的多模式安全扫描引擎
+ *
+ * 所有规则在启动时编译成一个按字节类压缩的 DFA，
+ * 每条命令只需线性扫描一次，与规则数量无关。按程序语义的检查
+ * 由 CommandSafetyAnalyzer 完成，这里只负责纯文本规则；remove、critical 等
+ * 组合规则和 nested 规则只用于无法解析的内嵌 shell 文本。
+ */
+class SafetyEngine {
+public:
+    SafetyEngine() = default;
+
+    /**
+     * @brief 添加一条规则（需要重新调用 compile 才会生效）
+     * @param pattern 要匹配的子串
+     * @param kind 规则类别
+     */
+    void add_rule(const std::string& pattern, SafetyRuleKind kind);
+
+    /**
+     * @brief 添加内置的默认规则集
+     */
+    void add_builtin_rules();
+
+    /**
+     * @brief 从配置文件加载规则
+     *
+     * 每行格式为 "<kind> <pattern>"，kind 取 command、pattern、remove、
+     * recursive-remove、root-glob、critical、nested 之一；空行和以 # 开头的行被忽略。
+     * @param path 配置文件路径
+     * @return 成功加载的规则数，文件无法打开时返回 -1
+     */
+    int load_rules_from_file(const std::string& path);
+
+    /**
+     * @brief 将所有规则编译为自动机
+     */
+    void compile();
+
+    /**
+     * @brief 扫描文本，一次性收集所有类别的命中情况
+     * @param text 要扫描的文本
+     * @return 扫描结果
+     */
+    SafetyScanResult scan(std::string_view text) const;
+
+    /**
+     * @brief 获取规则
+     * @param index 规则下标
+     * @return 规则引用
+     */
+    const SafetyRule& rule(int index) const { return rules_[static_cast<size_t>(index)]; }
+
+    /**
+     * @brief 获取规则数量
+     * @return 规则数量
+     */
+    size_t rule_count() const { return rules_.size(); }
+
+    /**
+     * @brief 获取进程共享的安全引擎
+     *
+     * 首次调用时加载内置规则以及 $NEXSH_SAFETY_RULES（默认
+     * ~/.nexsh_safety_rules）中的规则并完成编译。
+     * @return 已编译的共享引擎
+     */
+    static const SafetyEngine& shared();
+
+private:
+    struct Node {
+        int fail = 0;               // 失败指针
+        uint32_t output_begin = 0;  // 在 outputs_ 中的起始位置
+        uint32_t output_count = 0;  // 命中规则数量（含失败链上的规则）
+    };
+
+    std::vector<SafetyRule> rules_;
+    std::array<uint16_t, 256> byte_class_{};    // 字节 -> 字节类，0 表示不出现在任何规则中
+    size_t class_count_ = 1;
+    std::vector<Node> nodes_;
+    std::vector<int32_t> transitions_;          // nodes_.size() * class_count_ 的稠密转移表
+    std::vector<int32_t> outputs_;              // 各节点命中的规则下标
+    bool compiled_ = false;
+};
+
+} // namespace NeXShell
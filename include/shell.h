@@ -5,12 +5,15 @@
 #include <memory>
 #include <unordered_map>
 #include <functional>
+#include <chrono>
 
 namespace NeXShell {
 
 class CommandParser;
 class CommandExecutor;
 class AIAssistant;
+class LineEditor;
+class ForkServer;
 
 /**
  * @brief 主 Shell 类，负责整个 Shell 的运行逻辑
@@ -59,6 +62,14 @@ public:
      */
     bool change_directory(const std::string& path);
 
+    /**
+     * @brief 切换到 nexshd 会话的工作目录和环境变量（在守护进程的工作进程中调用）
+     * @param cwd 工作目录
+     * @param environment "NAME=value" 形式的环境变量，替换当前的全部环境变量
+     * @return 无法进入工作目录时返回 false
+     */
+    bool enter_session(const std::string& cwd, const std::vector<std::string>& environment);
+
     /**
      * @brief 添加命令到历史记录
      * @param command 命令字符串
@@ -77,6 +88,18 @@ public:
      */
     AIAssistant* get_ai_assistant() const { return ai_assistant_.get(); }
 
+    /**
+     * @brief 获取命令执行器（用于列出后台作业）
+     * @return 命令执行器指针
+     */
+    CommandExecutor* get_executor() const { return executor_.get(); }
+
+    /**
+     * @brief 获取 fork server（未启用或启动失败时为空）
+     * @return fork server 指针
+     */
+    ForkServer* get_fork_server() const { return fork_server_.get(); }
+
     /**
      * @brief 检查是否应该退出 Shell
      * @return 如果应该退出返回 true
@@ -111,14 +134,30 @@ private:
      */
     void setup_signal_handlers();
 
+    /**
+     * @brief 设置了 $NEXSH_METRICS_TEXTFILE 时，按间隔把指标写入 textfile
+     * @param force 忽略间隔立即写入（退出时）
+     */
+    void export_metrics(bool force);
+
 private:
     std::unique_ptr<CommandParser> parser_;
     std::unique_ptr<CommandExecutor> executor_;
+    std::unique_ptr<ForkServer> fork_server_;
     std::unique_ptr<AIAssistant> ai_assistant_;
+    std::unique_ptr<LineEditor> line_editor_;   // 开启 AI 预取时用于交互输入
     std::vector<std::string> command_history_;
     std::unordered_map<std::string, std::string> environment_variables_;
     bool exit_requested_;
     std::string current_directory_;
+    
+    // 停止输入多久后预取命令解释
+    static const int PREFETCH_IDLE_MS = 400;
+    
+    // node_exporter textfile 导出（$NEXSH_METRICS_TEXTFILE、$NEXSH_METRICS_INTERVAL 秒）
+    std::string metrics_textfile_;
+    std::chrono::seconds metrics_interval_{15};
+    std::chrono::steady_clock::time_point last_metrics_export_{};
 };
 
 } // namespace NeXShell
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief nexshd 的一个会话：工作目录和环境变量（"NAME=value"）
+ */
+struct DaemonSession {
+    std::string cwd;
+    std::vector<std::string> environment;
+};
+
+/**
+ * @brief 常驻的 shell 守护进程（nexshd）
+ *
+ * 自动化脚本每次调用 nexsh "<cmd>" 都要付出进程启动、导入环境变量和探测 AI 服务
+ * 的开销。nexshd 只初始化一次，在 Unix 域套接字（SOCK_SEQPACKET）上接收命令；
+ * 客户端的标准输入输出用 SCM_RIGHTS 传过来，命令的输出直接写到客户端的描述符上。
+ *
+ * 每条命令在从守护进程 fork 出的工作进程中执行：工作进程切换到会话的目录和环境，
+ * 执行完把新的目录和环境（cd、export 的结果）写回守护进程。会话属于一个连接；
+ * 带名字的会话（nexsh --client --session NAME）在守护进程中保留，跨连接共享。
+ * 固定数量的线程同时在监听套接字上 accept，每个线程一次服务一个连接。
+ * 只接受与守护进程同一用户（或 root）的连接。
+ */
+class ShellDaemon {
+public:
+    /**
+     * @brief 在工作进程中执行一条命令；标准输入输出已经是客户端的描述符
+     *
+     * 进入时 session 是会话当前的状态，返回前更新为执行后的状态。
+     * @return 命令的退出码
+     */
+    using CommandRunner = std::function<int(DaemonSession& session, const std::string& command)>;
+
+    // 一个请求的最大长度（命令 + 环境变量）
+    static constexpr size_t MAX_REQUEST = 1 << 20;
+
+    /**
+     * @param socket_path 监听的套接字路径
+     * @param threads 服务线程数（可同时执行的命令数）
+     * @param runner 执行命令的函数
+     */
+    ShellDaemon(std::string socket_path, size_t threads, CommandRunner runner);
+    ~ShellDaemon();
+
+    ShellDaemon(const ShellDaemon&) = delete;
+    ShellDaemon& operator=(const ShellDaemon&) = delete;
+
+    /**
+     * @brief 默认套接字路径：$NEXSH_DAEMON_SOCKET、$XDG_RUNTIME_DIR/nexshd.sock
+     *        或 /tmp/nexshd-<uid>.sock
+     */
+    static std::string default_socket_path();
+
+    /**
+     * @brief 绑定套接字并启动服务线程
+     * @return 套接字已被另一个守护进程使用或无法绑定时返回 false（错误已打印）
+     */
+    bool start();
+
+    /**
+     * @brief 停止接受连接，等待正在执行的命令结束后返回并删除套接字
+     */
+    void stop();
+
+    const std::string& socket_path() const { return socket_path_; }
+
+private:
+    /**
+     * @brief 服务线程：accept 一个连接并处理它的所有请求
+     */
+    void accept_loop();
+
+    void serve_connection(int connection_fd);
+
+    /**
+     * @brief fork 工作进程执行一条命令，客户端断开时终止工作进程
+     * @param fds 客户端的标准输入、输出、错误
+     * @return 退出码（被信号终止时为 128 + 信号）
+     */
+    int run_command(int connection_fd, DaemonSession& session, const std::string& command, const int* fds);
+
+private:
+    std::string socket_path_;
+    size_t thread_count_;
+    CommandRunner runner_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::set<int> connections_;                                 // 停止时 shutdown 这些连接
+    std::unordered_map<std::string, DaemonSession> sessions_;   // 带名字的会话
+};
+
+/**
+ * @brief nexsh --client 使用的客户端：把命令和当前进程的目录、环境转发给 nexshd
+ */
+class DaemonClient {
+public:
+    ~DaemonClient();
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    /**
+     * @brief 连接到守护进程
+     * @return 连接失败时为空（errno 保留）
+     */
+    static std::unique_ptr<DaemonClient> connect(const std::string& socket_path);
+
+    /**
+     * @brief 执行一条命令并等待它结束；同一连接上的命令共享一个会话
+     * @param command 命令行
+     * @param session 会话名，为空时使用连接自己的会话
+     * @return 命令的退出码，与守护进程通信失败时为 -1
+     */
+    int execute(const std::string& command, const std::string& session = "",
+                int stdin_fd = STDIN_FILENO, int stdout_fd = STDOUT_FILENO, int stderr_fd = STDERR_FILENO);
+
+private:
+    explicit DaemonClient(int socket_fd) : socket_fd_(socket_fd) {}
+
+    int socket_fd_;
+    std::vector<char> buffer_;
+};
+
+} // namespace NeXShell
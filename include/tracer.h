@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace NeXShell {
+
+/**
+ * @brief 一条已完成的跟踪记录
+ */
+struct TraceEvent {
+    const char* category = "";      // 分类（字符串字面量）
+    const char* name = "";          // 阶段名（字符串字面量）
+    uint64_t start_ns = 0;          // CLOCK_MONOTONIC 时间戳
+    uint64_t duration_ns = 0;
+    char detail[48] = {};           // 附加信息（命令、路径等），超长时截断
+};
+
+/**
+ * @brief 进程内的低开销跟踪器
+ *
+ * 每个线程写入自己的环形缓冲区（满了覆盖最旧的记录），只有导出时才汇总。
+ * 时间戳来自 vDSO 的 clock_gettime(CLOCK_MONOTONIC)。关闭时，跟踪点只有
+ * 一次对 enabled() 的判断。
+ */
+class Tracer {
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 4096;
+
+    /**
+     * @brief 跟踪是否开启（热路径上唯一的判断）
+     */
+    static bool enabled() { return __builtin_expect(enabled_.load(std::memory_order_relaxed), 0); }
+
+    /**
+     * @brief 开启或关闭跟踪
+     */
+    static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前单调时钟（纳秒）
+     */
+    static uint64_t now_ns();
+
+    /**
+     * @brief 记录一个阶段到当前线程的缓冲区
+     * @param category 分类（必须是静态字符串）
+     * @param name 阶段名（必须是静态字符串）
+     * @param start_ns 开始时间
+     * @param end_ns 结束时间
+     * @param detail 附加信息，会被复制
+     */
+    static void record(const char* category, const char* name, uint64_t start_ns, uint64_t end_ns,
+                       std::string_view detail = {});
+
+    /**
+     * @brief 缓冲区中的记录总数
+     */
+    static size_t event_count();
+
+    /**
+     * @brief 清空所有线程的记录
+     */
+    static void clear();
+
+    /**
+     * @brief 以 Chrome trace-event 格式（chrome://tracing、Perfetto）导出所有记录
+     * @return JSON 文本
+     */
+    static std::string to_chrome_json();
+
+    /**
+     * @brief 把 Chrome trace-event JSON 写入文件
+     * @param path 文件路径
+     * @return 写入成功时返回 true
+     */
+    static bool write_chrome_trace(const std::string& path);
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+};
+
+/**
+ * @brief 作用域跟踪点：构造时开始计时，析构时记录
+ *
+ * detail 只保存视图，调用方需保证它在作用域内有效。
+ */
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name, std::string_view detail = {})
+        : category_(category), name_(name), detail_(detail),
+          start_ns_(Tracer::enabled() ? Tracer::now_ns() : 0) {}
+
+    ~TraceScope() {
+        if (start_ns_ != 0) {
+            Tracer::record(category_, name_, start_ns_, Tracer::now_ns(), detail_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    std::string_view detail_;
+    uint64_t start_ns_;
+};
+
+} // namespace NeXShell
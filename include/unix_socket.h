@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string_view>
+#include <vector>
+
+namespace NeXShell {
+
+/**
+ * @brief AF_UNIX SOCK_SEQPACKET 消息的辅助函数（fork server 和 nexshd 共用）
+ *
+ * 消息体是一个固定头部加上若干以 NUL 结尾的字符串，描述符用 SCM_RIGHTS 传递。
+ */
+class UnixSocket {
+public:
+    // 一条消息最多携带的描述符数
+    static constexpr size_t MAX_FDS = 4;
+
+    /**
+     * @brief 追加一个以 NUL 结尾的字符串
+     */
+    static void append_string(std::vector<char>& buffer, std::string_view text);
+
+    /**
+     * @brief 从 buffer[offset, size) 取出下一个以 NUL 结尾的字符串
+     * @return 字符串起始位置；没有完整的字符串时为 nullptr
+     */
+    static const char* next_string(const std::vector<char>& buffer, size_t size, size_t& offset);
+
+    /**
+     * @brief 发送一条消息，可以附带描述符（不产生 SIGPIPE，自动重试 EINTR）
+     * @return 发送的字节数，失败时为 -1
+     */
+    static ssize_t send_message(int socket_fd, const void* data, size_t size,
+                                const int* fds = nullptr, size_t fd_count = 0);
+
+    /**
+     * @brief 接收一条消息和附带的描述符（描述符带 O_CLOEXEC）
+     * @param fds 至少 MAX_FDS 个元素
+     * @param fd_count 实际收到的描述符数
+     * @return 收到的字节数，对端关闭时为 0；消息或描述符被截断时关闭收到的描述符，
+     *         返回 -1 并设置 errno 为 EMSGSIZE
+     */
+    static ssize_t receive_message(int socket_fd, void* data, size_t capacity, int* fds, size_t& fd_count);
+};
+
+} // namespace NeXShell
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
+#include <optional>
+#include <type_traits>
 
 namespace NeXShell {
 
@@ -29,6 +33,26 @@ namespace Utils {
      */
     std::vector<std::string> split(const std::string& str, const std::string& delimiters);
 
+    /**
+     * @brief 分割字符串，结果是指向原字符串的视图（不分配字符串）
+     *
+     * 语义与 split(str, char) 相同：保留中间的空字段，忽略末尾分隔符之后的空字段。
+     * @param str 要分割的字符串（结果的生命周期不能超过它）
+     * @param delimiter 分隔符
+     * @param out 输出向量，先被清空；调用方可复用它以避免重复分配
+     * @return 字段数
+     */
+    size_t split_view(std::string_view str, char delimiter, std::vector<std::string_view>& out);
+
+    /**
+     * @brief 按任意一个分隔符分割为视图，跳过空字段（语义同 split(str, delimiters)）
+     * @param str 要分割的字符串
+     * @param delimiters 分隔符集合
+     * @param out 输出向量，先被清空
+     * @return 字段数
+     */
+    size_t split_view(std::string_view str, std::string_view delimiters, std::vector<std::string_view>& out);
+
     /**
      * @brief 去除字符串首尾空白字符
      * @param str 要处理的字符串
@@ -50,6 +74,23 @@ namespace Utils {
      */
     std::string rtrim(const std::string& str);
 
+    /**
+     * @brief 去除首尾空白字符，返回原字符串的视图
+     * @param str 要处理的字符串
+     * @return 去除空白后的视图
+     */
+    std::string_view trim_view(std::string_view str);
+
+    /**
+     * @brief 去除左侧空白字符，返回视图
+     */
+    std::string_view ltrim_view(std::string_view str);
+
+    /**
+     * @brief 去除右侧空白字符，返回视图
+     */
+    std::string_view rtrim_view(std::string_view str);
+
     /**
      * @brief 将字符串转换为小写
      * @param str 要转换的字符串
@@ -64,6 +105,18 @@ namespace Utils {
      */
     std::string to_upper(const std::string& str);
 
+    /**
+     * @brief 原地将 ASCII 字母转换为小写（非 ASCII 字节不变）
+     * @param str 要转换的字符串
+     */
+    void to_lower_in_place(std::string& str);
+
+    /**
+     * @brief 原地将 ASCII 字母转换为大写（非 ASCII 字节不变）
+     * @param str 要转换的字符串
+     */
+    void to_upper_in_place(std::string& str);
+
     /**
      * @brief 检查字符串是否以指定前缀开始
      * @param str 要检查的字符串
@@ -88,6 +141,14 @@ namespace Utils {
      */
     std::string join(const std::vector<std::string>& strings, const std::string& separator);
 
+    /**
+     * @brief 连接字符串视图（例如 split_view 的结果），结果只分配一次
+     * @param strings 视图向量
+     * @param separator 分隔符
+     * @return 连接后的字符串
+     */
+    std::string join(const std::vector<std::string_view>& strings, std::string_view separator);
+
     /**
      * @brief 替换字符串中的所有匹配项
      * @param str 原字符串
@@ -131,15 +192,46 @@ namespace Utils {
      */
     std::string expand_tilde(const std::string& path);
 
+    /**
+     * @brief 需要时给参数加上引号，让 CommandParser 重新解析命令行时还原出同一个参数
+     *
+     * 同时含单引号和双引号时拼接多段引号（'it'"'"'s'）。解析器在引号内也展开 $VAR
+     * 并丢弃空词，含变量引用的参数和空参数无法表示。
+     * @param argument 参数
+     * @return 不含空白、引号和管道/重定向字符时原样返回；无法表示时为 std::nullopt
+     */
+    std::optional<std::string> quote_argument(const std::string& argument);
+
+    namespace detail {
+        template<typename T>
+        auto format_arg(const T& value) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                return value.c_str();
+            } else {
+                return value;
+            }
+        }
+    } // namespace detail
+
     /**
      * @brief 格式化字符串（类似 printf）
+     *
+     * std::string 参数可以直接传给 %s。先测量长度，再一次性写入结果。
      * @tparam Args 参数类型
      * @param format 格式字符串
      * @param args 参数
-     * @return 格式化后的字符串
+     * @return 格式化后的字符串，格式错误时为空
      */
     template<typename... Args>
-    std::string format(const std::string& format, Args... args);
+    std::string format(const std::string& format, Args... args) {
+        int length = std::snprintf(nullptr, 0, format.c_str(), detail::format_arg(args)...);
+        if (length <= 0) {
+            return "";
+        }
+        std::string result(static_cast<size_t>(length), '\0');
+        std::snprintf(result.data(), result.size() + 1, format.c_str(), detail::format_arg(args)...);
+        return result;
+    }
 
     /**
      * @brief 获取当前时间戳字符串
@@ -1,6 +1,10 @@
 #include "ai_assistant.h"
 #include "shell.h"
 #include "utils.h"
+#include "command_parser.h"
+#include "json.h"
+#include "tracer.h"
+#include "metrics.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -8,36 +12,131 @@
 #include <string>
 #include <unistd.h>
 #include <cstdlib>
+#include <chrono>
+#include <cmath>
 
 namespace NeXShell {
 
+namespace {
+
+/**
+ * @brief 解释缓存的键：合并连续空白后的命令
+ */
+std::string explanation_key(const std::string& command) {
+    std::vector<std::string_view> words;
+    Utils::split_view(command, " \t", words);
+    return Utils::join(words, " ");
+}
+
+/**
+ * @brief 从编辑缓冲区中找出值得预取解释的命令
+ * @return "ai explain <cmd>" 中的命令，或含管道/重定向/多个参数的命令；否则为空
+ */
+std::string prefetch_target_for(const std::string& buffer) {
+    std::string trimmed = Utils::trim(buffer);
+    if (trimmed.empty()) {
+        return "";
+    }
+    
+    Pipeline pipeline;
+    try {
+        pipeline = CommandParser().parse(trimmed);
+    } catch (const std::exception&) {
+        return "";
+    }
+    if (pipeline.commands.empty()) {
+        return "";
+    }
+    
+    const Command& first = pipeline.commands.front();
+    if (first.program == "ai") {
+        // 与 cmd_ai 拼接参数的方式一致，保证缓存键相同
+        if (pipeline.commands.size() == 1 && first.arguments.size() > 1 && first.arguments[0] == "explain") {
+            return Utils::join(std::vector<std::string>(first.arguments.begin() + 1, first.arguments.end()), " ");
+        }
+        return "";
+    }
+    
+    bool complex = pipeline.commands.size() > 1 || first.arguments.size() >= 3 ||
+                   first.input_file.has_value() || first.output_file.has_value();
+    return complex ? trimmed : "";
+}
+
+/**
+ * @brief 默认的 Ollama 端点列表，$NEXSH_OLLAMA_ENDPOINTS 可指定多个（逗号分隔）
+ */
+std::string default_endpoints() {
+    const char* endpoints = getenv("NEXSH_OLLAMA_ENDPOINTS");
+    return endpoints && *endpoints ? endpoints : "http://localhost:11434";
+}
+
+/**
+ * @brief 创建连接器并应用 $NEXSH_OLLAMA_HEDGE_PERCENTILE（0 表示关闭对冲）
+ */
+std::unique_ptr<OllamaConnector> make_connector(const std::string& endpoints) {
+    auto connector = std::make_unique<OllamaConnector>(endpoints);
+    const char* percentile = getenv("NEXSH_OLLAMA_HEDGE_PERCENTILE");
+    if (percentile && *percentile) {
+        connector->set_hedge_percentile(std::atof(percentile));
+    }
+    return connector;
+}
+
+/**
+ * @brief 去掉命令外层的空白、反引号和提示符 "$ "
+ */
+std::string strip_command(const std::string& text) {
+    std::string command = Utils::trim(text);
+    while (!command.empty() && command.front() == '`') {
+        command.erase(command.begin());
+    }
+    while (!command.empty() && command.back() == '`') {
+        command.pop_back();
+    }
+    command = Utils::trim(command);
+    if (command.rfind("$ ", 0) == 0) {
+        command = Utils::trim(command.substr(2));
+    }
+    return command;
+}
+
+} // namespace
+
+const char* const AIAssistant::COMMAND_SCHEMA =
+    R"({"type":"object","properties":{"command":{"type":"string"},"explanation":{"type":"string"},)"
+    R"("risk":{"type":"string","enum":["low","medium","high"]}},"required":["command","explanation","risk"]})";
+
 AIAssistant::AIAssistant(Shell* shell) 
-    : shell_(shell), current_model_("llama3.2"), ai_enabled_(false) {
-    
-    // 初始化危险命令列表
-    dangerous_commands_ = {
-        "rm -rf /",
-        "rm -rf /*",
-        "dd if=/dev/zero",
-        "mkfs",
-        "fdisk",
-        "format",
-        "del /f /s /q C:\\",
-        "shutdown -h now",
-        "reboot",
-        "halt",
-        "init 0",
-        "kill -9 -1",
-        ":(){ :|:& };:",  // fork bomb
-        "chmod -R 777 /",
-        "chown -R root:root /",
-        "sudo rm -rf"
-    };
+    : shell_(shell), current_model_("llama3.2"), ai_enabled_(false),
+      safety_analyzer_(SafetyEngine::shared()),
+      workers_(AI_WORKER_THREADS, AI_QUEUE_CAPACITY) {
+    
+    // 加载之前学到的意图模板
+    const char* intents_path = getenv("NEXSH_INTENTS");
+    std::string path = intents_path ? intents_path : Utils::expand_tilde("~/.nexsh_intents");
+    intent_matcher_.load_templates(path);
+    intent_matcher_.set_storage_path(path);
+    
+    // 加载已接受建议的嵌入索引
+    const char* embeddings_path = getenv("NEXSH_EMBEDDINGS");
+    path = embeddings_path ? embeddings_path : Utils::expand_tilde("~/.nexsh_embeddings");
+    history_index_.load(path);
+    history_index_.set_storage_path(path);
+    const char* embedding_model = getenv("NEXSH_EMBED_MODEL");
+    embedding_model_ = embedding_model ? embedding_model : "nomic-embed-text";
+    
+    const char* prefetch = getenv("NEXSH_AI_PREFETCH");
+    prefetch_enabled_ = prefetch && std::string(prefetch) == "1";
+    
+    const char* prompt_budget = getenv("NEXSH_PROMPT_BUDGET");
+    if (prompt_budget && std::atoi(prompt_budget) > 0) {
+        prompt_budget_tokens_ = static_cast<size_t>(std::atoi(prompt_budget));
+    }
 }
 
 bool AIAssistant::initialize(const std::string& model_name) {
     current_model_ = model_name;
-    ollama_ = std::make_unique<OllamaConnector>();
+    ollama_ = make_connector(default_endpoints());
     
     // 检查 Ollama 服务是否可用
     if (!ollama_->is_service_available()) {
@@ -89,27 +188,102 @@ bool AIAssistant::auto_initialize(const std::string& model_name) {
 }
 
 std::string AIAssistant::process_natural_command(const std::string& natural_input) {
+    return process_natural_command(natural_input, shell_->get_current_directory());
+}
+
+std::string AIAssistant::process_natural_command(const std::string& natural_input,
+                                                 const std::string& cwd) {
+    TraceScope trace("ai", "natural_command", natural_input);
+    // 本地快速路径：常见意图直接由模板生成命令
+    IntentMatch local;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        local = intent_matcher_.match(natural_input);
+    }
+    if (local.confidence >= IntentMatcher::CONFIDENCE_THRESHOLD && is_command_safe(local.command, cwd)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++local_matches_;
+        Metrics::instance().ai_local_answers.inc();
+        last_suggestion_ = {local.command, "", ""};
+        command_history_.push_back({natural_input, local.command});
+        if (command_history_.size() > MAX_HISTORY_SIZE) {
+            command_history_.erase(command_history_.begin());
+        }
+        return local.command;
+    }
+    
     if (!ai_enabled_) {
         return "AI features are not available. Please check if Ollama is running.";
     }
     
     try {
-        std::string context_prompt = build_context_prompt(natural_input);
-        std::string ai_response = ollama_->query_model(context_prompt, current_model_);
+        std::vector<int> context;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            context = conversation_context_;
+        }
+        
+        // 已有上下文时只发送本轮输入，系统提示和历史已包含在 context 中
+        OllamaGeneration generation;
+        if (context.empty()) {
+            std::pair<std::string, std::string> prompts;
+            {
+                TraceScope prompt_trace("ai", "build_prompt");
+                prompts = build_initial_prompts(natural_input, cwd);
+            }
+            generation = ollama_->generate(prompts.second, current_model_, prompts.first, {}, COMMAND_SCHEMA);
+        } else {
+            generation = ollama_->generate(build_turn_prompt(natural_input, cwd), current_model_, "", context,
+                                           COMMAND_SCHEMA);
+        }
         
-        // 从 AI 响应中提取命令
-        std::string command = extract_command_from_response(ai_response);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!generation.success || generation.context.size() > MAX_CONTEXT_TOKENS) {
+                // 出错或上下文过长时重新开始，下一轮用文本历史重建
+                conversation_context_.clear();
+            } else {
+                conversation_context_ = generation.context;
+            }
+            
+            last_usage_ = {generation.prompt_tokens, generation.completion_tokens, !context.empty()};
+            total_usage_.prompt_tokens += generation.prompt_tokens;
+            total_usage_.completion_tokens += generation.completion_tokens;
+        }
         
-        if (command.empty()) {
+        if (!generation.success) {
+            return "Error: " + generation.error;
+        }
+        std::string ai_response = generation.response;
+        
+        // 从结构化回复中提取命令
+        std::optional<AICommandSuggestion> suggestion = parse_command_response(ai_response);
+        if (!suggestion) {
             return "AI Response: " + ai_response;
         }
+        if (suggestion->command.empty()) {
+            return "AI Response: " + (suggestion->explanation.empty() ? ai_response : suggestion->explanation);
+        }
+        const std::string& command = suggestion->command;
         
         // 验证命令安全性
-        if (!is_command_safe(command)) {
+        if (!is_command_safe(command, cwd)) {
             return "Unsafe command detected: " + command + "\nFor safety, this command was not executed.";
         }
         
+        // 解释随建议一起返回，之后的 ai explain 无需再请求
+        if (!suggestion->explanation.empty()) {
+            std::promise<std::optional<std::string>> ready;
+            ready.set_value(suggestion->explanation);
+            std::lock_guard<std::mutex> lock(prefetch_mutex_);
+            if (explanation_cache_.count(explanation_key(command)) == 0) {
+                cache_explanation(explanation_key(command), ready.get_future().share());
+            }
+        }
+        
         // 记录到历史
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_suggestion_ = *suggestion;
         command_history_.push_back({natural_input, command});
         if (command_history_.size() > MAX_HISTORY_SIZE) {
             command_history_.erase(command_history_.begin());
@@ -127,8 +301,138 @@ std::string AIAssistant::explain_command(const std::string& command) {
         return "AI features are not available.";
     }
     
+    // 优先使用进行中或已完成的（预取）结果
+    std::string key = explanation_key(command);
+    CachedExplanation cached;
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mutex_);
+        auto it = explanation_cache_.find(key);
+        if (it != explanation_cache_.end()) {
+            cached = it->second;
+        }
+    }
+    if (cached.valid()) {
+        // 预取失败或因输入变化被取消时重新请求
+        std::optional<std::string> explanation = cached.get();
+        if (explanation) {
+            std::lock_guard<std::mutex> lock(prefetch_mutex_);
+            ++explanation_cache_hits_;
+            Metrics::instance().ai_cache_hits.inc();
+            return *explanation;
+        }
+    }
+    
+    OllamaGeneration generation = request_explanation(command);
+    if (!generation.success) {
+        return "Error: " + generation.error;
+    }
+    std::promise<std::optional<std::string>> ready;
+    ready.set_value(generation.response);
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    cache_explanation(key, ready.get_future().share());
+    return generation.response;
+}
+
+OllamaGeneration AIAssistant::request_explanation(const std::string& command, const std::atomic<bool>* cancel) {
     std::string prompt = "Explain what this Linux command does in simple terms:\n" + command;
-    return ollama_->query_model(prompt, current_model_);
+    return ollama_->generate(prompt, current_model_, "", {}, "", cancel);
+}
+
+void AIAssistant::prefetch_explanation(const std::string& buffer) {
+    if (!prefetch_enabled_ || !ai_enabled_) {
+        return;
+    }
+    
+    std::string target = prefetch_target_for(buffer);
+    if (target.empty()) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    // 输入已经变了，为旧输入进行中的请求不再有用，释放工作线程
+    if (prefetch_cancel_ && prefetch_running_ != target) {
+        prefetch_cancel_->store(true);
+    }
+    if (explanation_cache_.count(explanation_key(target)) > 0) {
+        return;
+    }
+    
+    // 替换尚未开始的目标；同一时间最多一个预取请求
+    prefetch_target_ = target;
+    if (prefetch_scheduled_) {
+        return;
+    }
+    try {
+        workers_.submit([this]() { run_prefetch(); }, AIPriority::Low);
+        prefetch_scheduled_ = true;
+    } catch (const std::exception&) {
+        // 队列已满时放弃预取
+        prefetch_target_.clear();
+    }
+}
+
+void AIAssistant::cancel_prefetch(const std::string& submitted) {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    prefetch_target_.clear();
+    // 提交的正是进行中的目标时保留请求，之后的 ai explain 会用到它
+    if (prefetch_cancel_ && prefetch_running_ != prefetch_target_for(submitted)) {
+        prefetch_cancel_->store(true);
+    }
+}
+
+void AIAssistant::run_prefetch() {
+    while (true) {
+        std::string target;
+        std::string key;
+        std::promise<std::optional<std::string>> promise;
+        std::shared_ptr<std::atomic<bool>> cancel;
+        {
+            std::lock_guard<std::mutex> lock(prefetch_mutex_);
+            if (prefetch_target_.empty()) {
+                prefetch_scheduled_ = false;
+                return;
+            }
+            target.swap(prefetch_target_);
+            key = explanation_key(target);
+            if (explanation_cache_.count(key) > 0) {
+                continue;
+            }
+            cache_explanation(key, promise.get_future().share());
+            cancel = std::make_shared<std::atomic<bool>>(false);
+            prefetch_cancel_ = cancel;
+            prefetch_running_ = target;
+        }
+        
+        OllamaGeneration generation = request_explanation(target, cancel.get());
+        promise.set_value(generation.success ? std::optional<std::string>(generation.response) : std::nullopt);
+        
+        std::lock_guard<std::mutex> lock(prefetch_mutex_);
+        prefetch_cancel_.reset();
+        prefetch_running_.clear();
+        if (!generation.success) {
+            // 失败或被取消的结果不缓存，下次重新请求
+            explanation_cache_.erase(key);
+            explanation_order_.erase(std::remove(explanation_order_.begin(), explanation_order_.end(), key),
+                                     explanation_order_.end());
+        }
+    }
+}
+
+void AIAssistant::cache_explanation(const std::string& key, CachedExplanation explanation) {
+    if (explanation_cache_.count(key) == 0) {
+        explanation_order_.push_back(key);
+    }
+    explanation_cache_[key] = std::move(explanation);
+    
+    while (explanation_order_.size() > MAX_CACHED_EXPLANATIONS) {
+        explanation_cache_.erase(explanation_order_.front());
+        explanation_order_.pop_front();
+    }
+}
+
+size_t AIAssistant::get_explanation_cache_hits() const {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    return explanation_cache_hits_;
 }
 
 std::vector<std::string> AIAssistant::suggest_commands(const std::string& intent) {
@@ -146,7 +450,7 @@ std::vector<std::string> AIAssistant::suggest_commands(const std::string& intent
     // 简单分割响应为命令列表
     std::istringstream iss(response);
     std::string line;
-    while (std::getline(iss, line) && suggestions.size() < 3) {
+    while (std::getline(iss, line) && suggestions.size() < MAX_SUGGESTIONS) {
         line = Utils::trim(line);
         if (!line.empty() && line[0] != '#') {
             suggestions.push_back(line);
@@ -156,139 +460,413 @@ std::vector<std::string> AIAssistant::suggest_commands(const std::string& intent
     return suggestions;
 }
 
-std::string AIAssistant::build_system_prompt() {
-    return R"(You are a Linux shell command assistant. Your job is to convert natural language requests into appropriate Linux shell commands.
+std::vector<std::vector<std::string>> AIAssistant::suggest_commands_batch(const std::vector<std::string>& intents) {
+    std::vector<std::vector<std::string>> results(intents.size());
+    if (!ai_enabled_ || intents.empty()) {
+        return results;
+    }
+    
+    // 按块提交到工作线程池并发执行，队列已满时在当前线程执行
+    struct Chunk {
+        size_t start;
+        std::vector<std::string> intents;
+        std::future<std::vector<std::vector<std::string>>> result;
+    };
+    std::vector<Chunk> chunks;
+    for (size_t start = 0; start < intents.size(); start += BATCH_CHUNK_SIZE) {
+        size_t end = std::min(start + BATCH_CHUNK_SIZE, intents.size());
+        chunks.push_back({start, std::vector<std::string>(intents.begin() + start, intents.begin() + end), {}});
+    }
+    for (auto& chunk : chunks) {
+        try {
+            chunk.result = workers_.submit([this, chunk_intents = chunk.intents]() {
+                return suggest_commands_chunk(chunk_intents);
+            });
+        } catch (const std::exception&) {
+            // 留到下面同步执行
+        }
+    }
+    
+    for (auto& chunk : chunks) {
+        std::vector<std::vector<std::string>> chunk_results;
+        try {
+            chunk_results = chunk.result.valid() ? chunk.result.get() : suggest_commands_chunk(chunk.intents);
+        } catch (const std::exception&) {
+            chunk_results.clear();
+        }
+        chunk_results.resize(chunk.intents.size());
+        
+        for (size_t i = 0; i < chunk.intents.size(); ++i) {
+            // 模型漏掉的意图单独请求
+            results[chunk.start + i] = chunk_results[i].empty()
+                ? suggest_commands(chunk.intents[i])
+                : std::move(chunk_results[i]);
+        }
+    }
+    
+    return results;
+}
 
-Rules:
-1. Return ONLY the command, no explanations unless specifically asked
-2. Use safe, commonly available Linux commands
-3. Be precise and avoid dangerous operations
-4. If the request is unclear, ask for clarification
-5. For file operations, use relative paths unless absolute paths are specified
+std::vector<std::vector<std::string>> AIAssistant::suggest_commands_chunk(const std::vector<std::string>& intents) {
+    std::ostringstream prompt;
+    prompt << "For each numbered task below, suggest up to " << MAX_SUGGESTIONS << " Linux commands.\n"
+           << "Respond with JSON only, in the form "
+           << R"({"results":[{"task":1,"commands":["command 1","command 2"]}]})"
+           << ", with one entry per task and no explanations.\n\nTasks:\n";
+    for (size_t i = 0; i < intents.size(); ++i) {
+        prompt << (i + 1) << ". " << intents[i] << "\n";
+    }
+    
+    OllamaGeneration generation = ollama_->generate(prompt.str(), current_model_, "", {}, "json");
+    if (!generation.success) {
+        return std::vector<std::vector<std::string>>(intents.size());
+    }
+    return parse_batch_response(generation.response, intents.size());
+}
 
-Current directory: )" + shell_->get_current_directory() + R"(
-Available files: )" + get_system_context();
+std::future<std::string> AIAssistant::process_natural_command_async(const std::string& natural_input) {
+    // 在调用线程上取当前目录，避免工作线程与 cd 竞争
+    std::string cwd = shell_->get_current_directory();
+    return workers_.submit([this, natural_input, cwd]() {
+        return process_natural_command(natural_input, cwd);
+    });
 }
 
-std::string AIAssistant::build_context_prompt(const std::string& user_input) {
-    std::ostringstream prompt;
+std::future<std::string> AIAssistant::explain_command_async(const std::string& command) {
+    return workers_.submit([this, command]() { return explain_command(command); });
+}
+
+std::future<std::vector<std::string>> AIAssistant::suggest_commands_async(const std::string& intent) {
+    return workers_.submit([this, intent]() { return suggest_commands(intent); });
+}
+
+int AIAssistant::submit_background_request(const std::string& description,
+                                           std::function<std::string()> task) {
+    std::future<std::string> result;
+    try {
+        result = workers_.submit(std::move(task));
+    } catch (const std::exception& e) {
+        std::cerr << "ai: " << e.what() << std::endl;
+        return -1;
+    }
     
-    prompt << build_system_prompt() << "\n\n";
+    int id = next_request_id_++;
+    background_requests_.push_back({id, description, std::move(result)});
+    std::cout << "[ai " << id << "] " << description << std::endl;
+    return id;
+}
+
+void AIAssistant::cleanup_background_requests() {
+    auto it = background_requests_.begin();
+    while (it != background_requests_.end()) {
+        if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        
+        // 请求已完成
+        std::cout << "[ai " << it->id << "] Done    " << it->description << std::endl;
+        try {
+            std::cout << it->result.get() << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+        it = background_requests_.erase(it);
+    }
+}
+
+std::vector<std::pair<int, std::string>> AIAssistant::get_background_requests() const {
+    std::vector<std::pair<int, std::string>> requests;
+    for (const auto& request : background_requests_) {
+        requests.push_back({request.id, request.description});
+    }
+    return requests;
+}
+
+std::pair<std::string, std::string> AIAssistant::build_initial_prompts(const std::string& user_input,
+                                                                       const std::string& cwd) {
+    PromptBudget budget(prompt_budget_tokens_, &compaction_cache_);
     
-    // 添加最近的命令历史作为上下文
-    if (!command_history_.empty()) {
-        prompt << "Recent commands:\n";
-        for (const auto& hist : command_history_) {
-            prompt << "User: " << hist.first << " -> Command: " << hist.second << "\n";
+    PromptSection rules;
+    rules.required = true;
+    rules.items = {R"(You are a Linux shell command assistant. Your job is to convert natural language requests into appropriate Linux shell commands.
+
+Rules:
+1. Respond with a JSON object: {"command": the shell command, "explanation": one short sentence, "risk": "low", "medium" or "high"}
+2. Use safe, commonly available Linux commands
+3. Be precise and avoid dangerous operations
+4. If the request is unclear, leave "command" empty and ask for clarification in "explanation"
+5. For file operations, use relative paths unless absolute paths are specified
+)",
+                   "Current directory: " + cwd};
+    size_t rules_index = budget.add(std::move(rules));
+    
+    // 目录列表优先级最低，放不下时用按快照缓存的摘要替代
+    size_t listing_index = budget.add(build_directory_section(cwd));
+    
+    // 最相关的历史示例
+    PromptSection examples;
+    examples.header = "Relevant examples:";
+    examples.priority = 30;
+    for (const auto& example : retrieve_examples(user_input)) {
+        examples.items.push_back("User: " + example.first + " -> Command: " + example.second);
+    }
+    bool have_examples = !examples.items.empty();
+    size_t examples_index = budget.add(std::move(examples));
+    
+    // 最近的命令历史，截断时保留最新的；已有相关示例时只保留最后几条
+    PromptSection recent;
+    recent.header = "Recent commands:";
+    recent.priority = 20;
+    recent.keep_newest = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t start = 0;
+        if (have_examples && command_history_.size() > RECENT_HISTORY_WITH_EXAMPLES) {
+            start = command_history_.size() - RECENT_HISTORY_WITH_EXAMPLES;
+        }
+        for (size_t i = start; i < command_history_.size(); ++i) {
+            recent.items.push_back("User: " + command_history_[i].first + " -> Command: " + command_history_[i].second);
         }
-        prompt << "\n";
     }
+    size_t recent_index = budget.add(std::move(recent));
     
-    prompt << "User request: " << user_input << "\n";
-    prompt << "Command:";
+    PromptSection turn;
+    turn.required = true;
+    turn.items = {build_turn_prompt(user_input, cwd)};
+    size_t turn_index = budget.add(std::move(turn));
     
+    std::vector<std::string> sections = budget.fit();
+    
+    std::string system = sections[rules_index] + sections[listing_index];
+    std::string prompt;
+    for (size_t index : {examples_index, recent_index}) {
+        if (!sections[index].empty()) {
+            prompt += sections[index] + "\n";
+        }
+    }
+    prompt += sections[turn_index];
+    return {system, prompt};
+}
+
+std::string AIAssistant::build_turn_prompt(const std::string& user_input, const std::string& cwd) {
+    std::ostringstream prompt;
+    prompt << "Current directory: " << cwd << "\n";
+    prompt << "User request: " << user_input << "\n";
+    prompt << "JSON:";
     return prompt.str();
 }
 
-bool AIAssistant::is_command_safe(const std::string& command) {
-    // 检查命令是否在危险命令列表中
-    for (const auto& dangerous : dangerous_commands_) {
-        if (command.find(dangerous) != std::string::npos) {
-            return false;
+std::vector<std::pair<std::string, std::string>> AIAssistant::retrieve_examples(const std::string& user_input) {
+    std::vector<std::pair<std::string, std::string>> examples;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        if (history_index_.size() == 0) {
+            return examples;
         }
     }
+    if (!ai_enabled_ || !embeddings_enabled_) {
+        return examples;
+    }
     
-    // 检查其他危险模式
-    if (command.find("rm -rf") != std::string::npos && 
-        (command.find("/*") != std::string::npos || command.find("/ ") != std::string::npos)) {
-        return false;
+    std::vector<float> query = ollama_->embed(user_input, embedding_model_);
+    if (query.empty()) {
+        embeddings_enabled_ = false;
+        return examples;
     }
     
-    // 检查是否尝试修改系统关键目录
-    std::vector<std::string> critical_dirs = {"/bin", "/sbin", "/usr", "/lib", "/etc", "/boot"};
-    for (const auto& dir : critical_dirs) {
-        if (command.find("rm") != std::string::npos && command.find(dir) != std::string::npos) {
-            return false;
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (const auto& hit : history_index_.top_k(std::move(query), RETRIEVED_EXAMPLES)) {
+        if (hit.score >= MIN_EXAMPLE_SIMILARITY) {
+            examples.push_back(history_index_.entry(hit.index));
         }
     }
+    return examples;
+}
+
+void AIAssistant::accept_suggestion(const std::string& natural_input, const std::string& command) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        intent_matcher_.learn(natural_input, command);
+    }
     
-    return true;
+    if (!ai_enabled_ || !embeddings_enabled_) {
+        return;
+    }
+    
+    // 在工作线程上计算嵌入并加入索引，不阻塞命令执行
+    try {
+        workers_.submit([this, natural_input, command]() {
+            std::vector<float> embedding = ollama_->embed(natural_input, embedding_model_);
+            if (embedding.empty()) {
+                embeddings_enabled_ = false;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(index_mutex_);
+            history_index_.add(std::move(embedding), natural_input, command);
+        });
+    } catch (const std::exception&) {
+        // 队列已满时放弃这条示例
+    }
 }
 
-std::string AIAssistant::extract_command_from_response(const std::string& ai_response) {
-    std::string response = Utils::trim(ai_response);
+std::vector<EndpointStatus> AIAssistant::get_endpoint_status() const {
+    return ollama_ ? ollama_->get_endpoint_status() : std::vector<EndpointStatus>{};
+}
+
+size_t AIAssistant::get_local_match_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return local_matches_;
+}
+
+AIUsage AIAssistant::get_last_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_usage_;
+}
+
+AIUsage AIAssistant::get_total_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_usage_;
+}
+
+bool AIAssistant::is_command_safe(const std::string& command, const std::string& cwd) {
+    // 在解析后的命令结构上按程序规则检查，结果按规范化命令缓存
+    std::lock_guard<std::mutex> lock(mutex_);
+    SafetyVerdict verdict = safety_analyzer_.analyze(command, cwd);
+    return verdict.safe;
+}
+
+std::vector<std::vector<std::string>> AIAssistant::parse_batch_response(const std::string& response,
+                                                                       size_t task_count) {
+    std::vector<std::vector<std::string>> results(task_count);
+    auto json = JsonValue::parse(response);
+    if (!json) {
+        return results;
+    }
+    
+    // 接受 {"results":[...]} 或直接的数组；没有 task 编号时按顺序对应
+    std::vector<bool> answered(task_count, false);
+    const auto& entries = json->is_array() ? json->items() : (*json)["results"].items();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const JsonValue& entry = entries[i];
+        size_t index = i;
+        if (entry.find("task")) {
+            // 模型返回的编号不可信：先检查类型和范围再转换
+            const JsonValue& task = entry["task"];
+            double number = task.is_number() ? task.as_number() : 0.0;
+            if (!std::isfinite(number) || number != std::floor(number) ||
+                number < 1 || number > static_cast<double>(task_count)) {
+                continue;
+            }
+            index = static_cast<size_t>(number) - 1;
+        }
+        if (index >= task_count || answered[index]) {
+            continue;
+        }
+        answered[index] = true;
+        
+        for (const auto& command : entry["commands"].items()) {
+            std::string text = Utils::trim(command.as_string());
+            if (!text.empty() && results[index].size() < MAX_SUGGESTIONS) {
+                results[index].push_back(text);
+            }
+        }
+    }
     
-    // 如果响应看起来像一个命令（不包含解释性文字）
-    if (response.length() < 200 && 
-        response.find('\n') == std::string::npos &&
-        (response.find("ls") != std::string::npos ||
-         response.find("cd") != std::string::npos ||
-         response.find("mkdir") != std::string::npos ||
-         response.find("cp") != std::string::npos ||
-         response.find("mv") != std::string::npos ||
-         response.find("find") != std::string::npos ||
-         response.find("grep") != std::string::npos ||
-         response.find("cat") != std::string::npos ||
-         response.find("echo") != std::string::npos)) {
-        return response;
+    return results;
+}
+
+std::optional<AICommandSuggestion> AIAssistant::parse_command_response(const std::string& response) {
+    std::string text = Utils::trim(response);
+    
+    // JSON 模式：取最外层的对象，忽略模型偶尔加上的代码块或前后缀
+    size_t open = text.find('{');
+    size_t close = text.rfind('}');
+    if (open != std::string::npos && close != std::string::npos && close > open) {
+        auto json = JsonValue::parse(std::string_view(text).substr(open, close - open + 1));
+        if (json && json->is_object()) {
+            const JsonValue* command = json->find("command");
+            if (command && !command->is_string() && !command->is_null()) {
+                return std::nullopt;
+            }
+            AICommandSuggestion suggestion;
+            suggestion.command = command ? strip_command(command->as_string()) : "";
+            suggestion.explanation = Utils::trim((*json)["explanation"].as_string());
+            suggestion.risk = Utils::to_lower(Utils::trim((*json)["risk"].as_string()));
+            return suggestion;
+        }
     }
     
-    // 尝试从多行响应中提取第一个命令
-    std::istringstream iss(response);
-    std::string line;
-    while (std::getline(iss, line)) {
-        line = Utils::trim(line);
-        if (!line.empty() && line[0] != '#' && line.find("command:") == std::string::npos) {
-            // 简单检查是否看起来像命令
-            if (line.length() < 100 && line.find(' ') != std::string::npos) {
-                return line;
+    // 服务端忽略 format 时：代码块中的第一行
+    size_t fence = text.find("```");
+    if (fence != std::string::npos) {
+        size_t start = text.find('\n', fence);
+        size_t end = start == std::string::npos ? std::string::npos : text.find("```", start);
+        if (end != std::string::npos) {
+            std::istringstream block(text.substr(start + 1, end - start - 1));
+            std::string line;
+            while (std::getline(block, line)) {
+                line = strip_command(line);
+                if (!line.empty()) {
+                    return AICommandSuggestion{line, "", ""};
+                }
             }
         }
+        return std::nullopt;
     }
     
-    return ""; // 无法提取命令，返回空字符串
+    // 或者整个回复只有一行
+    if (!text.empty() && text.find('\n') == std::string::npos) {
+        return AICommandSuggestion{strip_command(text), "", ""};
+    }
+    return std::nullopt;
+}
+
+AICommandSuggestion AIAssistant::get_last_suggestion() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_suggestion_;
 }
 
-std::string AIAssistant::get_system_context() {
-    // 获取当前目录的文件列表作为上下文
+PromptSection AIAssistant::build_directory_section(const std::string& cwd) {
+    auto snapshot = directory_context_.get(cwd);
+    
+    PromptSection listing;
+    listing.header = "Available files:";
+    listing.priority = 10;
+    for (const auto& entry : snapshot->entries) {
+        listing.items.push_back(DirectoryContext::format_entry(entry));
+    }
+    if (snapshot->truncated) {
+        listing.items.push_back("... (" + std::to_string(snapshot->total_entries - snapshot->entries.size()) +
+                                "+ more entries not shown)");
+    }
+    listing.compact_key = cwd + "\n" + std::to_string(snapshot->generation);
+    listing.compactor = [snapshot](const std::vector<std::string>&) {
+        return DirectoryContext::summarize(*snapshot);
+    };
+    return listing;
+}
+
+void AIAssistant::on_directory_changed(const std::string& cwd) {
+    if (!ai_enabled_) {
+        return;
+    }
+    // 后台低优先级预热，cd 本身不等待扫描
     try {
-        // 使用 shell 执行 ls 命令
-        // 这里简化实现，实际应该通过 shell 的接口获取
-        return "Use 'ls' to see current directory contents";
-    } catch (...) {
-        return "Unable to get directory context";
+        workers_.submit([this, cwd]() { directory_context_.refresh(cwd); }, AIPriority::Low);
+    } catch (const std::exception&) {
+        // 队列已满时下一次查询再扫描
     }
 }
 
 // CommandValidator 实现
-CommandValidator::CommandValidator() {
+CommandValidator::CommandValidator()
+    : safety_engine_(SafetyEngine::shared()), safety_analyzer_(safety_engine_) {
     initialize_dangerous_patterns();
 }
 
 void CommandValidator::initialize_dangerous_patterns() {
-    dangerous_commands_ = {
-        "rm -rf /",
-        "rm -rf /*",
-        "dd if=/dev/zero",
-        "mkfs",
-        "fdisk",
-        "format",
-        "shutdown",
-        "reboot",
-        "halt",
-        "init 0",
-        "kill -9 -1"
-    };
-    
-    dangerous_patterns_ = {
-        "rm -rf",
-        "dd if=",
-        "mkfs.",
-        ":(){ :|:& };:",
-        "chmod -R 777 /",
-        "chown -R"
-    };
-    
+    // 危险命令和模式由共享的 SafetyEngine 统一编译，这里只保留替代建议
     safe_alternatives_ = {
         {"rm -rf /", "Use 'rm -rf directory_name' with specific directory"},
         {"dd if=/dev/zero", "Use 'dd' with specific of= parameter"},
@@ -298,37 +876,31 @@ void CommandValidator::initialize_dangerous_patterns() {
 }
 
 bool CommandValidator::is_safe(const std::string& command) {
-    // 检查完全匹配的危险命令
-    for (const auto& dangerous : dangerous_commands_) {
-        if (command.find(dangerous) != std::string::npos) {
-            return false;
-        }
-    }
-    
-    // 检查危险模式
-    for (const auto& pattern : dangerous_patterns_) {
-        if (command.find(pattern) != std::string::npos) {
-            return false;
-        }
-    }
-    
-    return true;
+    return evaluate(command).safe;
 }
 
 std::string CommandValidator::get_danger_reason(const std::string& command) {
-    for (const auto& dangerous : dangerous_commands_) {
-        if (command.find(dangerous) != std::string::npos) {
-            return "Contains dangerous command: " + dangerous;
-        }
+    SafetyVerdict verdict = evaluate(command);
+    return verdict.safe ? "Command appears safe" : verdict.reason;
+}
+
+SafetyVerdict CommandValidator::evaluate(const std::string& command) {
+    SafetyVerdict verdict = safety_analyzer_.analyze(command);
+    if (!verdict.safe) {
+        return verdict;
     }
     
-    for (const auto& pattern : dangerous_patterns_) {
-        if (command.find(pattern) != std::string::npos) {
-            return "Contains dangerous pattern: " + pattern;
-        }
+    // 严格模式：合并连续空白后再检查可疑模式，避免多余空格绕过
+    std::vector<std::string_view> words;
+    Utils::split_view(command, " \t", words);
+    std::string collapsed = Utils::join(words, " ");
+    SafetyScanResult scan = safety_engine_.scan(collapsed);
+    if (scan.has(SafetyRuleKind::DangerousPattern)) {
+        int rule = scan.first_rule[static_cast<size_t>(SafetyRuleKind::DangerousPattern)];
+        return {false, "Contains dangerous pattern: " + safety_engine_.rule(rule).pattern};
     }
     
-    return "Command appears safe";
+    return {};
 }
 
 std::string CommandValidator::suggest_safer_alternative(const std::string& dangerous_command) {
@@ -343,7 +915,7 @@ std::string CommandValidator::suggest_safer_alternative(const std::string& dange
 
 bool AIAssistant::check_and_handle_ollama_service() {
     // 先尝试连接默认的Ollama服务
-    ollama_ = std::make_unique<OllamaConnector>();
+    ollama_ = make_connector(default_endpoints());
     
     if (ollama_->is_service_available()) {
         std::cout << "✓ Ollama service is running." << std::endl;
@@ -363,7 +935,7 @@ bool AIAssistant::check_and_handle_ollama_service() {
     if (choice == "1") {
         return start_ollama_service();
     } else if (choice == "2") {
-        std::cout << "Enter API endpoint (e.g., http://remote-server:11434): ";
+        std::cout << "Enter API endpoint(s), comma-separated (e.g., http://remote-server:11434): ";
         std::string api_endpoint;
         std::getline(std::cin, api_endpoint);
         return setup_api_mode(api_endpoint);
@@ -409,7 +981,7 @@ bool AIAssistant::setup_api_mode(const std::string& api_endpoint) {
     std::cout << "Testing connection to " << api_endpoint << "..." << std::endl;
     
     // 创建新的connector指向指定端点
-    ollama_ = std::make_unique<OllamaConnector>(api_endpoint);
+    ollama_ = make_connector(api_endpoint);
     
     if (ollama_->is_service_available()) {
         std::cout << "✓ Successfully connected to remote API." << std::endl;
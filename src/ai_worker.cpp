@@ -0,0 +1,96 @@
+#include "ai_worker.h"
+
+namespace NeXShell {
+
+AIWorkerPool::AIWorkerPool(size_t thread_count, size_t queue_capacity)
+    : thread_count_(thread_count == 0 ? 1 : thread_count), queue_capacity_(queue_capacity) {
+}
+
+AIWorkerPool::~AIWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        // 未开始的请求直接丢弃，对应的 future 会得到 broken_promise
+        queue_.clear();
+        low_priority_queue_.clear();
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+size_t AIWorkerPool::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size() + low_priority_queue_.size() + running_;
+}
+
+bool AIWorkerPool::can_run_low_priority() const {
+    size_t limit = thread_count_ > 1 ? thread_count_ - 1 : 1;
+    return !low_priority_queue_.empty() && running_low_priority_ < limit;
+}
+
+bool AIWorkerPool::enqueue(std::function<void()> job, AIPriority priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& queue = priority == AIPriority::Low ? low_priority_queue_ : queue_;
+        if (stopping_ || queue.size() >= queue_capacity_) {
+            return false;
+        }
+
+        // 按需启动工作线程
+        if (workers_.empty()) {
+            for (size_t i = 0; i < thread_count_; ++i) {
+                workers_.emplace_back([this]() { worker_loop(); });
+            }
+        }
+
+        queue.push_back(std::move(job));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void AIWorkerPool::worker_loop() {
+    while (true) {
+        std::function<void()> job;
+        bool low_priority = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stopping_ || !queue_.empty() || can_run_low_priority(); });
+            if (stopping_) {
+                return;
+            }
+            if (!queue_.empty()) {
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            } else {
+                job = std::move(low_priority_queue_.front());
+                low_priority_queue_.pop_front();
+                low_priority = true;
+                ++running_low_priority_;
+            }
+            ++running_;
+        }
+
+        // packaged_task 会把异常保存到 future 中
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --running_;
+            if (low_priority) {
+                --running_low_priority_;
+            }
+        }
+        if (low_priority) {
+            // 其他线程可能在等待低优先级名额
+            cv_.notify_one();
+        }
+    }
+}
+
+} // namespace NeXShell
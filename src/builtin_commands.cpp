@@ -2,14 +2,37 @@
 #include "shell.h"
 #include "ai_assistant.h"
 #include "utils.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "pipe_sizing.h"
+#include "command_executor.h"
+#include "job_cgroup.h"
+#include "command_cache.h"
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
 
 namespace NeXShell {
 
+namespace {
+
+/**
+ * @brief 判断 AI 返回的是错误信息而不是命令
+ */
+bool is_ai_error(const std::string& result) {
+    return result.find("Error") == 0 || result.find("AI Response:") == 0 ||
+           result.find("Unsafe command detected:") == 0 ||
+           result.find("AI features are not available") == 0;
+}
+
+} // namespace
+
 BuiltinCommands::BuiltinCommands(Shell* shell) : shell_(shell) {
     initialize_commands();
 }
@@ -27,6 +50,12 @@ void BuiltinCommands::initialize_commands() {
     commands_["fg"] = [this](const std::vector<std::string>& args) { return cmd_fg(args); };
     commands_["bg"] = [this](const std::vector<std::string>& args) { return cmd_bg(args); };
     commands_["ai"] = [this](const std::vector<std::string>& args) { return cmd_ai(args); };
+    commands_["trace"] = [this](const std::vector<std::string>& args) { return cmd_trace(args); };
+    commands_["stats"] = [this](const std::vector<std::string>& args) { return cmd_stats(args); };
+    commands_["pipesize"] = [this](const std::vector<std::string>& args) { return cmd_pipesize(args); };
+    commands_["parallel"] = [this](const std::vector<std::string>& args) { return cmd_parallel(args); };
+    commands_["limit"] = [this](const std::vector<std::string>& args) { return cmd_limit(args); };
+    commands_["cache"] = [this](const std::vector<std::string>& args) { return cmd_cache(args); };
 }
 
 bool BuiltinCommands::is_builtin(const std::string& command_name) const {
@@ -36,6 +65,7 @@ bool BuiltinCommands::is_builtin(const std::string& command_name) const {
 int BuiltinCommands::execute(const Command& command) {
     auto it = commands_.find(command.program);
     if (it != commands_.end()) {
+        run_in_background_ = command.run_in_background;
         return it->second(command.arguments);
     }
     return 1; // 命令不存在
@@ -91,9 +121,16 @@ int BuiltinCommands::cmd_help(const std::vector<std::string>& args) {
     std::cout << "  echo [text]      - Display text\n";
     std::cout << "  export VAR=value - Set environment variable\n";
     std::cout << "  unset VAR        - Unset environment variable\n";
-    std::cout << "  jobs             - List active jobs\n";
-    std::cout << "  fg [job]         - Bring job to foreground\n";
-    std::cout << "  bg [job]         - Send job to background\n";
+    std::cout << "  jobs [-l]        - List active jobs (-l: pid, limits, cgroup CPU/memory usage)\n";
+    std::cout << "  fg, bg           - Not supported yet: background jobs cannot be resumed or suspended\n";
+    std::cout << "  trace on|off|status|clear|dump FILE - Record per-stage latency (Chrome trace format)\n";
+    std::cout << "  stats [prometheus|write FILE] - Show counters and latency percentiles\n";
+    std::cout << "  pipesize [-v] [SIZE|auto|default] [pipeline] - Show/set pipe capacity, or run one pipeline with it\n";
+    std::cout << "  time [-p|-v|--json|-f FMT] pipeline - Report real/user/sys time, RSS, faults per stage\n";
+    std::cout << "  limit [-c WEIGHT] [-m SIZE] [-p N] [pipeline] | off - Show/set per-job cgroup limits, or run one pipeline with them\n";
+    std::cout << "  parallel [-j N] [-k] [--tag] [--joblog FILE] cmd [::: args] - Run cmd once per argument (or input line), N at a time\n";
+    std::cout << "  cache [--ttl N] [--key-files F...] [--env VAR...] -- cmd - Replay cmd's saved output, or run and save it\n";
+    std::cout << "  cache [stats|evict|clear] - Show cache usage, drop expired/over-size entries, or empty the cache\n";
     std::cout << "\nSupported features:\n";
     std::cout << "  - Pipes (|)\n";
     std::cout << "  - Redirection (>, <, >>)\n";
@@ -161,10 +198,40 @@ int BuiltinCommands::cmd_unset(const std::vector<std::string>& args) {
 }
 
 int BuiltinCommands::cmd_jobs(const std::vector<std::string>& args) {
-    (void)args; // 未使用的参数
+    bool long_format = !args.empty() && args[0] == "-l";
+    
+    // 只列出 & 启动的后台作业和后台 AI 请求；不支持挂起（Ctrl-Z）的作业
+    AIAssistant* ai = shell_->get_ai_assistant();
+    auto requests = ai ? ai->get_background_requests() : std::vector<std::pair<int, std::string>>{};
+    CommandExecutor* executor = shell_->get_executor();
+    size_t process_jobs = executor ? executor->background_jobs().size() : 0;
+    if (requests.empty() && process_jobs == 0) {
+        std::cout << "No active jobs" << std::endl;
+        return 0;
+    }
     
-    // TODO: 实现作业控制
-    std::cout << "No active jobs" << std::endl;
+    for (size_t i = 0; i < process_jobs; ++i) {
+        const auto& job = executor->background_jobs()[i];
+        std::cout << "[" << job.id << "] ";
+        if (long_format) {
+            std::cout << job.pid << " ";
+        }
+        std::cout << "Running " << job.command << std::endl;
+        if (long_format) {
+            if (job.cgroup) {
+                std::cout << "    cgroup " << job.cgroup->path() << "\n";
+                std::cout << "    " << job.cgroup->stats().format() << "\n";
+                if (!job.cgroup->unenforced().empty()) {
+                    std::cout << "    setrlimit fallback: " << job.cgroup->unenforced().describe() << "\n";
+                }
+            }
+            std::cout << "    limits " << job.limits.describe() << std::endl;
+        }
+    }
+    
+    for (const auto& request : requests) {
+        std::cout << "[ai " << request.first << "] Running " << request.second << std::endl;
+    }
     
     return 0;
 }
@@ -172,8 +239,7 @@ int BuiltinCommands::cmd_jobs(const std::vector<std::string>& args) {
 int BuiltinCommands::cmd_fg(const std::vector<std::string>& args) {
     (void)args; // 未使用的参数
     
-    // TODO: 实现前台作业控制
-    std::cout << "fg: no current job" << std::endl;
+    std::cout << "fg: job control is not supported" << std::endl;
     
     return 1;
 }
@@ -181,8 +247,7 @@ int BuiltinCommands::cmd_fg(const std::vector<std::string>& args) {
 int BuiltinCommands::cmd_bg(const std::vector<std::string>& args) {
     (void)args; // 未使用的参数
     
-    // TODO: 实现后台作业控制
-    std::cout << "bg: no current job" << std::endl;
+    std::cout << "bg: job control is not supported" << std::endl;
     
     return 1;
 }
@@ -193,11 +258,14 @@ int BuiltinCommands::cmd_ai(const std::vector<std::string>& args) {
         std::cout << "  ai \"describe what you want to do\"\n";
         std::cout << "  ai explain <command>\n";
         std::cout << "  ai suggest <task>\n";
+        std::cout << "  ai batch <file>          (one task per line)\n";
         std::cout << "  ai status\n";
+        std::cout << "  ai prefetch on|off\n";
+        std::cout << "\nAppend '&' to run a request in the background.\n";
         std::cout << "\nExamples:\n";
         std::cout << "  ai \"find all .txt files in current directory\"\n";
         std::cout << "  ai explain \"ls -la\"\n";
-        std::cout << "  ai suggest \"backup my files\"\n";
+        std::cout << "  ai suggest \"backup my files\" &\n";
         return 0;
     }
     
@@ -208,57 +276,127 @@ int BuiltinCommands::cmd_ai(const std::vector<std::string>& args) {
     }
     
     std::string first_arg = args[0];
+    std::string description = "ai " + Utils::join(args, " ");
     
     if (first_arg == "status") {
         if (ai->is_ai_enabled()) {
             std::cout << "AI Assistant is enabled using model: " << ai->get_current_model() << std::endl;
+            
+            AIUsage last = ai->get_last_usage();
+            AIUsage total = ai->get_total_usage();
+            std::cout << "Last request: " << last.prompt_tokens << " prompt tokens, "
+                      << last.completion_tokens << " completion tokens"
+                      << (last.context_reused ? " (context reused)" : "") << std::endl;
+            std::cout << "Total: " << total.prompt_tokens << " prompt tokens, "
+                      << total.completion_tokens << " completion tokens" << std::endl;
+            
+            auto endpoints = ai->get_endpoint_status();
+            if (endpoints.size() > 1) {
+                std::cout << "Endpoints:" << std::endl;
+                for (const auto& endpoint : endpoints) {
+                    std::cout << "  " << endpoint.url << (endpoint.healthy ? "" : " (backing off)")
+                              << ": " << endpoint.requests << " requests, " << endpoint.failures
+                              << " failures, " << endpoint.in_flight << " in flight, "
+                              << static_cast<int>(endpoint.ewma_ms) << " ms avg" << std::endl;
+                }
+            }
         } else {
             std::cout << "AI Assistant is disabled. Check Ollama service." << std::endl;
         }
+        std::cout << "Answered locally: " << ai->get_local_match_count() << " requests" << std::endl;
+        std::cout << "Explanation prefetch: " << (ai->is_prefetch_enabled() ? "on" : "off")
+                  << ", cache hits: " << ai->get_explanation_cache_hits() << std::endl;
+        std::cout << "Prompt budget: " << ai->get_prompt_budget() << " tokens" << std::endl;
         return 0;
     }
     
+    if (first_arg == "prefetch") {
+        if (args.size() == 2 && (args[1] == "on" || args[1] == "off")) {
+            ai->set_prefetch_enabled(args[1] == "on");
+            return 0;
+        }
+        std::cout << "Usage: ai prefetch on|off" << std::endl;
+        return 1;
+    }
+    
     if (first_arg == "explain" && args.size() > 1) {
         std::string command = Utils::join(std::vector<std::string>(args.begin() + 1, args.end()), " ");
-        std::string explanation = ai->explain_command(command);
-        std::cout << "Explanation: " << explanation << std::endl;
+        auto explain = [ai, command]() {
+            return "Explanation: " + ai->explain_command(command);
+        };
+        
+        if (run_in_background_) {
+            return ai->submit_background_request(description, explain) < 0 ? 1 : 0;
+        }
+        std::cout << explain() << std::endl;
         return 0;
     }
     
     if (first_arg == "suggest" && args.size() > 1) {
         std::string task = Utils::join(std::vector<std::string>(args.begin() + 1, args.end()), " ");
-        auto suggestions = ai->suggest_commands(task);
-        
-        if (suggestions.empty()) {
-            std::cout << "No suggestions available." << std::endl;
-            return 1;
-        }
+        auto suggest = [ai, task]() {
+            auto suggestions = ai->suggest_commands(task);
+            if (suggestions.empty()) {
+                return std::string("No suggestions available.");
+            }
+            
+            std::ostringstream out;
+            out << "Suggested commands for '" << task << "':";
+            for (size_t i = 0; i < suggestions.size(); ++i) {
+                out << "\n  " << (i + 1) << ". " << suggestions[i];
+            }
+            return out.str();
+        };
         
-        std::cout << "Suggested commands for '" << task << "':" << std::endl;
-        for (size_t i = 0; i < suggestions.size(); ++i) {
-            std::cout << "  " << (i + 1) << ". " << suggestions[i] << std::endl;
+        if (run_in_background_) {
+            return ai->submit_background_request(description, suggest) < 0 ? 1 : 0;
         }
-        return 0;
+        std::string output = suggest();
+        std::cout << output << std::endl;
+        return output == "No suggestions available." ? 1 : 0;
+    }
+    
+    if (first_arg == "batch" && args.size() == 2) {
+        return ai_batch(ai, args[1]);
     }
     
     // 默认处理：自然语言命令
     std::string natural_input = Utils::join(args, " ");
+    
+    if (run_in_background_) {
+        // 后台请求无法交互确认，完成后只报告建议的命令
+        std::string cwd = shell_->get_current_directory();
+        return ai->submit_background_request(description, [ai, natural_input, cwd]() {
+            std::string result = ai->process_natural_command(natural_input, cwd);
+            return is_ai_error(result) ? result : "AI suggests: " + result;
+        }) < 0 ? 1 : 0;
+    }
+    
     std::string result = ai->process_natural_command(natural_input);
     
-    if (result.find("Error:") == 0 || result.find("AI Response:") == 0) {
+    if (is_ai_error(result)) {
         std::cout << result << std::endl;
         return 1;
     }
     
     // 如果返回的是一个命令，询问用户是否执行
     std::cout << "AI suggests: " << result << std::endl;
+    AICommandSuggestion details = ai->get_last_suggestion();
+    if (details.command == result && !details.explanation.empty()) {
+        std::cout << "  " << details.explanation;
+        if (!details.risk.empty()) {
+            std::cout << " (risk: " << details.risk << ")";
+        }
+        std::cout << std::endl;
+    }
     std::cout << "Execute this command? [y/N]: ";
     
     std::string response;
     std::getline(std::cin, response);
     
     if (response == "y" || response == "Y" || response == "yes") {
-        // 执行建议的命令
+        // 执行建议的命令，并让本地意图匹配器学习这次映射
+        ai->accept_suggestion(natural_input, result);
         int exit_code = shell_->execute_command(result);
         return exit_code;
     } else {
@@ -267,4 +405,196 @@ int BuiltinCommands::cmd_ai(const std::vector<std::string>& args) {
     }
 }
 
+int BuiltinCommands::cmd_trace(const std::vector<std::string>& args) {
+    std::string action = args.empty() ? "status" : args[0];
+    
+    if (action == "on" || action == "off") {
+        Tracer::set_enabled(action == "on");
+        return 0;
+    }
+    if (action == "status") {
+        std::cout << "Tracing: " << (Tracer::enabled() ? "on" : "off") << ", "
+                  << Tracer::event_count() << " events recorded" << std::endl;
+        return 0;
+    }
+    if (action == "clear") {
+        Tracer::clear();
+        return 0;
+    }
+    if (action == "dump" && args.size() == 2) {
+        std::string path = Utils::expand_tilde(args[1]);
+        if (!Tracer::write_chrome_trace(path)) {
+            std::cerr << "trace: cannot write " << args[1] << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << Tracer::event_count() << " events to " << path
+                  << " (open in chrome://tracing or ui.perfetto.dev)" << std::endl;
+        return 0;
+    }
+    
+    std::cerr << "Usage: trace on|off|status|clear|dump FILE" << std::endl;
+    return 1;
+}
+
+int BuiltinCommands::cmd_pipesize(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        std::cout << "Pipe size: " << PipeSizeSetting::from_environment().describe() << " (default "
+                  << PipeSizer::format_size(static_cast<double>(PipeSizer::default_size())) << ", max "
+                  << PipeSizer::format_size(static_cast<double>(PipeSizer::max_size())) << ")" << std::endl;
+        return 0;
+    }
+    
+    auto setting = args.size() == 1 ? PipeSizeSetting::parse(args[0]) : std::nullopt;
+    if (!setting) {
+        std::cerr << "Usage: pipesize [-v] [SIZE|auto|default] [pipeline]" << std::endl;
+        return 1;
+    }
+    if (setting->mode == PipeSizeSetting::Mode::Fixed && setting->bytes > PipeSizer::max_size()) {
+        std::cerr << "pipesize: " << args[0] << " exceeds /proc/sys/fs/pipe-max-size ("
+                  << PipeSizer::max_size() << "), pipes will be capped" << std::endl;
+    }
+    shell_->set_environment_variable("NEXSH_PIPE_SIZE", args[0]);
+    return 0;
+}
+
+int BuiltinCommands::cmd_parallel(const std::vector<std::string>& args) {
+    // 在管道中时由 CommandExecutor 作为进程内阶段运行；这里直接使用 shell 的标准输入输出
+    return CommandExecutor(shell_).execute_parallel(args, STDIN_FILENO, STDOUT_FILENO);
+}
+
+int BuiltinCommands::cmd_limit(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        JobLimits limits = JobLimits::from_environment();
+        const std::string& base = JobCgroup::base_path();
+        std::cout << "Job limits: " << limits.describe() << std::endl;
+        if (!JobCgroup::enabled(limits)) {
+            std::cout << "Job cgroups: off (set NEXSH_JOB_CGROUPS=1 or a limit to enable)" << std::endl;
+        } else if (base.empty()) {
+            std::cout << "Job cgroups: cgroup v2 not available, limits use setrlimit" << std::endl;
+        } else {
+            std::cout << "Job cgroups: " << base << " (controllers: "
+                      << (JobCgroup::controllers().empty() ? "none" : Utils::join(JobCgroup::controllers(), " "))
+                      << ")" << std::endl;
+        }
+        return 0;
+    }
+    
+    if (args.size() == 1 && args[0] == "off") {
+        for (const char* name : {"NEXSH_JOB_CPU_WEIGHT", "NEXSH_JOB_MEMORY_MAX", "NEXSH_JOB_PIDS_MAX"}) {
+            shell_->set_environment_variable(name, "");
+        }
+        return 0;
+    }
+    
+    // 只有选项：设置之后所有作业的默认限制
+    JobLimits limits;
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size() || !limits.set_option(args[i], args[i + 1])) {
+            std::cerr << "Usage: limit [-c WEIGHT(1-10000)] [-m SIZE[K|M|G]] [-p N] [pipeline] | limit off" << std::endl;
+            return 1;
+        }
+        const char* name = args[i] == "-c" ? "NEXSH_JOB_CPU_WEIGHT" : args[i] == "-m" ? "NEXSH_JOB_MEMORY_MAX" : "NEXSH_JOB_PIDS_MAX";
+        shell_->set_environment_variable(name, args[i + 1]);
+    }
+    return 0;
+}
+
+int BuiltinCommands::cmd_cache(const std::vector<std::string>& args) {
+    CommandCache cache;
+    if (args.empty() || (args.size() == 1 && args[0] == "stats")) {
+        CacheStats stats = cache.stats();
+        const Metrics& metrics = Metrics::instance();
+        std::cout << "Cache: " << cache.directory() << "\n"
+                  << "  entries " << stats.entries << " (" << stats.expired << " expired), blobs " << stats.blobs
+                  << ", " << PipeSizer::format_size(static_cast<double>(stats.bytes)) << " of "
+                  << PipeSizer::format_size(static_cast<double>(CommandCache::default_max_bytes())) << "\n"
+                  << "  this session: " << metrics.command_cache_hits.value() << " hits, "
+                  << metrics.command_cache_misses.value() << " misses" << std::endl;
+        return 0;
+    }
+    if (args.size() == 1 && (args[0] == "evict" || args[0] == "clear")) {
+        size_t removed = cache.evict(args[0] == "clear");
+        std::cout << "cache: removed " << removed << " entr" << (removed == 1 ? "y" : "ies") << std::endl;
+        return 0;
+    }
+    
+    // 在管道中时由 CommandExecutor 作为进程内阶段运行；这里直接写到 shell 的标准输出
+    std::cout.flush();
+    return CommandExecutor(shell_).execute_cached(args, STDOUT_FILENO);
+}
+
+int BuiltinCommands::cmd_stats(const std::vector<std::string>& args) {
+    const Metrics& metrics = Metrics::instance();
+    
+    if (args.empty()) {
+        std::cout << metrics.to_table();
+        return 0;
+    }
+    if (args[0] == "prometheus" && args.size() == 1) {
+        std::cout << metrics.to_prometheus();
+        return 0;
+    }
+    if (args[0] == "write" && args.size() == 2) {
+        std::string path = Utils::expand_tilde(args[1]);
+        if (!metrics.write_textfile(path)) {
+            std::cerr << "stats: cannot write " << args[1] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    std::cerr << "Usage: stats [prometheus|write FILE]" << std::endl;
+    return 1;
+}
+
+int BuiltinCommands::ai_batch(AIAssistant* ai, const std::string& path) {
+    std::ifstream file(Utils::expand_tilde(path));
+    if (!file) {
+        std::cerr << "ai batch: cannot open " << path << std::endl;
+        return 1;
+    }
+    
+    // 每行一个任务，忽略空行和注释
+    std::vector<std::string> intents;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = Utils::trim(line);
+        if (!line.empty() && line[0] != '#') {
+            intents.push_back(line);
+        }
+    }
+    if (intents.empty()) {
+        std::cout << "ai batch: no tasks in " << path << std::endl;
+        return 1;
+    }
+    if (run_in_background_) {
+        std::cout << "ai batch: runs in the foreground" << std::endl;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    auto results = ai->suggest_commands_batch(intents);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    size_t answered = 0;
+    for (size_t i = 0; i < intents.size(); ++i) {
+        std::cout << intents[i] << ":" << std::endl;
+        if (results[i].empty()) {
+            std::cout << "  (no suggestions)" << std::endl;
+            continue;
+        }
+        ++answered;
+        for (size_t j = 0; j < results[i].size(); ++j) {
+            std::cout << "  " << (j + 1) << ". " << results[i][j] << std::endl;
+        }
+    }
+    
+    // 在局部流中格式化，不改变 std::cout 的精度
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(2)
+            << "Processed " << intents.size() << " tasks in " << seconds << "s ("
+            << (seconds > 0 ? intents.size() / seconds : 0.0) << " tasks/sec)";
+    std::cout << summary.str() << std::endl;
+    return answered == intents.size() ? 0 : 1;
+}
+
 } // namespace NeXShell
@@ -0,0 +1,565 @@
+#include "command_cache.h"
+#include "job_cgroup.h"
+#include "passthrough.h"
+#include "utils.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+namespace NeXShell {
+
+namespace {
+
+constexpr const char* ENTRY_MAGIC = "nexsh-cache 1";
+
+// 写到一半的 blob 在被记录引用之前不会被淘汰
+constexpr int64_t BLOB_GRACE_SECONDS = 60;
+
+// 异常退出留下的临时文件
+constexpr int64_t TMP_MAX_AGE_SECONDS = 3600;
+
+/**
+ * @brief 流式的 128 位哈希（MurmurHash3 x64_128），用于缓存键和内容寻址
+ */
+class Hasher {
+public:
+    void update(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        length_ += size;
+        if (tail_size_ > 0) {
+            size_t take = std::min(size, sizeof(tail_) - tail_size_);
+            std::memcpy(tail_ + tail_size_, bytes, take);
+            tail_size_ += take;
+            bytes += take;
+            size -= take;
+            if (tail_size_ < sizeof(tail_)) {
+                return;
+            }
+            block(tail_);
+            tail_size_ = 0;
+        }
+        for (; size >= sizeof(tail_); bytes += sizeof(tail_), size -= sizeof(tail_)) {
+            block(bytes);
+        }
+        std::memcpy(tail_, bytes, size);
+        tail_size_ = size;
+    }
+
+    /**
+     * @brief 加入一个字段，以 NUL 结尾，避免相邻字段拼接后产生歧义
+     */
+    void field(const std::string& text) {
+        update(text.c_str(), text.size() + 1);
+    }
+
+    std::string hex() {
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        for (size_t i = tail_size_; i > 8; --i) {
+            k2 = (k2 << 8) | tail_[i - 1];
+        }
+        for (size_t i = std::min<size_t>(tail_size_, 8); i > 0; --i) {
+            k1 = (k1 << 8) | tail_[i - 1];
+        }
+        if (tail_size_ > 8) {
+            h2_ ^= rotl(k2 * C2, 33) * C1;
+        }
+        if (tail_size_ > 0) {
+            h1_ ^= rotl(k1 * C1, 31) * C2;
+        }
+        h1_ ^= length_;
+        h2_ ^= length_;
+        h1_ += h2_;
+        h2_ += h1_;
+        h1_ = mix(h1_);
+        h2_ = mix(h2_);
+        h1_ += h2_;
+        h2_ += h1_;
+
+        char text[33];
+        std::snprintf(text, sizeof(text), "%016llx%016llx",
+                      static_cast<unsigned long long>(h1_), static_cast<unsigned long long>(h2_));
+        return text;
+    }
+
+private:
+    static constexpr uint64_t C1 = 0x87c37b91114253d5ull;
+    static constexpr uint64_t C2 = 0x4cf5ad432745937full;
+
+    static uint64_t rotl(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t mix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void block(const uint8_t* data) {
+        uint64_t k1;
+        uint64_t k2;
+        std::memcpy(&k1, data, 8);
+        std::memcpy(&k2, data + 8, 8);
+        h1_ ^= rotl(k1 * C1, 31) * C2;
+        h1_ = (rotl(h1_, 27) + h2_) * 5 + 0x52dce729;
+        h2_ ^= rotl(k2 * C2, 33) * C1;
+        h2_ = (rotl(h2_, 31) + h1_) * 5 + 0x38495ab5;
+    }
+
+    uint64_t h1_ = 0;
+    uint64_t h2_ = 0;
+    uint8_t tail_[16];
+    size_t tail_size_ = 0;
+    uint64_t length_ = 0;
+};
+
+/**
+ * @brief 哈希描述符的全部内容（从头读取，不改变读写位置）
+ * @return 读取失败时为空
+ */
+std::string hash_fd(int fd) {
+    Hasher hasher;
+    std::vector<char> buffer(1 << 20);
+    off_t offset = 0;
+    for (;;) {
+        ssize_t n = pread(fd, buffer.data(), buffer.size(), offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return "";
+        }
+        if (n == 0) {
+            return hasher.hex();
+        }
+        hasher.update(buffer.data(), static_cast<size_t>(n));
+        offset += n;
+    }
+}
+
+bool make_directory(const std::string& path) {
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+/**
+ * @brief 列出目录中的普通文件名（跳过 . 开头的项）
+ */
+std::vector<std::string> list_directory(const std::string& path) {
+    std::vector<std::string> names;
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return names;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+std::optional<CacheEntry> read_entry(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != ENTRY_MAGIC) {
+        return std::nullopt;
+    }
+    CacheEntry entry;
+    size_t fields = 0;
+    while (std::getline(file, line)) {
+        size_t space = line.find(' ');
+        std::string name = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        std::istringstream in(value);
+        if (name == "exit") {
+            fields += static_cast<bool>(in >> entry.exit_code);
+        } else if (name == "created") {
+            fields += static_cast<bool>(in >> entry.created);
+        } else if (name == "expires") {
+            fields += static_cast<bool>(in >> entry.expires);
+        } else if (name == "stdout") {
+            fields += static_cast<bool>(in >> entry.stdout_blob >> entry.stdout_size);
+        } else if (name == "stderr") {
+            fields += static_cast<bool>(in >> entry.stderr_blob >> entry.stderr_size);
+        } else if (name == "command") {
+            entry.command = value;
+        }
+    }
+    if (fields != 5) {
+        return std::nullopt;
+    }
+    return entry;
+}
+
+bool is_expired(const CacheEntry& entry, int64_t now) {
+    return entry.expires != 0 && now >= entry.expires;
+}
+
+} // namespace
+
+std::optional<CacheOptions> CacheOptions::parse(const std::vector<std::string>& args, std::string& error) {
+    CacheOptions options;
+    std::vector<std::string>* list = nullptr;
+    size_t i = 0;
+    for (; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "--") {
+            ++i;
+            break;
+        }
+        if (arg == "--ttl") {
+            char* end = nullptr;
+            long long ttl = i + 1 < args.size() ? std::strtoll(args[i + 1].c_str(), &end, 10) : -1;
+            if (ttl < 0 || !end || *end != '\0') {
+                error = "--ttl needs a number of seconds";
+                return std::nullopt;
+            }
+            options.ttl_seconds = ttl;
+            ++i;
+            list = nullptr;
+        } else if (arg == "--key-files") {
+            list = &options.key_files;
+        } else if (arg == "--env") {
+            list = &options.key_env;
+        } else if (list && !(arg.size() > 1 && arg[0] == '-')) {
+            list->push_back(arg);
+        } else {
+            error = "unknown option: " + arg;
+            return std::nullopt;
+        }
+    }
+    options.command.assign(args.begin() + static_cast<std::ptrdiff_t>(i), args.end());
+    if (options.command.empty()) {
+        error = "missing command after --";
+        return std::nullopt;
+    }
+    return options;
+}
+
+std::string CacheOptions::command_line() const {
+    std::string line;
+    for (const auto& word : command) {
+        if (!line.empty()) {
+            line += ' ';
+        }
+        line += Utils::quote_argument(word).value_or("'" + word + "'");
+    }
+    return line;
+}
+
+const std::vector<std::string>& CommandCache::default_key_env() {
+    static const std::vector<std::string> names = {"PATH", "LANG", "LC_ALL"};
+    return names;
+}
+
+CommandCache::CommandCache(std::string directory, uint64_t max_bytes)
+    : directory_(std::move(directory)), max_bytes_(max_bytes) {}
+
+std::string CommandCache::default_directory() {
+    const char* configured = getenv("NEXSH_CACHE_DIR");
+    if (configured && *configured) {
+        return configured;
+    }
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home) {
+        return std::string(cache_home) + "/nexsh/commands";
+    }
+    const char* home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/nexsh/commands";
+}
+
+uint64_t CommandCache::default_max_bytes() {
+    const char* configured = getenv("NEXSH_CACHE_MAX_SIZE");
+    std::optional<uint64_t> size = configured ? JobLimits::parse_size(configured) : std::nullopt;
+    return size ? *size : 256ull << 20;
+}
+
+std::string CommandCache::entry_path(const std::string& key) const {
+    return directory_ + "/entries/" + key;
+}
+
+std::string CommandCache::blob_path(const std::string& hash) const {
+    return directory_ + "/blobs/" + hash;
+}
+
+std::string CommandCache::key(const CacheOptions& options, const std::string& cwd) const {
+    Hasher hasher;
+    hasher.field(ENTRY_MAGIC);
+    hasher.field(std::to_string(options.command.size()));
+    for (const auto& word : options.command) {
+        hasher.field(word);
+    }
+    hasher.field(cwd);
+
+    std::vector<std::string> names = default_key_env();
+    names.insert(names.end(), options.key_env.begin(), options.key_env.end());
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (const auto& name : names) {
+        // 未设置和设置为空是不同的
+        const char* value = getenv(name.c_str());
+        hasher.field(value ? name + "=" + value : name);
+    }
+
+    // 普通文件按内容，目录和很大的文件按 mtime、大小和 inode
+    for (const auto& file : options.key_files) {
+        hasher.field(file);
+        struct stat st;
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            hasher.field("missing");
+        } else if (S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) <= MAX_HASHED_FILE) {
+            hasher.field("content " + hash_fd(fd));
+        } else {
+            hasher.field("stat " + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) +
+                         " " + std::to_string(st.st_size) + " " + std::to_string(st.st_ino));
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return hasher.hex();
+}
+
+std::optional<CacheEntry> CommandCache::lookup(const std::string& key, int64_t ttl_seconds) const {
+    std::string path = entry_path(key);
+    std::optional<CacheEntry> entry = read_entry(path);
+    if (!entry) {
+        return std::nullopt;
+    }
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    if (is_expired(*entry, now) || (ttl_seconds > 0 && now - entry->created >= ttl_seconds)) {
+        return std::nullopt;
+    }
+    // blob 可能已被另一个 shell 淘汰
+    struct stat st;
+    if (stat(blob_path(entry->stdout_blob).c_str(), &st) != 0 || static_cast<uint64_t>(st.st_size) != entry->stdout_size ||
+        stat(blob_path(entry->stderr_blob).c_str(), &st) != 0 || static_cast<uint64_t>(st.st_size) != entry->stderr_size) {
+        return std::nullopt;
+    }
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    return entry;
+}
+
+int CommandCache::replay(const CacheEntry& entry, int output_fd, int error_fd) const {
+    std::pair<const std::string*, int> outputs[] = {{&entry.stdout_blob, output_fd}, {&entry.stderr_blob, error_fd}};
+    for (const auto& [hash, target] : outputs) {
+        int fd = open(blob_path(*hash).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        bool fallback = false;
+        int error = 0;
+        for (;;) {
+            ssize_t n = sendfile(target, fd, nullptr, 1 << 30);
+            if (n > 0) {
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                error = errno;
+                // 目标不支持 sendfile（例如 O_APPEND 文件）时退回到通用的搬运
+                fallback = error == EINVAL || error == ENOSYS;
+            }
+            break;
+        }
+        if (fallback) {
+            error = PassthroughStage::transfer(fd, target) < 0 ? errno : 0;
+        }
+        close(fd);
+        if (error != 0) {
+            return error;
+        }
+    }
+    return 0;
+}
+
+int CommandCache::create_capture() const {
+    std::string tmp = directory_ + "/tmp";
+    // 逐级创建缓存目录（通常是 ~/.cache/nexsh/commands）
+    for (size_t slash = 1; (slash = directory_.find('/', slash)) != std::string::npos; ++slash) {
+        make_directory(directory_.substr(0, slash));
+    }
+    if (!make_directory(directory_) || !make_directory(directory_ + "/entries") ||
+        !make_directory(directory_ + "/blobs") || !make_directory(tmp)) {
+        return -1;
+    }
+
+    int fd = open(tmp.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+    // 文件系统不支持 O_TMPFILE
+    std::string name = tmp + "/capture.XXXXXX";
+    fd = mkostemp(name.data(), O_CLOEXEC);
+    if (fd >= 0) {
+        unlink(name.c_str());
+    }
+    return fd;
+}
+
+std::string CommandCache::store_blob(int fd, uint64_t& size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return "";
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    std::string hash = hash_fd(fd);
+    if (hash.empty()) {
+        return "";
+    }
+    std::string path = blob_path(hash);
+    if (access(path.c_str(), F_OK) == 0) {
+        // 相同的内容已经存在；更新 mtime，避免在记录写入之前被当作孤立的 blob 删除
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        return hash;
+    }
+
+    // O_TMPFILE 创建的文件可以直接链接进 blobs/；否则复制一份
+    std::string proc_path = "/proc/self/fd/" + std::to_string(fd);
+    if (linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, path.c_str(), AT_SYMLINK_FOLLOW) == 0 || errno == EEXIST) {
+        return hash;
+    }
+    std::string tmp = directory_ + "/tmp/blob.XXXXXX";
+    int copy = mkostemp(tmp.data(), O_CLOEXEC);
+    if (copy < 0) {
+        return "";
+    }
+    bool copied = lseek(fd, 0, SEEK_SET) == 0 && PassthroughStage::transfer(fd, copy) == st.st_size;
+    close(copy);
+    if (!copied || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return "";
+    }
+    return hash;
+}
+
+bool CommandCache::store(const std::string& key, const CacheOptions& options, int exit_code, int stdout_fd, int stderr_fd) {
+    CacheEntry entry;
+    entry.exit_code = exit_code;
+    entry.created = static_cast<int64_t>(std::time(nullptr));
+    entry.expires = options.ttl_seconds > 0 ? entry.created + options.ttl_seconds : 0;
+    entry.stdout_blob = store_blob(stdout_fd, entry.stdout_size);
+    entry.stderr_blob = store_blob(stderr_fd, entry.stderr_size);
+    if (entry.stdout_blob.empty() || entry.stderr_blob.empty()) {
+        return false;
+    }
+
+    // 先写临时文件再 rename，并发的查找不会读到一半的记录
+    std::string tmp = directory_ + "/tmp/entry.XXXXXX";
+    int fd = mkostemp(tmp.data(), O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::ostringstream text;
+    text << ENTRY_MAGIC << "\n"
+         << "exit " << entry.exit_code << "\n"
+         << "created " << entry.created << "\n"
+         << "expires " << entry.expires << "\n"
+         << "stdout " << entry.stdout_blob << " " << entry.stdout_size << "\n"
+         << "stderr " << entry.stderr_blob << " " << entry.stderr_size << "\n"
+         << "command " << options.command_line() << "\n";
+    std::string content = text.str();
+    bool written = write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size());
+    close(fd);
+    if (!written || rename(tmp.c_str(), entry_path(key).c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t CommandCache::evict(bool all) {
+    struct Candidate {
+        std::string path;
+        int64_t used;
+        uint64_t bytes;
+        std::string stdout_blob;
+        std::string stderr_blob;
+    };
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    size_t removed = 0;
+    std::vector<Candidate> kept;
+    uint64_t total = 0;
+    for (const auto& name : list_directory(directory_ + "/entries")) {
+        std::string path = entry_path(name);
+        std::optional<CacheEntry> entry = read_entry(path);
+        struct stat st;
+        if (all || !entry || is_expired(*entry, now) || stat(path.c_str(), &st) != 0) {
+            removed += unlink(path.c_str()) == 0;
+            continue;
+        }
+        kept.push_back({path, static_cast<int64_t>(st.st_mtime), entry->stdout_size + entry->stderr_size,
+                        entry->stdout_blob, entry->stderr_blob});
+        total += kept.back().bytes;
+    }
+
+    // 最久没有命中的记录先淘汰
+    std::sort(kept.begin(), kept.end(), [](const Candidate& a, const Candidate& b) { return a.used < b.used; });
+    size_t first_kept = 0;
+    while (total > max_bytes_ && first_kept < kept.size()) {
+        total -= kept[first_kept].bytes;
+        removed += unlink(kept[first_kept].path.c_str()) == 0;
+        ++first_kept;
+    }
+
+    std::unordered_set<std::string> referenced;
+    for (size_t i = first_kept; i < kept.size(); ++i) {
+        referenced.insert(kept[i].stdout_blob);
+        referenced.insert(kept[i].stderr_blob);
+    }
+    for (const auto& name : list_directory(directory_ + "/blobs")) {
+        std::string path = blob_path(name);
+        struct stat st;
+        if (!referenced.count(name) && stat(path.c_str(), &st) == 0 && (all || now - st.st_mtime >= BLOB_GRACE_SECONDS)) {
+            unlink(path.c_str());
+        }
+    }
+    for (const auto& name : list_directory(directory_ + "/tmp")) {
+        std::string path = directory_ + "/tmp/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && now - st.st_mtime >= TMP_MAX_AGE_SECONDS) {
+            unlink(path.c_str());
+        }
+    }
+    return removed;
+}
+
+CacheStats CommandCache::stats() const {
+    CacheStats stats;
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    for (const auto& name : list_directory(directory_ + "/entries")) {
+        std::optional<CacheEntry> entry = read_entry(entry_path(name));
+        if (entry) {
+            ++stats.entries;
+            stats.expired += is_expired(*entry, now);
+        }
+    }
+    for (const auto& name : list_directory(directory_ + "/blobs")) {
+        struct stat st;
+        if (stat(blob_path(name).c_str(), &st) == 0) {
+            ++stats.blobs;
+            stats.bytes += static_cast<uint64_t>(st.st_size);
+        }
+    }
+    return stats;
+}
+
+} // namespace NeXShell
@@ -1,13 +1,25 @@
 #include "command_executor.h"
 #include "shell.h"
 #include "builtin_commands.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "passthrough.h"
+#include "parallel_runner.h"
+#include "fork_server.h"
+#include "command_cache.h"
 #include <iostream>
+#include <fstream>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <cerrno>
 #include <cstring>
 #include <vector>
 #include <memory>
+#include <future>
 
 namespace NeXShell {
 
@@ -19,13 +31,47 @@ int CommandExecutor::execute_pipeline(const Pipeline& pipeline) {
         return 0;
     }
     
+    if (pipeline.commands[0].program == "time") {
+        return execute_timed(pipeline);
+    }
+    
+    if (pipeline.commands[0].program == "pipesize") {
+        return execute_with_pipe_size(pipeline);
+    }
+    
+    if (pipeline.commands[0].program == "limit") {
+        return execute_with_limits(pipeline);
+    }
+    
+    // 启用作业 cgroup 或设置了限制时，整个管道放进同一个 cgroup 叶子节点；
+    // 只有内建命令的单个命令不创建子进程，跳过
+    JobLimits limits = job_limits_override_ ? *job_limits_override_ : JobLimits::from_environment();
+    bool place = !job_placed_ && JobCgroup::enabled(limits) &&
+                 (pipeline.commands.size() > 1 || !BuiltinCommands(shell_).is_builtin(pipeline.commands[0].program));
+    if (place) {
+        job_limits_ = limits;
+        job_cgroup_ = JobCgroup::create(limits);
+        job_placed_ = true;
+    }
+    
+    int exit_code;
     if (pipeline.commands.size() == 1) {
-        // 单个命令
-        return execute_command(pipeline.commands[0]);
+        // 单个命令（解析器把后台标志放在管道上）
+        Command command = pipeline.commands[0];
+        command.run_in_background = pipeline.run_in_background;
+        exit_code = execute_command(command);
+    } else {
+        // 管道命令
+        exit_code = create_pipeline(pipeline);
     }
     
-    // 管道命令
-    return create_pipeline(pipeline);
+    if (place) {
+        // 前台作业已全部回收，删除 cgroup；后台作业已接管它
+        job_cgroup_.reset();
+        job_limits_ = JobLimits{};
+        job_placed_ = false;
+    }
+    return exit_code;
 }
 
 int CommandExecutor::execute_command(const Command& command) {
@@ -35,7 +81,14 @@ int CommandExecutor::execute_command(const Command& command) {
     
     // 检查是否为内建命令
     BuiltinCommands builtin(shell_);
-    if (builtin.is_builtin(command.program)) {
+    bool is_builtin;
+    {
+        TraceScope trace("exec", "builtin_lookup", command.program);
+        is_builtin = builtin.is_builtin(command.program);
+    }
+    if (is_builtin) {
+        TraceScope trace("exec", "builtin", command.program);
+        Metrics::instance().builtins.inc();
         return builtin.execute(command);
     }
     
@@ -43,7 +96,12 @@ int CommandExecutor::execute_command(const Command& command) {
     int input_fd = -1;
     int output_fd = -1;
     
-    if (!setup_redirections(command, input_fd, output_fd)) {
+    bool redirected;
+    {
+        TraceScope trace("exec", "redirect");
+        redirected = setup_redirections(command, input_fd, output_fd);
+    }
+    if (!redirected) {
         return 1;
     }
     
@@ -58,8 +116,18 @@ int CommandExecutor::execute_command(const Command& command) {
     }
     
     if (command.run_in_background) {
-        background_processes_.push_back(pid);
-        std::cout << "[" << background_processes_.size() << "] " << pid << std::endl;
+        // 作业号取现有最大号加一，作业结束前不会改变
+        BackgroundJob job;
+        job.id = background_jobs_.empty() ? 1 : background_jobs_.back().id + 1;
+        job.pid = pid;
+        job.command = command.program;
+        for (const auto& arg : command.arguments) {
+            job.command += " " + arg;
+        }
+        job.cgroup = std::move(job_cgroup_);
+        job.limits = job_limits_;
+        std::cout << "[" << job.id << "] " << pid << std::endl;
+        background_jobs_.push_back(std::move(job));
         return 0;
     } else {
         return wait_for_process(pid);
@@ -99,15 +167,66 @@ bool CommandExecutor::setup_redirections(const Command& command, int& input_fd,
 pid_t CommandExecutor::execute_external_program(const Command& command, 
                                                int input_fd, 
                                                int output_fd) {
-    pid_t pid = fork();
+    // 跟踪时用 CLOEXEC 管道测量 fork 到 exec 成功的时间：exec 后写端关闭，父进程读到 EOF
+    int exec_pipe[2] = {-1, -1};
+    bool tracing = Tracer::enabled() && pipe2(exec_pipe, O_CLOEXEC) == 0;
+    uint64_t fork_start = tracing ? Tracer::now_ns() : 0;
+    
+    // 在父进程中查找，缓存才能跨命令保留
+    std::string resolved = resolve_program(command.program);
+    
+    // 有 fork server 时由它 fork+exec，开销不随 shell 的内存增长；跟踪 fork/exec 阶段
+    // 和放入作业 cgroup 时仍在这里 fork
+    ForkServer* server = shell_ ? shell_->get_fork_server() : nullptr;
+    if (server && !tracing && !job_placed_ && (!resolved.empty() || command.program.find('/') != std::string::npos)) {
+        SpawnRequest request;
+        request.path = resolved;
+        request.argv.push_back(command.program);
+        request.argv.insert(request.argv.end(), command.arguments.begin(), command.arguments.end());
+        request.cwd = shell_->get_current_directory();
+        request.stdin_fd = input_fd != -1 ? input_fd : STDIN_FILENO;
+        request.stdout_fd = output_fd != -1 ? output_fd : STDOUT_FILENO;
+        auto spawn_begin = std::chrono::steady_clock::now();
+        pid_t pid = server->spawn(request);
+        if (pid > 0) {
+            Metrics& metrics = Metrics::instance();
+            metrics.forks.inc();
+            metrics.fork_latency.record_ns(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - spawn_begin).count()));
+            if (!command.run_in_background) {
+                process_starts_[pid] = {command.program, std::chrono::steady_clock::now()};
+            }
+            return pid;
+        }
+    }
+    
+    // 参数和错误信息在父进程中准备好：clone3 创建的子进程不经过 glibc 的 fork 处理，
+    // 在 exec 之前不能再分配内存
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(command.program.c_str()));
+    for (const auto& arg : command.arguments) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    std::string exec_error = "execvp " + command.program;
+    
+    auto fork_begin = std::chrono::steady_clock::now();
+    pid_t pid = job_placed_ ? JobCgroup::spawn(job_cgroup_.get(), job_limits_) : fork();
     
     if (pid < 0) {
         perror("fork");
+        if (tracing) {
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+        }
         return -1;
     }
     
     if (pid == 0) {
         // 子进程
+        if (tracing) {
+            close(exec_pipe[0]);
+        }
         
         // 设置输入重定向
         if (input_fd != -1) {
@@ -127,39 +246,74 @@ pid_t CommandExecutor::execute_external_program(const Command& command,
             close(output_fd);
         }
         
-        // 准备参数
-        std::vector<char*> argv;
-        argv.push_back(const_cast<char*>(command.program.c_str()));
-        
-        for (const auto& arg : command.arguments) {
-            argv.push_back(const_cast<char*>(arg.c_str()));
+        // 执行程序；缓存的路径失效（如程序被删除）时退回到 execvp
+        if (!resolved.empty()) {
+            execv(resolved.c_str(), argv.data());
         }
-        argv.push_back(nullptr);
-        
-        // 执行程序
         execvp(command.program.c_str(), argv.data());
         
         // 如果执行到这里，说明 execvp 失败了
-        perror(("execvp " + command.program).c_str());
+        perror(exec_error.c_str());
         _exit(127);
     }
     
+    Metrics& metrics = Metrics::instance();
+    metrics.forks.inc();
+    metrics.fork_latency.record_ns(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - fork_begin).count()));
+    
+    if (!command.run_in_background) {
+        process_starts_[pid] = {command.program, std::chrono::steady_clock::now()};
+    }
+    
+    if (tracing) {
+        uint64_t forked = Tracer::now_ns();
+        Tracer::record("exec", "fork", fork_start, forked, command.program);
+        close(exec_pipe[1]);
+        char byte;
+        while (read(exec_pipe[0], &byte, 1) < 0 && errno == EINTR) {
+        }
+        close(exec_pipe[0]);
+        Tracer::record("exec", "exec", forked, Tracer::now_ns(), command.program);
+    }
+    
     return pid;
 }
 
 int CommandExecutor::create_pipeline(const Pipeline& pipeline) {
+    TraceScope trace("exec", "pipeline");
     std::vector<pid_t> pids;
     std::vector<int> pipe_fds;
+    std::vector<std::future<int>> passthrough_results;
+    bool last_is_passthrough = false;
+    bool zero_copy = PassthroughStage::enabled();
+    std::vector<pid_t> stage_pids(pipeline.commands.size(), -1);
+    
+    // 管道容量：pipesize 前缀优先，其次 $NEXSH_PIPE_SIZE
+    PipeSizeSetting sizing = pipe_size_override_ ? *pipe_size_override_ : PipeSizeSetting::from_environment();
+    std::vector<PipeReport> pipe_reports;
+    std::vector<ino_t> pipe_inodes;
     
-    // 创建管道
+    // 创建管道；CLOEXEC 保证每个子进程只保留 dup2 到标准输入输出的那一端，
+    // 否则下游进程会持有自己输入管道的写端而永远读不到 EOF
     for (size_t i = 0; i < pipeline.commands.size() - 1; ++i) {
         int pipefd[2];
-        if (pipe(pipefd) < 0) {
+        if (pipe2(pipefd, O_CLOEXEC) < 0) {
             perror("pipe");
             return 1;
         }
         pipe_fds.push_back(pipefd[0]); // 读端
         pipe_fds.push_back(pipefd[1]); // 写端
+        
+        PipeReport report;
+        report.writer = pipeline.commands[i].program;
+        report.reader = pipeline.commands[i + 1].program;
+        report.initial_bytes = sizing.mode == PipeSizeSetting::Mode::Fixed
+                             ? PipeSizer::resize(pipefd[1], sizing.bytes) : PipeSizer::default_size();
+        report.final_bytes = report.initial_bytes;
+        pipe_reports.push_back(report);
+        struct stat st;
+        pipe_inodes.push_back(fstat(pipefd[0], &st) == 0 ? st.st_ino : 0);
     }
     
     // 启动每个命令
@@ -180,33 +334,76 @@ int CommandExecutor::create_pipeline(const Pipeline& pipeline) {
             output_fd = pipe_fds[i * 2 + 1];
         }
         
-        // 检查是否为内建命令
+        // 检查是否为内建命令（parallel 和 cache 除外，它们在下面作为进程内阶段运行）
         BuiltinCommands builtin(shell_);
-        if (builtin.is_builtin(cmd.program)) {
+        if (builtin.is_builtin(cmd.program) && cmd.program != "parallel" && cmd.program != "cache") {
             // 内建命令不能很好地处理管道，暂时跳过
             std::cerr << "Built-in commands in pipelines not fully supported" << std::endl;
             continue;
         }
         
         // 设置重定向（只对第一个和最后一个命令有效）
+        int redirect_in = -1;
+        int redirect_out = -1;
         if (i == 0 && cmd.input_file.has_value()) {
-            input_fd = open(cmd.input_file->c_str(), O_RDONLY);
+            redirect_in = input_fd = open(cmd.input_file->c_str(), O_RDONLY | O_CLOEXEC);
         }
         
         if (i == pipeline.commands.size() - 1 && cmd.output_file.has_value()) {
-            int flags = O_WRONLY | O_CREAT;
+            int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
             if (cmd.append_output) {
                 flags |= O_APPEND;
             } else {
                 flags |= O_TRUNC;
             }
-            output_fd = open(cmd.output_file->c_str(), flags, 0644);
+            redirect_out = output_fd = open(cmd.output_file->c_str(), flags, 0644);
         }
         
-        pid_t pid = execute_external_program(cmd, input_fd, output_fd);
-        if (pid > 0) {
-            pids.push_back(pid);
+        // cat、tee 这类直通阶段在 shell 内用 splice/tee 搬运数据，不 fork。
+        // 输入是终端时（cat | grep x）仍然 fork：进程内阶段会阻塞 shell 线程，Ctrl-C 也中断不了它
+        std::optional<PassthroughStage> passthrough;
+        if (zero_copy && !isatty(input_fd != -1 ? input_fd : STDIN_FILENO)) {
+            passthrough = PassthroughStage::detect(cmd);
         }
+        if (passthrough || cmd.program == "parallel" || cmd.program == "cache") {
+            // 线程持有自己的副本，结束时关闭它们，下游才能读到 EOF
+            int stage_in = fcntl(input_fd != -1 ? input_fd : STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+            int stage_out = fcntl(output_fd != -1 ? output_fd : STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+            if (passthrough) {
+                passthrough_results.push_back(std::async(std::launch::async, [stage = *passthrough, stage_in, stage_out]() {
+                    int code = stage.run(stage_in, stage_out);
+                    close(stage_in);
+                    close(stage_out);
+                    return code;
+                }));
+            } else if (cmd.program == "cache") {
+                // cache 的命令不读取输入（标准输入为 /dev/null），输出写到下游
+                close(stage_in);
+                passthrough_results.push_back(std::async(std::launch::async, [shell = shell_, args = cmd.arguments, stage_out]() {
+                    int code = CommandExecutor(shell).execute_cached(args, stage_out);
+                    close(stage_out);
+                    return code;
+                }));
+            } else {
+                // parallel 从上游逐行读取参数；用独立的执行器，不与本线程共享 PATH 缓存
+                passthrough_results.push_back(std::async(std::launch::async, [shell = shell_, args = cmd.arguments, stage_in, stage_out]() {
+                    int code = CommandExecutor(shell).execute_parallel(args, stage_in, stage_out);
+                    close(stage_in);
+                    close(stage_out);
+                    return code;
+                }));
+            }
+            last_is_passthrough = i == pipeline.commands.size() - 1;
+        } else {
+            pid_t pid = execute_external_program(cmd, input_fd, output_fd);
+            if (pid > 0) {
+                pids.push_back(pid);
+                stage_pids[i] = pid;
+            }
+        }
+        
+        if (redirect_in != -1) close(redirect_in);
+        if (redirect_out != -1) close(redirect_out);
     }
     
     // 关闭所有管道文件描述符
@@ -214,52 +411,468 @@ int CommandExecutor::create_pipeline(const Pipeline& pipeline) {
         close(fd);
     }
     
+    // 自适应模式或需要报告时，在等待期间采样各管道的积压量
+    std::optional<PipeMonitor> monitor;
+    if (sizing.mode == PipeSizeSetting::Mode::Adaptive || pipe_size_report_) {
+        monitor.emplace(sizing.mode == PipeSizeSetting::Mode::Adaptive);
+        for (size_t i = 0; i < pipe_reports.size(); ++i) {
+            monitor->watch(pipe_reports[i], stage_pids[i + 1], pipe_inodes[i]);
+        }
+        monitor->start();
+    }
+    auto started = std::chrono::steady_clock::now();
+    
     // 等待所有进程完成
     int last_exit_code = 0;
+    std::vector<StageThroughput> throughput;
     for (pid_t pid : pids) {
+        if (pipe_size_report_) {
+            // 先不回收，读取僵尸进程的 /proc/<pid>/io 得到写出的字节数
+            siginfo_t info;
+            while (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) {
+            }
+            StageThroughput stage;
+            stage.program = process_starts_.count(pid) ? process_starts_[pid].program : "";
+            stage.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+            std::string key;
+            while (io >> key >> stage.bytes_written && key != "wchar:") {
+            }
+            throughput.push_back(stage);
+        }
         int exit_code = wait_for_process(pid);
         last_exit_code = exit_code; // 使用最后一个命令的退出码
     }
     
+    if (monitor) {
+        pipe_reports = monitor->stop();
+    }
+    if (pipe_size_report_) {
+        std::cerr << PipeMonitor::format(sizing, pipe_reports, throughput);
+    }
+    
+    for (auto& result : passthrough_results) {
+        int exit_code = result.get();
+        if (last_is_passthrough) {
+            last_exit_code = exit_code;
+        }
+    }
+    
     return last_exit_code;
 }
 
 int CommandExecutor::wait_for_process(pid_t pid) {
+    TraceScope trace("exec", "wait");
     int status;
-    if (waitpid(pid, &status, 0) < 0) {
+    struct rusage rusage;
+    pid_t reaped;
+    while ((reaped = wait4(pid, &status, 0, &rusage)) < 0 && errno == EINTR) {
+    }
+    
+    ProcessUsage usage;
+    usage.pid = pid;
+    auto start = process_starts_.find(pid);
+    if (start != process_starts_.end()) {
+        usage.program = start->second.program;
+        usage.real_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start->second.start).count();
+        process_starts_.erase(start);
+    }
+    
+    if (reaped < 0) {
         perror("waitpid");
         return 1;
     }
     
+    int exit_code = 1;
     if (WIFEXITED(status)) {
-        return WEXITSTATUS(status);
+        exit_code = WEXITSTATUS(status);
     } else if (WIFSIGNALED(status)) {
-        return 128 + WTERMSIG(status);
+        exit_code = 128 + WTERMSIG(status);
+    }
+    
+    usage.set_rusage(rusage);
+    usage.exit_code = exit_code;
+    if (recording_usage_) {
+        reaped_usage_.push_back(std::move(usage));
+    }
+    return exit_code;
+}
+
+std::string CommandExecutor::resolve_program(const std::string& program) {
+    if (program.empty() || program.find('/') != std::string::npos) {
+        return "";
+    }
+    
+    const char* path_env = getenv("PATH");
+    std::string path = path_env ? path_env : "";
+    if (path != path_cache_env_) {
+        path_cache_.clear();
+        path_cache_env_ = path;
+    }
+    
+    Metrics& metrics = Metrics::instance();
+    auto it = path_cache_.find(program);
+    if (it != path_cache_.end()) {
+        metrics.path_cache_hits.inc();
+        return it->second;
+    }
+    metrics.path_cache_misses.inc();
+    
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find(':', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        // 空的或相对的 PATH 项依赖当前目录，交给 execvp 且不缓存
+        if (end == start || path[start] != '/') {
+            return "";
+        }
+        {
+            std::string candidate = path.substr(start, end - start) + "/" + program;
+            struct stat info;
+            if (stat(candidate.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+                path_cache_[program] = candidate;
+                return candidate;
+            }
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+int CommandExecutor::execute_timed(const Pipeline& pipeline) {
+    // 解析 time 自己的选项，剩下的参数成为第一个命令
+    Pipeline timed = pipeline;
+    Command& first = timed.commands[0];
+    TimeOptions options;
+    size_t index = 0;
+    for (; index < first.arguments.size(); ++index) {
+        const std::string& arg = first.arguments[index];
+        if (arg == "-p") {
+            options.posix = true;
+        } else if (arg == "-v") {
+            options.verbose = true;
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "-f" && index + 1 < first.arguments.size()) {
+            options.has_format = true;
+            options.format = first.arguments[++index];
+        } else if (arg == "--") {
+            ++index;
+            break;
+        } else {
+            break;
+        }
     }
+    std::vector<std::string> rest(first.arguments.begin() + static_cast<std::ptrdiff_t>(index), first.arguments.end());
+    first.program = rest.empty() ? "" : rest.front();
+    first.arguments = rest.empty() ? rest : std::vector<std::string>(rest.begin() + 1, rest.end());
     
-    return 1;
+    if (!options.has_format && !options.posix) {
+        const char* timeformat = getenv("TIMEFORMAT");
+        if (timeformat) {
+            options.has_format = true;
+            options.format = timeformat;
+        }
+    }
+    if (timed.run_in_background) {
+        std::cerr << "time: background jobs are not timed" << std::endl;
+        return execute_pipeline(timed);
+    }
+    
+    struct rusage self_before;
+    getrusage(RUSAGE_SELF, &self_before);
+    reaped_usage_.clear();
+    bool was_recording = recording_usage_;
+    recording_usage_ = true;
+    auto start = std::chrono::steady_clock::now();
+    
+    int exit_code = execute_pipeline(timed);
+    recording_usage_ = was_recording;
+    
+    ProcessUsage total;
+    total.program = "total";
+    total.real_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    total.exit_code = exit_code;
+    std::vector<ProcessUsage> stages = std::move(reaped_usage_);
+    reaped_usage_.clear();
+    if (stages.empty()) {
+        // 只有内建命令时报告 shell 自身的用量
+        struct rusage self_after;
+        getrusage(RUSAGE_SELF, &self_after);
+        ProcessUsage before;
+        ProcessUsage after;
+        before.set_rusage(self_before);
+        after.set_rusage(self_after);
+        total.user_ms = after.user_ms - before.user_ms;
+        total.sys_ms = after.sys_ms - before.sys_ms;
+        total.minor_faults = after.minor_faults - before.minor_faults;
+        total.major_faults = after.major_faults - before.major_faults;
+        total.voluntary_switches = after.voluntary_switches - before.voluntary_switches;
+        total.involuntary_switches = after.involuntary_switches - before.involuntary_switches;
+        total.max_rss_kb = after.max_rss_kb;
+    }
+    for (const auto& stage : stages) {
+        total.accumulate(stage);
+    }
+    
+    if (options.json) {
+        std::cerr << TimeReport::json(stages, total) << std::endl;
+        return exit_code;
+    }
+    if (options.verbose || stages.size() > 1) {
+        std::cerr << TimeReport::table(stages, total);
+    }
+    std::string format = options.has_format ? options.format
+                       : options.posix ? TimeReport::POSIX_FORMAT : TimeReport::DEFAULT_FORMAT;
+    if (options.verbose && !options.has_format) {
+        format += "\nmaxrss\t%M KB\nfaults\t%F major, %f minor\nswitch\t%w voluntary, %c involuntary";
+    }
+    // 与 bash 相同：TIMEFORMAT 为空时不输出
+    if (!format.empty()) {
+        std::cerr << TimeReport::format(format, total) << std::endl;
+    }
+    return exit_code;
+}
+
+int CommandExecutor::execute_with_pipe_size(const Pipeline& pipeline) {
+    const Command& first = pipeline.commands[0];
+    size_t index = 0;
+    bool report = false;
+    if (index < first.arguments.size() && first.arguments[index] == "-v") {
+        report = true;
+        ++index;
+    }
+    // 省略大小时使用全局设置（例如 pipesize -v pipeline 只要报告）
+    std::optional<PipeSizeSetting> setting;
+    if (index < first.arguments.size()) {
+        setting = PipeSizeSetting::parse(first.arguments[index]);
+        if (setting) {
+            ++index;
+        }
+    }
+    
+    // 没有跟随命令：pipesize 内建命令负责显示或设置全局值
+    if (index >= first.arguments.size() && pipeline.commands.size() == 1) {
+        return execute_command(first);
+    }
+    if (!setting && !report) {
+        return execute_command(first);
+    }
+    
+    Pipeline sized = pipeline;
+    Command& command = sized.commands[0];
+    std::vector<std::string> rest(first.arguments.begin() + static_cast<std::ptrdiff_t>(index), first.arguments.end());
+    command.program = rest.empty() ? "" : rest.front();
+    command.arguments = rest.empty() ? rest : std::vector<std::string>(rest.begin() + 1, rest.end());
+    
+    pipe_size_override_ = setting ? setting : PipeSizeSetting::from_environment();
+    pipe_size_report_ = report;
+    int exit_code = execute_pipeline(sized);
+    pipe_size_override_.reset();
+    pipe_size_report_ = false;
+    return exit_code;
+}
+
+int CommandExecutor::execute_parallel(const std::vector<std::string>& args, int input_fd, int output_fd) {
+    std::string error;
+    std::optional<ParallelOptions> options = ParallelOptions::parse(args, error);
+    if (!options) {
+        std::cerr << "parallel: " << error << std::endl;
+        std::cerr << "Usage: parallel [-j N] [-k] [--tag] [--joblog FILE] command [::: arg...]" << std::endl;
+        return 1;
+    }
+    
+    TraceScope trace("exec", "parallel", options->command_template);
+    ParallelRunner runner(std::move(*options), [this](const std::string& command, int output_fd, int error_fd) {
+        return spawn_job(command, output_fd, error_fd);
+    });
+    return runner.run(input_fd, output_fd);
+}
+
+int CommandExecutor::execute_cached(const std::vector<std::string>& args, int output_fd) {
+    std::string error;
+    std::optional<CacheOptions> options = CacheOptions::parse(args, error);
+    if (!options) {
+        std::cerr << "cache: " << error << std::endl;
+        std::cerr << "Usage: cache [--ttl SECONDS] [--key-files FILE...] [--env VAR...] -- command..." << std::endl;
+        return 1;
+    }
+    
+    TraceScope trace("exec", "cache", options->command_line());
+    SigpipeGuard guard;
+    CommandCache cache;
+    std::string key = cache.key(*options, shell_ ? shell_->get_current_directory() : ".");
+    Metrics& metrics = Metrics::instance();
+    if (std::optional<CacheEntry> entry = cache.lookup(key, options->ttl_seconds)) {
+        metrics.command_cache_hits.inc();
+        int replayed = cache.replay(*entry, output_fd, STDERR_FILENO);
+        if (replayed == EPIPE) {
+            return 128 + SIGPIPE;
+        }
+        return replayed == 0 ? entry->exit_code : 1;
+    }
+    metrics.command_cache_misses.inc();
+    
+    // 输出先写入捕获文件，命令结束后保存并回放；缓存目录不可用时直接执行
+    int captured_out = cache.create_capture();
+    int captured_err = captured_out >= 0 ? cache.create_capture() : -1;
+    bool capturing = captured_err >= 0;
+    if (!capturing && captured_out >= 0) {
+        close(captured_out);
+    }
+    Pipeline job;
+    job.commands.emplace_back();
+    job.commands[0].program = options->command.front();
+    job.commands[0].arguments.assign(options->command.begin() + 1, options->command.end());
+    pid_t pid = spawn_job(job, capturing ? captured_out : output_fd, capturing ? captured_err : STDERR_FILENO);
+    int exit_code = pid > 0 ? wait_for_process(pid) : 127;
+    if (!capturing) {
+        return exit_code;
+    }
+    
+    // 被信号终止（例如 Ctrl+C）和命令无法执行（126、127）的结果不保存
+    if (pid > 0 && exit_code <= 128 && exit_code != 126 && exit_code != 127) {
+        if (cache.store(key, *options, exit_code, captured_out, captured_err)) {
+            cache.evict();
+        }
+    }
+    int replayed = 0;
+    for (auto [fd, target] : {std::pair<int, int>{captured_out, output_fd}, {captured_err, STDERR_FILENO}}) {
+        if (replayed == 0 && lseek(fd, 0, SEEK_SET) == 0 && PassthroughStage::transfer(fd, target) < 0) {
+            replayed = errno;
+        }
+        close(fd);
+    }
+    return replayed == EPIPE ? 128 + SIGPIPE : exit_code;
+}
+
+pid_t CommandExecutor::spawn_job(const std::string& command_line, int output_fd, int error_fd) {
+    Pipeline pipeline;
+    try {
+        pipeline = CommandParser().parse(command_line);
+    } catch (const std::exception& e) {
+        std::cerr << "nexsh: " << command_line << ": " << e.what() << std::endl;
+        return -1;
+    }
+    return spawn_job(pipeline, output_fd, error_fd);
+}
+
+pid_t CommandExecutor::spawn_job(const Pipeline& pipeline, int output_fd, int error_fd) {
+    if (pipeline.commands.empty() || pipeline.commands[0].program.empty()) {
+        return -1;
+    }
+    
+    // 最常见的情况（单个外部命令）省掉中间的子 shell
+    const Command& first = pipeline.commands[0];
+    bool direct = pipeline.commands.size() == 1 && !pipeline.run_in_background &&
+                  !first.input_file && !first.output_file &&
+                  first.program != "time" && first.program != "pipesize" &&
+                  !BuiltinCommands(shell_).is_builtin(first.program);
+    std::string resolved = direct ? resolve_program(first.program) : "";
+    
+    auto fork_begin = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            close(null_fd);
+        }
+        if (dup2(output_fd, STDOUT_FILENO) < 0 || dup2(error_fd, STDERR_FILENO) < 0) {
+            _exit(1);
+        }
+        
+        if (!direct) {
+            // 子 shell 不 exec，关掉继承的其它描述符（例如其它作业或管道阶段的管道），
+            // 以免它们的读者迟迟等不到 EOF
+#ifdef SYS_close_range
+            syscall(SYS_close_range, 3, ~0U, 0);
+#endif
+            int exit_code = CommandExecutor(shell_).execute_pipeline(pipeline);
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(exit_code);
+        }
+        
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(first.program.c_str()));
+        for (const auto& arg : first.arguments) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        if (!resolved.empty()) {
+            execv(resolved.c_str(), argv.data());
+        }
+        execvp(first.program.c_str(), argv.data());
+        perror(("execvp " + first.program).c_str());
+        _exit(127);
+    }
+    
+    Metrics& metrics = Metrics::instance();
+    metrics.forks.inc();
+    metrics.fork_latency.record_ns(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - fork_begin).count()));
+    return pid;
+}
+
+int CommandExecutor::execute_with_limits(const Pipeline& pipeline) {
+    const Command& first = pipeline.commands[0];
+    JobLimits limits = JobLimits::from_environment();
+    size_t index = 0;
+    while (index + 1 < first.arguments.size() && limits.set_option(first.arguments[index], first.arguments[index + 1])) {
+        index += 2;
+    }
+    
+    // 没有跟随命令或选项无效：limit 内建命令负责显示、设置默认值和报告错误
+    if (index >= first.arguments.size() || first.arguments[index].empty() || first.arguments[index][0] == '-' ||
+        (index == 0 && first.arguments.size() == 1 && first.arguments[0] == "off")) {
+        return execute_command(first);
+    }
+    
+    Pipeline limited = pipeline;
+    Command& command = limited.commands[0];
+    std::vector<std::string> rest(first.arguments.begin() + static_cast<std::ptrdiff_t>(index), first.arguments.end());
+    command.program = rest.front();
+    command.arguments.assign(rest.begin() + 1, rest.end());
+    
+    job_limits_override_ = limits;
+    int exit_code = execute_pipeline(limited);
+    job_limits_override_.reset();
+    return exit_code;
 }
 
 void CommandExecutor::wait_for_background_processes() {
-    for (pid_t pid : background_processes_) {
-        waitpid(pid, nullptr, 0);
+    for (const auto& job : background_jobs_) {
+        waitpid(job.pid, nullptr, 0);
     }
-    background_processes_.clear();
+    background_jobs_.clear();
 }
 
 void CommandExecutor::cleanup_background_processes() {
-    auto it = background_processes_.begin();
-    while (it != background_processes_.end()) {
+    auto it = background_jobs_.begin();
+    while (it != background_jobs_.end()) {
         int status;
-        pid_t result = waitpid(*it, &status, WNOHANG);
+        pid_t result = waitpid(it->pid, &status, WNOHANG);
         
         if (result > 0) {
-            // 进程已完成
-            std::cout << "[Done] Process " << *it << " finished" << std::endl;
-            it = background_processes_.erase(it);
+            // 进程已完成；有 cgroup 时附上整个作业的用量
+            std::cout << "[" << it->id << "] Done    " << it->command;
+            if (it->cgroup) {
+                std::cout << ": " << it->cgroup->stats().format();
+            }
+            std::cout << std::endl;
+            it = background_jobs_.erase(it);
         } else if (result < 0) {
             // 错误或进程不存在
-            it = background_processes_.erase(it);
+            it = background_jobs_.erase(it);
         } else {
             // 进程仍在运行
             ++it;
@@ -13,11 +13,26 @@ Pipeline CommandParser::parse(const std::string& input) {
         return pipeline;
     }
     
-    // 简单实现：先按 | 分割，然后解析每个命令
-    std::vector<std::string> pipe_parts = Utils::split(input, '|');
+    // 先按引号外的 | 分割，然后解析每个命令（分割结果是 input 的视图）
+    std::vector<std::string_view> pipe_parts;
+    std::string_view rest(input);
+    char quote_char = '\0';
+    size_t part_start = 0;
+    for (size_t i = 0; i < rest.size(); ++i) {
+        char c = rest[i];
+        if (quote_char != '\0') {
+            quote_char = c == quote_char ? '\0' : quote_char;
+        } else if (c == '"' || c == '\'') {
+            quote_char = c;
+        } else if (c == '|') {
+            pipe_parts.push_back(rest.substr(part_start, i - part_start));
+            part_start = i + 1;
+        }
+    }
+    pipe_parts.push_back(rest.substr(part_start));
     
     for (size_t i = 0; i < pipe_parts.size(); ++i) {
-        std::string cmd_str = trim(pipe_parts[i]);
+        std::string_view cmd_str = Utils::trim_view(pipe_parts[i]);
         if (!cmd_str.empty()) {
             std::vector<std::string> tokens = tokenize(cmd_str);
             if (!tokens.empty()) {
@@ -41,14 +56,14 @@ Pipeline CommandParser::parse(const std::string& input) {
 }
 
 bool CommandParser::is_empty(const std::string& input) {
-    return trim(input).empty();
+    return Utils::trim_view(input).empty();
 }
 
 std::string CommandParser::trim(const std::string& str) {
     return Utils::trim(str);
 }
 
-std::vector<std::string> CommandParser::tokenize(const std::string& input) {
+std::vector<std::string> CommandParser::tokenize(std::string_view input) {
     std::vector<std::string> tokens;
     std::string current_token;
     bool in_quotes = false;
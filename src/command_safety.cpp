@@ -0,0 +1,626 @@
+#include "command_safety.h"
+#include "utils.h"
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NeXShell {
+
+namespace {
+
+// 递归分析 sh -c 等嵌套命令的最大深度
+constexpr int kMaxNestingDepth = 4;
+
+// 删除其中任何内容都视为危险的目录
+constexpr std::array<std::string_view, 14> kCriticalTrees = {
+    "/bin", "/sbin", "/lib", "/lib32", "/lib64", "/libx32", "/boot", "/etc",
+    "/usr/bin", "/usr/sbin", "/usr/lib", "/usr/lib64", "/usr/libexec", "/usr/include"
+};
+
+// 仅目录本身视为危险的目录（其中的普通文件可以操作）
+constexpr std::array<std::string_view, 12> kCriticalRoots = {
+    "/usr", "/usr/local", "/usr/share", "/var", "/home", "/opt",
+    "/root", "/srv", "/mnt", "/media", "/proc", "/sys"
+};
+
+// /dev 下允许写入的设备
+constexpr std::array<std::string_view, 9> kSafeDevices = {
+    "/dev/null", "/dev/zero", "/dev/full", "/dev/random", "/dev/urandom",
+    "/dev/tty", "/dev/stdin", "/dev/stdout", "/dev/stderr"
+};
+
+// 无论参数如何都拒绝执行的程序
+constexpr std::array<std::string_view, 13> kDestructivePrograms = {
+    "mke2fs", "mkswap", "fdisk", "sfdisk", "cfdisk", "gdisk", "parted",
+    "wipefs", "format", "shutdown", "reboot", "halt", "poweroff"
+};
+
+template<size_t N>
+bool contains(const std::array<std::string_view, N>& list, std::string_view value) {
+    return std::find(list.begin(), list.end(), value) != list.end();
+}
+
+std::string basename_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool is_shell(const std::string& program) {
+    return program == "sh" || program == "bash" || program == "zsh" ||
+           program == "dash" || program == "ksh";
+}
+
+/**
+ * @brief 跳过 sudo、env、xargs 等包装程序，返回真正执行的 argv 起点
+ */
+size_t skip_wrappers(const std::vector<std::string>& argv) {
+    size_t i = 0;
+    while (i < argv.size()) {
+        std::string program = basename_of(argv[i]);
+        std::string_view value_options;
+
+        if (program == "sudo" || program == "doas") {
+            value_options = "ugCprthU";
+        } else if (program == "env") {
+            value_options = "uC";
+        } else if (program == "nice") {
+            value_options = "n";
+        } else if (program == "xargs") {
+            value_options = "IindLsPaE";
+        } else if (program == "timeout") {
+            value_options = "sk";
+        } else if (program == "nohup" || program == "time" || program == "command" ||
+                   program == "exec" || program == "stdbuf" || program == "ionice") {
+            value_options = "";
+        } else {
+            break;
+        }
+
+        ++i;
+        while (i < argv.size()) {
+            const std::string& arg = argv[i];
+            if (arg == "--") {
+                ++i;
+                break;
+            }
+            if (program == "env" && arg.find('=') != std::string::npos && arg[0] != '-') {
+                ++i;
+                continue;
+            }
+            if (arg.size() < 2 || arg[0] != '-') {
+                break;
+            }
+            // 形如 "-u root" 的选项需要额外跳过取值
+            bool takes_value = arg.size() == 2 && arg[1] != '-' &&
+                               value_options.find(arg[1]) != std::string_view::npos;
+            i += takes_value ? 2 : 1;
+        }
+
+        // timeout 的第一个操作数是时长
+        if (program == "timeout" && i < argv.size()) {
+            ++i;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief 用安全引擎中的文本规则检查命令
+ */
+SafetyVerdict check_text_rules(const SafetyEngine& engine, const std::string& command) {
+    SafetyScanResult scan = engine.scan(command);
+    if (scan.has(SafetyRuleKind::DangerousCommand)) {
+        int rule = scan.first_rule[static_cast<size_t>(SafetyRuleKind::DangerousCommand)];
+        return {false, "Contains dangerous command: " + engine.rule(rule).pattern};
+    }
+    return {};
+}
+
+/**
+ * @brief 用原来的子串规则检查无法解析的内嵌 shell 文本
+ */
+SafetyVerdict check_nested_rules(const SafetyEngine& engine, const std::string& command) {
+    SafetyScanResult scan = engine.scan(command);
+    if (scan.has(SafetyRuleKind::NestedCommand)) {
+        int rule = scan.first_rule[static_cast<size_t>(SafetyRuleKind::NestedCommand)];
+        return {false, "Nested shell command contains: " + engine.rule(rule).pattern};
+    }
+    if (scan.has(SafetyRuleKind::RecursiveRemove) && scan.has(SafetyRuleKind::RootGlob)) {
+        return {false, "Nested shell command recursively removes from the root directory"};
+    }
+    if (scan.has(SafetyRuleKind::RemoveCommand) && scan.has(SafetyRuleKind::CriticalPath)) {
+        int rule = scan.first_rule[static_cast<size_t>(SafetyRuleKind::CriticalPath)];
+        return {false, "Nested shell command removes from system path: " + engine.rule(rule).pattern};
+    }
+    return {};
+}
+
+/**
+ * @brief 把 sh -c 的文本按引号外的 ;、&&、||、& 和换行拆成简单命令
+ * @return 含有无法静态分析的语法（未闭合的引号、命令替换、子 shell、
+ *         控制结构）时为空
+ */
+std::optional<std::vector<std::string>> split_command_list(const std::string& text) {
+    static const std::array<std::string_view, 16> keywords = {
+        "if", "then", "else", "elif", "fi", "for", "while", "until",
+        "do", "done", "case", "esac", "function", "{", "}", "!"
+    };
+
+    std::vector<std::string> parts;
+    std::string current;
+    auto finish = [&]() {
+        std::string part = Utils::trim(current);
+        current.clear();
+        if (part.empty()) {
+            return true;
+        }
+        std::string first = part.substr(0, part.find_first_of(" \t"));
+        if (contains(keywords, first)) {
+            return false;
+        }
+        parts.push_back(std::move(part));
+        return true;
+    };
+
+    char quote = '\0';
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        char next = i + 1 < text.size() ? text[i + 1] : '\0';
+        if (quote == '\'') {
+            quote = c == '\'' ? '\0' : quote;
+            current += c;
+            continue;
+        }
+        if (c == '`' || (c == '$' && next == '(')) {
+            return std::nullopt;
+        }
+        if (c == '\\' && next != '\0') {
+            current += c;
+            current += next;
+            ++i;
+            continue;
+        }
+        if (quote == '"') {
+            quote = c == '"' ? '\0' : quote;
+            current += c;
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            quote = c;
+            current += c;
+        } else if (c == '(' || c == ')') {
+            return std::nullopt;
+        } else if (c == ';' || c == '\n' || (c == '|' && next == '|') ||
+                   (c == '&' && next != '>' && (i == 0 || (text[i - 1] != '>' && text[i - 1] != '<' &&
+                                                           text[i - 1] != '|')))) {
+            if (!finish()) {
+                return std::nullopt;
+            }
+            // && 和 || 占两个字符
+            if ((c == '&' || c == '|') && next == c) {
+                ++i;
+            }
+        } else {
+            current += c;
+        }
+    }
+    if (quote != '\0' || !finish()) {
+        return std::nullopt;
+    }
+    return parts;
+}
+
+} // namespace
+
+CommandSafetyAnalyzer::CommandSafetyAnalyzer(const SafetyEngine& engine) : engine_(engine) {
+}
+
+SafetyVerdict CommandSafetyAnalyzer::analyze(const std::string& command, const std::string& cwd) {
+    std::string directory = cwd.empty() ? Utils::get_absolute_path(".") : cwd;
+
+    // 文本规则（如 fork bomb）无法从语法树中识别，先扫描原始文本
+    SafetyVerdict text_verdict = check_text_rules(engine_, command);
+    if (!text_verdict.safe) {
+        return text_verdict;
+    }
+
+    CommandParser parser;
+    Pipeline pipeline = parser.parse(command);
+    std::string key = cache_key(pipeline, directory);
+
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+        ++cache_hits_;
+        return it->second;
+    }
+
+    SafetyVerdict verdict = analyze_pipeline(pipeline, directory, 0);
+
+    if (cache_.size() >= MAX_CACHE_SIZE) {
+        cache_.clear();
+    }
+    cache_.emplace(std::move(key), verdict);
+    return verdict;
+}
+
+std::string CommandSafetyAnalyzer::normalize(const Pipeline& pipeline) {
+    std::vector<std::string> parts;
+    for (const auto& command : pipeline.commands) {
+        NormalizedCommand normalized = normalize_command(command);
+        std::vector<std::string> words = {normalized.program};
+        words.insert(words.end(), normalized.flags.begin(), normalized.flags.end());
+        words.insert(words.end(), normalized.operands.begin(), normalized.operands.end());
+        if (command.input_file.has_value()) {
+            words.push_back("<" + *command.input_file);
+        }
+        if (command.output_file.has_value()) {
+            words.push_back((command.append_output ? ">>" : ">") + *command.output_file);
+        }
+        parts.push_back(Utils::join(words, " "));
+    }
+    return Utils::join(parts, " | ");
+}
+
+std::string CommandSafetyAnalyzer::cache_key(const Pipeline& pipeline, const std::string& cwd) {
+    // 每个字段带类型标记和长度前缀：引号中的 ">/etc/passwd" 或 "a | b"
+    // 只能是普通参数，不会与真正的重定向或管道产生相同的键
+    std::string key;
+    auto field = [&key](char tag, const std::string& value) {
+        key += tag;
+        key += std::to_string(value.size());
+        key += ':';
+        key += value;
+    };
+
+    field('d', cwd);
+    for (const auto& command : pipeline.commands) {
+        NormalizedCommand normalized = normalize_command(command);
+        field('p', normalized.program);
+        for (const auto& flag : normalized.flags) {
+            field('f', flag);
+        }
+        for (const auto& operand : normalized.operands) {
+            field('o', operand);
+        }
+        if (command.input_file.has_value()) {
+            field('<', *command.input_file);
+        }
+        if (command.output_file.has_value()) {
+            field(command.append_output ? 'a' : '>', *command.output_file);
+        }
+        key += '|';
+    }
+    return key;
+}
+
+CommandSafetyAnalyzer::NormalizedCommand
+CommandSafetyAnalyzer::normalize_command(const Command& command) {
+    std::vector<std::string> full = {command.program};
+    full.insert(full.end(), command.arguments.begin(), command.arguments.end());
+
+    NormalizedCommand result;
+    size_t start = skip_wrappers(full);
+    if (start >= full.size()) {
+        return result;
+    }
+
+    result.program = basename_of(full[start]);
+    result.argv.assign(full.begin() + static_cast<std::ptrdiff_t>(start) + 1, full.end());
+
+    // find、dd、kill 的参数语法特殊，不做选项展开
+    bool cluster = result.program != "find" && result.program != "dd" && result.program != "kill";
+    bool options_done = false;
+    for (const auto& arg : result.argv) {
+        if (options_done || arg.size() < 2 || arg[0] != '-' || !cluster) {
+            result.operands.push_back(arg);
+        } else if (arg == "--") {
+            options_done = true;
+        } else if (arg[1] == '-') {
+            result.flags.push_back(arg.substr(0, arg.find('=')));
+        } else {
+            // 合并的短选项："-rf" -> "-r" "-f"
+            for (size_t i = 1; i < arg.size(); ++i) {
+                result.flags.push_back(std::string("-") + arg[i]);
+            }
+        }
+    }
+
+    std::sort(result.flags.begin(), result.flags.end());
+    result.flags.erase(std::unique(result.flags.begin(), result.flags.end()), result.flags.end());
+    return result;
+}
+
+SafetyVerdict CommandSafetyAnalyzer::analyze_text(const std::string& command,
+                                                  const std::string& cwd, int depth) {
+    SafetyVerdict text_verdict = check_text_rules(engine_, command);
+    if (!text_verdict.safe) {
+        return text_verdict;
+    }
+
+    // CommandParser 只理解管道，先按命令列表拆开再逐个按 argv 规则分析；
+    // 无法解析的文本一律拒绝，旧的子串黑名单只用来给出更具体的原因
+    std::optional<std::vector<std::string>> parts = split_command_list(command);
+    if (!parts.has_value()) {
+        text_verdict = check_nested_rules(engine_, command);
+        if (!text_verdict.safe) {
+            return text_verdict;
+        }
+        return {false, "Nested shell command is too complex to verify"};
+    }
+
+    CommandParser parser;
+    std::string directory = cwd;
+    for (const auto& part : *parts) {
+        Pipeline pipeline = parser.parse(part);
+        SafetyVerdict verdict = analyze_pipeline(pipeline, directory, depth);
+        if (!verdict.safe) {
+            return verdict;
+        }
+
+        // 后面的命令在 cd 之后的目录中执行
+        if (pipeline.commands.size() == 1 && (pipeline.commands[0].program == "cd" ||
+                                              pipeline.commands[0].program == "pushd")) {
+            const auto& arguments = pipeline.commands[0].arguments;
+            if (arguments.empty()) {
+                directory = Utils::get_absolute_path(Utils::get_home_directory());
+            } else if (arguments.size() == 1 && !arguments[0].empty() && arguments[0][0] != '-' &&
+                       arguments[0].find('$') == std::string::npos) {
+                directory = resolve_path(arguments[0], directory);
+            } else {
+                return {false, "Nested shell command changes to an unknown directory"};
+            }
+        }
+    }
+    return {};
+}
+
+SafetyVerdict CommandSafetyAnalyzer::analyze_pipeline(const Pipeline& pipeline,
+                                                      const std::string& cwd, int depth) {
+    for (const auto& command : pipeline.commands) {
+        // 检查重定向目标
+        if (command.output_file.has_value()) {
+            std::string target = resolve_path(*command.output_file, cwd);
+            if (is_critical_path(target)) {
+                return {false, "Redirects output to system path: " + target};
+            }
+        }
+
+        SafetyVerdict verdict = analyze_command(normalize_command(command), cwd, depth);
+        if (!verdict.safe) {
+            return verdict;
+        }
+    }
+    return {};
+}
+
+SafetyVerdict CommandSafetyAnalyzer::analyze_command(const NormalizedCommand& command,
+                                                     const std::string& cwd, int depth) {
+    const std::string& program = command.program;
+    auto has_flag = [&command](std::string_view flag) {
+        return std::find(command.flags.begin(), command.flags.end(), flag) != command.flags.end();
+    };
+    auto first_critical = [&](auto begin, auto end) -> std::string {
+        for (auto it = begin; it != end; ++it) {
+            std::string target = resolve_path(*it, cwd);
+            if (is_critical_path(target)) {
+                return target;
+            }
+        }
+        return "";
+    };
+
+    if (program.empty()) {
+        return {};
+    }
+
+    if (program.rfind("mkfs", 0) == 0 || contains(kDestructivePrograms, program)) {
+        return {false, "'" + program + "' is a destructive system command"};
+    }
+
+    if ((program == "init" || program == "telinit") &&
+        std::any_of(command.operands.begin(), command.operands.end(),
+                    [](const std::string& op) { return op == "0" || op == "6"; })) {
+        return {false, "Changes the system runlevel"};
+    }
+
+    if (program == "systemctl" &&
+        std::any_of(command.operands.begin(), command.operands.end(), [](const std::string& op) {
+            return op == "poweroff" || op == "reboot" || op == "halt" || op == "kexec";
+        })) {
+        return {false, "Powers off or restarts the system"};
+    }
+
+    if (program == "rm" || program == "rmdir" || program == "unlink" || program == "shred") {
+        if (has_flag("--no-preserve-root")) {
+            return {false, "Uses --no-preserve-root"};
+        }
+        std::string target = first_critical(command.operands.begin(), command.operands.end());
+        if (!target.empty()) {
+            return {false, "Removes system path: " + target};
+        }
+        bool recursive = has_flag("-r") || has_flag("-R") || has_flag("--recursive");
+        std::string home = Utils::get_absolute_path(Utils::get_home_directory());
+        for (const auto& operand : command.operands) {
+            if (recursive && resolve_path(operand, cwd) == home) {
+                return {false, "Recursively removes the home directory"};
+            }
+        }
+        return {};
+    }
+
+    if (program == "chmod" || program == "chown" || program == "chgrp") {
+        // 第一个操作数是权限或属主，除非使用了 --reference
+        auto begin = command.operands.begin();
+        if (!has_flag("--reference") && begin != command.operands.end()) {
+            ++begin;
+        }
+        std::string target = first_critical(begin, command.operands.end());
+        if (!target.empty()) {
+            return {false, "Changes ownership or permissions of system path: " + target};
+        }
+        return {};
+    }
+
+    if (program == "mv" || program == "tee" || program == "truncate") {
+        std::string target = first_critical(command.operands.begin(), command.operands.end());
+        if (!target.empty()) {
+            return {false, "Modifies system path: " + target};
+        }
+        return {};
+    }
+
+    if ((program == "cp" || program == "ln" || program == "install") && !command.operands.empty()) {
+        std::string target = first_critical(command.operands.end() - 1, command.operands.end());
+        if (!target.empty()) {
+            return {false, "Overwrites system path: " + target};
+        }
+        return {};
+    }
+
+    if (program == "dd") {
+        for (const auto& arg : command.argv) {
+            if (arg.rfind("of=", 0) == 0) {
+                std::string target = resolve_path(arg.substr(3), cwd);
+                if (is_critical_path(target)) {
+                    return {false, "Writes raw data to system path: " + target};
+                }
+            }
+        }
+        return {};
+    }
+
+    if (program == "kill") {
+        // 第一个选项是信号，其后的 -1 表示所有进程
+        bool signal_seen = false;
+        for (size_t i = 0; i < command.argv.size(); ++i) {
+            const std::string& arg = command.argv[i];
+            if (!signal_seen && (arg == "-s" || arg == "-n")) {
+                signal_seen = true;
+                ++i;
+            } else if (!signal_seen && arg.size() > 1 && arg[0] == '-' && arg != "-1") {
+                signal_seen = true;
+            } else if (arg == "-1" && i > 0) {
+                return {false, "Sends a signal to every process"};
+            } else if (arg == "--") {
+                signal_seen = true;
+            }
+        }
+        return {};
+    }
+
+    if (program == "find") {
+        bool destructive = false;
+        std::vector<std::string> roots;
+        bool in_roots = true;
+        for (size_t i = 0; i < command.argv.size(); ++i) {
+            const std::string& arg = command.argv[i];
+            if (in_roots && !arg.empty() && arg[0] != '-' && arg != "(" && arg != "!") {
+                roots.push_back(arg);
+                continue;
+            }
+            in_roots = false;
+            if (arg == "-delete") {
+                destructive = true;
+            } else if ((arg == "-exec" || arg == "-execdir" || arg == "-ok") &&
+                       i + 1 < command.argv.size()) {
+                std::string exec = basename_of(command.argv[i + 1]);
+                destructive = destructive || exec == "rm" || exec == "shred" ||
+                              exec == "unlink" || exec == "chmod" || exec == "chown";
+            }
+        }
+        if (roots.empty()) {
+            roots.push_back(".");
+        }
+        std::string target = destructive ? first_critical(roots.begin(), roots.end()) : "";
+        if (!target.empty()) {
+            return {false, "Deletes files under system path: " + target};
+        }
+        return {};
+    }
+
+    if (is_shell(program)) {
+        // sh -c "..."（或 bash -lc "..."）：递归分析内嵌命令
+        for (size_t i = 0; i + 1 < command.argv.size(); ++i) {
+            const std::string& arg = command.argv[i];
+            if (arg.size() > 1 && arg[0] == '-' && arg[1] != '-' &&
+                arg.find('c') != std::string::npos) {
+                if (depth >= kMaxNestingDepth) {
+                    return {false, "Nested shell commands are too deep to verify"};
+                }
+                return analyze_text(command.argv[i + 1], cwd, depth + 1);
+            }
+        }
+        return {};
+    }
+
+    return {};
+}
+
+std::string CommandSafetyAnalyzer::resolve_path(const std::string& path, const std::string& cwd) {
+    std::string expanded = Utils::expand_tilde(path);
+
+    // 通配符作用于所在目录的内容，按所在目录判断
+    size_t glob = expanded.find_first_of("*?[");
+    if (glob != std::string::npos) {
+        size_t slash = expanded.rfind('/', glob);
+        expanded = slash == std::string::npos ? "." : expanded.substr(0, slash + 1);
+    }
+
+    if (expanded.empty() || expanded[0] != '/') {
+        expanded = cwd + "/" + expanded;
+    }
+
+    // 词法规范化 "."、".." 和重复的 "/"
+    std::vector<std::string> components;
+    for (const auto& part : Utils::split(expanded, "/")) {
+        if (part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            if (!components.empty()) {
+                components.pop_back();
+            }
+            continue;
+        }
+        components.push_back(part);
+    }
+    if (components.empty()) {
+        return "/";
+    }
+
+    // 只解析父目录中的符号链接，最后一级保持原样（rm 链接不会删除目标）
+    std::string last = components.back();
+    components.pop_back();
+    std::string parent = Utils::get_absolute_path("/" + Utils::join(components, "/"));
+    return (parent == "/" ? "" : parent) + "/" + last;
+}
+
+bool CommandSafetyAnalyzer::is_critical_path(const std::string& absolute_path) {
+    if (absolute_path == "/" || contains(kCriticalRoots, absolute_path)) {
+        return true;
+    }
+
+    for (std::string_view tree : kCriticalTrees) {
+        if (absolute_path.compare(0, tree.size(), tree) == 0 &&
+            (absolute_path.size() == tree.size() || absolute_path[tree.size()] == '/')) {
+            return true;
+        }
+    }
+
+    if (absolute_path == "/dev") {
+        return true;
+    }
+    if (Utils::starts_with(absolute_path, "/dev/")) {
+        return !contains(kSafeDevices, absolute_path) &&
+               !Utils::starts_with(absolute_path, "/dev/fd/") &&
+               !Utils::starts_with(absolute_path, "/dev/pts/") &&
+               !Utils::starts_with(absolute_path, "/dev/shm/");
+    }
+
+    return false;
+}
+
+} // namespace NeXShell
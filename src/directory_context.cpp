@@ -0,0 +1,297 @@
+#include "directory_context.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+namespace NeXShell {
+
+namespace {
+
+// 目录变化时需要重新扫描的事件
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// 超大目录最多读取的条目数（排序前），避免一次扫描读完几十万个条目
+constexpr size_t SCAN_LIMIT_FACTOR = 8;
+
+char type_from_dirent(unsigned char d_type) {
+    switch (d_type) {
+        case DT_DIR: return 'd';
+        case DT_REG: return 'f';
+        case DT_LNK: return 'l';
+        case DT_UNKNOWN: return '?';
+        default: return 'o';
+    }
+}
+
+char type_from_mode(uint16_t mode) {
+    if (S_ISDIR(mode)) return 'd';
+    if (S_ISREG(mode)) return 'f';
+    if (S_ISLNK(mode)) return 'l';
+    return 'o';
+}
+
+std::string human_size(uint64_t bytes) {
+    static const char* units[] = {"B", "K", "M", "G", "T"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        ++unit;
+    }
+    char buffer[32];
+    if (unit == 0) {
+        snprintf(buffer, sizeof(buffer), "%llu%s", static_cast<unsigned long long>(bytes), units[unit]);
+    } else {
+        snprintf(buffer, sizeof(buffer), value < 10.0 ? "%.1f%s" : "%.0f%s", value, units[unit]);
+    }
+    return buffer;
+}
+
+} // namespace
+
+DirectoryContext::DirectoryContext(size_t max_entries, size_t max_directories)
+    : max_entries_(max_entries), max_directories_(std::max<size_t>(1, max_directories)) {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+DirectoryContext::~DirectoryContext() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+std::shared_ptr<const DirectorySnapshot> DirectoryContext::get(const std::string& path) {
+    return lookup(path, false);
+}
+
+void DirectoryContext::refresh(const std::string& path) {
+    lookup(path, true);
+}
+
+std::shared_ptr<const DirectorySnapshot> DirectoryContext::lookup(const std::string& path, bool check_mtime) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_events();
+
+    auto it = cache_.find(path);
+    if (it != cache_.end() && !it->second.stale) {
+        // 有 inotify 监视时事件已经反映了变化，只在没有监视或切换目录时比较 mtime
+        if ((it->second.watch >= 0 && !check_mtime) || directory_mtime(path) == it->second.mtime_ns) {
+            it->second.last_used = ++clock_;
+            ++hits_;
+            return it->second.snapshot;
+        }
+    }
+
+    // 先记录 mtime 再扫描，扫描期间的修改会在下次检查时被发现
+    int64_t mtime = directory_mtime(path);
+    std::shared_ptr<DirectorySnapshot> snapshot = scan(path);
+    snapshot->generation = ++generation_;
+    ++scans_;
+
+    if (it == cache_.end()) {
+        if (cache_.size() >= max_directories_) {
+            evict_one();
+        }
+        it = cache_.emplace(path, CachedDirectory{}).first;
+        if (inotify_fd_ >= 0) {
+            int watch = inotify_add_watch(inotify_fd_, path.c_str(), WATCH_MASK);
+            if (watch >= 0) {
+                // 同一目录的不同写法（如符号链接）会得到相同的监视描述符
+                auto previous = watches_.find(watch);
+                if (previous != watches_.end() && previous->second != path) {
+                    cache_.erase(previous->second);
+                }
+                it->second.watch = watch;
+                watches_[watch] = path;
+            }
+        }
+    }
+    it->second.snapshot = snapshot;
+    it->second.mtime_ns = mtime;
+    it->second.stale = false;
+    it->second.last_used = ++clock_;
+    return snapshot;
+}
+
+std::shared_ptr<DirectorySnapshot> DirectoryContext::scan(const std::string& path) const {
+    auto snapshot = std::make_shared<DirectorySnapshot>();
+    snapshot->path = path;
+
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return snapshot;
+    }
+
+    // 一次 getdents64 遍历收集名称和 d_type
+    std::vector<DirectoryEntry> entries;
+    size_t scan_limit = max_entries_ * SCAN_LIMIT_FACTOR;
+    alignas(struct dirent64) char buffer[32768];
+    bool complete = true;
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < n;) {
+            auto* dirent = reinterpret_cast<struct dirent64*>(buffer + offset);
+            offset += dirent->d_reclen;
+            if (dirent->d_name[0] == '.') {
+                continue;
+            }
+            ++snapshot->total_entries;
+            entries.push_back({dirent->d_name, type_from_dirent(dirent->d_type), 0});
+        }
+        if (entries.size() >= scan_limit) {
+            complete = false;
+            break;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const DirectoryEntry& a, const DirectoryEntry& b) { return a.name < b.name; });
+    if (entries.size() > max_entries_) {
+        entries.resize(max_entries_);
+    }
+    snapshot->truncated = !complete || snapshot->total_entries > entries.size();
+
+    // 只对保留下来的文件调用 statx 取大小（以及文件系统不提供 d_type 时的类型）
+    for (auto& entry : entries) {
+        if (entry.type != 'f' && entry.type != '?') {
+            continue;
+        }
+        struct statx info;
+        if (statx(fd, entry.name.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                  STATX_TYPE | STATX_SIZE, &info) != 0) {
+            entry.type = entry.type == '?' ? 'o' : entry.type;
+            continue;
+        }
+        entry.type = type_from_mode(info.stx_mode);
+        entry.size = entry.type == 'f' ? info.stx_size : 0;
+    }
+
+    close(fd);
+    snapshot->entries = std::move(entries);
+    return snapshot;
+}
+
+void DirectoryContext::drain_events() {
+    if (inotify_fd_ < 0 || watches_.empty()) {
+        return;
+    }
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t n = read(inotify_fd_, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < n;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 丢失了事件，所有缓存都不可信
+                for (auto& cached : cache_) {
+                    cached.second.stale = true;
+                }
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end()) {
+                continue;
+            }
+            auto cached = cache_.find(watch->second);
+            if (cached != cache_.end()) {
+                cached->second.stale = true;
+                if (event->mask & IN_IGNORED) {
+                    // 目录被删除或监视被移除，之后退回到比较 mtime
+                    cached->second.watch = -1;
+                }
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(watch);
+            }
+        }
+    }
+}
+
+void DirectoryContext::evict_one() {
+    auto oldest = std::min_element(cache_.begin(), cache_.end(), [](const auto& a, const auto& b) {
+        return a.second.last_used < b.second.last_used;
+    });
+    if (oldest == cache_.end()) {
+        return;
+    }
+    if (oldest->second.watch >= 0) {
+        inotify_rm_watch(inotify_fd_, oldest->second.watch);
+        watches_.erase(oldest->second.watch);
+    }
+    cache_.erase(oldest);
+}
+
+int64_t DirectoryContext::directory_mtime(const std::string& path) {
+    struct statx info;
+    if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, STATX_MTIME, &info) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(info.stx_mtime.tv_sec) * 1000000000 + info.stx_mtime.tv_nsec;
+}
+
+size_t DirectoryContext::scan_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scans_;
+}
+
+size_t DirectoryContext::hit_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+std::string DirectoryContext::format_entry(const DirectoryEntry& entry) {
+    switch (entry.type) {
+        case 'd': return entry.name + "/";
+        case 'l': return entry.name + "@";
+        case 'f': return entry.name + " " + human_size(entry.size);
+        default: return entry.name;
+    }
+}
+
+std::string DirectoryContext::summarize(const DirectorySnapshot& snapshot) {
+    std::map<std::string, size_t> extensions;
+    std::vector<std::string> directories;
+    uint64_t total_size = 0;
+    for (const auto& entry : snapshot.entries) {
+        if (entry.type == 'd') {
+            directories.push_back(entry.name + "/");
+            continue;
+        }
+        total_size += entry.size;
+        size_t dot = entry.name.rfind('.');
+        extensions[dot == std::string::npos || dot == 0 ? "(no extension)" : entry.name.substr(dot)]++;
+    }
+
+    std::vector<std::pair<std::string, size_t>> common(extensions.begin(), extensions.end());
+    std::stable_sort(common.begin(), common.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    std::ostringstream summary;
+    summary << snapshot.total_entries << (snapshot.truncated ? "+" : "") << " entries ("
+            << directories.size() << " directories, " << human_size(total_size) << " in listed files)";
+    for (size_t i = 0; i < common.size() && i < 5; ++i) {
+        summary << (i == 0 ? "; files: " : ", ") << common[i].second << " " << common[i].first;
+    }
+    for (size_t i = 0; i < directories.size() && i < 10; ++i) {
+        summary << (i == 0 ? "; directories: " : " ") << directories[i];
+    }
+    return summary.str();
+}
+
+} // namespace NeXShell
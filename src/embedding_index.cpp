@@ -0,0 +1,243 @@
+#include "embedding_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NEXSH_HAVE_AVX2_DISPATCH 1
+#endif
+
+namespace NeXShell {
+
+namespace {
+
+// <path>.f32 文件头：魔数 + 维度
+constexpr char kMagic[4] = {'N', 'X', 'E', '1'};
+constexpr size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t);
+
+using DotFunction = float (*)(const float*, const float*, size_t);
+
+float dot_scalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef NEXSH_HAVE_AVX2_DISPATCH
+__attribute__((target("avx2,fma")))
+float dot_avx2(const float* a, const float* b, size_t n) {
+    // 两个累加器交替使用，隐藏 FMA 延迟
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum4 = _mm_hadd_ps(sum4, sum4);
+    sum4 = _mm_hadd_ps(sum4, sum4);
+    float sum = _mm_cvtss_f32(sum4);
+
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+#endif
+
+DotFunction select_dot() {
+#ifdef NEXSH_HAVE_AVX2_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return dot_avx2;
+    }
+#endif
+    return dot_scalar;
+}
+
+DotFunction dot_function() {
+    static const DotFunction function = select_dot();
+    return function;
+}
+
+/**
+ * @brief 去掉会破坏 TSV 格式的制表符和换行
+ */
+std::string sanitize_field(const std::string& text) {
+    std::string result = text;
+    std::replace_if(result.begin(), result.end(),
+                    [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    return result;
+}
+
+} // namespace
+
+float EmbeddingIndex::dot(const float* a, const float* b, size_t n) {
+    return dot_function()(a, b, n);
+}
+
+bool EmbeddingIndex::normalize(std::vector<float>& vector) {
+    float norm = std::sqrt(dot(vector.data(), vector.data(), vector.size()));
+    if (!(norm > 0.0f) || !std::isfinite(norm)) {
+        return false;
+    }
+    for (float& value : vector) {
+        value /= norm;
+    }
+    return true;
+}
+
+bool EmbeddingIndex::add(std::vector<float> embedding, const std::string& input, const std::string& command) {
+    if (embedding.empty() || (dimension_ != 0 && embedding.size() != dimension_)) {
+        return false;
+    }
+    if (!normalize(embedding)) {
+        return false;
+    }
+
+    dimension_ = embedding.size();
+    matrix_.insert(matrix_.end(), embedding.begin(), embedding.end());
+    entries_.push_back({input, command});
+
+    if (!storage_path_.empty()) {
+        append_to_storage(embedding, input, command);
+    }
+    return true;
+}
+
+std::vector<EmbeddingHit> EmbeddingIndex::top_k(std::vector<float> query, size_t k) const {
+    std::vector<EmbeddingHit> hits;
+    if (k == 0 || entries_.empty() || query.size() != dimension_ || !normalize(query)) {
+        return hits;
+    }
+
+    // 小顶堆保存当前最好的 k 个
+    auto worse = [](const EmbeddingHit& a, const EmbeddingHit& b) { return a.score > b.score; };
+    DotFunction dot_product = dot_function();
+    const float* row = matrix_.data();
+    hits.reserve(k + 1);
+    for (size_t i = 0; i < entries_.size(); ++i, row += dimension_) {
+        float score = dot_product(query.data(), row, dimension_);
+        if (hits.size() < k) {
+            hits.push_back({i, score});
+            std::push_heap(hits.begin(), hits.end(), worse);
+        } else if (score > hits.front().score) {
+            std::pop_heap(hits.begin(), hits.end(), worse);
+            hits.back() = {i, score};
+            std::push_heap(hits.begin(), hits.end(), worse);
+        }
+    }
+
+    std::sort_heap(hits.begin(), hits.end(), worse);
+    return hits;
+}
+
+int EmbeddingIndex::load(const std::string& path) {
+    std::ifstream matrix_file(path + ".f32", std::ios::binary);
+    std::ifstream entries_file(path + ".tsv");
+    if (!matrix_file || !entries_file) {
+        return -1;
+    }
+
+    char magic[sizeof(kMagic)];
+    uint32_t dimension = 0;
+    if (!matrix_file.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !matrix_file.read(reinterpret_cast<char*>(&dimension), sizeof(dimension)) ||
+        dimension == 0) {
+        return -1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string line;
+    while (std::getline(entries_file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            break;
+        }
+        entries.push_back({line.substr(0, tab), line.substr(tab + 1)});
+    }
+
+    // 读取完整的行，两个文件长度不一致时取公共前缀
+    matrix_file.seekg(0, std::ios::end);
+    size_t payload = static_cast<size_t>(matrix_file.tellg()) - kHeaderSize;
+    size_t rows = std::min(payload / (sizeof(float) * dimension), entries.size());
+    std::vector<float> matrix(rows * dimension);
+    matrix_file.seekg(kHeaderSize);
+    if (!matrix_file.read(reinterpret_cast<char*>(matrix.data()),
+                          static_cast<std::streamsize>(matrix.size() * sizeof(float)))) {
+        return -1;
+    }
+    entries.resize(rows);
+
+    dimension_ = dimension;
+    matrix_ = std::move(matrix);
+    entries_ = std::move(entries);
+    return static_cast<int>(rows);
+}
+
+bool EmbeddingIndex::append_to_storage(const std::vector<float>& embedding,
+                                       const std::string& input, const std::string& command) const {
+    std::fstream matrix_file(storage_path_ + ".f32", std::ios::binary | std::ios::in | std::ios::out);
+    if (!matrix_file) {
+        // 新文件：先写文件头
+        matrix_file.open(storage_path_ + ".f32", std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!matrix_file) {
+            return false;
+        }
+        uint32_t dimension = static_cast<uint32_t>(dimension_);
+        matrix_file.write(kMagic, sizeof(kMagic));
+        matrix_file.write(reinterpret_cast<const char*>(&dimension), sizeof(dimension));
+    } else {
+        // 已有文件的维度必须一致（例如换了嵌入模型时不再追加）
+        char magic[sizeof(kMagic)];
+        uint32_t dimension = 0;
+        if (!matrix_file.read(magic, sizeof(magic)) ||
+            std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+            !matrix_file.read(reinterpret_cast<char*>(&dimension), sizeof(dimension)) ||
+            dimension != dimension_) {
+            return false;
+        }
+        matrix_file.seekp(0, std::ios::end);
+    }
+
+    // 两个文件按行对应：任一写入失败时把两者都截断回写入前的大小
+    std::string matrix_path = storage_path_ + ".f32";
+    std::string entries_path = storage_path_ + ".tsv";
+    off_t matrix_size = static_cast<off_t>(matrix_file.tellp());
+    struct stat entries_stat;
+    off_t entries_size = stat(entries_path.c_str(), &entries_stat) == 0 ? entries_stat.st_size : 0;
+
+    std::ofstream entries_file(entries_path, std::ios::app);
+    entries_file << sanitize_field(input) << '\t' << sanitize_field(command) << '\n';
+    entries_file.close();
+    if (!entries_file) {
+        truncate(entries_path.c_str(), entries_size);
+        return false;
+    }
+
+    matrix_file.write(reinterpret_cast<const char*>(embedding.data()),
+                      static_cast<std::streamsize>(embedding.size() * sizeof(float)));
+    matrix_file.close();
+    if (!matrix_file) {
+        truncate(matrix_path.c_str(), matrix_size);
+        truncate(entries_path.c_str(), entries_size);
+        return false;
+    }
+    return true;
+}
+
+} // namespace NeXShell
@@ -0,0 +1,141 @@
+#include "endpoint_pool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NeXShell {
+
+namespace {
+
+// 连续失败后的退避时间：1s、2s、4s……最长 30s
+std::chrono::milliseconds backoff_for(size_t consecutive_failures) {
+    size_t exponent = std::min<size_t>(consecutive_failures - 1, 5);
+    return std::min(std::chrono::milliseconds(1000 << exponent), std::chrono::milliseconds(30000));
+}
+
+} // namespace
+
+EndpointPool::EndpointPool(std::vector<std::string> urls) {
+    for (auto& url : urls) {
+        Endpoint endpoint;
+        endpoint.url = std::move(url);
+        endpoints_.push_back(std::move(endpoint));
+    }
+}
+
+std::optional<size_t> EndpointPool::acquire(const std::vector<size_t>& excluded) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+
+    // 尚无样本的端点按已知最快延迟的一半估计：空闲时先被尝试一次，
+    // 但有请求进行中时不会被无限堆积
+    double unknown_ms = 0.0;
+    for (const auto& endpoint : endpoints_) {
+        if (endpoint.ewma_ms > 0.0 && (unknown_ms == 0.0 || endpoint.ewma_ms < unknown_ms)) {
+            unknown_ms = endpoint.ewma_ms;
+        }
+    }
+    unknown_ms = unknown_ms == 0.0 ? 1.0 : unknown_ms / 2.0;
+
+    std::optional<size_t> best;
+    double best_score = 0.0;
+    std::optional<size_t> earliest_retry;   // 全部不健康时用作探测
+    for (size_t i = 0; i < endpoints_.size(); ++i) {
+        if (std::find(excluded.begin(), excluded.end(), i) != excluded.end()) {
+            continue;
+        }
+
+        const Endpoint& endpoint = endpoints_[i];
+        if (endpoint.retry_at > now) {
+            if (!earliest_retry || endpoint.retry_at < endpoints_[*earliest_retry].retry_at) {
+                earliest_retry = i;
+            }
+            continue;
+        }
+
+        double latency = endpoint.ewma_ms > 0.0 ? endpoint.ewma_ms : unknown_ms;
+        double score = static_cast<double>(endpoint.in_flight + 1) * latency;
+        if (!best || score < best_score ||
+            (score == best_score && endpoint.in_flight < endpoints_[*best].in_flight)) {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    if (!best) {
+        best = earliest_retry;
+    }
+    if (best) {
+        ++endpoints_[*best].in_flight;
+    }
+    return best;
+}
+
+void EndpointPool::release(size_t index, EndpointOutcome outcome, double latency_ms, bool record_latency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Endpoint& endpoint = endpoints_[index];
+    if (endpoint.in_flight > 0) {
+        --endpoint.in_flight;
+    }
+
+    switch (outcome) {
+        case EndpointOutcome::Success:
+            ++endpoint.requests;
+            endpoint.consecutive_failures = 0;
+            endpoint.retry_at = {};
+            if (!record_latency) {
+                break;
+            }
+            endpoint.ewma_ms = endpoint.ewma_ms == 0.0
+                ? latency_ms
+                : EWMA_ALPHA * latency_ms + (1.0 - EWMA_ALPHA) * endpoint.ewma_ms;
+
+            if (recent_latencies_.size() < LATENCY_WINDOW) {
+                recent_latencies_.push_back(latency_ms);
+            } else {
+                recent_latencies_[next_latency_] = latency_ms;
+            }
+            next_latency_ = (next_latency_ + 1) % LATENCY_WINDOW;
+            break;
+
+        case EndpointOutcome::Failure:
+            ++endpoint.requests;
+            ++endpoint.failures;
+            ++endpoint.consecutive_failures;
+            endpoint.retry_at = Clock::now() + backoff_for(endpoint.consecutive_failures);
+            break;
+
+        case EndpointOutcome::Cancelled:
+            break;
+    }
+}
+
+std::optional<double> EndpointPool::hedge_delay_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (endpoints_.size() < 2 || hedge_percentile_ <= 0.0 || recent_latencies_.size() < MIN_HEDGE_SAMPLES) {
+        return std::nullopt;
+    }
+
+    std::vector<double> samples = recent_latencies_;
+    size_t rank = static_cast<size_t>(std::ceil(hedge_percentile_ * static_cast<double>(samples.size())));
+    rank = std::clamp<size_t>(rank, 1, samples.size()) - 1;
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(rank), samples.end());
+    return samples[rank];
+}
+
+void EndpointPool::set_hedge_percentile(double percentile) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hedge_percentile_ = std::min(percentile, 1.0);
+}
+
+std::vector<EndpointStatus> EndpointPool::status() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    std::vector<EndpointStatus> result;
+    for (const auto& endpoint : endpoints_) {
+        result.push_back({endpoint.url, endpoint.in_flight, endpoint.ewma_ms,
+                          endpoint.retry_at <= now, endpoint.requests, endpoint.failures});
+    }
+    return result;
+}
+
+} // namespace NeXShell
@@ -0,0 +1,248 @@
+#include "fork_server.h"
+#include "unix_socket.h"
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+extern char** environ;
+
+namespace NeXShell {
+
+namespace {
+
+// 每个请求传递的描述符：标准输入、输出、错误
+constexpr int PASSED_FDS = 3;
+
+// 辅助进程与 shell 同在前台进程组：忽略终端发出的信号，Ctrl-C/Ctrl-Z 不会终止或
+// 挂起它；子进程在 exec 前恢复默认处理
+constexpr int TERMINAL_SIGNALS[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+/**
+ * @brief 请求的固定头部，后面依次是以 NUL 结尾的 path、cwd、argv、环境变量
+ */
+struct RequestHeader {
+    uint32_t argc;
+    uint32_t envc;
+};
+
+struct Reply {
+    int32_t pid;
+    int32_t error;
+};
+
+void write_error(const char* program, int error) {
+    const char* prefix = "execvp ";
+    const char* message = std::strerror(error);
+    (void)!write(STDERR_FILENO, prefix, std::strlen(prefix));
+    (void)!write(STDERR_FILENO, program, std::strlen(program));
+    (void)!write(STDERR_FILENO, ": ", 2);
+    (void)!write(STDERR_FILENO, message, std::strlen(message));
+    (void)!write(STDERR_FILENO, "\n", 1);
+}
+
+/**
+ * @brief 在辅助进程中创建子进程；CLONE_PARENT 使它成为 shell 的子进程
+ * @return 子进程 ID，失败时为 -1（errno 保留）
+ */
+pid_t spawn_child(const char* path, const char* cwd, char* const* argv, char* const* envp, const int* fds) {
+    struct clone_args args = {};
+    // CLONE_PARENT 要求 exit_signal 为 0：子进程沿用辅助进程的退出信号（SIGCHLD）
+    args.flags = CLONE_PARENT;
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid != 0) {
+        return static_cast<pid_t>(pid);
+    }
+
+    // 子进程：辅助进程是单线程的，这里可以安全地继续执行到 exec
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+    for (int signal_number : TERMINAL_SIGNALS) {
+        signal(signal_number, SIG_DFL);
+    }
+    for (int target = 0; target < PASSED_FDS; ++target) {
+        if (dup2(fds[target], target) < 0) {
+            _exit(1);
+        }
+    }
+    if (*cwd && chdir(cwd) != 0) {
+        _exit(1);
+    }
+    execve(*path ? path : argv[0], argv, envp);
+    write_error(argv[0], errno);
+    _exit(127);
+}
+
+} // namespace
+
+ForkServer::~ForkServer() {
+    // 辅助进程读到 EOF 后退出
+    close(socket_fd_);
+    while (helper_pid_ > 0 && waitpid(helper_pid_, nullptr, 0) < 0 && errno == EINTR) {
+    }
+}
+
+void ForkServer::mark_broken() {
+    broken_ = true;
+    // 回收辅助进程，不留僵尸；之后的外部命令由 shell 自己 fork
+    kill(helper_pid_, SIGKILL);
+    while (waitpid(helper_pid_, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    helper_pid_ = -1;
+    std::cerr << "nexsh: fork server exited; external commands now use fork()" << std::endl;
+}
+
+bool ForkServer::enabled() {
+    const char* value = getenv("NEXSH_FORK_SERVER");
+    return value && std::string(value) == "1";
+}
+
+std::unique_ptr<ForkServer> ForkServer::start(const std::string& executable) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        return nullptr;
+    }
+    std::string fd_argument = std::to_string(fds[1]);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return nullptr;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        if (executable.empty()) {
+            _exit(serve(fds[1]));
+        }
+        // 只保留套接字和标准错误，其余描述符在 exec 时关闭
+        fcntl(fds[1], F_SETFD, 0);
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        execl(executable.c_str(), "nexsh-fork-server", "--fork-server", fd_argument.c_str(),
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    close(fds[1]);
+    return std::unique_ptr<ForkServer>(new ForkServer(pid, fds[0]));
+}
+
+int ForkServer::serve(int socket_fd) {
+    // shell 退出时一起退出，即使套接字被其它进程意外持有
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    for (int signal_number : TERMINAL_SIGNALS) {
+        signal(signal_number, SIG_IGN);
+    }
+
+    std::vector<char> buffer(MAX_REQUEST);
+    std::vector<char*> argv;
+    std::vector<char*> envp;
+    for (;;) {
+        int fds[UnixSocket::MAX_FDS];
+        size_t fd_count = 0;
+        ssize_t received = UnixSocket::receive_message(socket_fd, buffer.data(), buffer.size(), fds, fd_count);
+        if (received == 0 || (received < 0 && errno != EMSGSIZE)) {
+            return 0;
+        }
+
+        Reply reply = {-1, EINVAL};
+        RequestHeader request;
+        size_t size = received > 0 ? static_cast<size_t>(received) : 0;
+        if (fd_count == PASSED_FDS && size >= sizeof(request)) {
+            std::memcpy(&request, buffer.data(), sizeof(request));
+            size_t offset = sizeof(request);
+            const char* path = UnixSocket::next_string(buffer, size, offset);
+            const char* cwd = UnixSocket::next_string(buffer, size, offset);
+            argv.clear();
+            envp.clear();
+            bool complete = path && cwd && request.argc > 0;
+            for (uint32_t i = 0; complete && i < request.argc + request.envc; ++i) {
+                char* text = const_cast<char*>(UnixSocket::next_string(buffer, size, offset));
+                complete = text != nullptr;
+                (i < request.argc ? argv : envp).push_back(text);
+            }
+            if (complete) {
+                argv.push_back(nullptr);
+                envp.push_back(nullptr);
+                pid_t pid = spawn_child(path, cwd, argv.data(), envp.data(), fds);
+                reply = {pid, pid < 0 ? errno : 0};
+            }
+        }
+        for (size_t i = 0; i < fd_count; ++i) {
+            close(fds[i]);
+        }
+
+        if (UnixSocket::send_message(socket_fd, &reply, sizeof(reply)) != sizeof(reply)) {
+            return 1;
+        }
+    }
+}
+
+pid_t ForkServer::spawn(const SpawnRequest& request) {
+    if (request.argv.empty()) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (broken_) {
+        return -1;
+    }
+
+    RequestHeader header = {static_cast<uint32_t>(request.argv.size()), 0};
+    for (char** env = environ; *env; ++env) {
+        ++header.envc;
+    }
+    buffer_.resize(sizeof(header));
+    std::memcpy(buffer_.data(), &header, sizeof(header));
+    UnixSocket::append_string(buffer_, request.path);
+    UnixSocket::append_string(buffer_, request.cwd);
+    for (const auto& arg : request.argv) {
+        UnixSocket::append_string(buffer_, arg);
+    }
+    for (char** env = environ; *env; ++env) {
+        UnixSocket::append_string(buffer_, *env);
+    }
+    if (buffer_.size() > MAX_REQUEST) {
+        return -1;
+    }
+
+    int fds[PASSED_FDS] = {request.stdin_fd, request.stdout_fd, request.stderr_fd};
+    if (UnixSocket::send_message(socket_fd_, buffer_.data(), buffer_.size(), fds, PASSED_FDS) < 0) {
+        // 请求超过套接字缓冲区时只是这一次退回到 fork；其它错误说明辅助进程已经退出
+        if (errno != EMSGSIZE && errno != ENOBUFS) {
+            mark_broken();
+        }
+        return -1;
+    }
+
+    Reply reply;
+    ssize_t received;
+    while ((received = recv(socket_fd_, &reply, sizeof(reply), 0)) < 0 && errno == EINTR) {
+    }
+    if (received != sizeof(reply)) {
+        mark_broken();
+        return -1;
+    }
+    if (reply.pid < 0) {
+        errno = reply.error;
+        return -1;
+    }
+    return reply.pid;
+}
+
+} // namespace NeXShell
@@ -0,0 +1,492 @@
+#include "intent_matcher.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+namespace {
+
+// 内置模板：覆盖最常见的请求
+const std::vector<std::pair<const char*, const char*>> kBuiltinTemplates = {
+    {"list files", "ls -la"},
+    {"list hidden files", "ls -a"},
+    {"list files by size", "ls -lS"},
+    {"list files by time", "ls -lt"},
+    {"list files in {dir}", "ls -la {dir}"},
+    {"show current directory", "pwd"},
+    {"where am i", "pwd"},
+    {"show disk usage", "df -h"},
+    {"show free disk space", "df -h"},
+    {"disk usage of {dir}", "du -sh {dir}"},
+    {"show memory usage", "free -h"},
+    {"show running processes", "ps aux"},
+    {"find {ext} files", "find . -name '*.{ext}'"},
+    {"find files named {name}", "find . -name {name}"},
+    {"find large files", "find . -type f -size +100M"},
+    {"find empty files", "find . -type f -empty"},
+    {"find files modified today", "find . -type f -mtime -1"},
+    {"show largest files", "du -ah . | sort -rh | head -n 10"},
+    {"count files", "find . -type f | wc -l"},
+    {"count lines in {file}", "wc -l {file}"},
+    {"search {pattern} in files", "grep -rn {pattern} ."},
+    {"search {pattern} in {file}", "grep -n {pattern} {file}"},
+    {"show first {n} lines of {file}", "head -n {n} {file}"},
+    {"show last {n} lines of {file}", "tail -n {n} {file}"},
+    {"show contents of {file}", "cat {file}"},
+    {"make directory {name}", "mkdir -p {name}"},
+    {"show ip address", "ip addr"},
+    {"show date", "date"},
+    {"show uptime", "uptime"},
+    {"who am i", "whoami"},
+    {"show environment variables", "env"},
+    {"show kernel version", "uname -r"},
+    {"show system information", "uname -a"},
+    {"show git status", "git status"}
+};
+
+const std::unordered_set<std::string> kStopwords = {
+    "the", "a", "an", "all", "me", "my", "please", "of", "for", "to", "and",
+    "with", "that", "what", "is", "are", "which", "do", "can", "you", "in",
+    "on", "by", "called", "named", "some", "every", "any", "how", "does",
+    "it", "its", "here", "could", "would", "tell", "give", "just", "sorted"
+};
+
+// 否定词：模板无法表达"不是/排除"，含有它们的请求交给模型
+const std::unordered_set<std::string> kNegations = {
+    "not", "no", "never", "non", "nor", "neither", "except", "excluding",
+    "exclude", "without", "ignore", "ignoring", "skip", "skipping"
+};
+
+const std::unordered_map<std::string, std::string> kSynonyms = {
+    {"list", "show"}, {"display", "show"}, {"print", "show"}, {"view", "show"},
+    {"get", "show"}, {"check", "show"}, {"ls", "show"},
+    {"folder", "directory"}, {"dir", "directory"}, {"directories", "directory"},
+    {"create", "make"}, {"new", "make"}, {"mkdir", "make"},
+    {"grep", "search"}, {"look", "search"}, {"locate", "find"},
+    {"biggest", "largest"}, {"ram", "memory"}, {"storage", "disk"},
+    {"space", "usage"}, {"content", "contents"}, {"changed", "modified"},
+    {"edited", "modified"}, {"processes", "process"}, {"top", "first"},
+    {"beginning", "first"}, {"head", "first"}, {"bottom", "last"},
+    {"end", "last"}, {"tail", "last"},
+    {"info", "information"}, {"env", "environment"}, {"big", "large"},
+    {"huge", "large"}
+};
+
+const std::unordered_set<std::string> kKnownExtensions = {
+    "txt", "log", "cpp", "cc", "h", "hpp", "c", "py", "js", "ts", "md",
+    "json", "yaml", "yml", "xml", "csv", "sh", "conf", "html", "css",
+    "java", "go", "rs", "pdf", "png", "jpg", "gz", "zip", "tar", "ini"
+};
+
+bool is_digits(const std::string& text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(),
+                                        [](unsigned char c) { return std::isdigit(c); });
+}
+
+bool is_word_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/**
+ * @brief 去掉 "*." 或 "." 前缀，返回扩展名
+ */
+std::string strip_extension_prefix(const std::string& text) {
+    if (Utils::starts_with(text, "*.")) return text.substr(2);
+    if (Utils::starts_with(text, ".")) return text.substr(1);
+    return text;
+}
+
+/**
+ * @brief 在命令中把整词出现的 value 替换为 replacement
+ */
+bool replace_word(std::string& command, const std::string& value, const std::string& replacement) {
+    bool replaced = false;
+    size_t pos = 0;
+    while ((pos = command.find(value, pos)) != std::string::npos) {
+        size_t end = pos + value.size();
+        bool left_ok = pos == 0 || !is_word_char(command[pos - 1]);
+        bool right_ok = end >= command.size() || !is_word_char(command[end]);
+        if (left_ok && right_ok) {
+            command.replace(pos, value.size(), replacement);
+            pos += replacement.size();
+            replaced = true;
+        } else {
+            pos = end;
+        }
+    }
+    return replaced;
+}
+
+} // namespace
+
+IntentMatcher::IntentMatcher() {
+    for (const auto& entry : kBuiltinTemplates) {
+        add_template(entry.first, entry.second);
+    }
+}
+
+std::vector<IntentMatcher::Token> IntentMatcher::tokenize(const std::string& text) {
+    std::vector<Token> raw;
+    std::string current;
+    char quote = '\0';
+
+    auto flush = [&raw, &current]() {
+        if (current.empty()) {
+            return;
+        }
+        // 去掉结尾的标点
+        while (current.size() > 1 && std::string(",?!;:.").find(current.back()) != std::string::npos) {
+            current.pop_back();
+        }
+        raw.push_back({current, Utils::to_lower(current), false});
+        current.clear();
+    };
+
+    for (char c : text) {
+        if (quote != '\0') {
+            if (c == quote) {
+                raw.push_back({current, "", true});
+                current.clear();
+                quote = '\0';
+            } else {
+                current += c;
+            }
+        } else if (c == '"' || (c == '\'' && current.empty())) {
+            // 词中间的撇号（don't、what's）不是引号
+            flush();
+            quote = c;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            flush();
+        } else {
+            current += c;
+        }
+    }
+    if (quote != '\0') {
+        raw.push_back({current, "", true});
+    } else {
+        flush();
+    }
+
+    // 去掉 "in the current directory" 之类不影响命令的短语
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        const std::string& word = raw[i].canon;
+        if (!raw[i].quoted && (word == "in" || word == "inside" || word == "under" || word == "from")) {
+            size_t j = i + 1;
+            if (j < raw.size() && raw[j].canon == "the") ++j;
+            if (j + 1 < raw.size() &&
+                (raw[j].canon == "current" || raw[j].canon == "this" ||
+                 raw[j].canon == "present" || raw[j].canon == "working") &&
+                (raw[j + 1].canon == "directory" || raw[j + 1].canon == "folder" ||
+                 raw[j + 1].canon == "dir")) {
+                i = j + 1;
+                continue;
+            }
+        }
+
+        if (raw[i].quoted) {
+            tokens.push_back(raw[i]);
+        } else if (!kStopwords.count(word)) {
+            tokens.push_back({raw[i].text, canonicalize(word), false});
+        }
+    }
+
+    return tokens;
+}
+
+std::string IntentMatcher::canonicalize(const std::string& lower_word) {
+    auto it = kSynonyms.find(lower_word);
+    if (it != kSynonyms.end()) {
+        return it->second;
+    }
+
+    // 简单的复数还原：files -> file
+    if (lower_word.size() > 3 && lower_word.back() == 's' &&
+        lower_word[lower_word.size() - 2] != 's' && lower_word.front() != '{') {
+        std::string singular = lower_word.substr(0, lower_word.size() - 1);
+        it = kSynonyms.find(singular);
+        return it != kSynonyms.end() ? it->second : singular;
+    }
+
+    return lower_word;
+}
+
+double IntentMatcher::weight_of(const std::string& keyword) {
+    // "show" 几乎出现在所有请求中，区分度低
+    return keyword == "show" ? 0.3 : 1.0;
+}
+
+IntentMatcher::SlotType IntentMatcher::slot_type_of(const std::string& name) {
+    if (name == "n" || (Utils::starts_with(name, "n") && is_digits(name.substr(1)))) {
+        return SlotType::Number;
+    }
+    if (Utils::starts_with(name, "ext")) {
+        return SlotType::Extension;
+    }
+    if (name == "file" || name == "dir" || name == "path") {
+        return SlotType::Path;
+    }
+    return SlotType::Word;
+}
+
+bool IntentMatcher::fits_slot(const Token& token, SlotType type) {
+    switch (type) {
+        case SlotType::Number:
+            return is_digits(token.text);
+        case SlotType::Extension: {
+            std::string ext = strip_extension_prefix(Utils::to_lower(token.text));
+            bool prefixed = ext.size() != token.text.size();
+            return !ext.empty() && ext.size() <= 8 &&
+                   std::all_of(ext.begin(), ext.end(), [](unsigned char c) { return std::isalnum(c); }) &&
+                   (prefixed || kKnownExtensions.count(ext));
+        }
+        case SlotType::Path:
+        case SlotType::Word:
+            return !token.text.empty();
+    }
+    return false;
+}
+
+std::string IntentMatcher::slot_value(const Token& token, SlotType type) {
+    std::string value = type == SlotType::Extension ? strip_extension_prefix(token.text) : token.text;
+
+    bool plain = std::all_of(value.begin(), value.end(), [](unsigned char c) {
+        return std::isalnum(c) || std::string("._/~+-=:,@%").find(static_cast<char>(c)) != std::string::npos;
+    });
+    if (plain) {
+        return value;
+    }
+    if (value.find('\'') == std::string::npos) {
+        return "'" + value + "'";
+    }
+    if (value.find('"') == std::string::npos) {
+        return "\"" + value + "\"";
+    }
+    return "";
+}
+
+bool IntentMatcher::add_template(const std::string& pattern, const std::string& command) {
+    Template tmpl;
+    tmpl.command = command;
+
+    for (const auto& token : tokenize(pattern)) {
+        if (token.text.size() > 2 && token.text.front() == '{' && token.text.back() == '}') {
+            std::string name = token.text.substr(1, token.text.size() - 2);
+            tmpl.slots.push_back({name, slot_type_of(name)});
+        } else if (!token.quoted) {
+            tmpl.keywords.push_back(token.canon);
+        }
+    }
+
+    std::sort(tmpl.keywords.begin(), tmpl.keywords.end());
+    tmpl.keywords.erase(std::unique(tmpl.keywords.begin(), tmpl.keywords.end()), tmpl.keywords.end());
+    if (tmpl.keywords.empty()) {
+        return false;
+    }
+
+    // 关键词和槽位类型都相同的模板视为重复
+    std::string key = Utils::join(tmpl.keywords, " ") + "|";
+    for (const auto& slot : tmpl.slots) {
+        key += std::to_string(static_cast<int>(slot.type));
+    }
+    if (!pattern_keys_.insert(key).second) {
+        return false;
+    }
+
+    tmpl.keyword_weight = 0.0;
+    for (const auto& keyword : tmpl.keywords) {
+        tmpl.keyword_weight += weight_of(keyword);
+        keyword_index_[keyword].push_back(templates_.size());
+    }
+
+    templates_.push_back(std::move(tmpl));
+    return true;
+}
+
+double IntentMatcher::score(const Template& tmpl, const std::vector<Token>& tokens,
+                            std::string& command) const {
+    std::vector<bool> used(tokens.size(), false);
+    std::vector<std::string> matched;
+    double intersection = 0.0;
+
+    // 关键词匹配
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const Token& token = tokens[i];
+        if (token.quoted ||
+            !std::binary_search(tmpl.keywords.begin(), tmpl.keywords.end(), token.canon)) {
+            continue;
+        }
+        used[i] = true;
+        if (std::find(matched.begin(), matched.end(), token.canon) == matched.end()) {
+            matched.push_back(token.canon);
+            intersection += weight_of(token.canon);
+        }
+    }
+
+    // 按顺序填充槽位；Word/Path 槽位不能占用其他模板的关键词
+    command = tmpl.command;
+    for (const auto& slot : tmpl.slots) {
+        bool filled = false;
+        for (size_t i = 0; i < tokens.size() && !filled; ++i) {
+            const Token& token = tokens[i];
+            if (used[i] || !fits_slot(token, slot.type)) {
+                continue;
+            }
+            if ((slot.type == SlotType::Word || slot.type == SlotType::Path) &&
+                !token.quoted && keyword_index_.count(token.canon)) {
+                continue;
+            }
+
+            std::string value = slot_value(token, slot.type);
+            if (value.empty()) {
+                continue;
+            }
+            command = Utils::replace_all(command, "{" + slot.name + "}", value);
+            used[i] = true;
+            filled = true;
+        }
+        if (!filled) {
+            return 0.0;
+        }
+    }
+
+    // 未被使用的词降低置信度
+    double extra = 0.0;
+    std::vector<std::string> extras;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (used[i]) {
+            continue;
+        }
+        const std::string& word = tokens[i].quoted ? tokens[i].text : tokens[i].canon;
+        if (std::find(extras.begin(), extras.end(), word) == extras.end()) {
+            extras.push_back(word);
+            extra += tokens[i].quoted ? 1.0 : weight_of(word);
+        }
+    }
+
+    return intersection / (tmpl.keyword_weight + extra);
+}
+
+bool IntentMatcher::has_negation(const std::vector<Token>& tokens) {
+    return std::any_of(tokens.begin(), tokens.end(), [](const Token& token) {
+        return !token.quoted && (kNegations.count(token.canon) || Utils::ends_with(token.canon, "n't") ||
+                                 Utils::starts_with(token.canon, "non-"));
+    });
+}
+
+IntentMatch IntentMatcher::match(const std::string& input) const {
+    IntentMatch best;
+    std::vector<Token> tokens = tokenize(input);
+    if (tokens.empty() || has_negation(tokens)) {
+        return best;
+    }
+
+    // 通过倒排索引只对共享关键词的模板打分
+    std::vector<bool> visited(templates_.size(), false);
+    for (const auto& token : tokens) {
+        if (token.quoted) {
+            continue;
+        }
+        auto it = keyword_index_.find(token.canon);
+        if (it == keyword_index_.end()) {
+            continue;
+        }
+        for (size_t index : it->second) {
+            if (visited[index]) {
+                continue;
+            }
+            visited[index] = true;
+
+            std::string command;
+            double confidence = score(templates_[index], tokens, command);
+            if (confidence > best.confidence) {
+                best.confidence = confidence;
+                best.command = command;
+            }
+        }
+    }
+
+    return best;
+}
+
+bool IntentMatcher::learn(const std::string& input, const std::string& command) {
+    // 含否定词的输入永远不会被匹配，学到也没用
+    if (has_negation(tokenize(input))) {
+        return false;
+    }
+
+    std::vector<std::string> words;
+    std::string generalized = command;
+    bool has_keyword = false;
+    int slot_index = 1;
+
+    for (const auto& token : tokenize(input)) {
+        if (!token.quoted && keyword_index_.count(token.canon)) {
+            words.push_back(token.canon);
+            has_keyword = true;
+            continue;
+        }
+
+        // 原样出现在命令中的词泛化为槽位
+        SlotType type = is_digits(token.text) ? SlotType::Number
+                      : fits_slot(token, SlotType::Extension) ? SlotType::Extension
+                      : SlotType::Word;
+        std::string value = type == SlotType::Extension ? strip_extension_prefix(token.text) : token.text;
+        std::string name = (type == SlotType::Number ? "n" : type == SlotType::Extension ? "ext" : "arg") +
+                           std::to_string(slot_index);
+
+        if (!value.empty() && replace_word(generalized, value, "{" + name + "}")) {
+            words.push_back("{" + name + "}");
+            ++slot_index;
+        } else if (!token.quoted) {
+            words.push_back(token.canon);
+            has_keyword = true;
+        }
+    }
+
+    if (!has_keyword) {
+        return false;
+    }
+
+    std::string pattern = Utils::join(words, " ");
+    if (!add_template(pattern, generalized)) {
+        return false;
+    }
+
+    if (!storage_path_.empty()) {
+        std::ofstream out(storage_path_, std::ios::app);
+        if (out) {
+            out << pattern << '\t' << generalized << '\n';
+        }
+    }
+    return true;
+}
+
+int IntentMatcher::load_templates(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return -1;
+    }
+
+    int loaded = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            continue;
+        }
+        if (add_template(line.substr(0, tab), line.substr(tab + 1))) {
+            ++loaded;
+        }
+    }
+    return loaded;
+}
+
+} // namespace NeXShell
@@ -0,0 +1,433 @@
+#include "job_cgroup.h"
+#include "pipe_sizing.h"
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace NeXShell {
+
+namespace {
+
+// 作业可以使用的控制器
+const char* const JOB_CONTROLLERS[] = {"cpu", "memory", "pids"};
+
+constexpr uint64_t CPU_WEIGHT_MIN = 1;
+constexpr uint64_t CPU_WEIGHT_MAX = 10000;
+constexpr uint64_t CPU_WEIGHT_DEFAULT = 100;
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+bool write_file(const std::string& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size());
+    close(fd);
+    return ok;
+}
+
+std::optional<uint64_t> read_number(const std::string& path) {
+    std::ifstream in(path);
+    uint64_t value = 0;
+    if (in >> value) {
+        return value;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> split_words(const std::string& text) {
+    std::istringstream in(text);
+    std::vector<std::string> words;
+    for (std::string word; in >> word;) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+/**
+ * @brief cgroup2 的挂载点（/proc/self/mountinfo 中 " - " 之后的文件系统类型为 cgroup2）
+ */
+std::string find_cgroup2_mount() {
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    for (std::string line; std::getline(mountinfo, line);) {
+        size_t separator = line.find(" - ");
+        if (separator == std::string::npos || line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+        std::vector<std::string> fields = split_words(line.substr(0, separator));
+        if (fields.size() >= 5) {
+            return fields[4];
+        }
+    }
+    return "";
+}
+
+/**
+ * @brief 本进程在 cgroup v2 层级中的路径（/proc/self/cgroup 中 "0::" 开头的行），根为空串
+ */
+std::optional<std::string> find_own_cgroup() {
+    std::ifstream cgroup("/proc/self/cgroup");
+    for (std::string line; std::getline(cgroup, line);) {
+        if (line.compare(0, 3, "0::") == 0) {
+            std::string path = line.substr(3);
+            return path == "/" ? "" : path;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief 在 dir 的 cgroup.subtree_control 中启用该目录可用的作业控制器
+ */
+void enable_controllers(const std::string& dir) {
+    std::vector<std::string> available = split_words(read_file(dir + "/cgroup.controllers"));
+    for (const char* controller : JOB_CONTROLLERS) {
+        if (std::find(available.begin(), available.end(), controller) != available.end()) {
+            // shell 所在的非根 cgroup 中有进程时内核返回 EBUSY，该控制器就不可用
+            write_file(dir + "/cgroup.subtree_control", std::string("+") + controller);
+        }
+    }
+}
+
+struct CgroupBase {
+    std::string path;
+    std::vector<std::string> controllers;
+    bool owned = false;
+
+    ~CgroupBase() {
+        // 只在作业 cgroup 都已删除时成功；仍有后台作业时保留
+        if (owned) {
+            rmdir(path.c_str());
+        }
+    }
+};
+
+CgroupBase discover_base() {
+    CgroupBase base;
+    const char* root = getenv("NEXSH_CGROUP_ROOT");
+    if (root && *root) {
+        if (access((std::string(root) + "/cgroup.procs").c_str(), W_OK) != 0) {
+            return base;
+        }
+        base.path = root;
+    } else {
+        std::string mount = find_cgroup2_mount();
+        std::optional<std::string> own = find_own_cgroup();
+        if (mount.empty() || !own) {
+            return base;
+        }
+        std::string parent = mount + *own;
+        std::string path = parent + "/nexsh." + std::to_string(getpid());
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            return base;
+        }
+        enable_controllers(parent);
+        base.path = path;
+        base.owned = true;
+    }
+
+    enable_controllers(base.path);
+    std::vector<std::string> enabled = split_words(read_file(base.path + "/cgroup.subtree_control"));
+    for (const char* controller : JOB_CONTROLLERS) {
+        if (std::find(enabled.begin(), enabled.end(), controller) != enabled.end()) {
+            base.controllers.push_back(controller);
+        }
+    }
+    return base;
+}
+
+const CgroupBase& cgroup_base() {
+    static const CgroupBase base = discover_base();
+    return base;
+}
+
+bool has_controller(const char* controller) {
+    const auto& controllers = cgroup_base().controllers;
+    return std::find(controllers.begin(), controllers.end(), controller) != controllers.end();
+}
+
+std::optional<uint64_t> parse_number(const char* text) {
+    if (!text || !*text) {
+        return std::nullopt;
+    }
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (*end != '\0' || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(value);
+}
+
+std::string format_seconds(uint64_t usec) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.2fs", static_cast<double>(usec) / 1e6);
+    return buffer;
+}
+
+} // namespace
+
+std::optional<uint64_t> JobLimits::parse_size(const std::string& text) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        ++digits;
+    }
+    if (digits == 0 || digits + 1 < text.size()) {
+        return std::nullopt;
+    }
+    uint64_t value = std::strtoull(text.substr(0, digits).c_str(), nullptr, 10);
+    if (digits < text.size()) {
+        switch (std::toupper(static_cast<unsigned char>(text[digits]))) {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            case 'G': value <<= 30; break;
+            default: return std::nullopt;
+        }
+    }
+    if (value == 0) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+bool JobLimits::set_option(const std::string& option, const std::string& value) {
+    if (option == "-m") {
+        std::optional<uint64_t> size = parse_size(value);
+        memory_max = size ? size : memory_max;
+        return size.has_value();
+    }
+    std::optional<uint64_t> number = parse_number(value.c_str());
+    if (option == "-c" && number && *number >= CPU_WEIGHT_MIN && *number <= CPU_WEIGHT_MAX) {
+        cpu_weight = number;
+        return true;
+    }
+    if (option == "-p" && number && *number > 0) {
+        pids_max = number;
+        return true;
+    }
+    return false;
+}
+
+JobLimits JobLimits::from_environment() {
+    JobLimits limits;
+    auto weight = parse_number(getenv("NEXSH_JOB_CPU_WEIGHT"));
+    if (weight && *weight >= CPU_WEIGHT_MIN && *weight <= CPU_WEIGHT_MAX) {
+        limits.cpu_weight = weight;
+    }
+    const char* memory = getenv("NEXSH_JOB_MEMORY_MAX");
+    if (memory && *memory) {
+        limits.memory_max = parse_size(memory);
+    }
+    auto pids = parse_number(getenv("NEXSH_JOB_PIDS_MAX"));
+    if (pids && *pids > 0) {
+        limits.pids_max = pids;
+    }
+    return limits;
+}
+
+std::string JobLimits::describe() const {
+    if (empty()) {
+        return "none";
+    }
+    std::string text;
+    auto append = [&text](const std::string& item) {
+        text += text.empty() ? item : " " + item;
+    };
+    if (cpu_weight) {
+        append("cpu.weight=" + std::to_string(*cpu_weight));
+    }
+    if (memory_max) {
+        append("memory.max=" + PipeSizer::format_size(static_cast<double>(*memory_max)));
+    }
+    if (pids_max) {
+        append("pids.max=" + std::to_string(*pids_max));
+    }
+    return text;
+}
+
+void JobLimits::apply_rlimits() const {
+    if (memory_max) {
+        struct rlimit limit = {static_cast<rlim_t>(*memory_max), static_cast<rlim_t>(*memory_max)};
+        setrlimit(RLIMIT_AS, &limit);
+    }
+    if (pids_max) {
+        struct rlimit limit = {static_cast<rlim_t>(*pids_max), static_cast<rlim_t>(*pids_max)};
+        setrlimit(RLIMIT_NPROC, &limit);
+    }
+    if (cpu_weight && *cpu_weight != CPU_WEIGHT_DEFAULT) {
+        // 调度器中相邻 nice 级别的权重相差约 1.25 倍；提高优先级需要特权，失败时忽略
+        int nice = 0;
+        double weight = static_cast<double>(*cpu_weight);
+        while (weight < CPU_WEIGHT_DEFAULT / 1.25 && nice < 19) {
+            weight *= 1.25;
+            ++nice;
+        }
+        while (weight > CPU_WEIGHT_DEFAULT * 1.25 && nice > -20) {
+            weight /= 1.25;
+            --nice;
+        }
+        setpriority(PRIO_PROCESS, 0, nice);
+    }
+}
+
+std::string CgroupStats::format() const {
+    std::string text = "cpu " + format_seconds(usage_usec) + " (user " + format_seconds(user_usec) +
+                       ", sys " + format_seconds(system_usec) + ")";
+    if (memory_current) {
+        text += ", mem " + PipeSizer::format_size(static_cast<double>(*memory_current));
+        if (memory_peak) {
+            text += " (peak " + PipeSizer::format_size(static_cast<double>(*memory_peak)) + ")";
+        }
+    } else if (processes > 0) {
+        text += ", rss " + PipeSizer::format_size(static_cast<double>(rss_bytes));
+    }
+    text += ", pids " + std::to_string(pids_current.value_or(processes));
+    return text;
+}
+
+JobCgroup::~JobCgroup() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    // 仍有进程（例如脱离的后台孙进程）时内核返回 EBUSY，保留节点
+    rmdir(path_.c_str());
+}
+
+bool JobCgroup::enabled(const JobLimits& limits) {
+    if (!limits.empty()) {
+        return true;
+    }
+    const char* value = getenv("NEXSH_JOB_CGROUPS");
+    return value && std::string(value) == "1";
+}
+
+const std::string& JobCgroup::base_path() {
+    return cgroup_base().path;
+}
+
+const std::vector<std::string>& JobCgroup::controllers() {
+    return cgroup_base().controllers;
+}
+
+std::unique_ptr<JobCgroup> JobCgroup::create(const JobLimits& limits) {
+    const std::string& base = base_path();
+    if (base.empty()) {
+        return nullptr;
+    }
+    static std::atomic<unsigned> sequence{0};
+    std::string path = base + "/job-" + std::to_string(++sequence);
+    if (mkdir(path.c_str(), 0755) != 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<JobCgroup> cgroup(new JobCgroup());
+    cgroup->path_ = path;
+    cgroup->procs_path_ = path + "/cgroup.procs";
+    cgroup->fd_ = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    cgroup->limits_ = limits;
+
+    auto apply = [&path](const char* controller, const char* file, const std::optional<uint64_t>& value) {
+        return !value || (has_controller(controller) && write_file(path + "/" + file, std::to_string(*value)));
+    };
+    if (!apply("cpu", "cpu.weight", limits.cpu_weight)) {
+        cgroup->unenforced_.cpu_weight = limits.cpu_weight;
+    }
+    if (!apply("memory", "memory.max", limits.memory_max)) {
+        cgroup->unenforced_.memory_max = limits.memory_max;
+    }
+    if (!apply("pids", "pids.max", limits.pids_max)) {
+        cgroup->unenforced_.pids_max = limits.pids_max;
+    }
+    return cgroup;
+}
+
+pid_t JobCgroup::spawn(const JobCgroup* cgroup, const JobLimits& limits) {
+    // seccomp 过滤或旧内核拒绝 clone3 后不再尝试
+    static std::atomic<bool> clone3_usable{true};
+    if (cgroup && cgroup->fd_ >= 0 && clone3_usable) {
+        struct clone_args args = {};
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = static_cast<uint64_t>(cgroup->fd_);
+        long pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid == 0) {
+            cgroup->unenforced_.apply_rlimits();
+            return 0;
+        }
+        if (pid > 0) {
+            return static_cast<pid_t>(pid);
+        }
+        if (errno == ENOSYS || errno == E2BIG || errno == EINVAL || errno == EPERM) {
+            clone3_usable = false;
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        bool moved = false;
+        if (cgroup) {
+            int fd = open(cgroup->procs_path_.c_str(), O_WRONLY | O_CLOEXEC);
+            moved = fd >= 0 && write(fd, "0", 1) == 1;
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        (moved ? cgroup->unenforced_ : limits).apply_rlimits();
+    }
+    return pid;
+}
+
+CgroupStats JobCgroup::stats() const {
+    CgroupStats stats;
+    std::istringstream cpu(read_file(path_ + "/cpu.stat"));
+    std::string key;
+    uint64_t value = 0;
+    while (cpu >> key >> value) {
+        if (key == "usage_usec") {
+            stats.usage_usec = value;
+        } else if (key == "user_usec") {
+            stats.user_usec = value;
+        } else if (key == "system_usec") {
+            stats.system_usec = value;
+        }
+    }
+    stats.memory_current = read_number(path_ + "/memory.current");
+    stats.memory_peak = read_number(path_ + "/memory.peak");
+    stats.pids_current = read_number(path_ + "/pids.current");
+
+    // 没有 memory 控制器时把组内各进程的 VmRSS 相加
+    std::istringstream procs(read_file(procs_path_));
+    for (pid_t pid; procs >> pid;) {
+        ++stats.processes;
+        if (stats.memory_current) {
+            continue;
+        }
+        std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+        for (std::string line; std::getline(status, line);) {
+            if (line.compare(0, 6, "VmRSS:") == 0) {
+                stats.rss_bytes += std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+} // namespace NeXShell
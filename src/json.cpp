@@ -0,0 +1,314 @@
+#include "json.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace NeXShell {
+
+/**
+ * @brief 递归下降 JSON 解析器
+ */
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : text_(text) {}
+
+    bool parse_document(JsonValue& value) {
+        skip_whitespace();
+        if (!parse_value(value, 0)) {
+            return false;
+        }
+        skip_whitespace();
+        return pos_ == text_.size();
+    }
+
+private:
+    static constexpr int kMaxDepth = 256;
+
+    void skip_whitespace() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char expected) {
+        if (pos_ < text_.size() && text_[pos_] == expected) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_literal(std::string_view literal) {
+        if (text_.substr(pos_, literal.size()) == literal) {
+            pos_ += literal.size();
+            return true;
+        }
+        return false;
+    }
+
+    bool parse_value(JsonValue& value, int depth) {
+        if (depth > kMaxDepth || pos_ >= text_.size()) {
+            return false;
+        }
+
+        char c = text_[pos_];
+        if (c == '{') {
+            return parse_object(value, depth);
+        }
+        if (c == '[') {
+            return parse_array(value, depth);
+        }
+        if (c == '"') {
+            value.type_ = JsonValue::Type::String;
+            return parse_string(value.string_);
+        }
+        if (consume_literal("true")) {
+            value.type_ = JsonValue::Type::Bool;
+            value.bool_ = true;
+            return true;
+        }
+        if (consume_literal("false")) {
+            value.type_ = JsonValue::Type::Bool;
+            value.bool_ = false;
+            return true;
+        }
+        if (consume_literal("null")) {
+            value.type_ = JsonValue::Type::Null;
+            return true;
+        }
+        return parse_number(value);
+    }
+
+    bool parse_object(JsonValue& value, int depth) {
+        value.type_ = JsonValue::Type::Object;
+        ++pos_; // 跳过 '{'
+        skip_whitespace();
+        if (consume('}')) {
+            return true;
+        }
+
+        while (true) {
+            skip_whitespace();
+            std::string key;
+            if (pos_ >= text_.size() || text_[pos_] != '"' || !parse_string(key)) {
+                return false;
+            }
+            skip_whitespace();
+            if (!consume(':')) {
+                return false;
+            }
+            skip_whitespace();
+            JsonValue member;
+            if (!parse_value(member, depth + 1)) {
+                return false;
+            }
+            value.keys_.push_back(std::move(key));
+            value.items_.push_back(std::move(member));
+            skip_whitespace();
+            if (consume('}')) {
+                return true;
+            }
+            if (!consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool parse_array(JsonValue& value, int depth) {
+        value.type_ = JsonValue::Type::Array;
+        ++pos_; // 跳过 '['
+        skip_whitespace();
+        if (consume(']')) {
+            return true;
+        }
+
+        while (true) {
+            skip_whitespace();
+            JsonValue item;
+            if (!parse_value(item, depth + 1)) {
+                return false;
+            }
+            value.items_.push_back(std::move(item));
+            skip_whitespace();
+            if (consume(']')) {
+                return true;
+            }
+            if (!consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool parse_hex4(unsigned& code) {
+        if (pos_ + 4 > text_.size()) {
+            return false;
+        }
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char h = text_[pos_++];
+            code <<= 4;
+            if (h >= '0' && h <= '9') code |= static_cast<unsigned>(h - '0');
+            else if (h >= 'a' && h <= 'f') code |= static_cast<unsigned>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') code |= static_cast<unsigned>(h - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool parse_string(std::string& out) {
+        ++pos_; // 跳过开头的引号
+        while (pos_ < text_.size()) {
+            char c = text_[pos_++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+
+            char escape = text_[pos_++];
+            switch (escape) {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    unsigned code;
+                    if (!parse_hex4(code)) {
+                        return false;
+                    }
+                    // 代理对
+                    if (code >= 0xD800 && code <= 0xDBFF && consume_literal("\\u")) {
+                        unsigned low;
+                        if (!parse_hex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool parse_number(JsonValue& value) {
+        size_t start = pos_;
+        if (pos_ < text_.size() && text_[pos_] == '-') {
+            ++pos_;
+        }
+        while (pos_ < text_.size() &&
+               ((text_[pos_] >= '0' && text_[pos_] <= '9') || text_[pos_] == '.' ||
+                text_[pos_] == 'e' || text_[pos_] == 'E' || text_[pos_] == '+' || text_[pos_] == '-')) {
+            ++pos_;
+        }
+        if (pos_ == start) {
+            return false;
+        }
+
+        std::string number(text_.substr(start, pos_ - start));
+        char* end = nullptr;
+        value.number_ = std::strtod(number.c_str(), &end);
+        value.type_ = JsonValue::Type::Number;
+        return end == number.c_str() + number.size();
+    }
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+std::optional<JsonValue> JsonValue::parse(std::string_view text) {
+    JsonValue value;
+    JsonParser parser(text);
+    if (!parser.parse_document(value)) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+std::string JsonValue::quote(std::string_view text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+    return out;
+}
+
+bool JsonValue::as_bool(bool default_value) const {
+    return type_ == Type::Bool ? bool_ : default_value;
+}
+
+double JsonValue::as_number(double default_value) const {
+    return type_ == Type::Number ? number_ : default_value;
+}
+
+std::string JsonValue::as_string(const std::string& default_value) const {
+    return type_ == Type::String ? string_ : default_value;
+}
+
+const JsonValue* JsonValue::find(std::string_view key) const {
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        if (keys_[i] == key) {
+            return &items_[i];
+        }
+    }
+    return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const {
+    static const JsonValue null_value;
+    const JsonValue* member = find(key);
+    return member ? *member : null_value;
+}
+
+} // namespace NeXShell
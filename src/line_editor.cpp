@@ -0,0 +1,177 @@
+#include "line_editor.h"
+#include <iostream>
+#include <cerrno>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace NeXShell {
+
+namespace {
+
+/**
+ * @brief 在作用域内把终端切换到原始模式，退出时恢复
+ */
+class RawModeGuard {
+public:
+    explicit RawModeGuard(int fd) : fd_(fd) {
+        if (tcgetattr(fd_, &saved_) != 0) {
+            return;
+        }
+        termios raw = saved_;
+        raw.c_iflag &= ~static_cast<tcflag_t>(IXON | ICRNL);
+        raw.c_lflag &= ~static_cast<tcflag_t>(ECHO | ICANON | ISIG | IEXTEN);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        active_ = tcsetattr(fd_, TCSAFLUSH, &raw) == 0;
+    }
+
+    ~RawModeGuard() {
+        if (active_) {
+            tcsetattr(fd_, TCSAFLUSH, &saved_);
+        }
+    }
+
+    bool active() const { return active_; }
+
+private:
+    int fd_;
+    termios saved_{};
+    bool active_ = false;
+};
+
+constexpr char kCtrlC = 3;
+constexpr char kCtrlD = 4;
+constexpr char kBackspace = 8;
+constexpr char kCtrlU = 21;
+constexpr char kCtrlW = 23;
+constexpr char kEscape = 27;
+constexpr char kDelete = 127;
+
+} // namespace
+
+LineEditor::LineEditor(int fd) : fd_(fd) {}
+
+bool LineEditor::is_supported(int fd) {
+    return isatty(fd) == 1;
+}
+
+void LineEditor::set_idle_callback(IdleCallback callback, int idle_ms) {
+    idle_callback_ = std::move(callback);
+    idle_ms_ = idle_ms;
+}
+
+bool LineEditor::read_line(const std::string& prompt, std::string& line) {
+    line.clear();
+    std::cout << prompt;
+    std::cout.flush();
+
+    RawModeGuard raw_mode(fd_);
+    if (!raw_mode.active()) {
+        // 无法切换模式时退回行缓冲读取
+        return static_cast<bool>(std::getline(std::cin, line));
+    }
+
+    bool idle_notified = true;  // 缓冲区自上次回调后是否未变
+    while (true) {
+        if (idle_callback_ && !idle_notified) {
+            pollfd pfd{fd_, POLLIN, 0};
+            int ready = poll(&pfd, 1, idle_ms_);
+            if (ready == 0) {
+                idle_notified = true;
+                idle_callback_(line);
+                continue;
+            }
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+        }
+
+        char c;
+        ssize_t n = read(fd_, &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cout << std::endl;
+            return !line.empty();
+        }
+
+        switch (c) {
+            case '\r':
+            case '\n':
+                std::cout << std::endl;
+                return true;
+            case kCtrlD:
+                if (line.empty()) {
+                    std::cout << std::endl;
+                    return false;
+                }
+                break;
+            case kCtrlC:
+                std::cout << "^C" << std::endl;
+                line.clear();
+                return true;
+            case kBackspace:
+            case kDelete:
+                if (!line.empty()) {
+                    erase_last_char(line);
+                    idle_notified = false;
+                }
+                break;
+            case kCtrlU:
+                while (!line.empty()) {
+                    erase_last_char(line);
+                }
+                idle_notified = false;
+                break;
+            case kCtrlW:
+                while (!line.empty() && line.back() == ' ') {
+                    erase_last_char(line);
+                }
+                while (!line.empty() && line.back() != ' ') {
+                    erase_last_char(line);
+                }
+                idle_notified = false;
+                break;
+            case kEscape:
+                skip_escape_sequence();
+                break;
+            default:
+                if (static_cast<unsigned char>(c) >= 32) {
+                    line += c;
+                    std::cout << c;
+                    idle_notified = false;
+                }
+                break;
+        }
+        std::cout.flush();
+    }
+}
+
+void LineEditor::erase_last_char(std::string& buffer) {
+    // 去掉 UTF-8 续字节，再去掉首字节
+    while (!buffer.empty() && (static_cast<unsigned char>(buffer.back()) & 0xC0) == 0x80) {
+        buffer.pop_back();
+    }
+    if (!buffer.empty()) {
+        buffer.pop_back();
+    }
+    std::cout << "\b \b";
+}
+
+void LineEditor::skip_escape_sequence() {
+    // CSI 序列：ESC [ 参数... 终止字节（0x40~0x7E）
+    pollfd pfd{fd_, POLLIN, 0};
+    char c;
+    if (poll(&pfd, 1, 0) <= 0 || read(fd_, &c, 1) != 1 || c != '[') {
+        return;
+    }
+    while (poll(&pfd, 1, 0) > 0 && read(fd_, &c, 1) == 1) {
+        if (c >= 0x40 && c <= 0x7E) {
+            return;
+        }
+    }
+}
+
+} // namespace NeXShell
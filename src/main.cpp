@@ -1,8 +1,116 @@
 #include "shell.h"
+#include "fork_server.h"
+#include "shell_daemon.h"
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <exception>
+#include <signal.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+/**
+ * @brief 运行 nexshd：nexshd [--socket PATH] [--threads N]
+ * @param first 第一个选项在 argv 中的位置
+ * @return 程序退出码
+ */
+int run_daemon(int argc, char* argv[], int first) {
+    std::string socket_path = NeXShell::ShellDaemon::default_socket_path();
+    size_t threads = 4;
+    for (int i = first; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (option == "--threads" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            threads = static_cast<size_t>(std::atoi(argv[++i]));
+        } else {
+            std::cerr << "usage: nexshd [--socket PATH] [--threads N]" << std::endl;
+            return 2;
+        }
+    }
+    
+    // 在启动任何线程之前屏蔽停止信号，由主线程用 sigwait 等待
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    // Shell 只初始化一次（环境变量、AI 服务探测），之后由每个工作进程继承
+    NeXShell::Shell shell;
+    NeXShell::ShellDaemon daemon(socket_path, threads,
+        [&shell](NeXShell::DaemonSession& session, const std::string& command) {
+            if (!shell.enter_session(session.cwd, session.environment)) {
+                return 1;
+            }
+            int exit_code = shell.execute_command(command);
+            session.cwd = shell.get_current_directory();
+            session.environment.clear();
+            for (char** env = environ; *env; ++env) {
+                session.environment.emplace_back(*env);
+            }
+            return exit_code;
+        });
+    if (!daemon.start()) {
+        return EXIT_FAILURE;
+    }
+    std::cerr << "nexshd: listening on " << socket_path << std::endl;
+    
+    int received = 0;
+    sigwait(&signals, &received);
+    daemon.stop();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief 把命令转发给 nexshd：nexsh --client [--socket PATH] [--session NAME] command...
+ * @param first 第一个选项在 argv 中的位置
+ * @return 命令的退出码
+ */
+int run_client(int argc, char* argv[], int first) {
+    std::string socket_path = NeXShell::ShellDaemon::default_socket_path();
+    const char* session_env = getenv("NEXSH_SESSION");
+    std::string session = session_env ? session_env : "";
+    int i = first;
+    for (; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--socket") {
+            socket_path = argv[i + 1];
+        } else if (option == "--session") {
+            session = argv[i + 1];
+        } else {
+            break;
+        }
+    }
+    std::string command;
+    for (; i < argc; ++i) {
+        if (!command.empty()) command += " ";
+        command += argv[i];
+    }
+    if (command.empty()) {
+        std::cerr << "usage: nexsh --client [--socket PATH] [--session NAME] command..." << std::endl;
+        return 2;
+    }
+    
+    auto client = NeXShell::DaemonClient::connect(socket_path);
+    if (!client) {
+        std::cerr << "nexsh: cannot connect to nexshd at " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return 255;
+    }
+    int exit_code = client->execute(command, session);
+    if (exit_code < 0) {
+        std::cerr << "nexsh: nexshd request failed: " << std::strerror(errno) << std::endl;
+        return 255;
+    }
+    return exit_code;
+}
+
+} // namespace
 
 /**
  * @brief 程序入口点
@@ -11,6 +119,24 @@
  * @return 程序退出码
  */
 int main(int argc, char* argv[]) {
+    // fork server 辅助进程：在创建 Shell 之前进入，保持内存占用最小
+    if (argc == 3 && std::string(argv[1]) == "--fork-server") {
+        return NeXShell::ForkServer::serve(std::atoi(argv[2]));
+    }
+    
+    // nexshd：常驻的守护进程（以 nexshd 的名字运行，或 nexsh --daemon）；
+    // --client 不创建 Shell，只把命令转发给它
+    std::string program = argv[0];
+    if (program.substr(program.rfind('/') + 1) == "nexshd") {
+        return run_daemon(argc, argv, 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--daemon") {
+        return run_daemon(argc, argv, 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--client") {
+        return run_client(argc, argv, 2);
+    }
+    
     try {
         // 创建 Shell 实例
         NeXShell::Shell shell;
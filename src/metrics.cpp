@@ -0,0 +1,166 @@
+#include "metrics.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace NeXShell {
+
+namespace {
+
+const double QUANTILES[] = {0.5, 0.9, 0.99};
+
+std::string seconds(uint64_t ns) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(ns) / 1e9);
+    return buffer;
+}
+
+std::string human_duration(uint64_t ns) {
+    char buffer[32];
+    if (ns < 1000) {
+        snprintf(buffer, sizeof(buffer), "%lluns", static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        snprintf(buffer, sizeof(buffer), "%.1fus", static_cast<double>(ns) / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buffer, sizeof(buffer), "%.2fms", static_cast<double>(ns) / 1e6);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.2fs", static_cast<double>(ns) / 1e9);
+    }
+    return buffer;
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucket_index(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return static_cast<size_t>(ns);
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    size_t mantissa = static_cast<size_t>(ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    size_t index = static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + mantissa;
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::bucket_lower(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    return (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    return bucket_lower(index) + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::record_ns(uint64_t ns) {
+    buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile_ns(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t middle = bucket_lower(i) + (bucket_upper(i) - bucket_lower(i)) / 2;
+            return std::min(middle, max_ns());
+        }
+    }
+    return max_ns();
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+std::string Metrics::to_prometheus() const {
+    std::ostringstream out;
+    for (const Counter* counter : {&commands, &forks, &builtins, &path_cache_hits, &path_cache_misses,
+                                   &zero_copy_bytes, &ai_requests, &ai_failures, &ai_hedges, &ai_cache_hits,
+                                   &ai_local_answers, &command_cache_hits, &command_cache_misses}) {
+        out << "# HELP " << counter->name() << " " << counter->help() << "\n"
+            << "# TYPE " << counter->name() << " counter\n"
+            << counter->name() << " " << counter->value() << "\n";
+    }
+    out << "# HELP " << history_size.name() << " " << history_size.help() << "\n"
+        << "# TYPE " << history_size.name() << " gauge\n"
+        << history_size.name() << " " << history_size.value() << "\n";
+    for (const LatencyHistogram* histogram : {&parse_latency, &fork_latency, &command_latency, &ai_latency}) {
+        out << "# HELP " << histogram->name() << " " << histogram->help() << "\n"
+            << "# TYPE " << histogram->name() << " summary\n";
+        for (double q : QUANTILES) {
+            out << histogram->name() << "{quantile=\"" << q << "\"} " << seconds(histogram->percentile_ns(q)) << "\n";
+        }
+        out << histogram->name() << "_sum " << seconds(histogram->sum_ns()) << "\n"
+            << histogram->name() << "_count " << histogram->count() << "\n";
+    }
+    return out.str();
+}
+
+std::string Metrics::to_table() const {
+    std::ostringstream out;
+    char line[160];
+    for (const Counter* counter : {&commands, &forks, &builtins, &path_cache_hits, &path_cache_misses,
+                                   &zero_copy_bytes, &ai_requests, &ai_failures, &ai_hedges, &ai_cache_hits,
+                                   &ai_local_answers, &command_cache_hits, &command_cache_misses}) {
+        snprintf(line, sizeof(line), "%-40s %12llu\n", counter->name(),
+                 static_cast<unsigned long long>(counter->value()));
+        out << line;
+    }
+    snprintf(line, sizeof(line), "%-40s %12lld\n", history_size.name(),
+             static_cast<long long>(history_size.value()));
+    out << line;
+
+    snprintf(line, sizeof(line), "\n%-26s %8s %10s %10s %10s %10s\n", "latency", "count", "p50", "p90", "p99", "max");
+    out << line;
+    for (const LatencyHistogram* histogram : {&parse_latency, &fork_latency, &command_latency, &ai_latency}) {
+        snprintf(line, sizeof(line), "%-26s %8llu %10s %10s %10s %10s\n", histogram->name(),
+                 static_cast<unsigned long long>(histogram->count()),
+                 human_duration(histogram->percentile_ns(0.5)).c_str(),
+                 human_duration(histogram->percentile_ns(0.9)).c_str(),
+                 human_duration(histogram->percentile_ns(0.99)).c_str(),
+                 human_duration(histogram->max_ns()).c_str());
+        out << line;
+    }
+    return out.str();
+}
+
+bool Metrics::write_textfile(const std::string& path) const {
+    // node_exporter 可能随时读取，先写临时文件再原子替换
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << to_prometheus();
+        if (!out) {
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace NeXShell
@@ -1,4 +1,8 @@
 #include "ollama_connector.h"
+#include "json.h"
+#include "utils.h"
+#include "tracer.h"
+#include "metrics.h"
 #include <iostream>
 #include <sstream>
 #include <memory>
@@ -6,51 +10,228 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <cstddef>
 #include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <chrono>
+#include <future>
+#include <cerrno>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+extern char **environ;
 
 namespace NeXShell {
 
-OllamaConnector::OllamaConnector(const std::string& api_endpoint) 
-    : api_endpoint_(api_endpoint), timeout_seconds_(30) {}
+namespace {
 
-std::string OllamaConnector::query_model(const std::string& prompt, const std::string& model) {
-    if (!is_service_available()) {
-        return "Error: Ollama service is not available. Please start Ollama first.";
+/**
+ * @brief 生成进程内唯一的临时文件路径，允许多个请求并发进行
+ */
+std::string make_temp_path(const std::string& prefix) {
+    static std::atomic<unsigned> counter{0};
+    return "/tmp/" + prefix + std::to_string(getpid()) + "_" +
+           std::to_string(counter.fetch_add(1)) + ".json";
+}
+
+/**
+ * @brief 拆分逗号分隔的端点列表
+ */
+std::vector<std::string> split_endpoints(const std::string& endpoints) {
+    std::vector<std::string> result;
+    for (const auto& endpoint : Utils::split(endpoints, ',')) {
+        std::string trimmed = Utils::trim(endpoint);
+        while (!trimmed.empty() && trimmed.back() == '/') {
+            trimmed.pop_back();
+        }
+        if (!trimmed.empty()) {
+            result.push_back(trimmed);
+        }
     }
+    return result;
+}
 
-    // 构建请求JSON
-    std::string json_data = R"({
-        "model": ")" + model + R"(",
-        "prompt": ")" + prompt + R"(",
-        "stream": false
-    })";
+/**
+ * @brief 一次 curl 调用的结果
+ */
+struct CurlResult {
+    bool ok = false;        // curl 正常退出、HTTP 状态为 2xx 且有输出
+    int http_status = 0;
+    std::string output;     // 响应体（不含 -w 追加的状态码）
+};
+
+// 追加在响应体后面的 HTTP 状态码，由 run_curl 去掉
+const char* const kStatusFormat = "\n%{http_code}";
 
-    // 创建临时文件保存JSON数据
-    std::string temp_file = "/tmp/ollama_request_" + std::to_string(getpid()) + ".json";
-    std::string cmd = "echo '" + json_data + "' > " + temp_file;
-    system(cmd.c_str());
+/**
+ * @brief 响应是否为 Ollama 的错误对象（{"error": ...}）
+ */
+bool is_error_body(const std::string& output) {
+    if (output.find("\"error\"") == std::string::npos) {
+        return false;
+    }
+    auto json = JsonValue::parse(output);
+    return json && json->is_object() && json->find("error") != nullptr;
+}
 
-    // 使用curl发送请求
-    std::string curl_cmd = "curl -s -X POST " + api_endpoint_ + "/api/generate -H 'Content-Type: application/json' -d @" + temp_file;
-    std::string response = execute_command(curl_cmd);
+/**
+ * @brief 直接启动 curl（不经过 shell）并读取输出，cancel 置位时终止进程
+ */
+CurlResult run_curl(const std::vector<std::string>& args, const std::atomic<bool>& cancel) {
+    TraceScope trace("ai", "curl", args.back());
+    CurlResult result;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return result;
+    }
+
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
 
-    // 清理临时文件
-    std::string cleanup_cmd = "rm -f " + temp_file;
-    system(cleanup_cmd.c_str());
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, "curl", &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (spawned != 0) {
+        close(fds[0]);
+        return result;
+    }
+
+    bool killed = false;
+    pollfd pfd{fds[0], POLLIN, 0};
+    char buffer[4096];
+    while (true) {
+        if (!killed && cancel.load()) {
+            kill(pid, SIGKILL);
+            killed = true;
+        }
+        int ready = poll(&pfd, 1, 50);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) {
+            continue;
+        }
+        if (ready < 0) {
+            break;
+        }
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        result.output.append(buffer, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    size_t newline = result.output.rfind('\n');
+    if (newline != std::string::npos) {
+        result.http_status = std::atoi(result.output.c_str() + newline + 1);
+        result.output.erase(newline);
+    }
+    result.ok = !killed && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                result.http_status >= 200 && result.http_status < 300 && !result.output.empty();
+    return result;
+}
+
+} // namespace
+
+OllamaConnector::OllamaConnector(const std::string& api_endpoint) 
+    : endpoints_(split_endpoints(api_endpoint)), timeout_seconds_(30) {}
+
+std::string OllamaConnector::query_model(const std::string& prompt, const std::string& model,
+                                         const std::atomic<bool>* cancel) {
+    OllamaGeneration result = generate(prompt, model, "", {}, "", cancel);
+    if (!result.success) {
+        return "Error: " + result.error;
+    }
+    return result.response;
+}
+
+OllamaGeneration OllamaConnector::generate(const std::string& prompt, const std::string& model,
+                                           const std::string& system,
+                                           const std::vector<int>& context,
+                                           const std::string& format,
+                                           const std::atomic<bool>* cancel) {
+    if (!is_service_available()) {
+        OllamaGeneration result;
+        result.error = "Ollama service is not available. Please start Ollama first.";
+        return result;
+    }
+
+    // 构建请求JSON
+    std::ostringstream json;
+    json << "{\"model\":" << JsonValue::quote(model)
+         << ",\"prompt\":" << JsonValue::quote(prompt)
+         << ",\"stream\":false";
+    if (!system.empty()) {
+        json << ",\"system\":" << JsonValue::quote(system);
+    }
+    if (!context.empty()) {
+        // 复用上一轮的上下文，服务端无需重新评估历史
+        json << ",\"context\":[";
+        for (size_t i = 0; i < context.size(); ++i) {
+            if (i > 0) json << ',';
+            json << context[i];
+        }
+        json << ']';
+    }
+    if (!format.empty()) {
+        // JSON Schema 原样嵌入，其余（如 "json"）作为字符串
+        json << ",\"format\":" << (format[0] == '{' ? format : JsonValue::quote(format));
+    }
+    if (!keep_alive_.empty()) {
+        json << ",\"keep_alive\":" << JsonValue::quote(keep_alive_);
+    }
+    json << '}';
 
+    std::string response = send_http_request("/api/generate", json.str(), cancel);
     if (response.empty()) {
-        return "Error: No response from Ollama service";
+        OllamaGeneration result;
+        result.error = cancel && cancel->load() ? "Request cancelled" : "No response from Ollama service";
+        return result;
     }
 
     return parse_ollama_response(response);
 }
 
+std::vector<float> OllamaConnector::embed(const std::string& text, const std::string& model) {
+    std::vector<float> embedding;
+    std::string json = "{\"model\":" + JsonValue::quote(model) +
+                       ",\"prompt\":" + JsonValue::quote(text) + "}";
+    std::string response = send_http_request("/api/embeddings", json);
+    
+    auto parsed = JsonValue::parse(response);
+    if (!parsed) {
+        return embedding;
+    }
+    const auto& values = (*parsed)["embedding"].items();
+    embedding.reserve(values.size());
+    for (const auto& value : values) {
+        embedding.push_back(static_cast<float>(value.as_number()));
+    }
+    return embedding;
+}
+
 bool OllamaConnector::is_service_available() {
     try {
-        std::string check_cmd = "curl -s " + api_endpoint_ + "/api/tags";
-        std::string response = execute_command(check_cmd);
+        std::string response = send_http_request("/api/tags", "");
         return !response.empty() && response.find("models") != std::string::npos;
     } catch (...) {
         return false;
@@ -61,18 +242,16 @@ std::vector<std::string> OllamaConnector::get_available_models() {
     std::vector<std::string> models;
     
     try {
-        std::string cmd = "curl -s " + api_endpoint_ + "/api/tags";
-        std::string response = execute_command(cmd);
+        std::string response = send_http_request("/api/tags", "");
         
-        // 使用简单的字符串查找提取模型名称
-        size_t pos = 0;
-        while ((pos = response.find("\"name\":\"", pos)) != std::string::npos) {
-            pos += 8; // 跳过 "name":"
-            size_t end_pos = response.find("\"", pos);
-            if (end_pos != std::string::npos) {
-                std::string model_name = response.substr(pos, end_pos - pos);
-                models.push_back(model_name);
-                pos = end_pos;
+        // 提取 models[].name
+        auto json = JsonValue::parse(response);
+        if (json) {
+            for (const auto& model : (*json)["models"].items()) {
+                std::string name = model["name"].as_string();
+                if (!name.empty()) {
+                    models.push_back(name);
+                }
             }
         }
     } catch (...) {
@@ -87,112 +266,193 @@ void OllamaConnector::set_timeout(int timeout_seconds) {
     timeout_seconds_ = timeout_seconds;
 }
 
-std::string OllamaConnector::send_http_request(const std::string& endpoint, const std::string& json_data) {
-    // 创建临时文件保存JSON数据
-    std::string temp_file = "/tmp/ollama_json_" + std::to_string(getpid()) + ".json";
-    std::string cmd = "echo '" + json_data + "' > " + temp_file;
-    system(cmd.c_str());
+void OllamaConnector::set_keep_alive(const std::string& keep_alive) {
+    keep_alive_ = keep_alive;
+}
 
-    // 使用curl发送请求
-    std::string curl_cmd = "curl -s -X POST " + api_endpoint_ + endpoint + 
-                          " -H 'Content-Type: application/json' -d @" + temp_file +
-                          " --max-time " + std::to_string(timeout_seconds_);
-    std::string response = execute_command(curl_cmd);
+void OllamaConnector::set_hedge_percentile(double percentile) {
+    endpoints_.set_hedge_percentile(percentile);
+}
 
-    // 清理临时文件
-    std::string cleanup_cmd = "rm -f " + temp_file;
-    system(cleanup_cmd.c_str());
+std::vector<EndpointStatus> OllamaConnector::get_endpoint_status() const {
+    return endpoints_.status();
+}
 
+std::string OllamaConnector::send_http_request(const std::string& endpoint, const std::string& json_data,
+                                               const std::atomic<bool>* cancel) {
+    TraceScope trace("ai", "http", endpoint);
+    Metrics& metrics = Metrics::instance();
+    metrics.ai_requests.inc();
+    auto start = std::chrono::steady_clock::now();
+    
+    std::string response;
+    if (json_data.empty()) {
+        response = route_request(endpoint, "", cancel);
+    } else {
+        // 创建临时文件保存JSON数据（直接写文件，避免经过 shell 转义）
+        std::string temp_file = make_temp_path("ollama_json_");
+        bool written;
+        {
+            std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+            written = static_cast<bool>(out << json_data);
+        }
+        if (written) {
+            response = route_request(endpoint, temp_file, cancel);
+        }
+        
+        // 清理临时文件
+        std::remove(temp_file.c_str());
+    }
+    
+    metrics.ai_latency.record_ns(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count()));
+    bool cancelled = cancel && cancel->load();
+    if ((response.empty() && !cancelled) || is_error_body(response)) {
+        metrics.ai_failures.inc();
+    }
     return response;
 }
 
-std::string OllamaConnector::parse_ollama_response(const std::string& response) {
-    // 首先尝试使用jq解析
-    std::string temp_file = "/tmp/ollama_response_" + std::to_string(getpid()) + ".json";
-    std::string save_cmd = "echo '" + response + "' > " + temp_file;
-    system(save_cmd.c_str());
-    
-    std::string jq_cmd = "jq -r '.response // .error // \"parse_error\"' " + temp_file + " 2>/dev/null";
-    std::string jq_result = execute_command(jq_cmd);
+std::string OllamaConnector::route_request(const std::string& path, const std::string& body_file,
+                                           const std::atomic<bool>* cancel) {
+    using Clock = std::chrono::steady_clock;
     
-    // 清理临时文件
-    std::string cleanup_cmd = "rm -f " + temp_file;
-    system(cleanup_cmd.c_str());
+    struct Attempt {
+        size_t index;
+        std::shared_ptr<std::atomic<bool>> cancel;
+        std::future<CurlResult> result;
+        Clock::time_point start;
+    };
+    std::vector<size_t> tried;
+    std::vector<Attempt> attempts;
+    std::string last_error;     // 所有端点都失败时返回最后一个错误响应，保留错误信息
     
-    // 如果jq成功解析且不是错误
-    if (!jq_result.empty() && jq_result != "parse_error" && 
-        jq_result != "null" && jq_result != "\"null\"" && 
-        jq_result.find("parse error") == std::string::npos) {
-        // 移除可能的引号和换行符
-        if (jq_result.length() >= 2 && jq_result.front() == '"' && jq_result.back() == '"') {
-            jq_result = jq_result.substr(1, jq_result.length() - 2);
+    auto start_attempt = [&]() {
+        auto index = endpoints_.acquire(tried);
+        if (!index) {
+            return false;
         }
-        // 移除尾部换行符
-        if (!jq_result.empty() && jq_result.back() == '\n') {
-            jq_result.pop_back();
+        tried.push_back(*index);
+        
+        std::vector<std::string> args = {"curl", "-s", "-w", kStatusFormat,
+                                         "--max-time", std::to_string(timeout_seconds_)};
+        if (!body_file.empty()) {
+            args.insert(args.end(), {"-X", "POST", "-H", "Content-Type: application/json",
+                                     "--data-binary", "@" + body_file});
         }
-        return jq_result;
+        args.push_back(endpoints_.url(*index) + path);
+        
+        auto cancel = std::make_shared<std::atomic<bool>>(false);
+        attempts.push_back({*index, cancel,
+                            std::async(std::launch::async, [args, cancel]() { return run_curl(args, *cancel); }),
+                            Clock::now()});
+        return true;
+    };
+    auto elapsed_ms = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+    
+    if (!start_attempt()) {
+        return "";
     }
     
-    // 如果jq失败，尝试简单的字符串解析
-    size_t response_pos = response.find("\"response\":\"");
-    if (response_pos != std::string::npos) {
-        response_pos += 12; // 跳过 "response":"
-        size_t end_pos = response_pos;
-        
-        // 找到响应内容的结束位置，注意处理转义字符
-        while (end_pos < response.length()) {
-            if (response[end_pos] == '"' && (end_pos == 0 || response[end_pos - 1] != '\\')) {
-                break;
+    // 只对 /api/generate 对冲，延迟取最近 generate 请求的百分位；嵌入和 GET 请求
+    // 快得多，计入统计会拉低百分位，让慢一些的 generate 过早对冲
+    bool generate = path == "/api/generate";
+    std::optional<double> hedge_delay = generate ? endpoints_.hedge_delay_ms() : std::nullopt;
+    bool hedged = !hedge_delay.has_value();
+    Clock::time_point hedge_at = Clock::now() +
+        std::chrono::microseconds(static_cast<long long>(hedge_delay.value_or(0.0) * 1000.0));
+    
+    while (!attempts.empty()) {
+        if (cancel && cancel->load()) {
+            // 调用方不再需要结果：终止所有尝试，不计入端点的成败
+            for (auto& attempt : attempts) {
+                attempt.cancel->store(true);
+                attempt.result.wait();
+                endpoints_.release(attempt.index, EndpointOutcome::Cancelled, 0.0);
             }
-            end_pos++;
+            return "";
         }
-        
-        if (end_pos < response.length()) {
-            std::string result = response.substr(response_pos, end_pos - response_pos);
-            
-            // 处理基本的转义字符
-            size_t pos = 0;
-            while ((pos = result.find("\\n", pos)) != std::string::npos) {
-                result.replace(pos, 2, "\n");
-                pos += 1;
+        for (auto it = attempts.begin(); it != attempts.end();) {
+            if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
             }
             
-            pos = 0;
-            while ((pos = result.find("\\t", pos)) != std::string::npos) {
-                result.replace(pos, 2, "\t");
-                pos += 1;
+            CurlResult result = it->result.get();
+            // HTTP 错误和 {"error": ...} 响应都算失败，转移到下一个端点
+            if (!result.ok || is_error_body(result.output)) {
+                if (is_error_body(result.output)) {
+                    last_error = result.output;
+                }
+                endpoints_.release(it->index, EndpointOutcome::Failure, elapsed_ms(it->start));
+                it = attempts.erase(it);
+                continue;
             }
             
-            pos = 0;
-            while ((pos = result.find("\\\"", pos)) != std::string::npos) {
-                result.replace(pos, 2, "\"");
-                pos += 1;
+            // 第一个成功的结果胜出，取消其余请求
+            endpoints_.release(it->index, EndpointOutcome::Success, elapsed_ms(it->start), generate);
+            attempts.erase(it);
+            for (auto& other : attempts) {
+                other.cancel->store(true);
+                other.result.wait();
+                endpoints_.release(other.index, EndpointOutcome::Cancelled, 0.0);
             }
-            
-            return result;
+            return result.output;
+        }
+        
+        if (attempts.empty()) {
+            // 故障转移到下一个端点
+            if (!start_attempt()) {
+                break;
+            }
+            continue;
         }
+        if (!hedged && Clock::now() >= hedge_at) {
+            hedged = true;
+            if (start_attempt()) {
+                Metrics::instance().ai_hedges.inc();
+            }
+        }
+        attempts.front().result.wait_for(std::chrono::milliseconds(5));
+    }
+    
+    return last_error;
+}
+
+OllamaGeneration OllamaConnector::parse_ollama_response(const std::string& response) {
+    OllamaGeneration result;
+    
+    auto json = JsonValue::parse(response);
+    if (!json || !json->is_object()) {
+        result.error = "Failed to parse response. Raw response: " + response.substr(0, 200) + "...";
+        return result;
     }
     
     // 检查是否有错误信息
-    if (response.find("error") != std::string::npos) {
-        return "Error: " + response;
+    const JsonValue* error = json->find("error");
+    if (error) {
+        result.error = error->as_string(response);
+        return result;
     }
     
-    return "Failed to parse response. Raw response: " + response.substr(0, 200) + "...";
-}
-
-std::string OllamaConnector::execute_command(const std::string& command) {
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
+    const JsonValue* text = json->find("response");
+    if (!text || !text->is_string()) {
+        result.error = "Missing 'response' field. Raw response: " + response.substr(0, 200) + "...";
+        return result;
     }
     
-    std::string result;
-    char buffer[128];
-    while (fgets(buffer, sizeof(buffer), pipe.get()) != nullptr) {
-        result += buffer;
+    result.success = true;
+    result.response = text->as_string();
+    
+    // 上下文 token 和统计信息
+    for (const auto& token : (*json)["context"].items()) {
+        result.context.push_back(static_cast<int>(token.as_number()));
     }
+    result.prompt_tokens = static_cast<int>((*json)["prompt_eval_count"].as_number());
+    result.completion_tokens = static_cast<int>((*json)["eval_count"].as_number());
+    result.total_ms = (*json)["total_duration"].as_number() / 1e6;
     
     return result;
 }
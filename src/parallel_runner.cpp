@@ -0,0 +1,525 @@
+#include "parallel_runner.h"
+#include "utils.h"
+#include "passthrough.h"
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace NeXShell {
+
+namespace {
+
+// epoll 事件的 data.u64：作业下标 * 4 + 类型，读取参数的描述符使用 INPUT_TAG
+enum EventKind : uint64_t { EVENT_OUTPUT = 0, EVENT_ERROR = 1, EVENT_EXIT = 2 };
+constexpr uint64_t INPUT_TAG = ~uint64_t{0};
+
+constexpr size_t BUFFER_SIZE = 64 * 1024;
+constexpr int MAX_EVENTS = 64;
+// 没有 pidfd 时检查子进程的间隔
+constexpr int POLL_INTERVAL_MS = 10;
+// 与 GNU parallel 相同，失败数超过 100 时退出码为 101
+constexpr int MAX_FAILED = 101;
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool has_glob(const std::string& text) {
+    return text.find_first_of("*?[") != std::string::npos;
+}
+
+std::string strip_extension(const std::string& path) {
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) ||
+        dot == (slash == std::string::npos ? 0 : slash + 1)) {
+        return path;
+    }
+    return path.substr(0, dot);
+}
+
+std::string basename_of(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief --tag：在每行（包括没有换行结尾的最后一行）前加上前缀
+ */
+std::string tag_lines(const std::string& text, const std::string& prefix) {
+    std::string tagged;
+    tagged.reserve(text.size() + prefix.size() * 4);
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        end = end == std::string::npos ? text.size() : end + 1;
+        tagged += prefix;
+        tagged.append(text, start, end - start);
+        start = end;
+    }
+    return tagged;
+}
+
+} // namespace
+
+struct ParallelRunner::Job {
+    ParallelJobResult result;
+    pid_t pid = -1;
+    int pidfd = -1;
+    int output_fd = -1;
+    int error_fd = -1;
+    std::string output;
+    std::string error;
+    bool exited = false;
+    bool done = false;
+    std::chrono::steady_clock::time_point started;
+};
+
+std::optional<ParallelOptions> ParallelOptions::parse(const std::vector<std::string>& args, std::string& error) {
+    ParallelOptions options;
+    size_t i = 0;
+    for (; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "-k" || arg == "--keep-order") {
+            options.keep_order = true;
+        } else if (arg == "--tag") {
+            options.tag = true;
+        } else if (arg == "-j" || arg == "--jobs" || arg == "--joblog") {
+            if (i + 1 >= args.size()) {
+                error = "option " + arg + " requires an argument";
+                return std::nullopt;
+            }
+            const std::string& value = args[++i];
+            if (arg == "--joblog") {
+                options.joblog = value;
+            } else {
+                char* end = nullptr;
+                long jobs = std::strtol(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0' || jobs < 0) {
+                    error = "invalid job count: " + value;
+                    return std::nullopt;
+                }
+                options.jobs = static_cast<size_t>(jobs);
+            }
+        } else if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0 && std::isdigit(static_cast<unsigned char>(arg[2]))) {
+            options.jobs = static_cast<size_t>(std::strtoul(arg.c_str() + 2, nullptr, 10));
+        } else if (arg == "--") {
+            ++i;
+            break;
+        } else if (arg.size() > 1 && arg[0] == '-' && arg != ":::") {
+            error = "unknown option: " + arg;
+            return std::nullopt;
+        } else {
+            break;
+        }
+    }
+
+    // 命令模板是 ::: 之前的所有词，parallel 'gzip -9 {}' 和 parallel gzip -9 {} 等价
+    for (; i < args.size() && args[i] != ":::"; ++i) {
+        if (!options.command_template.empty()) {
+            options.command_template += ' ';
+        }
+        options.command_template += args[i];
+    }
+    if (options.command_template.empty()) {
+        error = "no command given";
+        return std::nullopt;
+    }
+
+    if (i < args.size()) {
+        options.arguments_from_input = false;
+        for (++i; i < args.size(); ++i) {
+            if (args[i] == ":::") {
+                error = "only one ::: argument list is supported";
+                return std::nullopt;
+            }
+            // shell 本身不展开通配符，在这里展开；没有匹配时保留原样
+            glob_t matches;
+            if (has_glob(args[i]) && glob(args[i].c_str(), 0, nullptr, &matches) == 0) {
+                for (size_t m = 0; m < matches.gl_pathc; ++m) {
+                    options.arguments.emplace_back(matches.gl_pathv[m]);
+                }
+                globfree(&matches);
+            } else {
+                options.arguments.push_back(args[i]);
+            }
+        }
+    }
+
+    if (options.jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options.jobs = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+    }
+    return options;
+}
+
+ParallelRunner::ParallelRunner(ParallelOptions options, Launcher launcher)
+    : options_(std::move(options)), launcher_(std::move(launcher)) {
+}
+
+ParallelRunner::~ParallelRunner() {
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+    if (joblog_) {
+        fclose(joblog_);
+    }
+}
+
+std::optional<std::string> ParallelRunner::expand(const std::string& command_template, const std::string& argument,
+                                                  size_t seq) {
+    std::string command;
+    bool replaced = false;
+    size_t i = 0;
+    while (i < command_template.size()) {
+        std::optional<std::string> value;
+        size_t length = 0;
+        if (command_template.compare(i, 2, "{}") == 0) {
+            value = Utils::quote_argument(argument);
+            length = 2;
+        } else if (command_template.compare(i, 3, "{.}") == 0) {
+            value = Utils::quote_argument(strip_extension(argument));
+            length = 3;
+        } else if (command_template.compare(i, 3, "{/}") == 0) {
+            value = Utils::quote_argument(basename_of(argument));
+            length = 3;
+        } else if (command_template.compare(i, 3, "{#}") == 0) {
+            value = std::to_string(seq);
+            length = 3;
+        }
+        if (length > 0) {
+            if (!value) {
+                return std::nullopt;
+            }
+            command += *value;
+            replaced = true;
+            i += length;
+        } else {
+            command += command_template[i++];
+        }
+    }
+    if (!replaced) {
+        std::optional<std::string> value = Utils::quote_argument(argument);
+        if (!value) {
+            return std::nullopt;
+        }
+        command += ' ';
+        command += *value;
+    }
+    return command;
+}
+
+void ParallelRunner::add_argument(std::string argument) {
+    Job job;
+    job.result.seq = jobs_.size() + 1;
+    std::optional<std::string> command = expand(options_.command_template, argument, job.result.seq);
+    if (!command) {
+        // 作业不启动，按启动失败计入失败数
+        fprintf(stderr, "parallel: cannot pass argument to the command line: '%s'\n", argument.c_str());
+    }
+    job.result.command = command.value_or("");
+    job.result.argument = std::move(argument);
+    jobs_.push_back(std::move(job));
+}
+
+bool ParallelRunner::launch(Job& job, size_t index) {
+    if (job.result.command.empty()) {
+        return false;
+    }
+    int output[2];
+    int error[2];
+    if (pipe2(output, O_CLOEXEC) < 0) {
+        perror("parallel: pipe");
+        return false;
+    }
+    if (pipe2(error, O_CLOEXEC) < 0) {
+        perror("parallel: pipe");
+        close(output[0]);
+        close(output[1]);
+        return false;
+    }
+
+    job.result.start_time = std::chrono::duration<double>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    job.started = std::chrono::steady_clock::now();
+    job.pid = launcher_(job.result.command, output[1], error[1]);
+    // 只有子进程持有写端，它（及其后代）退出后这里才会读到 EOF
+    close(output[1]);
+    close(error[1]);
+    if (job.pid < 0) {
+        close(output[0]);
+        close(error[0]);
+        return false;
+    }
+
+    job.output_fd = output[0];
+    job.error_fd = error[0];
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = index * 4 + EVENT_OUTPUT;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, job.output_fd, &event);
+    event.data.u64 = index * 4 + EVENT_ERROR;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, job.error_fd, &event);
+
+    // 子进程即使已经退出，只要还没回收，pidfd_open 仍然成功并立即可读
+    if (pidfd_supported_) {
+        job.pidfd = open_pidfd(job.pid);
+        if (job.pidfd >= 0) {
+            fcntl(job.pidfd, F_SETFD, FD_CLOEXEC);
+            event.data.u64 = index * 4 + EVENT_EXIT;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, job.pidfd, &event);
+        } else {
+            pidfd_supported_ = false;
+        }
+    }
+    return true;
+}
+
+void ParallelRunner::reap(Job& job, int options) {
+    int status = 0;
+    pid_t reaped;
+    while ((reaped = wait4(job.pid, &status, options, nullptr)) < 0 && errno == EINTR) {
+    }
+    if (reaped == 0) {
+        return;
+    }
+
+    job.exited = true;
+    job.result.runtime = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    if (reaped < 0) {
+        job.result.exit_code = 1;
+    } else if (WIFEXITED(status)) {
+        job.result.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        job.result.signal = WTERMSIG(status);
+        job.result.exit_code = 128 + job.result.signal;
+    }
+    if (job.pidfd >= 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, job.pidfd, nullptr);
+        close(job.pidfd);
+        job.pidfd = -1;
+    }
+}
+
+void ParallelRunner::drain(Job& job, int& fd, std::string& buffer) {
+    char chunk[BUFFER_SIZE];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n > 0) {
+        buffer.append(chunk, static_cast<size_t>(n));
+        if (&buffer == &job.output) {
+            job.result.received += static_cast<size_t>(n);
+        }
+        return;
+    }
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    fd = -1;
+}
+
+void ParallelRunner::finish(Job& job) {
+    job.done = true;
+    if (joblog_) {
+        // 与 GNU parallel 相同：被信号终止时 Exitval 为 0，信号记在 Signal 列
+        int exit_value = job.result.signal ? 0 : job.result.exit_code;
+        fprintf(joblog_, "%zu\t:\t%.3f\t%.3f\t0\t%zu\t%d\t%d\t%s\n", job.result.seq, job.result.start_time,
+                job.result.runtime, job.result.received, exit_value, job.result.signal,
+                job.result.command.c_str());
+        fflush(joblog_);
+    }
+
+    if (!options_.keep_order) {
+        flush(job);
+        return;
+    }
+    while (next_to_flush_ < jobs_.size() && jobs_[next_to_flush_].done) {
+        flush(jobs_[next_to_flush_++]);
+    }
+}
+
+void ParallelRunner::flush(Job& job) {
+    std::string prefix = options_.tag ? job.result.argument + "\t" : "";
+    if (!job.output.empty() && !output_closed_) {
+        std::string text = options_.tag ? tag_lines(job.output, prefix) : job.output;
+        if (!write_all(output_fd_, text.data(), text.size())) {
+            output_closed_ = true;
+        }
+    }
+    if (!job.error.empty()) {
+        std::string text = options_.tag ? tag_lines(job.error, prefix) : job.error;
+        write_all(STDERR_FILENO, text.data(), text.size());
+    }
+    job.output.clear();
+    job.output.shrink_to_fit();
+    job.error.clear();
+    job.error.shrink_to_fit();
+}
+
+int ParallelRunner::run(int input_fd, int output_fd) {
+    // 下游（如 head）提前关闭时 write 返回 EPIPE，而不是终止 shell
+    SigpipeGuard guard;
+    output_fd_ = output_fd;
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        perror("parallel: epoll_create1");
+        return 1;
+    }
+    if (!options_.joblog.empty()) {
+        joblog_ = fopen(options_.joblog.c_str(), "w");
+        if (!joblog_) {
+            perror(("parallel: " + options_.joblog).c_str());
+            return 1;
+        }
+        fprintf(joblog_, "Seq\tHost\tStarttime\tJobRuntime\tSend\tReceive\tExitval\tSignal\tCommand\n");
+    }
+
+    for (const auto& argument : options_.arguments) {
+        add_argument(argument);
+    }
+
+    // 参数边读边启动作业；普通文件不能加入 epoll，直接一次读完
+    bool reading = options_.arguments_from_input;
+    std::string pending;
+    auto read_input = [&]() {
+        char chunk[BUFFER_SIZE];
+        ssize_t n = read(input_fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            return;
+        }
+        if (n > 0) {
+            pending.append(chunk, static_cast<size_t>(n));
+        }
+        size_t start = 0;
+        size_t newline;
+        while ((newline = pending.find('\n', start)) != std::string::npos) {
+            if (newline > start) {
+                add_argument(pending.substr(start, newline - start));
+            }
+            start = newline + 1;
+        }
+        pending.erase(0, start);
+        if (n <= 0) {
+            if (!pending.empty()) {
+                add_argument(std::move(pending));
+                pending.clear();
+            }
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, input_fd, nullptr);
+            reading = false;
+        }
+    };
+    if (reading) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = INPUT_TAG;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, input_fd, &event) < 0) {
+            while (reading) {
+                read_input();
+            }
+        }
+    }
+
+    size_t next = 0;
+    size_t running = 0;
+    size_t oldest = 0;      // 最早的未结束作业
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        // 有空位就补上，始终保持 jobs 个作业在运行
+        while (running < options_.jobs && next < jobs_.size() && !output_closed_) {
+            Job& job = jobs_[next];
+            if (launch(job, next)) {
+                ++running;
+            } else {
+                job.exited = true;
+                job.result.exit_code = 127;
+                finish(job);
+            }
+            ++next;
+        }
+        if (running == 0 && (output_closed_ || (next == jobs_.size() && !reading))) {
+            break;
+        }
+
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, pidfd_supported_ ? -1 : POLL_INTERVAL_MS);
+        if (count < 0 && errno != EINTR) {
+            perror("parallel: epoll_wait");
+            break;
+        }
+        for (int e = 0; e < count; ++e) {
+            uint64_t tag = events[e].data.u64;
+            if (tag == INPUT_TAG) {
+                read_input();
+                continue;
+            }
+            Job& job = jobs_[tag / 4];
+            switch (tag % 4) {
+                case EVENT_OUTPUT: drain(job, job.output_fd, job.output); break;
+                case EVENT_ERROR: drain(job, job.error_fd, job.error); break;
+                case EVENT_EXIT: reap(job, WNOHANG); break;
+            }
+        }
+
+        // 作业在退出且输出读完之后才算结束
+        for (size_t i = oldest; i < next; ++i) {
+            Job& job = jobs_[i];
+            if (job.done) {
+                continue;
+            }
+            if (!job.exited && job.pidfd < 0) {
+                reap(job, WNOHANG);
+            }
+            if (job.exited && job.output_fd < 0 && job.error_fd < 0) {
+                finish(job);
+                --running;
+            }
+        }
+        while (oldest < next && jobs_[oldest].done) {
+            ++oldest;
+        }
+    }
+
+    int failed = 0;
+    results_.clear();
+    for (size_t i = 0; i < next; ++i) {
+        const Job& job = jobs_[i];
+        results_.push_back(job.result);
+        if (job.result.exit_code != 0) {
+            ++failed;
+        }
+    }
+    return output_closed_ ? 128 + SIGPIPE : std::min(failed, MAX_FAILED);
+}
+
+} // namespace NeXShell
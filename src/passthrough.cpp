@@ -0,0 +1,275 @@
+#include "passthrough.h"
+#include "metrics.h"
+#include "tracer.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace NeXShell {
+
+namespace {
+
+// 单次 splice/copy_file_range 请求的长度；实际每次最多移动一个管道缓冲区
+constexpr size_t CHUNK = 1 << 20;
+// 退回到 read/write 时的缓冲区
+constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+constexpr int EXIT_SIGPIPE = 128 + SIGPIPE;
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+ssize_t read_retry(int fd, char* buffer, size_t size) {
+    ssize_t n;
+    while ((n = read(fd, buffer, size)) < 0 && errno == EINTR) {
+    }
+    return n;
+}
+
+long long copy_userspace(int input_fd, int output_fd, long long done) {
+    std::vector<char> buffer(BUFFER_SIZE);
+    for (;;) {
+        ssize_t n = read_retry(input_fd, buffer.data(), buffer.size());
+        if (n == 0) {
+            return done;
+        }
+        if (n < 0 || !write_all(output_fd, buffer.data(), static_cast<size_t>(n))) {
+            return -1;
+        }
+        done += n;
+    }
+}
+
+/**
+ * @brief 内核搬运在第一次调用就失败时，这些错误表示该组合不受支持，可以退回到 read/write
+ */
+bool unsupported(int error) {
+    return error == EINVAL || error == EXDEV || error == ENOSYS || error == EOPNOTSUPP || error == EBADF;
+}
+
+void report_error(const char* program, const std::string& name) {
+    std::cerr << program << ": " << name << ": " << std::strerror(errno) << std::endl;
+}
+
+/**
+ * @brief tee 的快速路径：tee(2) 把输入复制到输出管道，再用 splice 把同样的字节消费到文件
+ * @return 成功时返回 true；输入不支持 tee(2) 且尚未搬运任何数据时返回 false 并设置 errno
+ */
+bool tee_spliced(int input_fd, int output_fd, int file_fd, bool& started) {
+    std::vector<char> buffer;
+    bool file_splice = true;
+    Counter& moved = Metrics::instance().zero_copy_bytes;
+    for (;;) {
+        ssize_t n = tee(input_fd, output_fd, CHUNK, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        started = true;
+        moved.inc(static_cast<uint64_t>(n));
+
+        // tee(2) 不消费输入，接着把这 n 字节移到文件
+        size_t remaining = static_cast<size_t>(n);
+        while (remaining > 0) {
+            ssize_t m = file_splice ? splice(input_fd, nullptr, file_fd, nullptr, remaining, SPLICE_F_MOVE) : -1;
+            if (m < 0 && errno == EINTR) {
+                continue;
+            }
+            if (m <= 0) {
+                // 文件系统不支持 splice：读出来再写
+                file_splice = false;
+                buffer.resize(BUFFER_SIZE);
+                m = read_retry(input_fd, buffer.data(), std::min(remaining, buffer.size()));
+                if (m <= 0 || !write_all(file_fd, buffer.data(), static_cast<size_t>(m))) {
+                    return false;
+                }
+            }
+            remaining -= static_cast<size_t>(m);
+        }
+    }
+}
+
+} // namespace
+
+SigpipeGuard::SigpipeGuard() {
+    sigemptyset(&sigpipe_);
+    sigaddset(&sigpipe_, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe_, &saved_);
+}
+
+SigpipeGuard::~SigpipeGuard() {
+    // 丢弃本线程上挂起的 SIGPIPE，再恢复原来的掩码
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&sigpipe_, nullptr, &zero) == SIGPIPE) {
+    }
+    pthread_sigmask(SIG_SETMASK, &saved_, nullptr);
+}
+
+std::optional<PassthroughStage> PassthroughStage::detect(const Command& command) {
+    PassthroughStage stage;
+    if (command.program == "cat") {
+        stage.kind = Kind::Cat;
+    } else if (command.program == "tee") {
+        stage.kind = Kind::Tee;
+    } else {
+        return std::nullopt;
+    }
+
+    for (const auto& arg : command.arguments) {
+        if (stage.kind == Kind::Tee && arg == "-a" && stage.files.empty()) {
+            stage.append = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            // 带选项的调用交给真正的程序
+            return std::nullopt;
+        } else {
+            stage.files.push_back(arg);
+        }
+    }
+    return stage;
+}
+
+long long PassthroughStage::transfer(int input_fd, int output_fd) {
+    struct stat in_stat;
+    struct stat out_stat;
+    if (fstat(input_fd, &in_stat) != 0 || fstat(output_fd, &out_stat) != 0) {
+        return -1;
+    }
+
+    Counter& moved = Metrics::instance().zero_copy_bytes;
+    long long done = 0;
+    bool regular = S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode);
+    if (regular || S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode)) {
+        for (;;) {
+            ssize_t n = regular ? copy_file_range(input_fd, nullptr, output_fd, nullptr, CHUNK, 0)
+                                : splice(input_fd, nullptr, output_fd, nullptr, CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                done += n;
+                moved.inc(static_cast<uint64_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                return done;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (done == 0 && unsupported(errno)) {
+                break;
+            }
+            return -1;
+        }
+    }
+    return copy_userspace(input_fd, output_fd, done);
+}
+
+int PassthroughStage::run(int input_fd, int output_fd) const {
+    SigpipeGuard guard;
+    int status = 0;
+
+    if (kind == Kind::Cat) {
+        TraceScope trace("exec", "passthrough", "cat");
+        std::vector<std::string> inputs = files.empty() ? std::vector<std::string>{"-"} : files;
+        for (const auto& name : inputs) {
+            int fd = name == "-" ? input_fd : open(name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                report_error("cat", name);
+                status = 1;
+                continue;
+            }
+            long long copied = transfer(fd, output_fd);
+            int error = errno;
+            if (fd != input_fd) {
+                close(fd);
+            }
+            if (copied < 0) {
+                if (error == EPIPE) {
+                    return EXIT_SIGPIPE;
+                }
+                errno = error;
+                report_error("cat", name == "-" ? "write error" : name);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    TraceScope trace("exec", "passthrough", "tee");
+    std::vector<int> file_fds;
+    for (const auto& name : files) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(name.c_str(), flags, 0644);
+        if (fd < 0) {
+            report_error("tee", name);
+            status = 1;
+        } else {
+            file_fds.push_back(fd);
+        }
+    }
+
+    bool done = false;
+    if (file_fds.size() == 1 && !append) {
+        bool started = false;
+        if (tee_spliced(input_fd, output_fd, file_fds[0], started)) {
+            done = true;
+        } else if (started || !unsupported(errno)) {
+            status = errno == EPIPE ? EXIT_SIGPIPE : 1;
+            done = true;
+        }
+    }
+
+    if (!done) {
+        std::vector<char> buffer(BUFFER_SIZE);
+        for (;;) {
+            ssize_t n = read_retry(input_fd, buffer.data(), buffer.size());
+            if (n <= 0) {
+                status = n < 0 ? 1 : status;
+                break;
+            }
+            if (!write_all(output_fd, buffer.data(), static_cast<size_t>(n))) {
+                status = errno == EPIPE ? EXIT_SIGPIPE : 1;
+                break;
+            }
+            for (int fd : file_fds) {
+                if (!write_all(fd, buffer.data(), static_cast<size_t>(n))) {
+                    status = 1;
+                }
+            }
+        }
+    }
+
+    for (int fd : file_fds) {
+        close(fd);
+    }
+    return status;
+}
+
+bool PassthroughStage::enabled() {
+    const char* value = getenv("NEXSH_ZERO_COPY");
+    return !value || std::string(value) != "0";
+}
+
+} // namespace NeXShell
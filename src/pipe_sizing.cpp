@@ -0,0 +1,218 @@
+#include "pipe_sizing.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace NeXShell {
+
+std::optional<PipeSizeSetting> PipeSizeSetting::parse(const std::string& text) {
+    PipeSizeSetting setting;
+    if (text == "default") {
+        return setting;
+    }
+    if (text == "auto") {
+        setting.mode = Mode::Adaptive;
+        return setting;
+    }
+
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        ++digits;
+    }
+    if (digits == 0 || digits + 1 < text.size()) {
+        return std::nullopt;
+    }
+    unsigned long long value = std::strtoull(text.substr(0, digits).c_str(), nullptr, 10);
+    if (digits < text.size()) {
+        switch (std::toupper(static_cast<unsigned char>(text[digits]))) {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            default: return std::nullopt;
+        }
+    }
+    if (value == 0) {
+        return std::nullopt;
+    }
+    setting.mode = Mode::Fixed;
+    setting.bytes = static_cast<size_t>(value);
+    return setting;
+}
+
+PipeSizeSetting PipeSizeSetting::from_environment() {
+    const char* value = getenv("NEXSH_PIPE_SIZE");
+    if (!value || !*value) {
+        return {};
+    }
+    return parse(value).value_or(PipeSizeSetting{});
+}
+
+std::string PipeSizeSetting::describe() const {
+    switch (mode) {
+        case Mode::Default: return "default";
+        case Mode::Adaptive: return "auto";
+        case Mode::Fixed: break;
+    }
+    return PipeSizer::format_size(static_cast<double>(bytes));
+}
+
+size_t PipeSizer::max_size() {
+    static const size_t max = []() {
+        std::ifstream in("/proc/sys/fs/pipe-max-size");
+        size_t value = 0;
+        return (in >> value) && value > 0 ? value : size_t{1} << 20;
+    }();
+    return max;
+}
+
+size_t PipeSizer::default_size() {
+    static const size_t size = []() {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return size_t{65536};
+        }
+        int capacity = fcntl(fds[0], F_GETPIPE_SZ);
+        close(fds[0]);
+        close(fds[1]);
+        return capacity > 0 ? static_cast<size_t>(capacity) : size_t{65536};
+    }();
+    return size;
+}
+
+size_t PipeSizer::resize(int fd, size_t bytes) {
+    size_t target = std::min(bytes, max_size());
+    int capacity = fcntl(fd, F_SETPIPE_SZ, static_cast<int>(target));
+    if (capacity < 0) {
+        // 例如超过了用户的管道内存配额（pipe-user-pages-soft），保持原容量
+        capacity = fcntl(fd, F_GETPIPE_SZ);
+    }
+    return capacity > 0 ? static_cast<size_t>(capacity) : 0;
+}
+
+std::string PipeSizer::format_size(double bytes) {
+    char buffer[32];
+    if (bytes >= 1024.0 * 1024.0 * 1024.0) {
+        snprintf(buffer, sizeof(buffer), "%.1f GiB", bytes / (1024.0 * 1024.0 * 1024.0));
+    } else if (bytes >= 1024.0 * 1024.0) {
+        snprintf(buffer, sizeof(buffer), "%.1f MiB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 1024.0) {
+        snprintf(buffer, sizeof(buffer), "%.0f KiB", bytes / 1024.0);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.0f B", bytes);
+    }
+    return buffer;
+}
+
+PipeMonitor::~PipeMonitor() {
+    stop();
+}
+
+void PipeMonitor::watch(const PipeReport& report, pid_t reader, ino_t inode) {
+    entries_.push_back({report, reader, inode, reader > 0});
+}
+
+void PipeMonitor::start() {
+    bool any = std::any_of(entries_.begin(), entries_.end(), [](const Entry& e) { return e.active; });
+    if (any) {
+        thread_ = std::thread([this]() { run(); });
+    }
+}
+
+std::vector<PipeReport> PipeMonitor::stop() {
+    stopping_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::vector<PipeReport> reports;
+    for (const auto& entry : entries_) {
+        reports.push_back(entry.report);
+    }
+    return reports;
+}
+
+void PipeMonitor::run() {
+    while (!stopping_) {
+        bool any = false;
+        for (auto& entry : entries_) {
+            if (entry.active) {
+                sample(entry);
+                any = any || entry.active;
+            }
+        }
+        if (!any) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(SAMPLE_INTERVAL_MS));
+    }
+}
+
+void PipeMonitor::sample(Entry& entry) {
+    // 读端退出（或换掉了标准输入）后不再采样
+    std::string path = "/proc/" + std::to_string(entry.reader) + "/fd/0";
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        entry.active = false;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode) || st.st_ino != entry.inode) {
+        close(fd);
+        entry.active = false;
+        return;
+    }
+
+    int queued = 0;
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    if (ioctl(fd, FIONREAD, &queued) == 0 && capacity > 0) {
+        ++entry.report.samples;
+        if (static_cast<size_t>(queued) * 100 >= static_cast<size_t>(capacity) * FULL_PERCENT) {
+            ++entry.report.full_samples;
+            if (adaptive_ && static_cast<size_t>(capacity) < PipeSizer::max_size()) {
+                capacity = static_cast<int>(PipeSizer::resize(fd, static_cast<size_t>(capacity) * 2));
+            }
+        }
+        entry.report.final_bytes = static_cast<size_t>(capacity);
+    }
+    close(fd);
+}
+
+std::string PipeMonitor::format(const PipeSizeSetting& setting, const std::vector<PipeReport>& pipes,
+                                const std::vector<StageThroughput>& stages) {
+    std::ostringstream out;
+    char line[160];
+    out << "pipesize: " << setting.describe() << " (default "
+        << PipeSizer::format_size(static_cast<double>(PipeSizer::default_size())) << ", max "
+        << PipeSizer::format_size(static_cast<double>(PipeSizer::max_size())) << ")\n";
+    snprintf(line, sizeof(line), "%-5s %-28s %10s %10s %12s\n", "pipe", "writer -> reader", "initial", "final", "full");
+    out << line;
+    for (size_t i = 0; i < pipes.size(); ++i) {
+        const PipeReport& pipe = pipes[i];
+        std::string ends = pipe.writer + " -> " + pipe.reader;
+        std::string full = pipe.samples > 0 ? std::to_string(pipe.full_samples) + "/" + std::to_string(pipe.samples)
+                                            : "-";
+        snprintf(line, sizeof(line), "%-5zu %-28.28s %10s %10s %12s\n", i + 1, ends.c_str(),
+                 PipeSizer::format_size(static_cast<double>(pipe.initial_bytes)).c_str(),
+                 PipeSizer::format_size(static_cast<double>(pipe.final_bytes)).c_str(), full.c_str());
+        out << line;
+    }
+    snprintf(line, sizeof(line), "%-5s %-16s %12s %10s %14s\n", "stage", "program", "written", "elapsed", "throughput");
+    out << line;
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageThroughput& stage = stages[i];
+        double rate = stage.seconds > 0 ? static_cast<double>(stage.bytes_written) / stage.seconds : 0.0;
+        snprintf(line, sizeof(line), "%-5zu %-16.16s %12s %9.3fs %12s/s\n", i + 1, stage.program.c_str(),
+                 PipeSizer::format_size(static_cast<double>(stage.bytes_written)).c_str(), stage.seconds,
+                 PipeSizer::format_size(rate).c_str());
+        out << line;
+    }
+    return out.str();
+}
+
+} // namespace NeXShell
@@ -0,0 +1,174 @@
+#include "prompt_budget.h"
+#include <algorithm>
+#include <numeric>
+
+namespace NeXShell {
+
+std::string CompactionCache::get_or_compute(const std::string& key, const std::function<std::string()>& compute) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
+        }
+    }
+
+    // 在锁外计算，避免阻塞其他请求
+    std::string summary = compute();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.find(key) == index_.end()) {
+        entries_.emplace_front(key, summary);
+        index_[key] = entries_.begin();
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+    return summary;
+}
+
+size_t CompactionCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+size_t CompactionCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+PromptBudget::PromptBudget(size_t max_tokens, CompactionCache* cache)
+    : max_tokens_(max_tokens), cache_(cache) {}
+
+size_t PromptBudget::estimate_tokens(std::string_view text) {
+    size_t tokens = 0;
+    size_t run = 0;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        bool word = (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') ||
+                    (byte >= 'A' && byte <= 'Z') || byte >= 0x80;
+        if (word) {
+            ++run;
+            continue;
+        }
+        tokens += (run + 3) / 4;
+        run = 0;
+        if (byte != ' ' && byte != '\n' && byte != '\t' && byte != '\r') {
+            ++tokens;
+        }
+    }
+    return tokens + (run + 3) / 4;
+}
+
+size_t PromptBudget::add(PromptSection section) {
+    sections_.push_back(std::move(section));
+    return sections_.size() - 1;
+}
+
+size_t PromptBudget::line_cost(const std::string& line) {
+    // 换行符本身约占一个 token
+    return estimate_tokens(line) + 1;
+}
+
+std::string PromptBudget::render(const std::string& header, const std::vector<std::string>& lines) {
+    std::string text;
+    if (!header.empty()) {
+        text += header + "\n";
+    }
+    for (const auto& line : lines) {
+        text += line + "\n";
+    }
+    return text;
+}
+
+std::vector<std::string> PromptBudget::fit() {
+    std::vector<std::string> rendered(sections_.size());
+    used_tokens_ = 0;
+    dropped_items_ = 0;
+
+    // 必需的段落先占用预算
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        const PromptSection& section = sections_[i];
+        if (!section.required) {
+            continue;
+        }
+        rendered[i] = render(section.header, section.items);
+        used_tokens_ += estimate_tokens(rendered[i]) + section.items.size();
+    }
+
+    // 其余段落按优先级分配剩余预算
+    std::vector<size_t> order(sections_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return sections_[a].priority > sections_[b].priority;
+    });
+
+    for (size_t i : order) {
+        const PromptSection& section = sections_[i];
+        if (section.required || section.items.empty()) {
+            continue;
+        }
+        size_t remaining = max_tokens_ > used_tokens_ ? max_tokens_ - used_tokens_ : 0;
+        size_t header_cost = section.header.empty() ? 0 : line_cost(section.header);
+
+        std::vector<size_t> costs;
+        size_t full_cost = header_cost;
+        for (const auto& item : section.items) {
+            costs.push_back(line_cost(item));
+            full_cost += costs.back();
+        }
+        if (full_cost <= remaining) {
+            rendered[i] = render(section.header, section.items);
+            used_tokens_ += full_cost;
+            continue;
+        }
+
+        // 放不下时优先使用（缓存的）压缩摘要
+        if (section.compactor && !section.compact_key.empty()) {
+            auto compute = [&section]() { return section.compactor(section.items); };
+            std::string summary = cache_ ? cache_->get_or_compute(section.compact_key, compute) : compute();
+            size_t summary_cost = header_cost + line_cost(summary);
+            if (!summary.empty() && summary_cost <= remaining) {
+                rendered[i] = render(section.header, {summary});
+                used_tokens_ += summary_cost;
+                dropped_items_ += section.items.size();
+                continue;
+            }
+        }
+
+        // 再按条目截断：历史保留最新的，其余保留开头的
+        if (header_cost >= remaining) {
+            dropped_items_ += section.items.size();
+            continue;
+        }
+        size_t budget = remaining - header_cost;
+        size_t kept = 0;
+        size_t kept_cost = 0;
+        for (size_t k = 0; k < costs.size(); ++k) {
+            size_t index = section.keep_newest ? costs.size() - 1 - k : k;
+            if (kept_cost + costs[index] > budget) {
+                break;
+            }
+            kept_cost += costs[index];
+            ++kept;
+        }
+        if (kept == 0) {
+            dropped_items_ += section.items.size();
+            continue;
+        }
+
+        std::vector<std::string> lines = section.keep_newest
+            ? std::vector<std::string>(section.items.end() - static_cast<std::ptrdiff_t>(kept), section.items.end())
+            : std::vector<std::string>(section.items.begin(), section.items.begin() + static_cast<std::ptrdiff_t>(kept));
+        rendered[i] = render(section.header, lines);
+        used_tokens_ += header_cost + kept_cost;
+        dropped_items_ += section.items.size() - kept;
+    }
+
+    return rendered;
+}
+
+} // namespace NeXShell
@@ -0,0 +1,150 @@
+#include "resource_usage.h"
+#include "json.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+
+namespace NeXShell {
+
+namespace {
+
+double timeval_ms(const struct timeval& tv) {
+    return static_cast<double>(tv.tv_sec) * 1000.0 + static_cast<double>(tv.tv_usec) / 1000.0;
+}
+
+/**
+ * @brief 以秒为单位格式化时长；long_form 时为 bash 的 "XmY.YYYs"
+ */
+std::string format_seconds(double ms, int precision, bool long_form) {
+    char buffer[64];
+    double seconds = ms / 1000.0;
+    if (long_form) {
+        long minutes = static_cast<long>(seconds / 60.0);
+        snprintf(buffer, sizeof(buffer), "%ldm%.*fs", minutes, precision, seconds - static_cast<double>(minutes) * 60.0);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.*f", precision, seconds);
+    }
+    return buffer;
+}
+
+std::string usage_fields(const ProcessUsage& usage) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "\"real_ms\":%.3f,\"user_ms\":%.3f,\"sys_ms\":%.3f,\"max_rss_kb\":%ld,"
+             "\"minor_faults\":%ld,\"major_faults\":%ld,\"voluntary_switches\":%ld,"
+             "\"involuntary_switches\":%ld,\"exit_code\":%d",
+             usage.real_ms, usage.user_ms, usage.sys_ms, usage.max_rss_kb, usage.minor_faults,
+             usage.major_faults, usage.voluntary_switches, usage.involuntary_switches, usage.exit_code);
+    return buffer;
+}
+
+} // namespace
+
+void ProcessUsage::set_rusage(const struct rusage& usage) {
+    user_ms = timeval_ms(usage.ru_utime);
+    sys_ms = timeval_ms(usage.ru_stime);
+    max_rss_kb = usage.ru_maxrss;
+    minor_faults = usage.ru_minflt;
+    major_faults = usage.ru_majflt;
+    voluntary_switches = usage.ru_nvcsw;
+    involuntary_switches = usage.ru_nivcsw;
+}
+
+void ProcessUsage::accumulate(const ProcessUsage& other) {
+    user_ms += other.user_ms;
+    sys_ms += other.sys_ms;
+    max_rss_kb = std::max(max_rss_kb, other.max_rss_kb);
+    minor_faults += other.minor_faults;
+    major_faults += other.major_faults;
+    voluntary_switches += other.voluntary_switches;
+    involuntary_switches += other.involuntary_switches;
+}
+
+const char* const TimeReport::DEFAULT_FORMAT = "\nreal\t%3lR\nuser\t%3lU\nsys\t%3lS";
+const char* const TimeReport::POSIX_FORMAT = "real %2R\nuser %2U\nsys %2S";
+
+std::string TimeReport::format(const std::string& format, const ProcessUsage& total) {
+    std::string out;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%' || i + 1 >= format.size()) {
+            out += format[i];
+            continue;
+        }
+
+        size_t j = i + 1;
+        int precision = 3;
+        bool long_form = false;
+        if (std::isdigit(static_cast<unsigned char>(format[j]))) {
+            precision = std::min(3, format[j] - '0');
+            ++j;
+        }
+        if (j < format.size() && format[j] == 'l') {
+            long_form = true;
+            ++j;
+        }
+        if (j >= format.size()) {
+            out += format.substr(i);
+            break;
+        }
+
+        char spec = format[j];
+        switch (spec) {
+            case '%': out += '%'; break;
+            case 'R': out += format_seconds(total.real_ms, precision, long_form); break;
+            case 'U': out += format_seconds(total.user_ms, precision, long_form); break;
+            case 'S': out += format_seconds(total.sys_ms, precision, long_form); break;
+            case 'P': {
+                char buffer[32];
+                double cpu = total.real_ms > 0 ? (total.user_ms + total.sys_ms) * 100.0 / total.real_ms : 0.0;
+                snprintf(buffer, sizeof(buffer), "%.*f", precision == 3 ? 2 : precision, cpu);
+                out += buffer;
+                break;
+            }
+            case 'M': out += std::to_string(total.max_rss_kb); break;
+            case 'F': out += std::to_string(total.major_faults); break;
+            case 'f': out += std::to_string(total.minor_faults); break;
+            case 'w': out += std::to_string(total.voluntary_switches); break;
+            case 'c': out += std::to_string(total.involuntary_switches); break;
+            default:
+                // 未知的转换原样输出
+                out += format.substr(i, j - i + 1);
+                break;
+        }
+        i = j;
+    }
+    return out;
+}
+
+std::string TimeReport::table(const std::vector<ProcessUsage>& stages, const ProcessUsage& total) {
+    std::ostringstream out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-5s %-16s %10s %10s %10s %10s %8s %6s %8s %8s %5s\n",
+             "stage", "program", "real", "user", "sys", "maxrss_kb", "minflt", "majflt", "vcsw", "ivcsw", "exit");
+    out << line;
+    auto row = [&](const std::string& stage, const ProcessUsage& usage) {
+        snprintf(line, sizeof(line), "%-5s %-16.16s %9.3fs %9.3fs %9.3fs %10ld %8ld %6ld %8ld %8ld %5d\n",
+                 stage.c_str(), usage.program.c_str(), usage.real_ms / 1000.0, usage.user_ms / 1000.0,
+                 usage.sys_ms / 1000.0, usage.max_rss_kb, usage.minor_faults, usage.major_faults,
+                 usage.voluntary_switches, usage.involuntary_switches, usage.exit_code);
+        out << line;
+    };
+    for (size_t i = 0; i < stages.size(); ++i) {
+        row(std::to_string(i + 1), stages[i]);
+    }
+    row("total", total);
+    return out.str();
+}
+
+std::string TimeReport::json(const std::vector<ProcessUsage>& stages, const ProcessUsage& total) {
+    std::ostringstream out;
+    out << "{" << usage_fields(total) << ",\"stages\":[";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        out << (i > 0 ? "," : "") << "{\"pid\":" << stages[i].pid
+            << ",\"program\":" << JsonValue::quote(stages[i].program) << "," << usage_fields(stages[i]) << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+} // namespace NeXShell
@@ -0,0 +1,240 @@
+#include "safety_engine.h"
+#include "utils.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace NeXShell {
+
+namespace {
+
+// 配置文件中的类别名称，下标与 SafetyRuleKind 对应
+constexpr const char* kKindNames[] = {
+    "command",
+    "pattern",
+    "remove",
+    "recursive-remove",
+    "root-glob",
+    "critical",
+    "nested"
+};
+
+bool parse_kind(const std::string& name, SafetyRuleKind& kind) {
+    for (size_t i = 0; i < SafetyScanResult::kKindCount; ++i) {
+        if (name == kKindNames[i]) {
+            kind = static_cast<SafetyRuleKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void SafetyEngine::add_rule(const std::string& pattern, SafetyRuleKind kind) {
+    if (pattern.empty()) {
+        return;
+    }
+    rules_.push_back({pattern, kind});
+    compiled_ = false;
+}
+
+void SafetyEngine::add_builtin_rules() {
+    // 语法树无法表达的危险文本；按程序划分的规则见 CommandSafetyAnalyzer
+    for (const char* dangerous : {
+             ":(){ :|:& };:",  // fork bomb
+             "del /f /s /q C:\\"}) {
+        add_rule(dangerous, SafetyRuleKind::DangerousCommand);
+    }
+
+    // 可疑模式（严格模式下拒绝）
+    for (const char* pattern : {
+             "rm -rf",
+             "dd if=",
+             "mkfs.",
+             ":(){ :|:& };:",
+             "chmod -R 777 /",
+             "chown -R"}) {
+        add_rule(pattern, SafetyRuleKind::DangerousPattern);
+    }
+
+    // 无法解析的 sh -c 文本用原来的子串黑名单给出拒绝原因
+    for (const char* dangerous : {
+             "rm -rf /",
+             "rm -rf /*",
+             "dd if=/dev/zero",
+             "mkfs",
+             "fdisk",
+             "format",
+             "shutdown -h now",
+             "reboot",
+             "halt",
+             "init 0",
+             "kill -9 -1",
+             "chmod -R 777 /",
+             "chown -R root:root /",
+             "sudo rm -rf"}) {
+        add_rule(dangerous, SafetyRuleKind::NestedCommand);
+    }
+
+    add_rule("rm", SafetyRuleKind::RemoveCommand);
+    add_rule("rm -rf", SafetyRuleKind::RecursiveRemove);
+    add_rule("/*", SafetyRuleKind::RootGlob);
+    add_rule("/ ", SafetyRuleKind::RootGlob);
+
+    // 系统关键目录
+    for (const char* dir : {"/bin", "/sbin", "/usr", "/lib", "/etc", "/boot"}) {
+        add_rule(dir, SafetyRuleKind::CriticalPath);
+    }
+}
+
+int SafetyEngine::load_rules_from_file(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return -1;
+    }
+
+    int loaded = 0;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::string_view content = Utils::trim_view(line);
+        if (content.empty() || content[0] == '#') {
+            continue;
+        }
+
+        // 模式部分原样保留，允许包含空格（例如 "root-glob / "）
+        size_t space = line.find(' ');
+        SafetyRuleKind kind;
+        if (space == std::string::npos || space + 1 >= line.size() ||
+            !parse_kind(line.substr(0, space), kind)) {
+            std::cerr << "nexsh: " << path << ":" << line_number
+                      << ": invalid safety rule" << std::endl;
+            continue;
+        }
+
+        add_rule(line.substr(space + 1), kind);
+        ++loaded;
+    }
+
+    return loaded;
+}
+
+void SafetyEngine::compile() {
+    // 为规则中出现过的字节分配字节类，未出现的字节统一映射到 0
+    byte_class_.fill(0);
+    class_count_ = 1;
+    for (const auto& rule : rules_) {
+        for (unsigned char c : rule.pattern) {
+            if (byte_class_[c] == 0) {
+                byte_class_[c] = static_cast<uint16_t>(class_count_++);
+            }
+        }
+    }
+
+    // 构建 trie，-1 表示尚无转移
+    nodes_.assign(1, Node{});
+    transitions_.assign(class_count_, -1);
+    std::vector<std::vector<int32_t>> own_outputs(1);
+
+    for (size_t r = 0; r < rules_.size(); ++r) {
+        size_t state = 0;
+        for (unsigned char c : rules_[r].pattern) {
+            int32_t& next = transitions_[state * class_count_ + byte_class_[c]];
+            if (next < 0) {
+                next = static_cast<int32_t>(nodes_.size());
+                nodes_.push_back(Node{});
+                own_outputs.emplace_back();
+                transitions_.resize(nodes_.size() * class_count_, -1);
+            }
+            state = static_cast<size_t>(transitions_[state * class_count_ + byte_class_[c]]);
+        }
+        own_outputs[state].push_back(static_cast<int32_t>(r));
+    }
+
+    // 按 BFS 顺序计算失败指针，同时把缺失的转移补全为 DFA
+    std::vector<size_t> order;
+    order.reserve(nodes_.size());
+    order.push_back(0);
+    for (size_t head = 0; head < order.size(); ++head) {
+        size_t state = order[head];
+        for (size_t c = 0; c < class_count_; ++c) {
+            int32_t& next = transitions_[state * class_count_ + c];
+            int32_t fallback = state == 0
+                ? 0
+                : transitions_[static_cast<size_t>(nodes_[state].fail) * class_count_ + c];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                nodes_[static_cast<size_t>(next)].fail = fallback;
+                order.push_back(static_cast<size_t>(next));
+            }
+        }
+    }
+
+    // 展开输出：节点自身的规则加上失败链上的规则
+    outputs_.clear();
+    std::vector<std::vector<int32_t>> merged(nodes_.size());
+    for (size_t state : order) {
+        merged[state] = own_outputs[state];
+        if (state != 0) {
+            const auto& inherited = merged[static_cast<size_t>(nodes_[state].fail)];
+            merged[state].insert(merged[state].end(), inherited.begin(), inherited.end());
+        }
+    }
+    for (size_t state = 0; state < nodes_.size(); ++state) {
+        nodes_[state].output_begin = static_cast<uint32_t>(outputs_.size());
+        nodes_[state].output_count = static_cast<uint32_t>(merged[state].size());
+        outputs_.insert(outputs_.end(), merged[state].begin(), merged[state].end());
+    }
+
+    compiled_ = true;
+}
+
+SafetyScanResult SafetyEngine::scan(std::string_view text) const {
+    SafetyScanResult result;
+    if (!compiled_) {
+        return result;
+    }
+
+    size_t state = 0;
+    for (unsigned char c : text) {
+        state = static_cast<size_t>(transitions_[state * class_count_ + byte_class_[c]]);
+        const Node& node = nodes_[state];
+        for (uint32_t i = 0; i < node.output_count; ++i) {
+            int32_t r = outputs_[node.output_begin + i];
+            size_t kind = static_cast<size_t>(rules_[static_cast<size_t>(r)].kind);
+            if (result.first_rule[kind] < 0) {
+                result.first_rule[kind] = r;
+                result.kinds |= 1u << kind;
+            }
+        }
+    }
+
+    return result;
+}
+
+const SafetyEngine& SafetyEngine::shared() {
+    static const SafetyEngine engine = [] {
+        SafetyEngine e;
+        e.add_builtin_rules();
+
+        const char* env_path = getenv("NEXSH_SAFETY_RULES");
+        std::string path = env_path ? env_path : Utils::expand_tilde("~/.nexsh_safety_rules");
+        if (e.load_rules_from_file(path) < 0 && env_path) {
+            std::cerr << "nexsh: cannot read safety rules from " << path << std::endl;
+        }
+
+        e.compile();
+        return e;
+    }();
+    return engine;
+}
+
+} // namespace NeXShell
@@ -1,8 +1,12 @@
 #include "shell.h"
 #include "command_parser.h"
 #include "command_executor.h"
+#include "fork_server.h"
 #include "ai_assistant.h"
 #include "utils.h"
+#include "line_editor.h"
+#include "tracer.h"
+#include "metrics.h"
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
@@ -42,10 +46,16 @@ Shell::Shell() : exit_requested_(false) {
 }
 
 Shell::~Shell() {
+    export_metrics(true);
     g_shell_instance = nullptr;
 }
 
 void Shell::initialize() {
+    // fork server 要在加载 AI 缓存等之前启动，启动时 shell 本身还很小
+    if (ForkServer::enabled()) {
+        fork_server_ = ForkServer::start("/proc/self/exe");
+    }
+    
     // 初始化解析器和执行器
     parser_ = std::make_unique<CommandParser>();
     executor_ = std::make_unique<CommandExecutor>(this);
@@ -54,6 +64,14 @@ void Shell::initialize() {
     ai_assistant_ = std::make_unique<AIAssistant>(this);
     ai_assistant_->auto_initialize(); // 自动检查并初始化AI服务
     
+    // 交互终端上使用行编辑器，以便在用户停顿时预取命令解释
+    if (LineEditor::is_supported(STDIN_FILENO)) {
+        line_editor_ = std::make_unique<LineEditor>(STDIN_FILENO);
+        line_editor_->set_idle_callback([this](const std::string& buffer) {
+            ai_assistant_->prefetch_explanation(buffer);
+        }, PREFETCH_IDLE_MS);
+    }
+    
     // 获取当前工作目录
     char* cwd = getcwd(nullptr, 0);
     if (cwd) {
@@ -66,6 +84,15 @@ void Shell::initialize() {
     // 设置信号处理
     setup_signal_handlers();
     
+    const char* textfile = getenv("NEXSH_METRICS_TEXTFILE");
+    if (textfile && *textfile) {
+        metrics_textfile_ = textfile;
+        const char* interval = getenv("NEXSH_METRICS_INTERVAL");
+        if (interval && std::atoi(interval) > 0) {
+            metrics_interval_ = std::chrono::seconds(std::atoi(interval));
+        }
+    }
+    
     // 初始化环境变量
     char** env = environ;
     while (*env) {
@@ -99,17 +126,47 @@ void Shell::run() {
             }
         }
         
-        // 清理已完成的后台进程
+        // 清理已完成的后台进程和后台 AI 请求
         executor_->cleanup_background_processes();
+        ai_assistant_->cleanup_background_requests();
+        export_metrics(false);
+    }
+}
+
+void Shell::export_metrics(bool force) {
+    if (metrics_textfile_.empty()) {
+        return;
+    }
+    // shell 空闲时指标不会变化，所以只在命令之后按间隔写入
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_metrics_export_ < metrics_interval_) {
+        return;
+    }
+    last_metrics_export_ = now;
+    if (!Metrics::instance().write_textfile(metrics_textfile_)) {
+        std::cerr << "nexsh: cannot write metrics to " << metrics_textfile_ << std::endl;
+        metrics_textfile_.clear();
     }
 }
 
 std::string Shell::read_input() {
     std::string prompt = get_prompt();
+    std::string input;
+    
+    if (line_editor_ && ai_assistant_->is_prefetch_enabled()) {
+        bool ok = line_editor_->read_line(prompt, input);
+        // 已提交的输入不再需要排队中的预取
+        ai_assistant_->cancel_prefetch(input);
+        if (!ok) {
+            request_exit();
+            return "";
+        }
+        return input;
+    }
+    
     std::cout << prompt;
     std::cout.flush();
     
-    std::string input;
     if (!std::getline(std::cin, input)) {
         // EOF (Ctrl+D)
         request_exit();
@@ -141,9 +198,24 @@ std::string Shell::get_prompt() const {
 }
 
 int Shell::execute_command(const std::string& command) {
+    TraceScope trace("shell", "command", command);
+    Metrics& metrics = Metrics::instance();
+    metrics.commands.inc();
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ns = [](std::chrono::steady_clock::time_point since) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - since).count());
+    };
     try {
-        Pipeline pipeline = parser_->parse(command);
-        return executor_->execute_pipeline(pipeline);
+        Pipeline pipeline;
+        {
+            TraceScope parse_trace("shell", "parse");
+            pipeline = parser_->parse(command);
+        }
+        metrics.parse_latency.record_ns(elapsed_ns(start));
+        int exit_code = executor_->execute_pipeline(pipeline);
+        metrics.command_latency.record_ns(elapsed_ns(start));
+        return exit_code;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
@@ -195,6 +267,9 @@ bool Shell::change_directory(const std::string& path) {
             current_directory_ = cwd;
             free(cwd);
             set_environment_variable("PWD", current_directory_);
+            if (ai_assistant_) {
+                ai_assistant_->on_directory_changed(current_directory_);
+            }
             return true;
         }
     }
@@ -203,6 +278,25 @@ bool Shell::change_directory(const std::string& path) {
     return false;
 }
 
+bool Shell::enter_session(const std::string& cwd, const std::vector<std::string>& environment) {
+    clearenv();
+    environment_variables_.clear();
+    for (const auto& entry : environment) {
+        size_t pos = entry.find('=');
+        if (pos != std::string::npos && pos > 0) {
+            set_environment_variable(entry.substr(0, pos), entry.substr(pos + 1));
+        }
+    }
+    
+    if (chdir(cwd.c_str()) != 0) {
+        perror(("cd " + cwd).c_str());
+        return false;
+    }
+    // 工作进程是短暂的，不为它预热目录上下文
+    current_directory_ = cwd;
+    return true;
+}
+
 void Shell::add_to_history(const std::string& command) {
     command_history_.push_back(command);
     
@@ -211,6 +305,7 @@ void Shell::add_to_history(const std::string& command) {
     if (command_history_.size() > max_history_size) {
         command_history_.erase(command_history_.begin());
     }
+    Metrics::instance().history_size.set(static_cast<int64_t>(command_history_.size()));
 }
 
 const std::vector<std::string>& Shell::get_history() const {
@@ -0,0 +1,422 @@
+#include "shell_daemon.h"
+#include "unix_socket.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+extern char** environ;
+
+namespace NeXShell {
+
+namespace {
+
+// 客户端传递的描述符：标准输入、输出、错误
+constexpr size_t PASSED_FDS = 3;
+
+/**
+ * @brief 请求的固定头部，后面依次是以 NUL 结尾的会话名、cwd、命令和环境变量
+ */
+struct RequestHeader {
+    uint32_t envc;
+};
+
+struct Reply {
+    int32_t exit_code;      // -1 表示请求无效
+};
+
+bool make_address(const std::string& path, struct sockaddr_un& address) {
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/**
+ * @brief 把会话序列化为 cwd 和环境变量的 NUL 分隔列表
+ */
+std::vector<char> encode_session(const DaemonSession& session) {
+    std::vector<char> buffer;
+    UnixSocket::append_string(buffer, session.cwd);
+    for (const auto& entry : session.environment) {
+        UnixSocket::append_string(buffer, entry);
+    }
+    return buffer;
+}
+
+bool decode_session(const std::vector<char>& buffer, DaemonSession& session) {
+    // 工作进程在写完之前被终止时，最后一个字符串不完整
+    if (buffer.empty() || buffer.back() != '\0') {
+        return false;
+    }
+    size_t offset = 0;
+    session.cwd = UnixSocket::next_string(buffer, buffer.size(), offset);
+    session.environment.clear();
+    while (const char* entry = UnixSocket::next_string(buffer, buffer.size(), offset)) {
+        session.environment.emplace_back(entry);
+    }
+    return true;
+}
+
+} // namespace
+
+ShellDaemon::ShellDaemon(std::string socket_path, size_t threads, CommandRunner runner)
+    : socket_path_(std::move(socket_path)), thread_count_(threads > 0 ? threads : 1), runner_(std::move(runner)) {}
+
+ShellDaemon::~ShellDaemon() {
+    stop();
+}
+
+std::string ShellDaemon::default_socket_path() {
+    const char* configured = getenv("NEXSH_DAEMON_SOCKET");
+    if (configured && *configured) {
+        return configured;
+    }
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir) {
+        return std::string(runtime_dir) + "/nexshd.sock";
+    }
+    return "/tmp/nexshd-" + std::to_string(getuid()) + ".sock";
+}
+
+bool ShellDaemon::start() {
+    struct sockaddr_un address;
+    if (!make_address(socket_path_, address)) {
+        std::cerr << "nexshd: invalid socket path: " << socket_path_ << std::endl;
+        return false;
+    }
+
+    // 已有守护进程在监听时不能删除它的套接字
+    int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool running = connect(probe, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0;
+        close(probe);
+        if (running) {
+            std::cerr << "nexshd: already running on " << socket_path_ << std::endl;
+            return false;
+        }
+    }
+    unlink(socket_path_.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        perror("nexshd: socket");
+        return false;
+    }
+    // 套接字只对当前用户可读写；连接时还会检查对端的 uid
+    mode_t old_mask = umask(0177);
+    int bound = bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    umask(old_mask);
+    if (bound != 0 || listen(listen_fd_, SOMAXCONN) != 0) {
+        perror(("nexshd: " + socket_path_).c_str());
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    stopping_ = false;
+    for (size_t i = 0; i < thread_count_; ++i) {
+        threads_.emplace_back(&ShellDaemon::accept_loop, this);
+    }
+    return true;
+}
+
+void ShellDaemon::stop() {
+    if (listen_fd_ < 0) {
+        return;
+    }
+    stopping_ = true;
+    // shutdown 唤醒阻塞在 accept 和等待下一个请求的线程；正在执行的命令会执行完
+    shutdown(listen_fd_, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : connections_) {
+            shutdown(fd, SHUT_RD);
+        }
+    }
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(socket_path_.c_str());
+}
+
+void ShellDaemon::accept_loop() {
+    while (!stopping_) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (stopping_) {
+                break;
+            }
+            if (errno != EINTR && errno != ECONNABORTED) {
+                // 例如描述符用尽：稍后重试，不要空转
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                close(fd);
+                break;
+            }
+            connections_.insert(fd);
+        }
+        serve_connection(fd);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.erase(fd);
+        }
+        close(fd);
+    }
+}
+
+void ShellDaemon::serve_connection(int connection_fd) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(connection_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 ||
+        (credentials.uid != geteuid() && credentials.uid != 0)) {
+        return;
+    }
+
+    std::vector<char> buffer(MAX_REQUEST);
+    DaemonSession connection_session;
+    bool has_connection_session = false;
+    while (!stopping_) {
+        int fds[UnixSocket::MAX_FDS];
+        size_t fd_count = 0;
+        ssize_t received = UnixSocket::receive_message(connection_fd, buffer.data(), buffer.size(), fds, fd_count);
+        if (received == 0 || (received < 0 && errno != EMSGSIZE)) {
+            break;
+        }
+
+        Reply reply = {-1};
+        RequestHeader header;
+        size_t size = received > 0 ? static_cast<size_t>(received) : 0;
+        if (fd_count == PASSED_FDS && size >= sizeof(header)) {
+            std::memcpy(&header, buffer.data(), sizeof(header));
+            size_t offset = sizeof(header);
+            const char* name = UnixSocket::next_string(buffer, size, offset);
+            const char* cwd = UnixSocket::next_string(buffer, size, offset);
+            const char* command = UnixSocket::next_string(buffer, size, offset);
+            // 客户端的目录和环境只用于初始化新的会话
+            DaemonSession client;
+            bool complete = name && cwd && command;
+            for (uint32_t i = 0; complete && i < header.envc; ++i) {
+                const char* entry = UnixSocket::next_string(buffer, size, offset);
+                complete = entry != nullptr;
+                if (complete) {
+                    client.environment.emplace_back(entry);
+                }
+            }
+            if (complete) {
+                client.cwd = cwd;
+                std::string session_name = name;
+                DaemonSession session;
+                if (!session_name.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = sessions_.find(session_name);
+                    session = it != sessions_.end() ? it->second : client;
+                } else {
+                    session = has_connection_session ? connection_session : client;
+                }
+
+                reply.exit_code = run_command(connection_fd, session, command, fds);
+
+                // 同一个带名字的会话上并发的命令，后结束的覆盖先结束的
+                if (!session_name.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    sessions_[session_name] = std::move(session);
+                } else {
+                    connection_session = std::move(session);
+                    has_connection_session = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < fd_count; ++i) {
+            close(fds[i]);
+        }
+
+        if (UnixSocket::send_message(connection_fd, &reply, sizeof(reply)) != sizeof(reply)) {
+            break;
+        }
+    }
+}
+
+int ShellDaemon::run_command(int connection_fd, DaemonSession& session, const std::string& command, const int* fds) {
+    int state[2];
+    if (pipe2(state, O_CLOEXEC) != 0) {
+        perror("nexshd: pipe");
+        return 1;
+    }
+
+    // 否则工作进程会把守护进程缓冲中的输出写给客户端
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("nexshd: fork");
+        close(state[0]);
+        close(state[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        // 工作进程：恢复守护进程屏蔽的信号，自成一个进程组，客户端断开时整组终止
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        for (int signal_number : {SIGINT, SIGTERM, SIGHUP, SIGPIPE, SIGTSTP}) {
+            signal(signal_number, SIG_DFL);
+        }
+        setpgid(0, 0);
+        for (size_t target = 0; target < PASSED_FDS; ++target) {
+            if (dup2(fds[target], static_cast<int>(target)) < 0) {
+                _exit(1);
+            }
+        }
+
+        int exit_code = runner_(session, command);
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(nullptr);
+
+        std::vector<char> encoded = encode_session(session);
+        size_t written = 0;
+        while (written < encoded.size()) {
+            ssize_t n = write(state[1], encoded.data() + written, encoded.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+        _exit(exit_code & 0xff);
+    }
+
+    // 父进程也设置一次，避免在子进程 setpgid 之前 kill 进程组失败
+    setpgid(pid, pid);
+    close(state[1]);
+
+    std::vector<char> encoded;
+    char chunk[4096];
+    struct pollfd watched[2] = {{state[0], POLLIN, 0}, {connection_fd, POLLRDHUP, 0}};
+    for (;;) {
+        if (poll(watched, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (watched[1].revents) {
+            // 客户端退出（例如被 Ctrl+C 终止）；守护进程自己停止时让命令执行完
+            if (!stopping_) {
+                kill(-pid, SIGTERM);
+            }
+            watched[1].fd = -1;
+        }
+        if (watched[0].revents) {
+            ssize_t n = read(state[0], chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            encoded.insert(encoded.end(), chunk, chunk + n);
+        }
+    }
+    close(state[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    DaemonSession updated;
+    if (WIFEXITED(status) && decode_session(encoded, updated)) {
+        session = std::move(updated);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+DaemonClient::~DaemonClient() {
+    close(socket_fd_);
+}
+
+std::unique_ptr<DaemonClient> DaemonClient::connect(const std::string& socket_path) {
+    struct sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        errno = ENAMETOOLONG;
+        return nullptr;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+    return std::unique_ptr<DaemonClient>(new DaemonClient(fd));
+}
+
+int DaemonClient::execute(const std::string& command, const std::string& session,
+                          int stdin_fd, int stdout_fd, int stderr_fd) {
+    RequestHeader header = {0};
+    for (char** env = environ; *env; ++env) {
+        ++header.envc;
+    }
+    char* cwd = getcwd(nullptr, 0);
+    buffer_.resize(sizeof(header));
+    std::memcpy(buffer_.data(), &header, sizeof(header));
+    UnixSocket::append_string(buffer_, session);
+    UnixSocket::append_string(buffer_, cwd ? cwd : "/");
+    UnixSocket::append_string(buffer_, command);
+    for (char** env = environ; *env; ++env) {
+        UnixSocket::append_string(buffer_, *env);
+    }
+    free(cwd);
+    if (buffer_.size() > ShellDaemon::MAX_REQUEST) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    int fds[PASSED_FDS] = {stdin_fd, stdout_fd, stderr_fd};
+    if (UnixSocket::send_message(socket_fd_, buffer_.data(), buffer_.size(), fds, PASSED_FDS) < 0) {
+        return -1;
+    }
+    Reply reply;
+    ssize_t received;
+    while ((received = recv(socket_fd_, &reply, sizeof(reply), 0)) < 0 && errno == EINTR) {
+    }
+    if (received != sizeof(reply)) {
+        errno = received == 0 ? ECONNRESET : errno;
+        return -1;
+    }
+    if (reply.exit_code < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return reply.exit_code;
+}
+
+} // namespace NeXShell
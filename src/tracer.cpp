@@ -0,0 +1,187 @@
+#include "tracer.h"
+#include "json.h"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace NeXShell {
+
+namespace {
+
+/**
+ * @brief 单个线程的环形缓冲区；只有所属线程写入，导出时短暂加锁读取
+ */
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t next = 0;            // 下一个写入位置
+    size_t count = 0;           // 有效记录数（不超过容量）
+    uint32_t tid = 0;
+    bool retired = false;       // 线程已退出，记录保留到被淘汰
+};
+
+// 已退出线程的缓冲区最多保留这么多个（对冲请求会创建短命线程）
+constexpr size_t MAX_RETIRED_BUFFERS = 32;
+
+struct Registry {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry() {
+    // 故意不析构：分离线程可能在静态析构之后才退出
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+struct ThreadHandle {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~ThreadHandle() {
+        if (!buffer) {
+            return;
+        }
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffer->retired = true;
+        size_t retired = static_cast<size_t>(std::count_if(reg.buffers.begin(), reg.buffers.end(),
+                                                           [](const auto& b) { return b->retired; }));
+        for (auto it = reg.buffers.begin(); it != reg.buffers.end() && retired > MAX_RETIRED_BUFFERS;) {
+            if ((*it)->retired) {
+                it = reg.buffers.erase(it);
+                --retired;
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+ThreadBuffer& thread_buffer() {
+    thread_local ThreadHandle handle;
+    if (!handle.buffer) {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.resize(Tracer::EVENTS_PER_THREAD);
+        buffer->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.buffers.push_back(buffer);
+        handle.buffer = std::move(buffer);
+    }
+    return *handle.buffer;
+}
+
+} // namespace
+
+uint64_t Tracer::now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void Tracer::record(const char* category, const char* name, uint64_t start_ns, uint64_t end_ns,
+                    std::string_view detail) {
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    TraceEvent& event = buffer.events[buffer.next];
+    event.category = category;
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    size_t length = std::min(detail.size(), sizeof(event.detail) - 1);
+    if (length < detail.size()) {
+        // 截断在 UTF-8 字符边界上：退回到续字节（10xxxxxx）之前，保证导出的 JSON 有效
+        while (length > 0 && (static_cast<unsigned char>(detail[length]) & 0xC0) == 0x80) {
+            --length;
+        }
+    }
+    detail.copy(event.detail, length);
+    event.detail[length] = '\0';
+
+    buffer.next = (buffer.next + 1) % buffer.events.size();
+    buffer.count = std::min(buffer.count + 1, buffer.events.size());
+}
+
+size_t Tracer::event_count() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    size_t total = 0;
+    for (const auto& buffer : reg.buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        total += buffer->count;
+    }
+    return total;
+}
+
+void Tracer::clear() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& buffer : reg.buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->next = 0;
+        buffer->count = 0;
+    }
+}
+
+std::string Tracer::to_chrome_json() {
+    struct Row {
+        uint32_t tid;
+        TraceEvent event;
+    };
+    std::vector<Row> rows;
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& buffer : reg.buffers) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            size_t capacity = buffer->events.size();
+            size_t first = (buffer->next + capacity - buffer->count) % capacity;
+            for (size_t i = 0; i < buffer->count; ++i) {
+                rows.push_back({buffer->tid, buffer->events[(first + i) % capacity]});
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end(),
+              [](const Row& a, const Row& b) { return a.event.start_ns < b.event.start_ns; });
+
+    // 时间戳相对第一条记录，单位为微秒
+    uint64_t origin = rows.empty() ? 0 : rows.front().event.start_ns;
+    int pid = static_cast<int>(getpid());
+    std::ostringstream json;
+    json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char number[64];
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const TraceEvent& event = rows[i].event;
+        json << (i > 0 ? ",\n" : "\n") << "{\"name\":" << JsonValue::quote(event.name)
+             << ",\"cat\":" << JsonValue::quote(event.category) << ",\"ph\":\"X\"";
+        snprintf(number, sizeof(number), ",\"ts\":%.3f,\"dur\":%.3f",
+                 static_cast<double>(event.start_ns - origin) / 1000.0,
+                 static_cast<double>(event.duration_ns) / 1000.0);
+        json << number << ",\"pid\":" << pid << ",\"tid\":" << rows[i].tid;
+        if (event.detail[0] != '\0') {
+            json << ",\"args\":{\"detail\":" << JsonValue::quote(event.detail) << "}";
+        }
+        json << "}";
+    }
+    json << "\n]}\n";
+    return json.str();
+}
+
+bool Tracer::write_chrome_trace(const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << to_chrome_json();
+    return static_cast<bool>(out);
+}
+
+} // namespace NeXShell
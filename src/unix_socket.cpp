@@ -0,0 +1,95 @@
+#include "unix_socket.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace NeXShell {
+
+void UnixSocket::append_string(std::vector<char>& buffer, std::string_view text) {
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    buffer.push_back('\0');
+}
+
+const char* UnixSocket::next_string(const std::vector<char>& buffer, size_t size, size_t& offset) {
+    if (offset >= size) {
+        return nullptr;
+    }
+    const char* start = buffer.data() + offset;
+    const void* end = std::memchr(start, '\0', size - offset);
+    if (!end) {
+        return nullptr;
+    }
+    offset = static_cast<size_t>(static_cast<const char*>(end) - buffer.data()) + 1;
+    return start;
+}
+
+ssize_t UnixSocket::send_message(int socket_fd, const void* data, size_t size, const int* fds, size_t fd_count) {
+    fd_count = std::min(fd_count, MAX_FDS);
+    struct iovec iov = {const_cast<void*>(data), size};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)] = {};
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (fd_count > 0) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fd_count);
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+        std::memcpy(CMSG_DATA(header), fds, sizeof(int) * fd_count);
+    }
+
+    ssize_t sent;
+    while ((sent = sendmsg(socket_fd, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+    }
+    return sent;
+}
+
+ssize_t UnixSocket::receive_message(int socket_fd, void* data, size_t capacity, int* fds, size_t& fd_count) {
+    fd_count = 0;
+    struct iovec iov = {data, capacity};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    while ((received = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    if (received < 0) {
+        return -1;
+    }
+
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (fd_count < MAX_FDS) {
+                fds[fd_count++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (size_t i = 0; i < fd_count; ++i) {
+            close(fds[i]);
+        }
+        fd_count = 0;
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return received;
+}
+
+} // namespace NeXShell
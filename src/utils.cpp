@@ -10,68 +10,192 @@
 #include <pwd.h>
 #include <ctime>
 #include <iomanip>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace NeXShell {
 namespace Utils {
 
-std::vector<std::string> split(const std::string& str, char delimiter) {
-    std::vector<std::string> tokens;
-    std::stringstream ss(str);
-    std::string token;
-    
-    while (std::getline(ss, token, delimiter)) {
-        tokens.push_back(token);
+namespace {
+
+// C locale 下 isspace 的集合：' '、\t、\n、\v、\f、\r
+inline bool is_ascii_space(unsigned char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief 16 字节中每个空白字节对应掩码的一位
+ */
+inline unsigned space_mask(const char* p) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i is_blank = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // c - '\t' <= 4（无符号）即 \t..\r
+    __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+    __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(4)), offset);
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(is_blank, is_control)));
+}
+
+/**
+ * @brief 对 16 字节中 [lo, lo+25] 范围内的字母翻转大小写位
+ */
+inline void flip_case_16(char* p, char lo) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(lo));
+    __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(25)), offset);
+    __m128i flipped = _mm_xor_si128(bytes, _mm_and_si128(in_range, _mm_set1_epi8(0x20)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), flipped);
+}
+#endif
+
+void flip_case(std::string& str, char lo) {
+    char* p = str.data();
+    size_t n = str.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        flip_case_16(p + i, lo);
+    }
+#endif
+    for (; i < n; ++i) {
+        if (static_cast<unsigned char>(p[i] - lo) < 26) {
+            p[i] = static_cast<char>(p[i] ^ 0x20);
+        }
     }
-    
-    return tokens;
 }
 
-std::vector<std::string> split(const std::string& str, const std::string& delimiters) {
-    std::vector<std::string> tokens;
+} // namespace
+
+size_t split_view(std::string_view str, char delimiter, std::vector<std::string_view>& out) {
+    out.clear();
+    const char* data = str.data();
+    size_t n = str.size();
+    size_t field = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i needle = _mm_set1_epi8(delimiter);
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+        while (mask != 0) {
+            size_t pos = i + static_cast<size_t>(__builtin_ctz(mask));
+            out.emplace_back(data + field, pos - field);
+            field = pos + 1;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (data[i] == delimiter) {
+            out.emplace_back(data + field, i - field);
+            field = i + 1;
+        }
+    }
+    // 与 std::getline 一致：末尾分隔符之后不产生空字段
+    if (field < n) {
+        out.emplace_back(data + field, n - field);
+    }
+    return out.size();
+}
+
+size_t split_view(std::string_view str, std::string_view delimiters, std::vector<std::string_view>& out) {
+    out.clear();
     size_t start = 0;
     size_t end = 0;
-    
-    while ((end = str.find_first_of(delimiters, start)) != std::string::npos) {
+    while ((end = str.find_first_of(delimiters, start)) != std::string_view::npos) {
         if (end != start) {
-            tokens.push_back(str.substr(start, end - start));
+            out.push_back(str.substr(start, end - start));
         }
         start = end + 1;
     }
-    
-    if (start < str.length()) {
-        tokens.push_back(str.substr(start));
+    if (start < str.size()) {
+        out.push_back(str.substr(start));
     }
-    
-    return tokens;
+    return out.size();
+}
+
+std::vector<std::string> split(const std::string& str, char delimiter) {
+    std::vector<std::string_view> views;
+    split_view(str, delimiter, views);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+std::vector<std::string> split(const std::string& str, const std::string& delimiters) {
+    std::vector<std::string_view> views;
+    split_view(str, delimiters, views);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+std::string_view ltrim_view(std::string_view str) {
+    const char* data = str.data();
+    size_t n = str.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        unsigned non_space = ~space_mask(data + i) & 0xFFFFu;
+        if (non_space != 0) {
+            return str.substr(i + static_cast<size_t>(__builtin_ctz(non_space)));
+        }
+    }
+#endif
+    while (i < n && is_ascii_space(static_cast<unsigned char>(data[i]))) {
+        ++i;
+    }
+    return str.substr(i);
+}
+
+std::string_view rtrim_view(std::string_view str) {
+    const char* data = str.data();
+    size_t n = str.size();
+#if defined(__SSE2__)
+    while (n >= 16) {
+        unsigned non_space = ~space_mask(data + n - 16) & 0xFFFFu;
+        if (non_space != 0) {
+            return str.substr(0, n - 16 + 32 - static_cast<size_t>(__builtin_clz(non_space)));
+        }
+        n -= 16;
+    }
+#endif
+    while (n > 0 && is_ascii_space(static_cast<unsigned char>(data[n - 1]))) {
+        --n;
+    }
+    return str.substr(0, n);
+}
+
+std::string_view trim_view(std::string_view str) {
+    return rtrim_view(ltrim_view(str));
 }
 
 std::string trim(const std::string& str) {
-    return ltrim(rtrim(str));
+    return std::string(trim_view(str));
 }
 
 std::string ltrim(const std::string& str) {
-    auto it = std::find_if(str.begin(), str.end(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    });
-    return std::string(it, str.end());
+    return std::string(ltrim_view(str));
 }
 
 std::string rtrim(const std::string& str) {
-    auto it = std::find_if(str.rbegin(), str.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    });
-    return std::string(str.begin(), it.base());
+    return std::string(rtrim_view(str));
+}
+
+void to_lower_in_place(std::string& str) {
+    flip_case(str, 'A');
+}
+
+void to_upper_in_place(std::string& str) {
+    flip_case(str, 'a');
 }
 
 std::string to_lower(const std::string& str) {
     std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+    to_lower_in_place(result);
     return result;
 }
 
 std::string to_upper(const std::string& str) {
     std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
+    to_upper_in_place(result);
     return result;
 }
 
@@ -90,14 +214,41 @@ std::string join(const std::vector<std::string>& strings, const std::string& sep
         return "";
     }
     
-    std::ostringstream oss;
-    oss << strings[0];
+    size_t length = separator.size() * (strings.size() - 1);
+    for (const auto& s : strings) {
+        length += s.size();
+    }
     
+    std::string result;
+    result.reserve(length);
+    result += strings[0];
     for (size_t i = 1; i < strings.size(); ++i) {
-        oss << separator << strings[i];
+        result += separator;
+        result += strings[i];
     }
     
-    return oss.str();
+    return result;
+}
+
+std::string join(const std::vector<std::string_view>& strings, std::string_view separator) {
+    if (strings.empty()) {
+        return "";
+    }
+    
+    size_t length = separator.size() * (strings.size() - 1);
+    for (const auto& s : strings) {
+        length += s.size();
+    }
+    
+    std::string result;
+    result.reserve(length);
+    result += strings[0];
+    for (size_t i = 1; i < strings.size(); ++i) {
+        result += separator;
+        result += strings[i];
+    }
+    
+    return result;
 }
 
 std::string replace_all(const std::string& str, const std::string& from, const std::string& to) {
@@ -165,6 +316,33 @@ std::string expand_tilde(const std::string& path) {
     return path; // 不支持 ~user 形式
 }
 
+std::optional<std::string> quote_argument(const std::string& argument) {
+    if (argument.empty()) {
+        return std::nullopt;
+    }
+    for (size_t pos = argument.find('$'); pos != std::string::npos; pos = argument.find('$', pos + 1)) {
+        if (pos + 1 < argument.size() &&
+            (std::isalnum(static_cast<unsigned char>(argument[pos + 1])) || argument[pos + 1] == '_')) {
+            return std::nullopt;
+        }
+    }
+    if (argument.find_first_of(" \t\n\r\v\f'\"|<>&") == std::string::npos) {
+        return argument;
+    }
+    if (argument.find('\'') == std::string::npos) {
+        return "'" + argument + "'";
+    }
+    if (argument.find('"') == std::string::npos) {
+        return "\"" + argument + "\"";
+    }
+    // 解析器把相邻的引号段拼成一个词：单引号放进双引号段
+    std::string quoted = "'";
+    for (char c : argument) {
+        quoted += c == '\'' ? std::string("'\"'\"'") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
 std::string get_timestamp() {
     auto now = std::time(nullptr);
     auto tm = *std::localtime(&now);
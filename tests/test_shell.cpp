@@ -1,12 +1,54 @@
 #include <iostream>
-#include <cassert>
+#include <cstdlib>
 #include <string>
+#include "safety_engine.h"
+#include "command_safety.h"
+#include "ai_worker.h"
+#include "json.h"
+#include "intent_matcher.h"
+#include "embedding_index.h"
+#include "endpoint_pool.h"
+#include "prompt_budget.h"
+#include "directory_context.h"
+#include "ai_assistant.h"
+#include "tracer.h"
+#include "resource_usage.h"
+#include "metrics.h"
+#include "utils.h"
+#include "passthrough.h"
+#include "pipe_sizing.h"
+#include "parallel_runner.h"
+#include "job_cgroup.h"
+#include "fork_server.h"
+#include "shell_daemon.h"
+#include "command_cache.h"
+#include "command_executor.h"
+#include "command_parser.h"
+#include <sys/resource.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <iterator>
+#include <cstdio>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
-// 简单的测试框架
+// 简单的测试框架：断言不依赖 NDEBUG，Release 构建中被测的调用同样会执行
 #define TEST(name) void test_##name()
-#define ASSERT_EQ(a, b) assert((a) == (b))
-#define ASSERT_TRUE(a) assert(a)
-#define ASSERT_FALSE(a) assert(!(a))
+#define ASSERT_EQ(a, b) test_check((a) == (b), #a " == " #b, __FILE__, __LINE__)
+#define ASSERT_TRUE(a) test_check(static_cast<bool>(a), #a, __FILE__, __LINE__)
+#define ASSERT_FALSE(a) test_check(!(a), "!(" #a ")", __FILE__, __LINE__)
+
+void test_check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        std::fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, expression);
+        std::abort();
+    }
+}
 
 // 由于头文件路径问题，我们先创建一些基本的测试
 TEST(basic_functionality) {
@@ -17,10 +59,1115 @@ TEST(basic_functionality) {
 }
 
 TEST(string_operations) {
-    std::string str1 = "  hello  ";
-    // 这里我们会测试 Utils::trim 函数，但现在先跳过
-    // 等头文件问题解决后再添加实际测试
-    ASSERT_TRUE(true);
+    using namespace NeXShell;
+    ASSERT_EQ(Utils::trim("  hello  "), std::string("hello"));
+    ASSERT_EQ(Utils::trim(" \t\n\v\f\r "), std::string(""));
+    // 超过 16 字节，经过向量化路径
+    std::string padded = std::string(37, ' ') + "git status\t--short" + std::string(21, '\n');
+    ASSERT_EQ(Utils::trim_view(padded), std::string_view("git status\t--short"));
+    ASSERT_EQ(Utils::ltrim(padded).size(), padded.size() - 37);
+    ASSERT_EQ(Utils::rtrim(padded).size(), padded.size() - 21);
+
+    std::vector<std::string_view> fields;
+    std::string path = "/usr/local/sbin:/usr/local/bin::/usr/sbin:/usr/bin:/sbin:/bin:";
+    ASSERT_EQ(Utils::split_view(path, ':', fields), 7u);
+    ASSERT_EQ(fields[2], std::string_view(""));
+    ASSERT_EQ(fields[6], std::string_view("/bin"));
+    ASSERT_EQ(Utils::split(",a", ',').size(), 2u);
+    ASSERT_TRUE(Utils::split("", ',').empty());
+    ASSERT_EQ(Utils::split_view("  ls \t -la  ", " \t", fields), 2u);
+    ASSERT_EQ(Utils::join(fields, " "), std::string("ls -la"));
+    ASSERT_EQ(Utils::join(std::vector<std::string>{"a", "b", "c"}, ", "), std::string("a, b, c"));
+
+    std::string mixed = "Hello, WORLD! [@`{] Zz 0123456789 \xC3\x89t\xC3\xA9";
+    ASSERT_EQ(Utils::to_lower(mixed), std::string("hello, world! [@`{] zz 0123456789 \xC3\x89t\xC3\xA9"));
+    ASSERT_EQ(Utils::to_upper(mixed), std::string("HELLO, WORLD! [@`{] ZZ 0123456789 \xC3\x89T\xC3\xA9"));
+
+    ASSERT_EQ(Utils::format("%s has %d items (%.1f%%)", std::string("list"), 3, 42.5),
+              std::string("list has 3 items (42.5%)"));
+}
+
+TEST(safety_engine) {
+    using namespace NeXShell;
+    SafetyEngine engine;
+    engine.add_builtin_rules();
+    engine.add_rule("he", SafetyRuleKind::DangerousPattern);
+    engine.add_rule("she", SafetyRuleKind::DangerousCommand);
+    engine.compile();
+
+    // 重叠模式经失败指针全部命中
+    auto scan = engine.scan("ushers");
+    ASSERT_TRUE(scan.has(SafetyRuleKind::DangerousCommand));
+    ASSERT_TRUE(scan.has(SafetyRuleKind::DangerousPattern));
+
+    scan = engine.scan(":(){ :|:& };:");
+    ASSERT_EQ(engine.rule(scan.first_rule[static_cast<size_t>(SafetyRuleKind::DangerousCommand)]).pattern,
+              std::string(":(){ :|:& };:"));
+
+    ASSERT_EQ(engine.scan("ls -la").kinds, 0u);
+
+    // AIAssistant 和 CommandValidator 共用同一套默认规则：
+    // 关机类命令带任何参数都拒绝，两者都拒绝 Windows 的 del 命令
+    CommandSafetyAnalyzer analyzer(SafetyEngine::shared());
+    ASSERT_FALSE(analyzer.analyze("shutdown -r +5", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("del /f /s /q C:\\", "/tmp").safe);
+    CommandValidator validator;
+    ASSERT_FALSE(validator.is_safe("shutdown -r +5"));
+    ASSERT_FALSE(validator.is_safe("del /f /s /q C:\\"));
+    ASSERT_FALSE(validator.is_safe("sudo rm -rf build"));
+    ASSERT_TRUE(validator.is_safe("ls -la"));
+
+    // 旧格式的规则文件中的所有类别都能加载
+    std::string path = "/tmp/nexsh_test_rules_" + std::to_string(getpid());
+    std::ofstream(path) << "# rules\ncommand halt -p\nremove shred\nrecursive-remove shred -u\n"
+                           "root-glob /.\ncritical /opt\nnested wipe\nbogus x\n";
+    SafetyEngine loaded;
+    ASSERT_EQ(loaded.load_rules_from_file(path), 6);
+    loaded.compile();
+    ASSERT_TRUE(loaded.scan("shred /opt/x").has(SafetyRuleKind::CriticalPath));
+    unlink(path.c_str());
+}
+
+TEST(command_safety) {
+    using namespace NeXShell;
+    CommandSafetyAnalyzer analyzer(SafetyEngine::shared());
+
+    // 不再因为同时出现 "rm" 和 "/usr" 而误报
+    ASSERT_TRUE(analyzer.analyze("grep -rm /usr/share/doc", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("rm -rf build", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("kill -1 1234", "/tmp").safe);
+
+    // 多余空格、拆开的选项和包装程序都能识别
+    ASSERT_FALSE(analyzer.analyze("rm  -rf /", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("rm -r -f /", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("sudo rm -rf /usr/*", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("rm -rf ../../etc", "/tmp/a").safe);
+    ASSERT_FALSE(analyzer.analyze("echo x > /etc/passwd", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("dd if=/dev/zero of=/dev/sda", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("kill -9 -1", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("bash -c 'rm -rf /'", "/tmp").safe);
+
+    // sh -c 的文本是命令列表：逐个分析，跟随 cd，无法分析的语法视为不安全
+    ASSERT_FALSE(analyzer.analyze("sh -c 'true; rm -rf /'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("sh -c 'cd / && rm -rf *'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("sh -c 'false || chmod 777 /etc'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("sh -c 'echo $(rm -rf ~)'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("sh -c 'if true; then echo; fi'", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("sh -c 'cd build && make -j4 2>&1; echo done'", "/tmp").safe);
+    // 能解析的内嵌文本与顶层命令使用相同的规则，不再按子串误报
+    ASSERT_TRUE(analyzer.analyze("git log --format=%h", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("sh -c 'git log --format=%h'", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("bash -c 'echo halt'", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("sh -c 'rm -rf /tmp/build'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("bash -c 'halt'", "/tmp").safe);
+    // 无法解析时子串黑名单给出原因
+    SafetyVerdict nested = analyzer.analyze("sh -c 'if true; then mkfs /dev/sda; fi'", "/tmp");
+    ASSERT_FALSE(nested.safe);
+    ASSERT_EQ(nested.reason, std::string("Nested shell command contains: mkfs"));
+
+    // 相同的规范化命令直接命中缓存
+    size_t hits = analyzer.cache_hits();
+    ASSERT_FALSE(analyzer.analyze("rm -fr /", "/tmp").safe);
+    ASSERT_EQ(analyzer.cache_hits(), hits + 1);
+
+    // 引号中的重定向和管道符只是普通参数，不能与真正的重定向共用缓存结论
+    ASSERT_TRUE(analyzer.analyze("echo a '>/etc/passwd'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("echo a > /etc/passwd", "/tmp").safe);
+    ASSERT_TRUE(analyzer.analyze("echo 'a | rm -rf /'", "/tmp").safe);
+    ASSERT_FALSE(analyzer.analyze("echo a | rm -rf /", "/tmp").safe);
+}
+
+TEST(ai_worker_pool) {
+    using namespace NeXShell;
+    AIWorkerPool pool(2, 4);
+
+    // 两个请求能够同时执行：各自等待对方开始
+    std::atomic<int> started{0};
+    auto wait_for_peer = [&started]() {
+        ++started;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (started.load() < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return started.load() == 2;
+    };
+    auto first = pool.submit(wait_for_peer);
+    auto second = pool.submit(wait_for_peer);
+    ASSERT_TRUE(first.get());
+    ASSERT_TRUE(second.get());
+
+    // 异常通过 future 传回
+    auto failing = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+    bool thrown = false;
+    try {
+        failing.get();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown);
+
+    // 队列已满时拒绝新请求
+    AIWorkerPool single(1, 1);
+    std::promise<void> running;
+    std::promise<void> release;
+    auto release_future = release.get_future().share();
+    auto blocker = single.submit([&running, release_future]() {
+        running.set_value();
+        release_future.wait();
+    });
+    running.get_future().wait();
+    auto queued = single.submit([]() {});
+    bool rejected = false;
+    try {
+        single.submit([]() {});
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    ASSERT_TRUE(rejected);
+    release.set_value();
+    blocker.get();
+    queued.get();
+
+    // 低优先级任务在普通任务之后执行
+    AIWorkerPool ordered(1, 4);
+    std::promise<void> busy;
+    std::promise<void> go;
+    auto go_future = go.get_future().share();
+    std::vector<int> order;
+    auto occupying = ordered.submit([&busy, go_future]() {
+        busy.set_value();
+        go_future.wait();
+    });
+    busy.get_future().wait();
+    auto low = ordered.submit([&order]() { order.push_back(2); }, AIPriority::Low);
+    auto normal = ordered.submit([&order]() { order.push_back(1); });
+    go.set_value();
+    occupying.get();
+    normal.get();
+    low.get();
+    ASSERT_EQ(order.size(), 2u);
+    ASSERT_EQ(order[0], 1);
+    ASSERT_EQ(order[1], 2);
+}
+
+TEST(json_reader) {
+    using namespace NeXShell;
+    auto json = JsonValue::parse(R"({"response":"ls \"a b\"\n\u00e9","done":true,)"
+                                 R"("context":[1,2,30000],"eval_count":7,"nested":{"x":null}})");
+    ASSERT_TRUE(json.has_value());
+    ASSERT_EQ((*json)["response"].as_string(), std::string("ls \"a b\"\n\xc3\xa9"));
+    ASSERT_TRUE((*json)["done"].as_bool());
+    ASSERT_EQ((*json)["context"].items().size(), 3u);
+    ASSERT_EQ((*json)["context"].items()[2].as_number(), 30000.0);
+    ASSERT_EQ((*json)["eval_count"].as_number(), 7.0);
+    ASSERT_TRUE((*json)["nested"]["x"].is_null());
+    ASSERT_TRUE((*json)["missing"].is_null());
+
+    ASSERT_FALSE(JsonValue::parse("{\"a\":}").has_value());
+    ASSERT_FALSE(JsonValue::parse("[1,2] x").has_value());
+
+    // quote 的输出能被重新解析
+    std::string text = "it's \"quoted\"\n\ttab";
+    ASSERT_EQ(JsonValue::parse(JsonValue::quote(text))->as_string(), text);
+}
+
+TEST(intent_matcher) {
+    using namespace NeXShell;
+    IntentMatcher matcher;
+    IntentMatch match = matcher.match("find all txt files in the current directory");
+    ASSERT_TRUE(match.confidence >= IntentMatcher::CONFIDENCE_THRESHOLD);
+    ASSERT_EQ(match.command, std::string("find . -name '*.txt'"));
+
+    match = matcher.match("show the first 20 lines of main.cpp");
+    ASSERT_TRUE(match.confidence >= IntentMatcher::CONFIDENCE_THRESHOLD);
+    ASSERT_EQ(match.command, std::string("head -n 20 main.cpp"));
+
+    // 不常见的请求交给模型
+    ASSERT_TRUE(matcher.match("compress the logs folder into a tarball").confidence <
+                IntentMatcher::CONFIDENCE_THRESHOLD);
+
+    // 否定的请求不能套用意思相反的模板
+    ASSERT_TRUE(matcher.match("find files modified today").confidence >= IntentMatcher::CONFIDENCE_THRESHOLD);
+    ASSERT_EQ(matcher.match("find files not modified today").confidence, 0.0);
+    ASSERT_EQ(matcher.match("find all files except txt files").confidence, 0.0);
+    ASSERT_EQ(matcher.match("show files that aren't hidden").confidence, 0.0);
+    ASSERT_FALSE(matcher.learn("find files without extension", "find . -type f ! -name '*.*'"));
+
+    // 学到的模板会泛化出现在命令里的词
+    size_t before = matcher.template_count();
+    ASSERT_TRUE(matcher.learn("compress logs into tarball", "tar czf logs.tar.gz logs"));
+    ASSERT_EQ(matcher.template_count(), before + 1);
+    match = matcher.match("compress src into tarball");
+    ASSERT_TRUE(match.confidence >= IntentMatcher::CONFIDENCE_THRESHOLD);
+    ASSERT_EQ(match.command, std::string("tar czf src.tar.gz src"));
+}
+
+TEST(embedding_index) {
+    using namespace NeXShell;
+    // AVX2 与标量实现在奇数长度下结果一致
+    std::vector<float> a(37), b(37);
+    float expected = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<float>(i) * 0.5f;
+        b[i] = 1.0f - static_cast<float>(i) * 0.01f;
+        expected += a[i] * b[i];
+    }
+    float actual = EmbeddingIndex::dot(a.data(), b.data(), a.size());
+    ASSERT_TRUE(actual > expected - 0.01f && actual < expected + 0.01f);
+
+    std::string path = "/tmp/nexsh_test_embeddings_" + std::to_string(getpid());
+    EmbeddingIndex index;
+    index.set_storage_path(path);
+    ASSERT_TRUE(index.add({1.0f, 0.0f, 0.0f}, "list files", "ls"));
+    ASSERT_TRUE(index.add({0.0f, 2.0f, 0.0f}, "show disk usage", "df -h"));
+    ASSERT_TRUE(index.add({0.0f, 1.0f, 1.0f}, "disk usage here", "du -sh ."));
+    ASSERT_FALSE(index.add({1.0f, 0.0f}, "wrong dimension", "true"));
+
+    auto hits = index.top_k({0.1f, 1.0f, 0.2f}, 2);
+    ASSERT_EQ(hits.size(), 2u);
+    ASSERT_EQ(index.entry(hits[0].index).second, std::string("df -h"));
+    ASSERT_EQ(index.entry(hits[1].index).second, std::string("du -sh ."));
+    ASSERT_TRUE(hits[0].score >= hits[1].score);
+
+    // 重新加载后结果相同
+    EmbeddingIndex loaded;
+    ASSERT_EQ(loaded.load(path), 3);
+    ASSERT_EQ(loaded.dimension(), 3u);
+    hits = loaded.top_k({0.1f, 1.0f, 0.2f}, 1);
+    ASSERT_EQ(loaded.entry(hits[0].index).second, std::string("df -h"));
+
+    std::remove((path + ".f32").c_str());
+    std::remove((path + ".tsv").c_str());
+}
+
+TEST(endpoint_pool) {
+    using namespace NeXShell;
+    EndpointPool pool({"http://a:11434", "http://b:11434", "http://c:11434"});
+
+    // 没有样本时按进行中的请求数分散
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    ASSERT_TRUE(first.has_value() && second.has_value());
+    ASSERT_TRUE(*first != *second);
+    pool.release(*first, EndpointOutcome::Success, 100.0);
+    pool.release(*second, EndpointOutcome::Success, 10.0);
+
+    // 失败的端点进入退避，之后优先选择延迟低的端点
+    auto third = pool.acquire({*first, *second});
+    ASSERT_TRUE(third.has_value());
+    pool.release(*third, EndpointOutcome::Failure, 5.0);
+    ASSERT_FALSE(pool.status()[*third].healthy);
+    auto next = pool.acquire();
+    ASSERT_EQ(*next, *second);
+    pool.release(*next, EndpointOutcome::Cancelled, 0.0);
+    ASSERT_EQ(pool.status()[*second].in_flight, 0u);
+
+    // 所有端点都已尝试时没有可用端点
+    ASSERT_FALSE(pool.acquire({0, 1, 2}).has_value());
+
+    // 对冲延迟为最近成功延迟的百分位
+    ASSERT_FALSE(pool.hedge_delay_ms().has_value());
+    for (int i = 1; i <= 20; ++i) {
+        auto index = pool.acquire();
+        pool.release(*index, EndpointOutcome::Success, i * 10.0);
+    }
+    pool.set_hedge_percentile(0.5);
+    auto delay = pool.hedge_delay_ms();
+    ASSERT_TRUE(delay.has_value());
+    ASSERT_TRUE(*delay >= 90.0 && *delay <= 110.0);
+    pool.set_hedge_percentile(0.0);
+    ASSERT_FALSE(pool.hedge_delay_ms().has_value());
+}
+
+TEST(prompt_budget) {
+    using namespace NeXShell;
+    ASSERT_EQ(PromptBudget::estimate_tokens(""), 0u);
+    ASSERT_EQ(PromptBudget::estimate_tokens("ls -la"), 3u);
+    ASSERT_EQ(PromptBudget::estimate_tokens("abcdefgh"), 2u);
+
+    CompactionCache cache;
+    auto build = [&cache](size_t max_tokens, std::vector<std::string>& out) {
+        PromptBudget budget(max_tokens, &cache);
+        PromptSection rules;
+        rules.required = true;
+        rules.items = {"rules"};
+        budget.add(rules);
+
+        PromptSection listing;
+        listing.header = "Files:";
+        listing.priority = 10;
+        for (int i = 0; i < 100; ++i) {
+            listing.items.push_back("file" + std::to_string(i) + ".txt");
+        }
+        listing.compact_key = "listing";
+        listing.compactor = [](const std::vector<std::string>& items) {
+            return std::to_string(items.size()) + " files";
+        };
+        budget.add(listing);
+
+        PromptSection history;
+        history.header = "History:";
+        history.priority = 20;
+        history.keep_newest = true;
+        history.items = {"old one", "middle one", "newest one"};
+        budget.add(history);
+
+        out = budget.fit();
+        ASSERT_TRUE(budget.used_tokens() <= max_tokens);
+        return budget.dropped_items();
+    };
+
+    // 预算充足时完整保留
+    std::vector<std::string> sections;
+    ASSERT_EQ(build(10000, sections), 0u);
+    ASSERT_TRUE(sections[1].find("file99.txt") != std::string::npos);
+
+    // 预算不足时目录列表被摘要替代，第二次命中缓存
+    build(30, sections);
+    ASSERT_EQ(sections[1], std::string("Files:\n100 files\n"));
+    ASSERT_TRUE(sections[2].find("old one") != std::string::npos);
+    build(30, sections);
+    ASSERT_EQ(cache.hits(), 1u);
+
+    // 更小的预算下历史只保留最新的条目，目录列表被丢弃
+    ASSERT_TRUE(build(12, sections) > 0u);
+    ASSERT_EQ(sections[0], std::string("rules\n"));
+    ASSERT_TRUE(sections[1].empty());
+    ASSERT_TRUE(sections[2].find("newest one") != std::string::npos);
+    ASSERT_TRUE(sections[2].find("old one") == std::string::npos);
+}
+
+TEST(directory_context) {
+    using namespace NeXShell;
+    std::string dir = "/tmp/nexsh_test_dir_" + std::to_string(getpid());
+    ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+    ASSERT_EQ(mkdir((dir + "/sub").c_str(), 0755), 0);
+    std::ofstream(dir + "/b.txt") << std::string(2048, 'x');
+    std::ofstream(dir + "/a.cpp") << "int main() {}";
+    std::ofstream(dir + "/.hidden") << "secret";
+
+    DirectoryContext context(2);
+    auto snapshot = context.get(dir);
+    ASSERT_EQ(snapshot->total_entries, 3u);
+    ASSERT_EQ(snapshot->entries.size(), 2u);
+    ASSERT_TRUE(snapshot->truncated);
+    ASSERT_EQ(snapshot->entries[0].name, std::string("a.cpp"));
+    ASSERT_EQ(snapshot->entries[0].size, 13u);
+    ASSERT_EQ(DirectoryContext::format_entry(snapshot->entries[1]), std::string("b.txt 2.0K"));
+    ASSERT_TRUE(DirectoryContext::summarize(*snapshot).find("3+ entries") == 0);
+
+    // 没有变化时直接命中缓存
+    ASSERT_EQ(context.get(dir), snapshot);
+    context.refresh(dir);
+    ASSERT_EQ(context.scan_count(), 1u);
+    ASSERT_EQ(context.hit_count(), 2u);
+
+    // 新建文件后缓存失效（inotify 事件或 mtime）
+    std::ofstream(dir + "/0.log") << "";
+    auto updated = context.get(dir);
+    ASSERT_TRUE(updated->generation > snapshot->generation);
+    ASSERT_EQ(updated->entries[0].name, std::string("0.log"));
+
+    std::remove((dir + "/0.log").c_str());
+    std::remove((dir + "/a.cpp").c_str());
+    std::remove((dir + "/b.txt").c_str());
+    std::remove((dir + "/.hidden").c_str());
+    rmdir((dir + "/sub").c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(command_response_parsing) {
+    using namespace NeXShell;
+    auto parsed = AIAssistant::parse_command_response(
+        R"({"command":"du -sh .","explanation":"Shows the size of this directory.","risk":"Low"})");
+    ASSERT_TRUE(parsed.has_value());
+    ASSERT_EQ(parsed->command, std::string("du -sh ."));
+    ASSERT_EQ(parsed->explanation, std::string("Shows the size of this directory."));
+    ASSERT_EQ(parsed->risk, std::string("low"));
+
+    // 包裹在代码块里的 JSON、代码块和单行回复
+    parsed = AIAssistant::parse_command_response("```json\n{\"command\":\"`ls -la`\"}\n```");
+    ASSERT_EQ(parsed->command, std::string("ls -la"));
+    parsed = AIAssistant::parse_command_response("Try this:\n```bash\n$ find . -name '*.txt'\n```\nDone.");
+    ASSERT_EQ(parsed->command, std::string("find . -name '*.txt'"));
+    parsed = AIAssistant::parse_command_response("  cat README.md  ");
+    ASSERT_EQ(parsed->command, std::string("cat README.md"));
+
+    // 请求不明确时命令为空；无法确定命令时失败
+    parsed = AIAssistant::parse_command_response(R"({"command":"","explanation":"Which directory?"})");
+    ASSERT_TRUE(parsed.has_value() && parsed->command.empty());
+    ASSERT_FALSE(AIAssistant::parse_command_response("You could use ls.\nOr maybe find.").has_value());
+    ASSERT_FALSE(AIAssistant::parse_command_response(R"({"command":42})").has_value());
+}
+
+TEST(batch_response_parsing) {
+    using namespace NeXShell;
+    auto results = AIAssistant::parse_batch_response(
+        R"({"results":[{"task":2,"commands":["du -sh ."]},{"task":1,"commands":[" ls "," ","pwd"]}]})", 2);
+    ASSERT_EQ(results.size(), 2u);
+    ASSERT_EQ(results[0], (std::vector<std::string>{"ls", "pwd"}));
+    ASSERT_EQ(results[1], (std::vector<std::string>{"du -sh ."}));
+
+    // 没有 task 编号时按顺序对应；直接的数组也接受；每个任务最多 3 条
+    results = AIAssistant::parse_batch_response(R"([{"commands":["a","b","c","d"]},{"commands":["e"]}])", 2);
+    ASSERT_EQ(results[0].size(), 3u);
+    ASSERT_EQ(results[1], (std::vector<std::string>{"e"}));
+
+    // 越界、负数、零、小数和非数字的编号被丢弃，不会按位置错配
+    results = AIAssistant::parse_batch_response(
+        R"({"results":[{"task":3,"commands":["x"]},{"task":-1,"commands":["x"]},{"task":0,"commands":["x"]},)"
+        R"({"task":1.5,"commands":["x"]},{"task":"two","commands":["x"]},{"task":1e308,"commands":["x"]}]})", 2);
+    ASSERT_TRUE(results[0].empty() && results[1].empty());
+
+    // 重复的编号只取第一个条目；缺失的任务为空
+    results = AIAssistant::parse_batch_response(
+        R"({"results":[{"task":1,"commands":["first"]},{"task":1,"commands":["second"]}]})", 3);
+    ASSERT_EQ(results.size(), 3u);
+    ASSERT_EQ(results[0], (std::vector<std::string>{"first"}));
+    ASSERT_TRUE(results[1].empty() && results[2].empty());
+
+    // 无法解析的回复
+    results = AIAssistant::parse_batch_response("not json", 2);
+    ASSERT_TRUE(results.size() == 2 && results[0].empty() && results[1].empty());
+}
+
+TEST(tracer) {
+    using namespace NeXShell;
+    Tracer::clear();
+    {
+        TraceScope ignored("test", "disabled");
+    }
+    ASSERT_EQ(Tracer::event_count(), 0u);
+
+    Tracer::set_enabled(true);
+    {
+        TraceScope outer("test", "outer", "detail \"quoted\"");
+        TraceScope inner("test", "inner");
+    }
+    std::thread([]() { TraceScope worker("test", "worker"); }).join();
+    Tracer::set_enabled(false);
+    ASSERT_EQ(Tracer::event_count(), 3u);
+
+    auto trace = JsonValue::parse(Tracer::to_chrome_json());
+    ASSERT_TRUE(trace.has_value());
+    const auto& events = (*trace)["traceEvents"].items();
+    ASSERT_EQ(events.size(), 3u);
+    ASSERT_EQ(events[0]["name"].as_string(), std::string("outer"));
+    ASSERT_EQ(events[0]["ph"].as_string(), std::string("X"));
+    ASSERT_EQ(events[0]["args"]["detail"].as_string(), std::string("detail \"quoted\""));
+    ASSERT_TRUE(events[0]["dur"].as_number() >= events[1]["dur"].as_number());
+    ASSERT_TRUE(events[2]["tid"].as_number() != events[0]["tid"].as_number());
+
+    // 超长的 detail 在 UTF-8 字符边界上截断
+    Tracer::clear();
+    Tracer::set_enabled(true);
+    std::string path = "cd ";
+    for (int i = 0; i < 20; ++i) {
+        path += "目录";
+    }
+    {
+        TraceScope chinese("test", "utf8", path);
+    }
+    Tracer::set_enabled(false);
+    trace = JsonValue::parse(Tracer::to_chrome_json());
+    ASSERT_TRUE(trace.has_value());
+    std::string detail = (*trace)["traceEvents"].items()[0]["args"]["detail"].as_string();
+    ASSERT_EQ(detail.size(), 45u);
+    ASSERT_EQ(path.compare(0, detail.size(), detail), 0);
+
+    Tracer::clear();
+    ASSERT_EQ(Tracer::event_count(), 0u);
+}
+
+TEST(time_report) {
+    using namespace NeXShell;
+    ProcessUsage first;
+    first.program = "sort";
+    first.real_ms = 1500.0;
+    first.user_ms = 1000.0;
+    first.sys_ms = 250.0;
+    first.max_rss_kb = 2048;
+    first.minor_faults = 10;
+    ProcessUsage second;
+    second.program = "uniq";
+    second.user_ms = 125.0;
+    second.max_rss_kb = 4096;
+    second.minor_faults = 5;
+
+    ProcessUsage total;
+    total.real_ms = 1500.0;
+    total.accumulate(first);
+    total.accumulate(second);
+    ASSERT_EQ(total.max_rss_kb, 4096);
+    ASSERT_EQ(total.minor_faults, 15);
+
+    ASSERT_EQ(TimeReport::format(TimeReport::DEFAULT_FORMAT, total),
+              std::string("\nreal\t0m1.500s\nuser\t0m1.125s\nsys\t0m0.250s"));
+    ASSERT_EQ(TimeReport::format(TimeReport::POSIX_FORMAT, total), std::string("real 1.50\nuser 1.12\nsys 0.25"));
+    ASSERT_EQ(TimeReport::format("%R %P%% %M %f %x", total), std::string("1.500 91.67% 4096 15 %x"));
+
+    auto json = JsonValue::parse(TimeReport::json({first, second}, total));
+    ASSERT_TRUE(json.has_value());
+    ASSERT_EQ((*json)["stages"].items().size(), 2u);
+    ASSERT_EQ((*json)["stages"].items()[1]["program"].as_string(), std::string("uniq"));
+    ASSERT_TRUE((*json)["user_ms"].as_number() > 1124.0);
+    ASSERT_TRUE(TimeReport::table({first, second}, total).find("total") != std::string::npos);
+}
+TEST(metrics) {
+    using namespace NeXShell;
+    for (uint64_t ns : {0ull, 7ull, 8ull, 15ull, 16ull, 1000ull, 123456789ull}) {
+        size_t index = LatencyHistogram::bucket_index(ns);
+        ASSERT_TRUE(LatencyHistogram::bucket_lower(index) <= ns);
+        ASSERT_TRUE(LatencyHistogram::bucket_upper(index) >= ns);
+    }
+    ASSERT_EQ(LatencyHistogram::bucket_index(1000), LatencyHistogram::bucket_index(1010));
+    ASSERT_TRUE(LatencyHistogram::bucket_index(1000) < LatencyHistogram::bucket_index(1200));
+
+    LatencyHistogram histogram("test_seconds", "Test latency");
+    ASSERT_EQ(histogram.percentile_ns(0.5), 0u);
+    for (int i = 0; i < 90; ++i) {
+        histogram.record_ns(1000);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.record_ns(1000000);
+    }
+    ASSERT_EQ(histogram.count(), 100u);
+    ASSERT_EQ(histogram.max_ns(), 1000000u);
+    uint64_t p50 = histogram.percentile_ns(0.5);
+    uint64_t p99 = histogram.percentile_ns(0.99);
+    ASSERT_TRUE(p50 >= 900 && p50 <= 1130);
+    ASSERT_TRUE(p99 >= 880000 && p99 <= 1000000);
+
+    Metrics& metrics = Metrics::instance();
+    uint64_t before = metrics.commands.value();
+    metrics.commands.inc();
+    ASSERT_EQ(metrics.commands.value(), before + 1);
+    std::string text = metrics.to_prometheus();
+    ASSERT_TRUE(text.find("# TYPE nexsh_commands_total counter") != std::string::npos);
+    ASSERT_TRUE(text.find("nexsh_fork_seconds{quantile=\"0.99\"}") != std::string::npos);
+    ASSERT_TRUE(text.find("nexsh_history_size ") != std::string::npos);
+
+    std::string path = "/tmp/nexsh_metrics_test_" + std::to_string(getpid()) + ".prom";
+    ASSERT_TRUE(metrics.write_textfile(path));
+    std::ifstream in(path);
+    std::string first_line;
+    std::getline(in, first_line);
+    ASSERT_TRUE(first_line.rfind("# HELP ", 0) == 0);
+    std::remove(path.c_str());
+}
+TEST(passthrough) {
+    using namespace NeXShell;
+    Command command;
+    command.program = "cat";
+    ASSERT_TRUE(PassthroughStage::detect(command).has_value());
+    command.arguments = {"-n"};
+    ASSERT_FALSE(PassthroughStage::detect(command).has_value());
+    command.program = "tee";
+    command.arguments = {"-a", "log.txt"};
+    auto tee = PassthroughStage::detect(command);
+    ASSERT_TRUE(tee.has_value() && tee->append && tee->files.size() == 1);
+    command.program = "grep";
+    ASSERT_FALSE(PassthroughStage::detect(command).has_value());
+
+    // tee FILE：管道输入复制到管道输出和文件
+    std::string data(300000, 'x');
+    for (size_t i = 0; i < data.size(); i += 7) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    int in[2];
+    int out[2];
+    bool piped = pipe(in) == 0 && pipe(out) == 0;
+    ASSERT_TRUE(piped);
+    std::thread writer([&]() {
+        ssize_t written = write(in[1], data.data(), data.size());
+        ASSERT_EQ(written, static_cast<ssize_t>(data.size()));
+        close(in[1]);
+    });
+    std::string received;
+    std::thread reader([&]() {
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(out[0], buffer, sizeof(buffer))) > 0) {
+            received.append(buffer, static_cast<size_t>(n));
+        }
+    });
+    std::string path = "/tmp/nexsh_passthrough_test_" + std::to_string(getpid());
+    PassthroughStage stage;
+    stage.kind = PassthroughStage::Kind::Tee;
+    stage.files = {path};
+    ASSERT_EQ(stage.run(in[0], out[1]), 0);
+    close(out[1]);
+    writer.join();
+    reader.join();
+    close(in[0]);
+    close(out[0]);
+    ASSERT_TRUE(received == data);
+
+    // cat FILE > FILE：普通文件之间用 copy_file_range
+    std::string copy = path + ".copy";
+    int source = open(path.c_str(), O_RDONLY);
+    int target = open(copy.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_EQ(PassthroughStage::transfer(source, target), static_cast<long long>(data.size()));
+    close(source);
+    close(target);
+    std::ifstream copied(copy, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(copied)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(contents == data);
+    std::remove(path.c_str());
+    std::remove(copy.c_str());
+}
+TEST(pipe_sizing) {
+    using namespace NeXShell;
+    ASSERT_TRUE(PipeSizeSetting::parse("default")->mode == PipeSizeSetting::Mode::Default);
+    ASSERT_TRUE(PipeSizeSetting::parse("auto")->mode == PipeSizeSetting::Mode::Adaptive);
+    ASSERT_EQ(PipeSizeSetting::parse("256K")->bytes, 256u * 1024);
+    ASSERT_EQ(PipeSizeSetting::parse("1m")->bytes, 1024u * 1024);
+    ASSERT_EQ(PipeSizeSetting::parse("4096")->bytes, 4096u);
+    ASSERT_FALSE(PipeSizeSetting::parse("0").has_value());
+    ASSERT_FALSE(PipeSizeSetting::parse("1MB").has_value());
+    ASSERT_FALSE(PipeSizeSetting::parse("big").has_value());
+
+    int fds[2];
+    bool piped = pipe(fds) == 0;
+    ASSERT_TRUE(piped);
+    size_t capacity = PipeSizer::resize(fds[1], 256 * 1024);
+    ASSERT_TRUE(capacity >= 256 * 1024 || capacity == PipeSizer::max_size());
+    ASSERT_EQ(PipeSizer::resize(fds[1], PipeSizer::max_size() * 4), PipeSizer::max_size());
+    close(fds[0]);
+    close(fds[1]);
+
+    // 自适应：读端进程不读，缓冲区积压超过 3/4 后容量翻倍
+    piped = pipe(fds) == 0;
+    ASSERT_TRUE(piped);
+    pid_t reader = fork();
+    if (reader == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp("sleep", "sleep", "5", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    std::string backlog(PipeSizer::default_size() * 7 / 8, 'x');
+    ssize_t written = write(fds[1], backlog.data(), backlog.size());
+    ASSERT_EQ(written, static_cast<ssize_t>(backlog.size()));
+    struct stat st;
+    fstat(fds[0], &st);
+    PipeReport report;
+    report.writer = "test";
+    report.reader = "sleep";
+    report.initial_bytes = report.final_bytes = PipeSizer::default_size();
+    PipeMonitor monitor(true);
+    monitor.watch(report, reader, st.st_ino);
+    monitor.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto reports = monitor.stop();
+    kill(reader, SIGKILL);
+    waitpid(reader, nullptr, 0);
+    close(fds[0]);
+    close(fds[1]);
+    ASSERT_EQ(reports.size(), 1u);
+    ASSERT_TRUE(reports[0].full_samples > 0);
+    ASSERT_TRUE(reports[0].final_bytes > reports[0].initial_bytes);
+    ASSERT_TRUE(PipeMonitor::format(PipeSizeSetting{}, reports, {}).find("test -> sleep") != std::string::npos);
+}
+
+TEST(parallel_runner) {
+    using namespace NeXShell;
+    std::string error;
+    auto options = ParallelOptions::parse({"-j", "3", "-k", "--tag", "--joblog", "/tmp/x", "gzip", "-9", ":::", "a", "b"}, error);
+    ASSERT_TRUE(options.has_value());
+    ASSERT_EQ(options->jobs, 3u);
+    ASSERT_TRUE(options->keep_order && options->tag);
+    ASSERT_EQ(options->joblog, "/tmp/x");
+    ASSERT_EQ(options->command_template, "gzip -9");
+    ASSERT_EQ(options->arguments.size(), 2u);
+    ASSERT_FALSE(options->arguments_from_input);
+    ASSERT_TRUE(ParallelOptions::parse({"-j4", "echo"}, error)->arguments_from_input);
+    ASSERT_FALSE(ParallelOptions::parse({"-j", "x", "echo"}, error).has_value());
+    ASSERT_FALSE(ParallelOptions::parse({":::", "a"}, error).has_value());
+
+    ASSERT_EQ(ParallelRunner::expand("gzip", "a b.txt", 1), "gzip 'a b.txt'");
+    ASSERT_EQ(ParallelRunner::expand("mv {} {.}.bak #{#}", "dir/f.txt", 7), "mv dir/f.txt dir/f.bak #7");
+    ASSERT_EQ(ParallelRunner::expand("echo {/}", "dir/.hidden", 1), "echo .hidden");
+    ASSERT_EQ(ParallelRunner::expand("echo {}", "costs 5$ each", 1), "echo 'costs 5$ each'");
+
+    // 加了引号的参数经 CommandParser 解析后还原；无法表示的参数被拒绝
+    for (std::string argument : {"it's \"quoted\"", "a|b & c", "say \"hi\"", "'"}) {
+        auto command = ParallelRunner::expand("echo", argument, 1);
+        ASSERT_TRUE(command.has_value());
+        Pipeline reparsed = CommandParser().parse(*command);
+        ASSERT_TRUE(reparsed.commands.size() == 1 &&
+                    reparsed.commands[0].arguments == std::vector<std::string>{argument});
+    }
+    ASSERT_FALSE(ParallelRunner::expand("echo {}", "$HOME", 1).has_value());
+    ASSERT_FALSE(ParallelRunner::expand("echo", "", 1).has_value());
+
+    // 作业通过 sh -c 运行；输出写到管道后读回
+    auto launcher = [](const std::string& command, int output_fd, int error_fd) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(output_fd, STDOUT_FILENO);
+            dup2(error_fd, STDERR_FILENO);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        return pid;
+    };
+    auto run = [&](const std::vector<std::string>& args, int input_fd, std::string& output) {
+        std::string parse_error;
+        auto parsed = ParallelOptions::parse(args, parse_error);
+        int fds[2];
+        if (!parsed || pipe(fds) != 0) {
+            return -1;
+        }
+        ParallelRunner runner(*parsed, launcher);
+        int code = runner.run(input_fd, fds[1]);
+        close(fds[1]);
+        char buffer[4096];
+        ssize_t n;
+        output.clear();
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            output.append(buffer, static_cast<size_t>(n));
+        }
+        close(fds[0]);
+        return code;
+    };
+
+    // -k：完成顺序与参数顺序相反，输出仍按参数顺序
+    std::string output;
+    ASSERT_EQ(run({"-j", "3", "-k", "--tag", "sleep {} && echo done", ":::", "0.3", "0.2", "0.1"}, -1, output), 0);
+    ASSERT_EQ(output, "0.3\tdone\n0.2\tdone\n0.1\tdone\n");
+
+    // 无法表示的参数不启动作业，计为失败
+    int saved_stderr = dup(STDERR_FILENO);
+    int quiet = open("/dev/null", O_WRONLY);
+    dup2(quiet, STDERR_FILENO);
+    int failed = run({"echo", ":::", "a", "$HOME"}, -1, output);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(quiet);
+    ASSERT_EQ(failed, 1);
+    ASSERT_EQ(output, "a\n");
+
+    // 始终保持 N 个作业在运行：4 个 0.2 秒的作业在 -j 2 下约 0.4 秒
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(run({"-j", "2", "sleep", ":::", "0.2", "0.2", "0.2", "0.2"}, -1, output), 0);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ASSERT_TRUE(elapsed >= 0.35 && elapsed < 0.75);
+
+    // 参数来自输入，每个失败的作业计数一次，并写入作业日志
+    const std::string joblog = "/tmp/nexsh_test_joblog.txt";
+    int input[2];
+    bool piped = pipe(input) == 0;
+    ASSERT_TRUE(piped);
+    std::string lines = "0\n3\n\n0\n1";
+    ssize_t written = write(input[1], lines.data(), lines.size());
+    ASSERT_EQ(written, static_cast<ssize_t>(lines.size()));
+    close(input[1]);
+    ASSERT_EQ(run({"--joblog", joblog, "exit"}, input[0], output), 2);
+    close(input[0]);
+    std::ifstream log(joblog);
+    std::string header;
+    std::getline(log, header);
+    ASSERT_EQ(header, "Seq\tHost\tStarttime\tJobRuntime\tSend\tReceive\tExitval\tSignal\tCommand");
+    size_t entries = 0;
+    size_t failures = 0;
+    for (std::string line; std::getline(log, line); ++entries) {
+        failures += line.find("\t0\texit 0") == std::string::npos ? 1 : 0;
+    }
+    ASSERT_EQ(entries, 4u);
+    ASSERT_EQ(failures, 2u);
+    std::remove(joblog.c_str());
+}
+
+TEST(job_cgroup) {
+    using namespace NeXShell;
+    JobLimits limits;
+    ASSERT_TRUE(limits.empty());
+    ASSERT_EQ(limits.describe(), "none");
+    ASSERT_TRUE(limits.set_option("-c", "50"));
+    ASSERT_TRUE(limits.set_option("-m", "64M"));
+    ASSERT_TRUE(limits.set_option("-p", "32"));
+    ASSERT_FALSE(limits.set_option("-c", "0"));
+    ASSERT_FALSE(limits.set_option("-m", "lots"));
+    ASSERT_FALSE(limits.set_option("-x", "1"));
+    ASSERT_EQ(*limits.memory_max, 64ull << 20);
+    ASSERT_EQ(limits.describe(), "cpu.weight=50 memory.max=64.0 MiB pids.max=32");
+    ASSERT_EQ(*JobLimits::parse_size("2G"), 2ull << 30);
+    ASSERT_TRUE(JobCgroup::enabled(limits));
+
+    // 没有 cgroup 时 spawn 退回到 fork + setrlimit
+    JobLimits memory_only;
+    memory_only.memory_max = 64ull << 20;
+    pid_t pid = JobCgroup::spawn(nullptr, memory_only);
+    if (pid == 0) {
+        struct rlimit limit;
+        getrlimit(RLIMIT_AS, &limit);
+        _exit(limit.rlim_cur == (64ull << 20) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // 有可写的 cgroup v2 时，子进程直接创建在作业的叶子节点中
+    auto cgroup = JobCgroup::create(memory_only);
+    if (cgroup) {
+        pid = JobCgroup::spawn(cgroup.get(), memory_only);
+        if (pid == 0) {
+            execlp("sleep", "sleep", "0.2", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        std::ifstream membership("/proc/" + std::to_string(pid) + "/cgroup");
+        std::string content((std::istreambuf_iterator<char>(membership)), std::istreambuf_iterator<char>());
+        std::string leaf = cgroup->path().substr(cgroup->path().rfind("/nexsh."));
+        ASSERT_TRUE(content.find(leaf) != std::string::npos);
+        ASSERT_EQ(cgroup->stats().processes, 1u);
+        waitpid(pid, &status, 0);
+        ASSERT_EQ(cgroup->stats().processes, 0u);
+        std::string path = cgroup->path();
+        cgroup.reset();
+        ASSERT_TRUE(access(path.c_str(), F_OK) != 0);
+    }
+}
+
+TEST(fork_server) {
+    using namespace NeXShell;
+    auto server = ForkServer::start("");
+    ASSERT_TRUE(server != nullptr);
+
+    // 子进程由辅助进程创建，但父进程是当前进程，可以直接 waitpid
+    int out[2];
+    ASSERT_EQ(pipe(out), 0);
+    setenv("NEXSH_FORK_TEST", "zygote", 1);
+    SpawnRequest request;
+    request.path = "/bin/sh";
+    request.argv = {"sh", "-c", "pwd; echo $NEXSH_FORK_TEST; exit 5"};
+    request.cwd = "/tmp";
+    request.stdout_fd = out[1];
+    pid_t pid = server->spawn(request);
+    close(out[1]);
+    unsetenv("NEXSH_FORK_TEST");
+    ASSERT_TRUE(pid > 0);
+    std::string output;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(out[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, static_cast<size_t>(n));
+    }
+    close(out[0]);
+    int status = 0;
+    pid_t waited = waitpid(pid, &status, 0);
+    ASSERT_EQ(waited, pid);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 5);
+    ASSERT_EQ(output, "/tmp\nzygote\n");
+
+    // exec 失败时与自己 fork 一样以 127 退出
+    int null_fd = open("/dev/null", O_WRONLY);
+    SpawnRequest missing;
+    missing.argv = {"/nonexistent/program"};
+    missing.stderr_fd = null_fd;
+    pid = server->spawn(missing);
+    close(null_fd);
+    ASSERT_TRUE(pid > 0);
+    waited = waitpid(pid, &status, 0);
+    ASSERT_EQ(waited, pid);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 127);
+
+    // 终端的 Ctrl-C、Ctrl-Z 不影响辅助进程；子进程恢复默认的信号处理
+    pid_t helper = server->helper_pid();
+    ASSERT_EQ(kill(helper, SIGINT), 0);
+    ASSERT_EQ(kill(helper, SIGTSTP), 0);
+    SpawnRequest interrupted;
+    interrupted.argv = {"/bin/sh", "-c", "kill -INT $$; exit 3"};
+    pid = server->spawn(interrupted);
+    ASSERT_TRUE(pid > 0);
+    waited = waitpid(pid, &status, 0);
+    ASSERT_EQ(waited, pid);
+    ASSERT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGINT);
+
+    // 辅助进程意外退出后被回收，spawn 返回 -1 让调用者自己 fork
+    std::unique_ptr<ForkServer> killed = ForkServer::start("");
+    ASSERT_TRUE(killed != nullptr);
+    pid_t killed_helper = killed->helper_pid();
+    ASSERT_EQ(kill(killed_helper, SIGKILL), 0);
+    ASSERT_EQ(killed->spawn(request), -1);
+    ASSERT_EQ(killed->helper_pid(), -1);
+    ASSERT_TRUE(waitpid(killed_helper, nullptr, WNOHANG) < 0 && errno == ECHILD);
+    killed.reset();
+
+    // 关闭套接字后辅助进程退出
+    server.reset();
+    ASSERT_TRUE(kill(helper, 0) != 0);
+}
+
+TEST(shell_daemon) {
+    using namespace NeXShell;
+    // 用不依赖 Shell 的执行函数测试协议和会话：输出目录和上一条命令，并记住这一条
+    auto runner = [](DaemonSession& session, const std::string& command) {
+        std::string last;
+        for (const auto& entry : session.environment) {
+            if (entry.rfind("LAST=", 0) == 0) {
+                last = entry.substr(5);
+            }
+        }
+        std::string line = session.cwd + " " + last + "\n";
+        (void)!write(STDOUT_FILENO, line.data(), line.size());
+        if (command == "cd") {
+            session.cwd = "/";
+        }
+        session.environment.push_back("LAST=" + command);
+        return static_cast<int>(command.size());
+    };
+    std::string socket_path = "/tmp/nexsh_test_daemon_" + std::to_string(getpid()) + ".sock";
+    ShellDaemon daemon(socket_path, 2, runner);
+    ASSERT_TRUE(daemon.start());
+
+    auto run = [](DaemonClient& client, const std::string& command, const std::string& session, int& exit_code) {
+        int out[2];
+        if (pipe(out) != 0) {
+            return std::string();
+        }
+        exit_code = client.execute(command, session, STDIN_FILENO, out[1], STDERR_FILENO);
+        close(out[1]);
+        char buffer[256];
+        ssize_t n = read(out[0], buffer, sizeof(buffer));
+        close(out[0]);
+        return n > 0 ? std::string(buffer, static_cast<size_t>(n)) : std::string();
+    };
+
+    char* cwd = getcwd(nullptr, 0);
+    std::string here = cwd ? cwd : "/";
+    free(cwd);
+
+    // 同一连接上的命令共享会话
+    int exit_code = -1;
+    auto client = DaemonClient::connect(socket_path);
+    ASSERT_TRUE(client != nullptr);
+    std::string output = run(*client, "cd", "", exit_code);
+    ASSERT_EQ(exit_code, 2);
+    ASSERT_EQ(output, here + " \n");
+    output = run(*client, "pwd", "", exit_code);
+    ASSERT_EQ(exit_code, 3);
+    ASSERT_EQ(output, "/ cd\n");
+
+    // 新连接从客户端的目录和环境开始；带名字的会话跨连接保留
+    client = DaemonClient::connect(socket_path);
+    ASSERT_TRUE(client != nullptr);
+    output = run(*client, "first", "named", exit_code);
+    ASSERT_EQ(output, here + " \n");
+    client = DaemonClient::connect(socket_path);
+    ASSERT_TRUE(client != nullptr);
+    output = run(*client, "second", "named", exit_code);
+    ASSERT_EQ(output, here + " first\n");
+
+    client.reset();
+    daemon.stop();
+    ASSERT_TRUE(access(socket_path.c_str(), F_OK) != 0);
+    ASSERT_TRUE(DaemonClient::connect(socket_path) == nullptr);
+}
+
+TEST(command_cache) {
+    using namespace NeXShell;
+    std::string error;
+    auto options = CacheOptions::parse({"--ttl", "5", "--key-files", "a", "b", "--env", "FOO", "--", "sh", "-c", "echo hi"}, error);
+    ASSERT_TRUE(options.has_value());
+    ASSERT_EQ(options->ttl_seconds, 5);
+    ASSERT_EQ(options->key_files.size(), 2u);
+    ASSERT_EQ(options->key_env[0], "FOO");
+    ASSERT_EQ(options->command_line(), "sh -c 'echo hi'");
+    ASSERT_FALSE(CacheOptions::parse({"--ttl", "soon", "--", "ls"}, error).has_value());
+    ASSERT_FALSE(CacheOptions::parse({"--key-files", "a"}, error).has_value());
+
+    std::string directory = "/tmp/nexsh_test_cache_" + std::to_string(getpid());
+    std::string input = directory + "_input";
+    CommandCache cache(directory, 8);
+
+    // 键包含 cwd、选定的环境变量和输入文件的内容（而不是 mtime）
+    CacheOptions keyed = *CacheOptions::parse({"--key-files", input, "--env", "NEXSH_CACHE_TEST", "--", "cat"}, error);
+    { std::ofstream(input) << "v1"; }
+    std::string key = cache.key(keyed, "/tmp");
+    ASSERT_TRUE(key.size() == 32);
+    ASSERT_TRUE(cache.key(keyed, "/") != key);
+    setenv("NEXSH_CACHE_TEST", "1", 1);
+    ASSERT_TRUE(cache.key(keyed, "/tmp") != key);
+    unsetenv("NEXSH_CACHE_TEST");
+    { std::ofstream(input) << "v2"; }
+    ASSERT_TRUE(cache.key(keyed, "/tmp") != key);
+    { std::ofstream(input) << "v1"; }
+    ASSERT_EQ(cache.key(keyed, "/tmp"), key);
+
+    // 保存后命中，回放输出和退出码
+    auto store = [&](const std::string& entry_key, const std::string& output) {
+        int out = cache.create_capture();
+        int err = cache.create_capture();
+        bool stored = out >= 0 && err >= 0 &&
+                      write(out, output.data(), output.size()) == static_cast<ssize_t>(output.size()) &&
+                      cache.store(entry_key, keyed, 3, out, err);
+        close(out);
+        close(err);
+        return stored;
+    };
+    ASSERT_FALSE(cache.lookup(key, 0).has_value());
+    ASSERT_TRUE(store(key, "hello"));
+    auto entry = cache.lookup(key, 0);
+    ASSERT_TRUE(entry.has_value());
+    ASSERT_EQ(entry->exit_code, 3);
+    int out[2];
+    ASSERT_EQ(pipe(out), 0);
+    int null_fd = open("/dev/null", O_WRONLY);
+    int replayed = cache.replay(*entry, out[1], null_fd);
+    close(out[1]);
+    close(null_fd);
+    ASSERT_EQ(replayed, 0);
+    char buffer[16];
+    ssize_t n = read(out[0], buffer, sizeof(buffer));
+    close(out[0]);
+    ASSERT_EQ(std::string(buffer, static_cast<size_t>(n > 0 ? n : 0)), "hello");
+
+    // 相同的输出只存一份；超过容量时先淘汰最久没有命中的记录
+    std::string other = cache.key(keyed, "/");
+    ASSERT_TRUE(store(other, "hello"));
+    ASSERT_EQ(cache.stats().entries, 2u);
+    ASSERT_EQ(cache.stats().blobs, 2u);
+    struct timespec old_times[2] = {{1, 0}, {1, 0}};
+    std::string entry_path = directory + "/entries/" + key;
+    utimensat(AT_FDCWD, entry_path.c_str(), old_times, 0);
+    ASSERT_TRUE(store(cache.key(keyed, "/usr"), "world"));
+    ASSERT_EQ(cache.evict(), 2u);
+    ASSERT_FALSE(cache.lookup(key, 0).has_value());
+    ASSERT_EQ(cache.stats().entries, 1u);
+
+    ASSERT_EQ(cache.evict(true), 1u);
+    CacheStats empty = cache.stats();
+    ASSERT_EQ(empty.entries + empty.blobs, 0u);
+
+    // cache 直接执行 argv：同时含两种引号的参数原样传给命令；无法执行（127）的结果不保存
+    setenv("NEXSH_CACHE_DIR", directory.c_str(), 1);
+    CommandExecutor executor(nullptr);
+    int captured[2];
+    ASSERT_EQ(pipe(captured), 0);
+    ASSERT_EQ(executor.execute_cached({"--", "printf", "%s", "it's \"x\""}, captured[1]), 0);
+    close(captured[1]);
+    n = read(captured[0], buffer, sizeof(buffer));
+    close(captured[0]);
+    ASSERT_EQ(std::string(buffer, static_cast<size_t>(n > 0 ? n : 0)), "it's \"x\"");
+    ASSERT_EQ(cache.stats().entries, 1u);
+    null_fd = open("/dev/null", O_WRONLY);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    int missing = executor.execute_cached({"--", "/nonexistent/nexsh-cache-test"}, null_fd);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(null_fd);
+    unsetenv("NEXSH_CACHE_DIR");
+    ASSERT_EQ(missing, 127);
+    ASSERT_EQ(cache.stats().entries, 1u);
+    ASSERT_EQ(cache.evict(true), 1u);
+    rmdir((directory + "/entries").c_str());
+    rmdir((directory + "/blobs").c_str());
+    rmdir((directory + "/tmp").c_str());
+    rmdir(directory.c_str());
+    unlink(input.c_str());
 }
 
 int main() {
@@ -33,6 +1180,69 @@ int main() {
         test_string_operations();
         std::cout << "✓ String operations test passed\n";
         
+        test_safety_engine();
+        std::cout << "✓ Safety engine test passed\n";
+        
+        test_command_safety();
+        std::cout << "✓ Command safety test passed\n";
+        
+        test_ai_worker_pool();
+        std::cout << "✓ AI worker pool test passed\n";
+        
+        test_json_reader();
+        std::cout << "✓ JSON reader test passed\n";
+        
+        test_intent_matcher();
+        std::cout << "✓ Intent matcher test passed\n";
+        
+        test_embedding_index();
+        std::cout << "✓ Embedding index test passed\n";
+        
+        test_endpoint_pool();
+        std::cout << "✓ Endpoint pool test passed\n";
+        
+        test_prompt_budget();
+        std::cout << "✓ Prompt budget test passed\n";
+        
+        test_directory_context();
+        std::cout << "✓ Directory context test passed\n";
+        
+        test_command_response_parsing();
+        std::cout << "✓ Command response parsing test passed\n";
+        
+        test_batch_response_parsing();
+        std::cout << "✓ Batch response parsing test passed\n";
+        
+        test_tracer();
+        std::cout << "✓ Tracer test passed\n";
+        
+        test_time_report();
+        std::cout << "✓ Time report test passed\n";
+        
+        test_metrics();
+        std::cout << "✓ Metrics test passed\n";
+        
+        test_passthrough();
+        std::cout << "✓ Passthrough test passed\n";
+        
+        test_pipe_sizing();
+        std::cout << "✓ Pipe sizing test passed\n";
+        
+        test_parallel_runner();
+        std::cout << "✓ Parallel runner test passed\n";
+        
+        test_job_cgroup();
+        std::cout << "✓ Job cgroup test passed\n";
+        
+        test_fork_server();
+        std::cout << "✓ Fork server test passed\n";
+        
+        test_shell_daemon();
+        std::cout << "✓ Shell daemon test passed\n";
+        
+        test_command_cache();
+        std::cout << "✓ Command cache test passed\n";
+        
         std::cout << "All tests passed!\n";
         return 0;
     } catch (const std::exception& e) {